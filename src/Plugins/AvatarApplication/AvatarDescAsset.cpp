@@ -3,6 +3,7 @@
 #include "StableHeaders.h"
 #include "AvatarDescAsset.h"
 #include "AssetAPI.h"
+#include "IAssetDecodeJob.h"
 #include "Math/Quat.h"
 #include "Math/MathFunc.h"
 #include "LoggingFunctions.h"
@@ -79,6 +80,7 @@ AvatarDescAsset::~AvatarDescAsset()
 
 void AvatarDescAsset::DoUnload()
 {
+    avatarAppearanceXML_ = "";
     mesh_ = "";
     skeleton_ = "";
     materials_.Clear();
@@ -90,26 +92,48 @@ void AvatarDescAsset::DoUnload()
     properties_.Clear();
 }
 
-bool AvatarDescAsset::DeserializeFromData(const u8 *data, uint numBytes, bool /*allowAsynchronous*/)
+/// Parses the XML document in a worker thread. Reading the appearance from the document is done in Commit.
+class AvatarDescAsset::DecodeJob : public IAssetDecodeJob
 {
-    // Store the raw XML as a string
-    avatarAppearanceXML_ = String((const char*)data, numBytes);
-    
-    // Then try to parse
-    Urho3D::XMLFile avatarDoc(GetContext());
-    // If invalid XML, empty it so we will report IsLoaded == false
-    if (!avatarDoc.FromString(avatarAppearanceXML_))
+public:
+    DecodeJob(AvatarDescAsset *asset, const u8 *data, uint numBytes) :
+        IAssetDecodeJob(asset, data, numBytes),
+        context(asset->GetContext())
     {
-        LogError("Failed to deserialize AvatarDescAsset from data.");
-        avatarAppearanceXML_ = "";
-        return false;
     }
 
-    ReadAvatarAppearance(avatarDoc);
-    AppearanceChanged.Emit();
+    bool Decode() override
+    {
+        xml = String(data.Size() ? (const char*)&data[0] : "", data.Size());
+        doc = new Urho3D::XMLFile(context);
+        if (!doc->FromString(xml))
+        {
+            error = "Failed to deserialize AvatarDescAsset from data.";
+            return false;
+        }
+        return true;
+    }
+
+    bool Commit() override
+    {
+        AvatarDescAsset *avatarDesc = static_cast<AvatarDescAsset*>(Asset());
+        // Store the raw XML as a string
+        avatarDesc->avatarAppearanceXML_ = xml;
+        avatarDesc->ReadAvatarAppearance(*doc);
+        avatarDesc->AppearanceChanged.Emit();
+        return true;
+    }
 
-    assetAPI->AssetLoadCompleted(Name());
-    return true;
+private:
+    Urho3D::Context *context;
+    String xml;
+    SharedPtr<Urho3D::XMLFile> doc;
+};
+
+bool AvatarDescAsset::DeserializeFromData(const u8 *data, uint numBytes, bool allowAsynchronous)
+{
+    // If invalid XML, the asset is unloaded so we will report IsLoaded == false
+    return assetAPI->DecodeAsset(AssetDecodeJobPtr(new DecodeJob(this, data, numBytes)), allowAsynchronous);
 }
 
 bool AvatarDescAsset::SerializeTo(Vector<u8> &dst, const String &/*serializationParameters*/) const
@@ -35,6 +35,8 @@ public:
     bool IsLoaded() const;
 
 private:
+    class DecodeJob;
+
     virtual void DoUnload();
 
     /// Parse from XML data. Return true if successful
@@ -20,8 +20,20 @@ namespace Tundra
 HttpAssetProvider::HttpAssetProvider(Framework *framework, const HttpClientPtr &client) :
     IAssetProvider(framework->GetContext()),
     framework_(framework),
-    client_(client)
-{
+    client_(client),
+    maxBufferedAssetSize_(64 * 1024 * 1024),
+    parallelRangeSize_(0),
+    parallelRanges_(4)
+{
+    StringVector sizeParam = framework_->CommandLineParameters("--httpMaxBufferedAssetSize");
+    if (sizeParam.Size() > 0)
+        maxBufferedAssetSize_ = Urho3D::ToUInt(sizeParam.Front()) * 1024 * 1024;
+    StringVector rangeSizeParam = framework_->CommandLineParameters("--httpParallelRangeSize");
+    if (rangeSizeParam.Size() > 0)
+        parallelRangeSize_ = Urho3D::ToUInt(rangeSizeParam.Front()) * 1024 * 1024;
+    StringVector rangesParam = framework_->CommandLineParameters("--httpParallelRanges");
+    if (rangesParam.Size() > 0)
+        parallelRanges_ = Max(Urho3D::ToUInt(rangesParam.Front()), 1U);
 }
 
 HttpAssetProvider::~HttpAssetProvider()
@@ -62,6 +74,16 @@ String HttpAssetProvider::UniqueName(String prefix) const
     return "";
 }
 
+HttpRequestPtr HttpAssetProvider::CreateRequest(const String &url)
+{
+    return client_->Create(Http::Method::Get, url);
+}
+
+bool HttpAssetProvider::ScheduleRequest(const HttpRequestPtr &request)
+{
+    return client_->Schedule(request);
+}
+
 // IAssetProvider implementaion
 
 String HttpAssetProvider::Name() const
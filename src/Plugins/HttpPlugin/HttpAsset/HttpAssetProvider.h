@@ -21,6 +21,24 @@ public:
 
     Framework *Fw() { return framework_; }
 
+    /// Returns the largest asset size in bytes that is kept in memory after download.
+    /** Larger assets are streamed to the asset cache only and loaded from there. 0 means no limit. */
+    uint MaxBufferedAssetSize() const { return maxBufferedAssetSize_; }
+
+    /// Returns the size in bytes from which assets are fetched with parallel range requests, 0 if disabled.
+    /** The first request fetches this many bytes and the rest of the asset is split to ParallelRanges requests. */
+    uint ParallelRangeSize() const { return parallelRangeSize_; }
+
+    /// Returns the maximum number of parallel range requests per asset.
+    uint ParallelRanges() const { return parallelRanges_; }
+
+    /// Creates a GET request for @c url without scheduling it.
+    /** Used by HttpAssetTransfer for resumed and ranged requests. */
+    HttpRequestPtr CreateRequest(const String &url);
+
+    /// Schedules @c request for execution.
+    bool ScheduleRequest(const HttpRequestPtr &request);
+
     /// IAssetProvider override.
     String Name() const override;
     /// IAssetProvider override.
@@ -57,6 +75,9 @@ private:
 
     Framework *framework_;
     HttpClientPtr client_;
+    uint maxBufferedAssetSize_;
+    uint parallelRangeSize_;
+    uint parallelRanges_;
 
     Vector<AssetStoragePtr> httpStorages_;
 };
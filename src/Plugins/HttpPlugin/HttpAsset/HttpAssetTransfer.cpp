@@ -11,30 +11,41 @@
 #include "Framework.h"
 #include "LoggingFunctions.h"
 
+#include <Urho3D/IO/FileSystem.h>
+
 namespace Tundra
 {
 
+/// How many times an interrupted download is resumed before the transfer fails.
+static const uint cMaxResumes = 3;
+
 HttpAssetTransfer::HttpAssetTransfer(HttpAssetProvider *provider, HttpRequestPtr &request, const String &assetRef_, const String &assetType_) :
     provider_(provider),
-    request_(request)
+    request_(request),
+    numResumes_(0),
+    refetched_(false)
 {
     // Prepare IAssetTransfer
     source.ref = assetRef_;
     assetType = assetType_;
 
-    /* At this point we don't know if we can use the cached asset. 
+    /* At this point we don't know if we can use the cached asset.
        Once 304 response is detected, this will be changed to Cached. */
-    diskSourceType = IAsset::Original; 
+    diskSourceType = IAsset::Original;
 
-    // Cache destination path and source for 'If-Modified-Since' for a '304 Not Modified' response.
     if (provider_->Fw()->Asset()->Cache())
     {
-        String cacheFile = provider_->Fw()->Asset()->Cache()->DiskSourceByRef(source.ref);
-        request->SetCacheFile(cacheFile, true);
+        cacheFile_ = provider_->Fw()->Asset()->Cache()->DiskSourceByRef(source.ref);
         /* Indicated so AssetAPI that we will take care of writing the cache, but it can find
            the source file from this path. */
-        SetCachingBehavior(false, cacheFile);
+        SetCachingBehavior(false, cacheFile_);
     }
+    PrepareRequest(request);
+
+    /* The first request fetches only the first range of the asset. If the response tells that the
+       asset is larger than that, the rest of it is fetched with parallel range requests. */
+    if (!cacheFile_.Empty() && provider_->ParallelRangeSize() > 0)
+        request->SetRange(0, static_cast<int>(provider_->ParallelRangeSize() - 1));
 
     // Connect to finished signal
     request_->Finished.Connect(this, &HttpAssetTransfer::OnFinished);
@@ -44,6 +55,22 @@ HttpAssetTransfer::~HttpAssetTransfer()
 {
 }
 
+void HttpAssetTransfer::PrepareRequest(HttpRequestPtr &request)
+{
+    if (cacheFile_.Empty())
+        return;
+
+    // Cache destination path and source for 'If-Modified-Since' and 'If-None-Match' for a '304 Not Modified' response.
+    request->SetCacheFile(cacheFile_, true);
+    if (provider_->Fw()->GetSubsystem<Urho3D::FileSystem>()->FileExists(cacheFile_))
+        request->SetCacheETag(provider_->Fw()->Asset()->Cache()->ETag(source.ref));
+    /* The response body is streamed to the cache file while downloading. Large assets
+       are not kept in memory at all, AssetAPI loads them from the cache file. */
+    request->SetMaxBufferedBodySize(provider_->MaxBufferedAssetSize());
+    // An interrupted download is continued from where it was left off.
+    request->SetResumable(true);
+}
+
 void HttpAssetTransfer::OnFinished(HttpRequestPtr &request, int status, const String &error)
 {
     // Clear out reference.
@@ -53,24 +80,172 @@ void HttpAssetTransfer::OnFinished(HttpRequestPtr &request, int status, const St
     // but these redirects are automatically detected and executed by HttpRequest.
     if ((status == 200 || status == 304) && error.Empty())
     {
-        /* 304 Not Modified
-           1) HttpRequest has already written file to asset cache file set with HttpRequest::SetCacheFile()
-           2) Mark disk source as cached. Previous SetCachingBehavior already marked so that AssetAPI wont
-              rewrite the disk file even if we provide rawAssetData.
-           3) If we do not load 'rawAssetData' with a valid disk source. AssetAPI will do the right thing and load
-              bytes from disk. This was desirable with Ogre as its threading mechanisms let us pass a filepath.
-              If it was a certain type of Ogre asset, the disk read was skipped and path was used. With Urho it is more efficient 
-              to do a memcpy here and not re-read from disk, which is slower as we already have the file in memory here.
-              @todo In other works for above: AssetAPI and its 'data shuffling' could be re-thinked with Urho. */
-        if (status == 304)
-            diskSourceType = IAsset::Cached;
-
-        request->CopyResponseBodyTo(rawAssetData);
-
-        provider_->Fw()->Asset()->AssetTransferCompleted(this);
+        Completed(request, status);
+        return;
+    }
+
+    // 206 Partial Content from a resumed download or the first range of the asset.
+    if (status == 206 && error.Empty())
+    {
+        uint first = 0, last = 0, total = 0;
+        bool validRange = request->ResponseContentRange(first, last, total);
+        // The cache file has been completed.
+        if (validRange && total > 0 && last + 1 == total)
+        {
+            Completed(request, status);
+            return;
+        }
+        if (validRange && total > 0 && first == 0 && !refetched_)
+        {
+            // The rest of the ranges must be of the same resource. Prefer strong ETag over the modification date.
+            String validator = request->ResponseHeader(Http::Header::ETag);
+            if (!Http::IsStrongETag(validator))
+                validator = request->ResponseHeader(Http::Header::LastModified);
+            if (!validator.Empty())
+            {
+                rangeLastModified_ = request->ResponseHeader(Http::Header::LastModified);
+                FetchRanges(last + 1, total, validator);
+                return;
+            }
+        }
+        // The ranges cannot be assembled, fetch the whole asset instead.
+        if (!refetched_)
+        {
+            Refetch();
+            return;
+        }
+    }
+    // Resume an interrupted download.
+    else if (!error.Empty() && !cacheFile_.Empty() && numResumes_ < cMaxResumes &&
+        provider_->Fw()->GetSubsystem<Urho3D::FileSystem>()->FileExists(HttpRequest::PartialCacheFile(cacheFile_)))
+    {
+        ++numResumes_;
+        LogWarning(Urho3D::ToString("HttpAssetTransfer: Resuming interrupted download of %s: %s", source.ref.CString(), error.CString()));
+        Refetch();
+        return;
+    }
+
+    Failed(!error.Empty() ? error : Urho3D::ToString("%d %s", status, request->Status().CString()));
+}
+
+void HttpAssetTransfer::FetchRanges(uint first, uint total, const String &validator)
+{
+    uint remaining = total - first;
+    uint rangeSize = Max(provider_->ParallelRangeSize(), 1U);
+    uint numRanges = Min(provider_->ParallelRanges(), (remaining + rangeSize - 1) / rangeSize);
+    rangeSize = (remaining + numRanges - 1) / numRanges;
+
+    for(uint i = 0; i < numRanges; ++i)
+    {
+        uint rangeFirst = first + i * rangeSize;
+        uint rangeLast = Min(rangeFirst + rangeSize, total) - 1;
+
+        HttpRequestPtr request = provider_->CreateRequest(source.ref);
+        if (!request)
+        {
+            rangeRequests_.Clear();
+            Refetch();
+            return;
+        }
+        // The ranges are written to the partial cache file at their offsets.
+        request->SetCacheFile(cacheFile_, String());
+        request->SetRange(rangeFirst, static_cast<int>(rangeLast), validator);
+        request->Finished.Connect(this, &HttpAssetTransfer::OnRangeFinished);
+        rangeRequests_.Push(request);
     }
-    else
-        provider_->Fw()->Asset()->AssetTransferFailed(this, (!error.Empty() ? error : Urho3D::ToString("%d %s", status, request->Status().CString())));
+
+    foreach(const HttpRequestPtr &request, rangeRequests_)
+        provider_->ScheduleRequest(request);
+}
+
+void HttpAssetTransfer::OnRangeFinished(HttpRequestPtr &request, int status, const String &error)
+{
+    rangeRequests_.Remove(request);
+
+    // Any other response than the requested range means that the asset has changed or the server failed.
+    if (rangeError_.Empty())
+    {
+        uint first = 0, last = 0, total = 0;
+        if (!error.Empty())
+            rangeError_ = error;
+        else if (status != 206 || !request->ResponseContentRange(first, last, total))
+            rangeError_ = Urho3D::ToString("%d %s", status, request->Status().CString());
+    }
+    if (!rangeRequests_.Empty())
+        return;
+
+    if (!rangeError_.Empty())
+    {
+        LogWarning(Urho3D::ToString("HttpAssetTransfer: Range request for %s failed, fetching the whole asset: %s", source.ref.CString(), rangeError_.CString()));
+        Refetch();
+        return;
+    }
+
+    // All ranges have been written to the partial cache file, replace the cache file with it.
+    Urho3D::FileSystem *fileSystem = provider_->Fw()->GetSubsystem<Urho3D::FileSystem>();
+    if (fileSystem->FileExists(cacheFile_))
+        fileSystem->Delete(cacheFile_);
+    if (!fileSystem->Rename(HttpRequest::PartialCacheFile(cacheFile_), cacheFile_))
+    {
+        Failed("Failed to move downloaded file to cache file " + cacheFile_);
+        return;
+    }
+    if (!rangeLastModified_.Empty())
+    {
+        time_t epoch = Http::HttpDateToUtcEpoch(rangeLastModified_);
+        if (epoch > 0) // SetLastModifiedTime converts utc epoch correctly to local
+            fileSystem->SetLastModifiedTime(cacheFile_, static_cast<uint>(epoch));
+    }
+    Completed(request, status);
+}
+
+void HttpAssetTransfer::Refetch()
+{
+    refetched_ = true;
+
+    HttpRequestPtr request = provider_->CreateRequest(source.ref);
+    if (!request)
+    {
+        Failed("Failed to create request");
+        return;
+    }
+    PrepareRequest(request);
+    request->Finished.Connect(this, &HttpAssetTransfer::OnFinished);
+    request_ = request;
+    provider_->ScheduleRequest(request);
+}
+
+void HttpAssetTransfer::Completed(HttpRequestPtr &request, int status)
+{
+    /* 304 Not Modified
+       1) HttpRequest has already written file to asset cache file set with HttpRequest::SetCacheFile()
+       2) Mark disk source as cached. Previous SetCachingBehavior already marked so that AssetAPI wont
+          rewrite the disk file even if we provide rawAssetData.
+       3) If we do not load 'rawAssetData' with a valid disk source. AssetAPI will do the right thing and load
+          bytes from disk. This was desirable with Ogre as its threading mechanisms let us pass a filepath.
+          If it was a certain type of Ogre asset, the disk read was skipped and path was used. With Urho it is more efficient
+          to take the data here and not re-read from disk, which is slower as we already have the file in memory here.
+          @todo In other works for above: AssetAPI and its 'data shuffling' could be re-thinked with Urho. */
+    if (status == 304)
+        diskSourceType = IAsset::Cached;
+
+    // Take ownership of the body instead of copying it. Empty if the body was only streamed to the cache file.
+    request->TakeResponseBody(rawAssetData);
+
+    // AssetAPI adds the cache file to the cache index, store the ETag for revalidating it afterwards.
+    AssetCache *cache = provider_->Fw()->Asset()->Cache();
+    String assetRef = source.ref;
+    String etag = (status != 304 ? request->ResponseHeader(Http::Header::ETag) : String());
+
+    provider_->Fw()->Asset()->AssetTransferCompleted(this);
+
+    if (cache && status != 304)
+        cache->SetETag(assetRef, etag);
+}
+
+void HttpAssetTransfer::Failed(const String &reason)
+{
+    provider_->Fw()->Asset()->AssetTransferFailed(this, reason);
 }
 
 }
@@ -11,6 +11,8 @@ namespace Tundra
 {
 
 /// HTTP asset transfer
+/** Interrupted downloads are resumed from the partial cache file. If HttpAssetProvider::ParallelRangeSize
+    is set, large assets are fetched with parallel range requests that are assembled to the cache file. */
 class TUNDRA_HTTP_API HttpAssetTransfer : public IAssetTransfer
 {
 public:
@@ -21,9 +23,32 @@ public:
 
 private:
     void OnFinished(HttpRequestPtr &request, int status, const String &error);
+    void OnRangeFinished(HttpRequestPtr &request, int status, const String &error);
+
+    /// Sets the cache file and revalidation headers to @c request.
+    void PrepareRequest(HttpRequestPtr &request);
+    /// Fetches the rest of the asset after the first range from @c first to @c total - 1 with parallel requests.
+    void FetchRanges(uint first, uint total, const String &validator);
+    /// Fetches the asset with a single request, resuming from the partial cache file if possible.
+    void Refetch();
+
+    void Completed(HttpRequestPtr &request, int status);
+    void Failed(const String &reason);
 
     HttpAssetProvider *provider_;
     HttpRequestPtr request_;
+    String cacheFile_;
+
+    /// Pending parallel range requests.
+    Vector<HttpRequestPtr> rangeRequests_;
+    /// Error of the first failed range request.
+    String rangeError_;
+    /// 'Last-Modified' header of the first range.
+    String rangeLastModified_;
+    /// Number of times an interrupted download has been resumed.
+    uint numResumes_;
+    /// If the asset is fetched with a single request after parallel ranges have failed.
+    bool refetched_;
 };
 
 }
@@ -0,0 +1,37 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "HttpPluginApi.h"
+#include "HttpPluginFwd.h"
+
+#include <Urho3D/Container/RefCounted.h>
+
+namespace Tundra
+{
+
+/// Receives a HTTP response body while it is being downloaded.
+/** Set to a request with HttpRequest::SetBodySink. Lets the body be processed, eg. hashed or decoded,
+    in chunks without buffering all of it to memory first.
+    @note All functions are invoked in the HTTP worker thread context. */
+class TUNDRA_HTTP_API HttpBodySink : public Urho3D::RefCounted
+{
+public:
+    virtual ~HttpBodySink() {}
+
+    /// Called when the response headers have been received, before the first body chunk.
+    /** @param status HTTP response status code.
+        @param contentLength Value of the Content-Length header, 0 if not known.
+        @return False to abort the request. */
+    virtual bool Begin(int /*status*/, uint /*contentLength*/) { return true; }
+
+    /// Called for each received body chunk.
+    /** @return False to abort the request. */
+    virtual bool Write(const u8 *data, uint size) = 0;
+
+    /// Called when the request has finished. Not called if Begin was not.
+    /** @param success True if the whole body was received without errors. */
+    virtual void End(bool /*success*/) {}
+};
+
+}
@@ -22,7 +22,7 @@ HttpClient::HttpClient(Framework *framework) :
 {
     CURLcode err = curl_global_init(CURL_GLOBAL_DEFAULT);
     if (err == CURLE_OK)
-        queue_ = new HttpWorkQueue();
+        queue_ = new HttpWorkQueue(framework_);
     else
         LogErrorF("[HttpClient] Failed to initialize curl: %s", curl_easy_strerror(err));
 }
@@ -266,6 +266,29 @@ time_t HttpDateToUtcEpoch(const String &date)
 #endif
 }
 
+bool ParseContentRange(const String &value, uint &first, uint &last, uint &total)
+{
+    // bytes 21010-47021/47022 ; total can be '*' if not known
+    String range = value.Trimmed();
+    if (!range.StartsWith("bytes ", false))
+        return false;
+    StringVector parts = range.Substring(6).Trimmed().Split('/');
+    if (parts.Size() != 2)
+        return false;
+    StringVector bounds = parts[0].Split('-');
+    if (bounds.Size() != 2 || bounds[0].Empty() || bounds[1].Empty())
+        return false;
+    first = Urho3D::ToUInt(bounds[0]);
+    last = Urho3D::ToUInt(bounds[1]);
+    total = (parts[1].Trimmed() == "*" ? 0 : Urho3D::ToUInt(parts[1]));
+    return (last >= first && (total == 0 || last < total));
+}
+
+bool IsStrongETag(const String &etag)
+{
+    return (!etag.Empty() && !etag.StartsWith("W/"));
+}
+
 // RequestData
 
 RequestData::RequestData() :
@@ -274,6 +297,14 @@ RequestData::RequestData() :
     msecNetwork(-1),
     msecDiskRead(-1),
     msecDiskWrite(-1),
+    numConnects(-1),
+    rangeFirst(-1),
+    rangeLast(-1),
+    rangeExplicit(false),
+    resumable(false),
+    resumeOffset(0),
+    keepBody(true),
+    maxBufferedBodySize(0),
     bodyWritePos(0),
     method(-1)
 {
@@ -320,7 +351,13 @@ ResponseData::ResponseData() :
     status(-1),
     downloadBytesPerSec(-1.0),
     uploadBytesPerSec(-1.0),
-    headersParsed(false)
+    headersParsed(false),
+    bodySize(0),
+    bodyStarted(false),
+    bufferBody(true),
+    completesCacheFile(true),
+    cacheWriter(0),
+    cacheWriteFailed(false)
 {
 }
 
@@ -329,6 +366,8 @@ ResponseData::ResponseData() :
 Stats::Stats() :
     requests(0),
     errors(0),
+    connectionsOpened(0),
+    connectionsReused(0),
     downloads(0),
     uploads(0),
     diskReads(0),
@@ -399,6 +438,9 @@ String Stats::GetData(bool averages_, bool current_)
         PadDouble(totals.msecDiskRead / 1000.0, 12).CString(),
         PadDouble(totals.msecDiskWrite / 1000.0, 12).CString()
     );
+    str.AppendWithFormat("%s %d new, %d reused\n",
+        PadString("Connections", 12).CString(), connectionsOpened, connectionsReused
+    );
     if (averages_)
     {
         str.AppendWithFormat("%s %s %s %s %s kB/sec\n",
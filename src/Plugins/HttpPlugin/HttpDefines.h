@@ -3,6 +3,7 @@
 #pragma once
 
 #include "HttpPluginFwd.h"
+#include "HttpBodySink.h"
 
 #include <Urho3D/Core/Timer.h>
 
@@ -12,6 +13,11 @@
 
 struct curl_slist;
 
+namespace Urho3D
+{
+    class File;
+}
+
 namespace Tundra
 {
 namespace Http
@@ -108,6 +114,13 @@ namespace Http
     /** @see http://tools.ietf.org/html/rfc2616#page-134 */
     time_t HttpDateToUtcEpoch(const String &date);
 
+    /// Parses a "bytes first-last/total" Content-Range header value. @c total is 0 if not known.
+    /** @see http://tools.ietf.org/html/rfc7233#section-4.2 */
+    bool ParseContentRange(const String &value, uint &first, uint &last, uint &total);
+
+    /// Returns if @c etag is a strong entity tag, that can be used with If-Range.
+    bool IsStrongETag(const String &etag);
+
     /// @cond PRIVATE
     // Everything below is an implementation detail.
 
@@ -150,14 +163,34 @@ namespace Http
         // File to read and write cache entry to
         String cacheFile;
 
+        // Receiver of the response body chunks
+        HttpBodySinkPtr bodySink;
+        // If the response body should be buffered to memory
+        bool keepBody;
+        // Largest response body that is buffered if the body is also received by the cache file or sink. 0 for no limit.
+        uint maxBufferedBodySize;
+
         // Error occurred during threaded run.
         String error;
 
         // Time spent executing request and processing data.
+        Urho3D::Timer networkTimer;
         int msecNetwork;
         int msecDiskRead;
         int msecDiskWrite;
 
+        // Number of new connections made for the request. 0 if a kept alive connection was reused.
+        long numConnects;
+
+        // Byte range set with HttpRequest::SetRange, -1 if not set
+        int rangeFirst;
+        int rangeLast;
+        bool rangeExplicit;
+        // If an interrupted body is kept for resuming the download
+        bool resumable;
+        // Size of the partial cache file that the download is resumed from
+        uint resumeOffset;
+
         // Defalt ctor
         RequestData();
 
@@ -189,6 +222,21 @@ namespace Http
         Vector<u8> headersBytes;
         bool headersParsed;
 
+        // Number of body bytes received from the network
+        uint bodySize;
+        // If the first body chunk has been received
+        bool bodyStarted;
+        // If received body chunks are buffered to bodyBytes
+        bool bufferBody;
+        // If the cache file is complete once the body has been received
+        bool completesCacheFile;
+        // Cache file that the body is streamed to while downloading
+        Urho3D::File *cacheWriter;
+        // Received body bytes that HttpDiskThread has not written to cacheWriter yet
+        Vector<u8> pendingWrite;
+        // If writing to cacheWriter has failed
+        bool cacheWriteFailed;
+
         // Response download speed
         double downloadBytesPerSec;
         double uploadBytesPerSec;
@@ -240,6 +288,9 @@ namespace Http
         uint requests;
         uint errors;
 
+        uint connectionsOpened;
+        uint connectionsReused;
+
         uint downloads;
         uint uploads;
         uint diskReads;
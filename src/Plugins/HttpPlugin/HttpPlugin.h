@@ -18,6 +18,9 @@ public:
     HttpPlugin(Framework* owner);
     ~HttpPlugin();
 
+    /// Returns the HTTP client, which is valid between Load and Uninitialize.
+    HttpClientPtr Client() const { return client_; }
+
 private:
     void Load() override;
     void Initialize() override;
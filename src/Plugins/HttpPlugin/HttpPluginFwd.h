@@ -22,12 +22,14 @@ namespace Tundra
     class HttpWorkQueue;
     class HttpClient;
     class HttpRequest;
+    class HttpBodySink;
 
     typedef SharedPtr<HttpWorkQueue> HttpWorkQueuePtr;
     typedef WeakPtr<HttpWorkQueue> HttpWorkQueueWeakPtr;
     typedef SharedPtr<HttpClient> HttpClientPtr;
     typedef WeakPtr<HttpClient> HttpClientWeakPtr;
     typedef SharedPtr<HttpRequest> HttpRequestPtr;
+    typedef SharedPtr<HttpBodySink> HttpBodySinkPtr;
     typedef Vector<HttpRequestPtr> HttpRequestPtrList;
 
     typedef std::map<String, String, StringCompareCaseInsensitive> HttpHeaderMap;
@@ -38,6 +40,7 @@ namespace Tundra
         
         typedef HashMap<String, Option> OptionMap;
         typedef void RequestHandle;
+        typedef void MultiHandle;
         typedef void EngineHandle;
     }
 
@@ -47,7 +50,7 @@ namespace Tundra
         struct Stats;
     }
     class HttpWorkThread;
-    typedef Vector<HttpWorkThread*> HttpWorkThreadList;
+    class HttpDiskThread;
     class HttpHudPanel;
     /// @endcond
 }
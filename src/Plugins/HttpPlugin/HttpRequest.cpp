@@ -18,12 +18,16 @@ namespace Tundra
 {
 
 #define HTTP_INITIAL_BODY_SIZE (256*1024)
+// Amount of received body data that is handed to HttpDiskThread at once
+#define HTTP_DISK_WRITE_SIZE (64*1024)
 
 // HttpRequest
 const Logger HttpRequest::log = Logger("HttpRequest");
 
 HttpRequest::HttpRequest(Framework* framework, int method, const String &url) :
     framework_(framework),
+    diskScheduled_(false),
+    diskFinished_(false),
     executing_(false),
     verbose_(false),
     completed_(false)
@@ -252,6 +256,94 @@ bool HttpRequest::SetCacheFile(const String &filepath, const String &lastModifie
     return true;
 }
 
+bool HttpRequest::SetCacheETag(const String &etag)
+{
+    Urho3D::MutexLock m(mutexExecute_);
+    if (executing_)
+    {
+        log.Error("SetCacheETag: Cannot set cache entity tag to a running request.");
+        return false;
+    }
+    // Do not lock inside SetHeaderInternal, already aquired above.
+    if (etag.Empty())
+        return RemoveHeaderInternal(Http::Header::IfNoneMatch, false, false);
+    return SetHeaderInternal(Http::Header::IfNoneMatch, etag, false, false);
+}
+
+bool HttpRequest::SetRange(uint first, int last, const String &validator)
+{
+    Urho3D::MutexLock m(mutexExecute_);
+    if (executing_)
+    {
+        log.Error("SetRange: Cannot set range to a running request.");
+        return false;
+    }
+    if (last > -1 && static_cast<uint>(last) < first)
+    {
+        log.ErrorF("SetRange: Invalid range %u-%d.", first, last);
+        return false;
+    }
+    requestData_.rangeFirst = static_cast<int>(first);
+    requestData_.rangeLast = last;
+    requestData_.rangeExplicit = true;
+
+    // Do not lock inside SetHeaderInternal, already aquired above.
+    SetHeaderInternal(Http::Header::Range, (last > -1 ? Urho3D::ToString("bytes=%u-%d", first, last) : Urho3D::ToString("bytes=%u-", first)), false, false);
+    if (!validator.Empty())
+        SetHeaderInternal(Http::Header::IfRange, validator, false, false);
+    else
+        RemoveHeaderInternal(Http::Header::IfRange, false, false);
+    return true;
+}
+
+bool HttpRequest::SetResumable(bool enabled)
+{
+    Urho3D::MutexLock m(mutexExecute_);
+    if (executing_)
+    {
+        log.Error("SetResumable: Cannot set resuming to a running request.");
+        return false;
+    }
+    requestData_.resumable = enabled;
+    return true;
+}
+
+String HttpRequest::PartialCacheFile(const String &cacheFile)
+{
+    return cacheFile + ".part";
+}
+
+/// Returns the file that stores the validator of a partial cache file.
+static String PartialValidatorFile(const String &cacheFile)
+{
+    return HttpRequest::PartialCacheFile(cacheFile) + ".validator";
+}
+
+bool HttpRequest::SetBodySink(const HttpBodySinkPtr &sink, bool keepBody)
+{
+    Urho3D::MutexLock m(mutexExecute_);
+    if (executing_)
+    {
+        log.Error("SetBodySink: Cannot set body sink to a running request.");
+        return false;
+    }
+    requestData_.bodySink = sink;
+    requestData_.keepBody = (sink ? keepBody : true);
+    return true;
+}
+
+bool HttpRequest::SetMaxBufferedBodySize(uint bytes)
+{
+    Urho3D::MutexLock m(mutexExecute_);
+    if (executing_)
+    {
+        log.Error("SetMaxBufferedBodySize: Cannot set buffering of a running request.");
+        return false;
+    }
+    requestData_.maxBufferedBodySize = bytes;
+    return true;
+}
+
 // Response API
 
 int HttpRequest::StatusCode()
@@ -323,6 +415,22 @@ Vector<u8> HttpRequest::CloneResponseBody()
     return responseData_.bodyBytes;
 }
 
+bool HttpRequest::TakeResponseBody(Vector<u8> &dest)
+{
+    if (!HasCompleted() || responseData_.bodyBytes.Empty())
+        return false;
+    dest.Clear();
+    dest.Swap(responseData_.bodyBytes);
+    return true;
+}
+
+bool HttpRequest::ResponseContentRange(uint &first, uint &last, uint &total)
+{
+    if (!HasCompleted() || responseData_.status != 206)
+        return false;
+    return Http::ParseContentRange(HeaderInternal(Http::Header::ContentRange, true), first, last, total);
+}
+
 bool HttpRequest::HasResponseHeader(const String &name)
 {
     return HasHeaderInternal(name, true);
@@ -531,25 +639,33 @@ uint HttpRequest::HeaderUIntInternal(const String &name, uint defaultValue, bool
     return value;
 }
 
-void HttpRequest::Perform()
+bool HttpRequest::Start(Curl::RequestHandle *handle)
 {
     // @note Invoked in worker thread context
     {
         Urho3D::MutexLock m(mutexExecute_);
+        requestData_.curlHandle = handle;
         executing_ = Prepare();
         completed_ = !executing_;
+        if (!executing_ && requestData_.error.Empty())
+            requestData_.error = "Failed to prepare request";
     }
-    if (!executing_)
-        return;
+    if (executing_)
+        requestData_.networkTimer.Reset();
+    return executing_;
+}
 
-    Urho3D::Timer timer;
-    CURLcode res = curl_easy_perform(requestData_.curlHandle);
+bool HttpRequest::Finish(int curlResult)
+{
+    // @note Invoked in worker thread context
+
+    CURLcode res = static_cast<CURLcode>(curlResult);
     if (res != CURLE_OK)
     {
         requestData_.error = curl_easy_strerror(res);
-        log.ErrorF("Failed to initialze request: %s", requestData_.error.CString());
+        log.ErrorF("Failed to execute request %s: %s", requestData_.OptionValueString(Options::Url).CString(), requestData_.error.CString());
     }
-    requestData_.msecNetwork = timer.GetMSec(false);
+    requestData_.msecNetwork = requestData_.networkTimer.GetMSec(false);
 
     /* Compact unused bytes from input buffers. bodyBytes should not have any free
        capacity if Content-Lenght header was provided by the server and correct. */
@@ -566,53 +682,80 @@ void HttpRequest::Perform()
             log.ErrorF("Failed to read response download speed");
         if (curl_easy_getinfo(requestData_.curlHandle, CURLINFO_SPEED_UPLOAD, &responseData_.uploadBytesPerSec) != CURLE_OK)
             log.ErrorF("Failed to read response upload speed");
+        // Zero new connections means that a kept alive connection was reused.
+        if (curl_easy_getinfo(requestData_.curlHandle, CURLINFO_NUM_CONNECTS, &requestData_.numConnects) != CURLE_OK)
+            requestData_.numConnects = -1;
 
         // Parse headers if not done yet.
         ParseHeaders();
 
-        // Only perform this sanity check for 200 OK. As eg. Not Modified might not return the true bytes in header.
-        if (responseData_.status == 200)
+        // Only perform this sanity check for 200 OK and 206 Partial Content. As eg. Not Modified might not return the true bytes in header.
+        if (responseData_.status == 200 || responseData_.status == 206)
         {
             uint contentLenght = HeaderUIntInternal(Http::Header::ContentLength, 0, true, false);
-            if (contentLenght > 0 && responseData_.bodyBytes.Size() != contentLenght)
-                log.WarningF("Content-Lenght %d header does not match size of %d read bytes for %s. Data might be incomplete.", contentLenght, responseData_.bodyBytes.Size(), requestData_.options[Options::Url].value.GetString().CString());
+            if (contentLenght > 0 && responseData_.bodySize != contentLenght)
+                log.WarningF("Content-Lenght %d header does not match size of %d read bytes for %s. Data might be incomplete.", contentLenght, responseData_.bodySize, requestData_.options[Options::Url].value.GetString().CString());
+        }
+    }
+
+    // The cache file is written or read in HttpDiskThread, see FinishDiskAccess.
+    if (!requestData_.cacheFile.Empty())
+        return true;
+
+    if (requestData_.bodySink && responseData_.bodyStarted)
+        requestData_.bodySink->End(res == CURLE_OK && requestData_.error.Empty());
+    SetCompleted();
+    return false;
+}
+
+void HttpRequest::FinishDiskAccess()
+{
+    // @note Invoked in HttpDiskThread context, after the transfer has finished
+
+    if (responseData_.cacheWriteFailed && requestData_.error.Empty())
+        requestData_.error = "Failed to write cache file " + requestData_.cacheFile;
+    bool success = requestData_.error.Empty();
 
+    if (success)
+    {
+        if (responseData_.status == 200 || responseData_.status == 206)
+        {
+            // The body was streamed to the partial cache file while downloading, replace the cache file with it.
+            if (responseData_.cacheWriter)
+                CloseCacheWriter(true);
             // Write cache file if designated. File will be written regardless if server sent a 'Last-Modified' header.
-            if (!requestData_.cacheFile.Empty())
+            else if (!requestData_.cacheFile.Empty() && !responseData_.bodyStarted && responseData_.status == 200)
             {
-                String lastModified = HeaderInternal(Http::Header::LastModified, true, false);
-
                 /** @todo Check if this is safe. We are in a secondary thread here. But it *should* be guaranteed by AssetAPI and the HttpClient that
                     one request is ongoing at a time to a unique URL. The URL designates the filepath where we are writing. Framework and Urho3D
                     Engine and its subsystem are guaranteed to be up while any worker thread is running (exit blocks waiting for workers to finish).
-                    Still this is dicy, it would be nice to execute the disk write in thread but if not safe it can be moved to main thread. */
+                    Still this is dicy, it would be nice to execute the disk write in thread but if not safe it can be moved to main thread.
+                    @note Only empty bodies are written here, others are streamed to the file in AccessDisk. */
                 Urho3D::File file(framework_->GetContext(), requestData_.cacheFile, Urho3D::FILE_WRITE);
                 if (file.IsOpen())
                 {
                     Urho3D::Timer t;
-                    uint bodySize = responseData_.bodyBytes.Size();
-                    if (file.Write(&responseData_.bodyBytes[0], bodySize) == bodySize)
+                    file.Close();
+                    String lastModified = HeaderInternal(Http::Header::LastModified, true, false);
+                    if (!lastModified.Empty())
                     {
-                        file.Close(); // File shared ptr will close when gets out of scope. Lets just do it here before modifying below last modified on the file.
-                        if (!lastModified.Empty())
-                        {
-                            time_t epoch = Http::HttpDateToUtcEpoch(lastModified);
-                            if (epoch > 0) // SetLastModifiedTime converts utc epoch correctly to local
-                                framework_->GetSubsystem<Urho3D::FileSystem>()->SetLastModifiedTime(requestData_.cacheFile, static_cast<uint>(epoch));
-                        }
+                        time_t epoch = Http::HttpDateToUtcEpoch(lastModified);
+                        if (epoch > 0) // SetLastModifiedTime converts utc epoch correctly to local
+                            framework_->GetSubsystem<Urho3D::FileSystem>()->SetLastModifiedTime(requestData_.cacheFile, static_cast<uint>(epoch));
                     }
                     requestData_.msecDiskWrite = t.GetMSec(false);
                 }
             }
         }
-        else if (responseData_.status == 304)
+        else if (responseData_.status == 304 && requestData_.keepBody)
         {
             /// See above 200 OK file access comment
             Urho3D::File file(framework_->GetContext(), requestData_.cacheFile, Urho3D::FILE_READ);
-            if (file.IsOpen())
+            uint fileSize = (file.IsOpen() ? file.GetSize() : 0);
+            // Large cached files are left for the caller to read from the cache file, like large downloaded bodies.
+            if (fileSize > 0 && (requestData_.maxBufferedBodySize == 0 || fileSize <= requestData_.maxBufferedBodySize))
             {
                 Urho3D::Timer t;
-                uint fileSize = file.GetSize();
                 responseData_.bodyBytes.Resize(fileSize);
                 if (file.Read(&responseData_.bodyBytes[0], fileSize) != fileSize)
                 {
@@ -622,29 +765,140 @@ void HttpRequest::Perform()
                 requestData_.msecDiskRead = t.GetMSec(false);
             }
         }
+        // The partial cache file does not match the resource anymore, start over on the next request.
+        else if (responseData_.status == 416 && requestData_.resumeOffset > 0)
+        {
+            Urho3D::FileSystem *fileSystem = framework_->GetSubsystem<Urho3D::FileSystem>();
+            fileSystem->Delete(PartialCacheFile(requestData_.cacheFile));
+            fileSystem->Delete(PartialValidatorFile(requestData_.cacheFile));
+        }
     }
 
-    Cleanup();
+    // A partially streamed cache file is discarded on errors and other than 200 OK and 206 Partial Content responses, unless it can be resumed.
+    if (responseData_.cacheWriter)
+        CloseCacheWriter(false);
+    if (requestData_.bodySink && responseData_.bodyStarted)
+        requestData_.bodySink->End(success);
+    SetCompleted();
+}
+
+bool HttpRequest::Abort(const String &error)
+{
+    // @note Invoked in worker thread context
 
     {
         Urho3D::MutexLock m(mutexExecute_);
-        executing_ = false;
-        completed_ = true;
+        if (requestData_.error.Empty())
+            requestData_.error = error;
+    }
+    // A partially streamed cache file is closed in HttpDiskThread.
+    if (responseData_.cacheWriter)
+        return true;
+    SetCompleted();
+    return false;
+}
+
+void HttpRequest::SetCompleted()
+{
+    Urho3D::MutexLock m(mutexExecute_);
+    executing_ = false;
+    completed_ = true;
+}
+
+bool HttpRequest::MarkDiskAccess(bool finished)
+{
+    // @note Invoked in worker thread context
+
+    Urho3D::MutexLock m(mutexDisk_);
+    if (finished)
+        diskFinished_ = true;
+    // Already queued, HttpDiskThread sees the new data and the finished state when it gets to the request.
+    if (diskScheduled_)
+        return false;
+    if (!finished && responseData_.pendingWrite.Size() < HTTP_DISK_WRITE_SIZE)
+        return false;
+    diskScheduled_ = true;
+    return true;
+}
+
+bool HttpRequest::AccessDisk()
+{
+    // @note Invoked in HttpDiskThread context
+
+    Vector<u8> data;
+    bool finished = false;
+    {
+        Urho3D::MutexLock m(mutexDisk_);
+        data.Swap(responseData_.pendingWrite);
+        finished = diskFinished_;
+        diskScheduled_ = false;
+    }
+
+    if (!data.Empty() && responseData_.cacheWriter && !responseData_.cacheWriteFailed)
+    {
+        Urho3D::Timer t;
+        uint written = responseData_.cacheWriter->Write(&data[0], data.Size());
+        requestData_.msecDiskWrite += t.GetMSec(false);
+        if (written != data.Size())
+        {
+            // ReadBody aborts the transfer once it sees this.
+            Urho3D::MutexLock m(mutexDisk_);
+            responseData_.cacheWriteFailed = true;
+        }
     }
+
+    if (finished)
+        FinishDiskAccess();
+    return finished;
+}
+
+Curl::RequestHandle *HttpRequest::Detach()
+{
+    // @note Invoked in worker thread context
+
+    /* The handle is pooled by HttpWorkThread, only release our headers.
+       The cache file may still be written by HttpDiskThread, it is closed in FinishDiskAccess. */
+    Curl::RequestHandle *handle = requestData_.curlHandle;
+    requestData_.curlHandle = 0;
+    if (requestData_.curlHeaders)
+    {
+        curl_slist_free_all(requestData_.curlHeaders);
+        requestData_.curlHeaders = 0;
+    }
+    return handle;
 }
 
 bool HttpRequest::Prepare()
 {
     // @note Invoked in worker thread context
 
-    /* @todo If we want to reuse the curl handle, its possible,
-       but not within the same HttpRequest. They would need to be pooled somewhere.
-       Research if this would make a perf difference. */
-    if (!requestData_.curlHandle)
-        requestData_.curlHandle = curl_easy_init();
+    // The curl handle is pooled by HttpWorkThread and reset between requests, so connections to the same host are reused.
     if (!requestData_.curlHandle)
         return false;
 
+    /* Resume an interrupted download from the partial cache file. If-Range makes the server respond
+       with the whole resource if it has changed since, in which case the partial file is overwritten. */
+    requestData_.resumeOffset = 0;
+    if (requestData_.resumable && !requestData_.rangeExplicit && !requestData_.cacheFile.Empty())
+    {
+        Urho3D::File partFile(framework_->GetContext());
+        Urho3D::File validatorFile(framework_->GetContext());
+        if (partFile.Open(PartialCacheFile(requestData_.cacheFile), Urho3D::FILE_READ) && partFile.GetSize() > 0 &&
+            validatorFile.Open(PartialValidatorFile(requestData_.cacheFile), Urho3D::FILE_READ))
+        {
+            String validator = validatorFile.ReadLine().Trimmed();
+            if (!validator.Empty())
+            {
+                requestData_.resumeOffset = partFile.GetSize();
+                requestData_.headers[Http::Header::Range] = Urho3D::ToString("bytes=%u-", requestData_.resumeOffset);
+                requestData_.headers[Http::Header::IfRange] = validator;
+                // The cache file is older than the partial one, a '304 Not Modified' would not be correct.
+                requestData_.headers.erase(Http::Header::IfModifiedSince);
+                requestData_.headers.erase(Http::Header::IfNoneMatch);
+            }
+        }
+    }
+
     if (verbose_)
     {
         String str;
@@ -680,6 +934,8 @@ bool HttpRequest::Prepare()
     // Standard options
     curl_easy_setopt(requestData_.curlHandle, CURLOPT_TCP_KEEPALIVE, 1L);
     curl_easy_setopt(requestData_.curlHandle, CURLOPT_FOLLOWLOCATION, 1L);
+    // Required for multi threaded use of curl, the default resolver uses signals for timeouts.
+    curl_easy_setopt(requestData_.curlHandle, CURLOPT_NOSIGNAL, 1L);
   
     // Write custom options
     for(Curl::OptionMap::ConstIterator iter = requestData_.options.Begin(); iter != requestData_.options.End(); ++iter)
@@ -735,6 +991,8 @@ void HttpRequest::Cleanup()
 {
     // @note Invoked in worker thread context
 
+    if (responseData_.cacheWriter)
+        CloseCacheWriter(false);
     if (requestData_.curlHandle)
     {
         curl_easy_cleanup(requestData_.curlHandle);
@@ -756,11 +1014,17 @@ void HttpRequest::WriteStats(Http::Stats *stats)
         if (requestData_.msecNetwork > -1)
             stats->requests++;
 
+        // Connection reuse
+        if (requestData_.numConnects == 0)
+            stats->connectionsReused++;
+        else if (requestData_.numConnects > 0)
+            stats->connectionsOpened += static_cast<uint>(requestData_.numConnects);
+
         // Disk write
         if (requestData_.msecDiskWrite > -1)
         {
             stats->diskWrites += 1;
-            stats->totals.diskWriteBytes += responseData_.bodyBytes.Size();
+            stats->totals.diskWriteBytes += responseData_.bodySize;
             stats->totals.msecDiskWrite += requestData_.msecDiskWrite;
             if (stats->averages.msecDiskWrite < 0.0)
                 stats->averages.msecDiskWrite = static_cast<double>(requestData_.msecDiskWrite);
@@ -783,7 +1047,7 @@ void HttpRequest::WriteStats(Http::Stats *stats)
         else
         {
             stats->downloads += 1;
-            stats->totals.downloadBytes += responseData_.bodyBytes.Size();
+            stats->totals.downloadBytes += responseData_.bodySize;
             if (responseData_.downloadBytesPerSec > -1.0)
             {
                 if (stats->averages.bestDownloadBytesPerSec < responseData_.downloadBytesPerSec)
@@ -860,7 +1124,7 @@ void HttpRequest::DumpResponse(bool headers, bool body)
         str.AppendWithFormat("  Url      : %s\n", requestData_.OptionValueString(Options::Url).CString());
         str.AppendWithFormat("  Status   : %d %s\n", responseData_.status, responseData_.statusText.CString());
         str.AppendWithFormat("  Headers  : %d bytes\n", responseData_.headersBytes.Size());
-        str.AppendWithFormat("  Body     : %d bytes\n", responseData_.bodyBytes.Size());
+        str.AppendWithFormat("  Body     : %d bytes\n", (responseData_.status != 304 ? responseData_.bodySize : responseData_.bodyBytes.Size()));
         if (requestData_.msecNetwork > -1)
             str.AppendWithFormat("  Spent    : %d msec\n", requestData_.msecNetwork);
         if (requestData_.msecDiskRead > -1)
@@ -919,20 +1183,191 @@ size_t HttpRequest::ReadBody(void *buffer, uint size)
 {
     /* First body bytes are being received. Parse headers to determine exact size of
        incoming data. This way we don't have to resize the body buffer mid flight. */
-    if (responseData_.bodyBytes.Empty() && !responseData_.headersBytes.Empty())
+    if (!responseData_.bodyStarted && !BeginBody())
+        return 0; // Propagates a CURLE_WRITE_ERROR and aborts transfer
+
+    responseData_.bodySize += size;
+
+    if (responseData_.bufferBody)
     {
-        if (!ParseHeaders())
-            return 0; // Propagates a CURLE_WRITE_ERROR and aborts transfer
+        /* Stop buffering if the body grows too large without a Content-Length header
+           and it is received by the cache file or a sink. */
+        uint bufferedSize = responseData_.bodyBytes.Size();
+        if (requestData_.maxBufferedBodySize > 0 && bufferedSize + size > requestData_.maxBufferedBodySize &&
+            (responseData_.cacheWriter || requestData_.bodySink))
+        {
+            responseData_.bodyBytes.Clear();
+            responseData_.bodyBytes.Compact();
+            responseData_.bufferBody = false;
+        }
+        else
+        {
+            responseData_.bodyBytes.Resize(bufferedSize + size);
+            memcpy(&responseData_.bodyBytes[bufferedSize], buffer, size);
+        }
+    }
 
-        // Headers have been parsed. Reserve bodyBytes_ to "Content-Length" size.
-        responseData_.bodyBytes.Reserve(HeaderUIntInternal(Http::Header::ContentLength, HTTP_INITIAL_BODY_SIZE, true, false));
+    // The body is written to the cache file by HttpDiskThread, so that disk access does not hold up the transfers.
+    if (responseData_.cacheWriter)
+    {
+        Urho3D::MutexLock m(mutexDisk_);
+        if (responseData_.cacheWriteFailed)
+        {
+            requestData_.error = "Failed to write cache file " + requestData_.cacheFile;
+            return 0;
+        }
+        uint pendingSize = responseData_.pendingWrite.Size();
+        responseData_.pendingWrite.Resize(pendingSize + size);
+        memcpy(&responseData_.pendingWrite[pendingSize], buffer, size);
     }
 
-    Vector<u8> data(static_cast<u8*>(buffer), size);
-    responseData_.bodyBytes.Push(data);
+    if (requestData_.bodySink && !requestData_.bodySink->Write(static_cast<const u8*>(buffer), size))
+    {
+        requestData_.error = "Response body rejected by the body sink";
+        return 0;
+    }
     return size;
 }
 
+bool HttpRequest::BeginBody()
+{
+    // @note Invoked in worker thread context
+    responseData_.bodyStarted = true;
+
+    if (!ParseHeaders())
+        return false;
+
+    long status = 0;
+    curl_easy_getinfo(requestData_.curlHandle, CURLINFO_RESPONSE_CODE, &status);
+    uint contentLength = HeaderUIntInternal(Http::Header::ContentLength, 0, true, false);
+
+    /* Stream 200 OK and 206 Partial Content bodies to the partial cache file.
+       It replaces the cache file once it contains the whole resource. */
+    uint offset = 0;
+    responseData_.completesCacheFile = true;
+    if (status == 206)
+    {
+        uint first = 0, last = 0, total = 0;
+        if (!Http::ParseContentRange(HeaderInternal(Http::Header::ContentRange, true, false), first, last, total))
+        {
+            requestData_.error = "Invalid Content-Range in 206 Partial Content response";
+            return false;
+        }
+        if (requestData_.resumeOffset > 0 && first != requestData_.resumeOffset)
+        {
+            requestData_.error = Urho3D::ToString("Resumed download starts from byte %u instead of %u", first, requestData_.resumeOffset);
+            return false;
+        }
+        offset = first;
+        uint start = (requestData_.rangeExplicit ? 0 : requestData_.resumeOffset);
+        responseData_.completesCacheFile = (first == start && total > 0 && last + 1 == total);
+    }
+    else
+        requestData_.resumeOffset = 0; // The whole resource was sent.
+
+    if ((status == 200 || status == 206) && !requestData_.cacheFile.Empty())
+    {
+        String partFile = PartialCacheFile(requestData_.cacheFile);
+        responseData_.cacheWriter = new Urho3D::File(framework_->GetContext());
+        if (responseData_.cacheWriter->Open(partFile, offset > 0 ? Urho3D::FILE_READWRITE : Urho3D::FILE_WRITE) && responseData_.cacheWriter->Seek(offset) == offset)
+            requestData_.msecDiskWrite = 0;
+        else
+        {
+            log.WarningF("Failed to open cache file '%s' for writing", requestData_.cacheFile.CString());
+            SAFE_DELETE(responseData_.cacheWriter);
+        }
+
+        /* Remember what the partial file is a part of, so that an interrupted download can be resumed.
+           Explicitly ranged requests are not resumed, the caller can write the partial file out of order. */
+        if (responseData_.cacheWriter && requestData_.resumable && !requestData_.rangeExplicit)
+        {
+            String validator = HeaderInternal(Http::Header::ETag, true, false);
+            if (!Http::IsStrongETag(validator))
+                validator = HeaderInternal(Http::Header::LastModified, true, false);
+            Urho3D::FileSystem *fileSystem = framework_->GetSubsystem<Urho3D::FileSystem>();
+            if (!validator.Empty())
+            {
+                Urho3D::File validatorFile(framework_->GetContext(), PartialValidatorFile(requestData_.cacheFile), Urho3D::FILE_WRITE);
+                validatorFile.WriteLine(validator);
+            }
+            else if (fileSystem->FileExists(PartialValidatorFile(requestData_.cacheFile)))
+                fileSystem->Delete(PartialValidatorFile(requestData_.cacheFile));
+        }
+    }
+
+    /* Large bodies are not buffered to memory if someone else receives them.
+       Neither are partial bodies that are only a part of the cache file. */
+    bool streamed = (responseData_.cacheWriter || requestData_.bodySink);
+    responseData_.bufferBody = requestData_.keepBody &&
+        !(streamed && requestData_.maxBufferedBodySize > 0 && contentLength > requestData_.maxBufferedBodySize) &&
+        !(responseData_.cacheWriter && (offset > 0 || !responseData_.completesCacheFile));
+    if (responseData_.bufferBody)
+        responseData_.bodyBytes.Reserve(contentLength > 0 ? contentLength : HTTP_INITIAL_BODY_SIZE);
+
+    if (requestData_.bodySink && !requestData_.bodySink->Begin(static_cast<int>(status), contentLength))
+    {
+        requestData_.error = "Response body rejected by the body sink";
+        return false;
+    }
+    return true;
+}
+
+void HttpRequest::CloseCacheWriter(bool success)
+{
+    // @note Invoked in worker thread context
+    if (!responseData_.cacheWriter)
+        return;
+
+    Urho3D::Timer t;
+    responseData_.cacheWriter->Close();
+    SAFE_DELETE(responseData_.cacheWriter);
+
+    Urho3D::FileSystem *fileSystem = framework_->GetSubsystem<Urho3D::FileSystem>();
+    String partFile = PartialCacheFile(requestData_.cacheFile);
+    String validatorFile = PartialValidatorFile(requestData_.cacheFile);
+    if (success && responseData_.completesCacheFile)
+    {
+        if (fileSystem->FileExists(requestData_.cacheFile))
+            fileSystem->Delete(requestData_.cacheFile);
+        if (fileSystem->FileExists(validatorFile))
+            fileSystem->Delete(validatorFile);
+        if (fileSystem->Rename(partFile, requestData_.cacheFile))
+        {
+            String lastModified = HeaderInternal(Http::Header::LastModified, true, false);
+            if (!lastModified.Empty())
+            {
+                time_t epoch = Http::HttpDateToUtcEpoch(lastModified);
+                if (epoch > 0) // SetLastModifiedTime converts utc epoch correctly to local
+                    fileSystem->SetLastModifiedTime(requestData_.cacheFile, static_cast<uint>(epoch));
+            }
+        }
+        else
+        {
+            log.WarningF("Failed to move downloaded file to cache file '%s'", requestData_.cacheFile.CString());
+            fileSystem->Delete(partFile);
+            requestData_.msecDiskWrite = -1;
+            return;
+        }
+        requestData_.msecDiskWrite += t.GetMSec(false);
+    }
+    // A part of the resource, the caller of SetRange assembles the cache file.
+    else if (success)
+        requestData_.msecDiskWrite += t.GetMSec(false);
+    // Keep interrupted bodies that can be resumed later.
+    else if (requestData_.resumable && !requestData_.rangeExplicit && responseData_.bodySize > 0 && fileSystem->FileExists(validatorFile))
+        requestData_.msecDiskWrite = -1;
+    else
+    {
+        if (!requestData_.rangeExplicit)
+        {
+            fileSystem->Delete(partFile);
+            if (fileSystem->FileExists(validatorFile))
+                fileSystem->Delete(validatorFile);
+        }
+        requestData_.msecDiskWrite = -1;
+    }
+}
+
 bool HttpRequest::ParseHeaders()
 {
     if (responseData_.headersParsed || responseData_.headersBytes.Empty())
@@ -960,6 +1395,14 @@ bool HttpRequest::ParseHeaders()
 
 size_t HttpRequest::ReadHeaders(void *buffer, uint size)
 {
+    // Headers of a followed redirect are followed by the headers of the final response. Only keep the last ones.
+    if (size >= 5 && memcmp(buffer, "HTTP/", 5) == 0 && !responseData_.bodyStarted)
+    {
+        responseData_.headersBytes.Clear();
+        responseData_.headersParsed = false;
+        responseData_.headers.clear();
+    }
+
     if (responseData_.headersBytes.Empty())
         responseData_.headersBytes.Reserve(HTTP_MAX_HEADER_SIZE);
 
@@ -29,6 +29,7 @@ class TUNDRA_HTTP_API HttpRequest : public Urho3D::RefCounted
     /// @cond PRIVATE
     friend class HttpClient;
     friend class HttpWorkThread;
+    friend class HttpDiskThread;
     friend class HttpWorkQueue;
     friend size_t CurlWriteBody(void *buffer, size_t size, size_t items, void *data);
     friend size_t CurlReadBody(void *buffer, size_t size, size_t items, void *data);
@@ -116,6 +117,35 @@ public:
     /** @param 'If-Modified-Since' header will be written to the provided @c lastModifiedHttpDate if non empty string. */
     bool SetCacheFile(const String &filepath, const String &lastModifiedHttpDate);
 
+    /// Sets the 'If-None-Match' header from @c etag, to revalidate the cache file set with SetCacheFile.
+    /** A '304 Not Modified' response is then handled as with 'If-Modified-Since'. */
+    bool SetCacheETag(const String &etag);
+
+    /// Requests bytes from @c first to @c last, inclusive, of the resource. Use -1 as @c last to request the rest of the resource.
+    /** If @c validator, a strong ETag or a HTTP date, is given it is sent as 'If-Range'. The server then responds
+        with the whole resource if it has changed. With a cache file, '206 Partial Content' bodies are written to
+        the partial cache file at their offset. The cache file is replaced only if the range starts from zero and
+        covers the whole resource, otherwise the caller is responsible for the partial cache file. @see PartialCacheFile. */
+    bool SetRange(uint first, int last = -1, const String &validator = "");
+
+    /// Sets if an interrupted download of the cache file can be resumed.
+    /** An interrupted body is kept in the partial cache file if the response had a strong ETag or a 'Last-Modified' header.
+        The next resumable request to the same cache file then requests only the missing bytes with 'Range' and 'If-Range' headers. */
+    bool SetResumable(bool enabled);
+
+    /// Returns the file where the body is written to before it replaces @c cacheFile.
+    static String PartialCacheFile(const String &cacheFile);
+
+    /// Sets @c sink to receive the response body in chunks while it is being downloaded.
+    /** @param keepBody If false the body is not buffered to memory and ResponseBody will be empty.
+        @note The sink is invoked in the HTTP worker threads. */
+    bool SetBodySink(const HttpBodySinkPtr &sink, bool keepBody = false);
+
+    /// Sets the largest response body in bytes that is buffered to memory, when the body is also received by a cache file or a body sink.
+    /** Larger bodies are only streamed to the cache file and the sink, so ResponseBody will be empty.
+        If the cache file is used, it can be read once the request has completed. 0 means no limit, which is the default. */
+    bool SetMaxBufferedBodySize(uint bytes);
+
     ///////////////////////// RESPONSE API
 
     /// Returns status code eg, 200 if request has completed successfully, otherwise -1.
@@ -155,9 +185,18 @@ public:
     /** This function should be avoided for large body sizes. @see ResponseBody(). */
     Vector<u8> CloneResponseBody();
 
+    /// Moves the response body to @c dest without copying, if request has completed.
+    /** After this the response body of the request is empty.
+        @return False if request has not completed or response body is empty. */
+    bool TakeResponseBody(Vector<u8> &dest);
+
     /// @todo Implement response body to JSONValue and JSON string.
     //JSONValue ResponseJSON();
 
+    /// Returns the byte range of a '206 Partial Content' response, if request has completed.
+    /** @param total Size of the whole resource, 0 if not known by the server. */
+    bool ResponseContentRange(uint &first, uint &last, uint &total);
+
     /// Returns if response contained header @c name.
     bool HasResponseHeader(const String &name);
 
@@ -195,7 +234,17 @@ private:
     uint HeaderUIntInternal(const String &name, uint defaultValue, bool respose, bool lock = true);
 
     /// Called by HttpWorkThread in worker thread context.
-    void Perform();
+    /** Prepares @c handle for executing this request. If false is returned the request has been completed with an error.
+        The handle is owned by the caller, get it back with Detach once the request has finished. */
+    bool Start(Curl::RequestHandle *handle);
+    /// Called by HttpWorkThread in worker thread context, when the transfer has finished with @c curlResult.
+    /** @return True if the cache file still has to be written or read by HttpDiskThread before the request is completed. */
+    bool Finish(int curlResult);
+    /// Called by HttpWorkThread in worker thread context. Completes a request that could not be executed with @c error.
+    /** @return True if the cache file still has to be closed by HttpDiskThread before the request is completed. */
+    bool Abort(const String &error);
+    /// Called by HttpWorkThread in worker thread context. Returns the curl handle that was given to Start.
+    Curl::RequestHandle *Detach();
     /// Invoked in worker thread context.
     bool Prepare();
     /// Invoked in worker thread context.
@@ -203,6 +252,21 @@ private:
 
     /// Parse headers from response raw bytes.
     bool ParseHeaders();
+    /// Called when the first body chunk is received. Decides where the body is streamed to.
+    bool BeginBody();
+    /// Closes the streamed cache file. It replaces the cache file if @c success is true, otherwise it is removed.
+    void CloseCacheWriter(bool success);
+    /// Marks the request completed.
+    void SetCompleted();
+
+    /// Called by HttpWorkQueue in worker thread context. Returns true if the request should be queued for HttpDiskThread.
+    /** The request is queued when there is enough received body data to write, or when it has @c finished. */
+    bool MarkDiskAccess(bool finished);
+    /// Called by HttpDiskThread. Writes the received body data to the cache file.
+    /** @return True if the request has finished, in which case the cache file has been closed or read and the request completed. */
+    bool AccessDisk();
+    /// Called by AccessDisk once the transfer has finished. Handles the cache file like Finish would for the response.
+    void FinishDiskAccess();
     
     /// Called by HttpWorkQueue in main thread context.
     void EmitCompletion(HttpRequestPtr &self);
@@ -232,6 +296,10 @@ private:
     Http::ResponseData responseData_;
 
     Urho3D::Mutex mutexExecute_;
+    /// Protects the received body data that waits to be written to the cache file, and the disk access state.
+    Urho3D::Mutex mutexDisk_;
+    bool diskScheduled_;
+    bool diskFinished_;
     bool executing_;
     bool completed_;
     bool verbose_;
@@ -10,27 +10,43 @@
 #include <Urho3D/Core/ProcessUtils.h>
 #include <Urho3D/Core/StringUtils.h>
 
+#include <curl/curl.h>
+
 namespace Tundra
 {
 
 // HttpWorkQueue
 
 const float DurationKeepAliveThreads = 10.f;
+/// How long HttpDiskThread sleeps when there is nothing to write.
+const uint DiskThreadIdleMSec = 5;
 const Logger HttpWorkQueue::log = Logger("HttpRequest");
 
-HttpWorkQueue::HttpWorkQueue() :
+HttpWorkQueue::HttpWorkQueue(Framework *framework) :
     durationNoWork_(0.f),
+    thread_(0),
+    diskThread_(0),
+    maxTransfers_(32),
+    maxHostConnections_(6),
+    pipelining_(false),
     stats_(new Http::Stats())
 {
-    numMaxThreads_ = Urho3D::GetNumLogicalCPUs();
-    if (numMaxThreads_ < 1) numMaxThreads_ = 1;         // Need at least one worker
-    else if (numMaxThreads_ > 32) numMaxThreads_ = 32;  // Cap to something sensible
-    log.DebugF("Maximum number of threads %d detected from %d physical and %d logical CPUs", numMaxThreads_, Urho3D::GetNumPhysicalCPUs(), Urho3D::GetNumLogicalCPUs());
+    /* Most of our requests are small assets from a single host. A handful of
+       kept alive connections per host is faster than a connection per request. */
+    StringVector param = framework->CommandLineParameters("--httpMaxTransfers");
+    if (param.Size() > 0 && Urho3D::ToUInt(param.Front()) > 0)
+        maxTransfers_ = Urho3D::ToUInt(param.Front());
+    param = framework->CommandLineParameters("--httpMaxHostConnections");
+    if (param.Size() > 0 && Urho3D::ToUInt(param.Front()) > 0)
+        maxHostConnections_ = Urho3D::ToUInt(param.Front());
+    pipelining_ = framework->HasCommandLineParameter("--httpPipelining");
+
+    log.DebugF("Maximum of %d transfers and %d connections per host, pipelining %s", maxTransfers_, maxHostConnections_, (pipelining_ ? "enabled" : "disabled"));
 }
 
 HttpWorkQueue::~HttpWorkQueue()
 {
-    // Stop all threads first. They hold raw ptrs to our queues.
+    // Stop the threads first. They hold raw ptrs to our queues.
     StopThreads();
     {
         Urho3D::MutexLock m(mutexRequests_);
@@ -79,12 +95,14 @@ void HttpWorkQueue::Update(float frametime)
        This is done so that main thread can prepare the created request
        witin the creation frame update without threading conflicts. */
     uint numPending = 0;
+    bool newWork = false;
     {
         Urho3D::MutexLock m2(mutexRequests_);
         if (created_.Size() > 0)
         {
             requests_.Insert(requests_.End(), created_.Begin(), created_.End());
             created_.Clear();
+            newWork = true;
         }
         numPending = requests_.Size();
     }
@@ -94,79 +112,104 @@ void HttpWorkQueue::Update(float frametime)
 
     if (numPending + numExecuting == 0)
     {
-        /* Don't stop workers immediately. Wait for some time
-           if new work will come in. Spinning up threads is not free. */
+        /* Don't stop the worker immediately. Wait for some time
+           if new work will come in. The thread keeps the connections alive. */
         durationNoWork_ += frametime;
-        if (durationNoWork_ > DurationKeepAliveThreads && threads_.Size() > 0)
+        if (durationNoWork_ > DurationKeepAliveThreads && thread_)
             StopThreads();
-        stats_->current.idle = (threads_.Size() > 0 ? durationNoWork_ : -1.f);
+        stats_->current.idle = (thread_ ? durationNoWork_ : -1.f);
         return;
     }
     durationNoWork_ = 0.f;
 
-    // Start new threads
-    if (threads_.Size() < numPending)
-        StartThreads(numPending);
+    if (!thread_)
+        StartThreads();
+    // Wake up the thread instead of letting it poll for new requests.
+    else if (newWork)
+        thread_->Wakeup();
 
     stats_->current.idle = -1.f;
-    stats_->current.threads = threads_.Size();
+    stats_->current.threads = (thread_ ? 1 : 0) + (diskThread_ ? 1 : 0);
 }
 
-void HttpWorkQueue::StartThreads(uint max)
+void HttpWorkQueue::StartThreads()
 {
-    if (max > numMaxThreads_)
-        max = numMaxThreads_;
-    if (threads_.Size() >= max)
+    if (thread_)
         return;
 
-    while(threads_.Size() < max)
+    // The disk thread is started first, the work thread hands requests to it.
+    diskThread_ = new HttpDiskThread(this);
+    if (!diskThread_->Run())
     {
-        HttpWorkThread *thread = new HttpWorkThread(this);
-        if (thread->Run())
-            threads_.Push(thread);
-        else
+        log.Error("Failed to start disk thread.");
+        SAFE_DELETE(diskThread_);
+    }
+    else
+    {
+        thread_ = new HttpWorkThread(this);
+        if (!thread_->Run())
         {
             log.Error("Failed to start worker thread.");
-            delete thread;
-            break;
+            SAFE_DELETE(thread_);
+            StopThreads();
         }
     }
+    stats_->current.threads = (thread_ ? 1 : 0) + (diskThread_ ? 1 : 0);
 }
 
 void HttpWorkQueue::StopThreads()
 {
-    while(threads_.Size() > 0)
+    // The work thread hands the cache files of the requests it aborts to the disk thread, so it is stopped first.
+    if (thread_)
     {
-        HttpWorkThread *thread = threads_.Back();
-        threads_.Pop();
-
-        log.DebugF("Stopping thread %d", threads_.Size()+1);
-        thread->Stop();
-        delete thread;
+        log.Debug("Stopping threads");
+        thread_->RequestStop();
+        thread_->Stop();
+        SAFE_DELETE(thread_);
+    }
+    if (diskThread_)
+    {
+        diskThread_->Stop();
+        SAFE_DELETE(diskThread_);
     }
-    stats_->current.threads = threads_.Size();
+    stats_->current.threads = 0;
 }
 
 HttpRequest* HttpWorkQueue::Next()
 {
-    mutexRequests_.Acquire();
-    if (requests_.Size() > 0)
+    HttpRequestPtr next;
     {
         // Remove from pending
-        HttpRequestPtrList::Iterator iter = requests_.Begin();
-        HttpRequestPtr next = *iter;
-        requests_.Erase(iter);
-        mutexRequests_.Release();
-
-        // Add to executing
-        {
-            Urho3D::MutexLock m(mutexCompleted_);
-            executing_.Push(next);
-        }
-        return next;
+        Urho3D::MutexLock m(mutexRequests_);
+        if (requests_.Empty())
+            return nullptr;
+        next = requests_.Front();
+        requests_.Erase(0);
     }
-    mutexRequests_.Release();
-    return nullptr;
+
+    // Add to executing
+    Urho3D::MutexLock m(mutexCompleted_);
+    executing_.Push(next);
+    return next;
+}
+
+void HttpWorkQueue::ScheduleDiskAccess(HttpRequest *request, bool finished)
+{
+    if (!request->MarkDiskAccess(finished))
+        return;
+
+    Urho3D::MutexLock m(mutexDisk_);
+    diskRequests_.Push(request);
+}
+
+HttpRequest* HttpWorkQueue::NextDiskAccess()
+{
+    Urho3D::MutexLock m(mutexDisk_);
+    if (diskRequests_.Empty())
+        return nullptr;
+    HttpRequest *next = diskRequests_.Front();
+    diskRequests_.Erase(0);
+    return next;
 }
 
 HttpRequestPtrList::Iterator HttpWorkQueue::FindExecuting(HttpRequest *request)
@@ -198,27 +241,251 @@ void HttpWorkQueue::Completed(HttpRequest *request)
 // HttpWorkThread
 
 HttpWorkThread::HttpWorkThread(HttpWorkQueue *queue) :
-    queue_(queue)
+    queue_(queue),
+    multi_(0)
+{
+}
+
+void HttpWorkThread::RequestStop()
 {
+    shouldRun_ = false;
+    Wakeup();
+}
+
+void HttpWorkThread::Wakeup()
+{
+#if LIBCURL_VERSION_NUM >= 0x074400
+    Urho3D::MutexLock m(mutexMulti_);
+    if (multi_)
+        curl_multi_wakeup(static_cast<CURLM*>(multi_));
+#endif
 }
 
 void HttpWorkThread::ThreadFunction()
 {
     LogDebug("[HttpWorkThread] Starting " + String(GetCurrentThreadID()));
 
+    CURLM *multi = curl_multi_init();
+    if (!multi)
+    {
+        LogError("[HttpWorkThread] Failed to initialize curl multi handle");
+        return;
+    }
+
+    /* The multi handle owns the connection and DNS caches.
+       Easy handles added to it share them, so requests to the same host reuse connections. */
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, static_cast<long>(queue_->maxHostConnections_));
+    curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, static_cast<long>(queue_->maxTransfers_));
+    curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, static_cast<long>(queue_->maxTransfers_));
+    if (queue_->pipelining_)
+    {
+#ifdef CURLPIPE_MULTIPLEX
+        curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#else
+        curl_multi_setopt(multi, CURLMOPT_PIPELINING, 1L);
+        curl_multi_setopt(multi, CURLMOPT_MAX_PIPELINE_LENGTH, 5L);
+#endif
+    }
+    {
+        Urho3D::MutexLock m(mutexMulti_);
+        multi_ = multi;
+    }
+
     while(shouldRun_)
     {
-        HttpRequest  *request = queue_->Next();
-        if (request)
+        StartTransfers();
+        if (!transfers_.Empty())
+        {
+            int running = 0;
+            curl_multi_perform(multi, &running);
+            ScheduleDiskWrites();
+            FinishTransfers();
+            // Finished transfers make room for waiting requests.
+            StartTransfers();
+        }
+
+        /* Block until there is network activity, curl needs to handle a timeout or new requests are scheduled.
+           Without transfers this waits for Wakeup, which HttpWorkQueue calls for new requests and RequestStop. */
+#if LIBCURL_VERSION_NUM >= 0x074400
+        curl_multi_poll(multi, 0, 0, 1000, 0);
+#else
+        if (transfers_.Empty())
+        {
+            Urho3D::Time::Sleep(10); // Without curl_multi_wakeup new requests are polled for.
+            continue;
+        }
+        long timeout = -1;
+        curl_multi_timeout(multi, &timeout);
+        if (timeout < 0 || timeout > 10)
+            timeout = 10; // Without curl_multi_wakeup new requests are picked up after this timeout.
+        int numfds = 0;
+        curl_multi_wait(multi, 0, 0, static_cast<int>(timeout), &numfds);
+        // Older curl returns immediately if it has no sockets to wait on, eg. while resolving.
+        if (numfds == 0 && timeout > 0)
+            Urho3D::Time::Sleep(1);
+#endif
+    }
+
+    Cleanup();
+
+    LogDebug("[HttpWorkThread] Stopping " + String(GetCurrentThreadID()));
+}
+
+void HttpWorkThread::StartTransfers()
+{
+    CURLM *multi = static_cast<CURLM*>(multi_);
+    while(transfers_.Size() < queue_->maxTransfers_)
+    {
+        HttpRequest *request = queue_->Next();
+        if (!request)
+            break;
+
+        Curl::RequestHandle *handle = AcquireHandle();
+        if (!handle || !request->Start(handle))
         {
-            request->Perform();
+            if (handle)
+                ReleaseHandle(request->Detach());
+            else
+                request->Abort("Failed to initialize curl handle");
             queue_->Completed(request);
+            continue;
+        }
+
+        curl_easy_setopt(handle, CURLOPT_PRIVATE, request);
+        CURLMcode res = curl_multi_add_handle(multi, handle);
+        if (res != CURLM_OK)
+        {
+            // Nothing has been received, so there is no cache file to close.
+            request->Abort(curl_multi_strerror(res));
+            ReleaseHandle(request->Detach());
+            queue_->Completed(request);
+            continue;
+        }
+        transfers_.Push(request);
+    }
+}
+
+void HttpWorkThread::FinishTransfers()
+{
+    CURLM *multi = static_cast<CURLM*>(multi_);
+    int numMessages = 0;
+    CURLMsg *message = 0;
+    while((message = curl_multi_info_read(multi, &numMessages)) != 0)
+    {
+        if (message->msg != CURLMSG_DONE)
+            continue;
+
+        // The message is invalidated by curl_multi_remove_handle, read it first.
+        CURL *handle = message->easy_handle;
+        CURLcode result = message->data.result;
+
+        char *data = 0;
+        curl_easy_getinfo(handle, CURLINFO_PRIVATE, &data);
+        HttpRequest *request = reinterpret_cast<HttpRequest*>(data);
+
+        curl_multi_remove_handle(multi, handle);
+
+        if (request)
+        {
+            transfers_.Remove(request);
+            bool diskAccess = request->Finish(static_cast<int>(result));
+            ReleaseHandle(request->Detach());
+            if (diskAccess)
+                queue_->ScheduleDiskAccess(request, true);
+            else
+                queue_->Completed(request);
         }
         else
-            Urho3D::Time::Sleep(16);
+            ReleaseHandle(handle);
     }
+}
 
-    LogDebug("[HttpWorkThread] Stopping " + String(GetCurrentThreadID()));
+void HttpWorkThread::ScheduleDiskWrites()
+{
+    for(uint i = 0; i < transfers_.Size(); ++i)
+        queue_->ScheduleDiskAccess(transfers_[i], false);
+}
+
+void HttpWorkThread::Cleanup()
+{
+    CURLM *multi = static_cast<CURLM*>(multi_);
+    {
+        Urho3D::MutexLock m(mutexMulti_);
+        multi_ = 0;
+    }
+
+    // Abort transfers that are still running.
+    for(uint i = 0; i < transfers_.Size(); ++i)
+    {
+        HttpRequest *request = transfers_[i];
+        Curl::RequestHandle *handle = request->Detach();
+        curl_multi_remove_handle(multi, handle);
+        bool diskAccess = request->Abort("Aborted");
+        ReleaseHandle(handle);
+        if (diskAccess)
+            queue_->ScheduleDiskAccess(request, true);
+        else
+            queue_->Completed(request);
+    }
+    transfers_.Clear();
+
+    for(uint i = 0; i < handles_.Size(); ++i)
+        curl_easy_cleanup(handles_[i]);
+    handles_.Clear();
+
+    curl_multi_cleanup(multi);
+}
+
+Curl::RequestHandle *HttpWorkThread::AcquireHandle()
+{
+    if (!handles_.Empty())
+    {
+        Curl::RequestHandle *handle = handles_.Back();
+        handles_.Pop();
+        return handle;
+    }
+    return curl_easy_init();
+}
+
+void HttpWorkThread::ReleaseHandle(Curl::RequestHandle *handle)
+{
+    if (!handle)
+        return;
+    // Reset clears the options but keeps the connection and session caches.
+    curl_easy_reset(handle);
+    if (handles_.Size() < queue_->maxTransfers_)
+        handles_.Push(handle);
+    else
+        curl_easy_cleanup(handle);
+}
+
+// HttpDiskThread
+
+HttpDiskThread::HttpDiskThread(HttpWorkQueue *queue) :
+    queue_(queue)
+{
+}
+
+void HttpDiskThread::ThreadFunction()
+{
+    LogDebug("[HttpDiskThread] Starting " + String(GetCurrentThreadID()));
+
+    for(;;)
+    {
+        HttpRequest *request = queue_->NextDiskAccess();
+        if (!request)
+        {
+            // Drain the queue before exiting, so that the cache files of finished and aborted requests are closed.
+            if (!shouldRun_)
+                break;
+            Urho3D::Time::Sleep(DiskThreadIdleMSec);
+            continue;
+        }
+        if (request->AccessDisk())
+            queue_->Completed(request);
+    }
+
+    LogDebug("[HttpDiskThread] Stopping " + String(GetCurrentThreadID()));
 }
 
 }
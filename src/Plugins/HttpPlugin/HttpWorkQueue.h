@@ -16,15 +16,19 @@ namespace Tundra
 {
 
 /// HttpWorkQueue request
+/** Requests are executed by a single HttpWorkThread that drives all transfers with a curl multi handle.
+    Connections and DNS lookups are reused between requests to the same host. Cache files are written
+    and read by a HttpDiskThread, so that disk access does not hold up the transfers. */
 class HttpWorkQueue : public Urho3D::RefCounted
 {
     /// @cond PRIVATE
     friend class HttpClient;
     friend class HttpWorkThread;
+    friend class HttpDiskThread;
     /// @endcond
 
 public:
-    HttpWorkQueue();
+    HttpWorkQueue(Framework *framework);
     ~HttpWorkQueue();
 
     void Schedule(const HttpRequestPtr &request);
@@ -36,7 +40,7 @@ private:
     /// @note You have to ensure mutexCompleted_ is locked prior to calling this function.
     HttpRequestPtrList::Iterator FindExecuting(HttpRequest *request);
 
-    void StartThreads(uint max);
+    void StartThreads();
     void StopThreads();
 
     /// Called by HttpClient
@@ -44,14 +48,29 @@ private:
 
     /// Called by HttpWorkThread
     HttpRequest *Next();
+    /// Called by HttpWorkThread and HttpDiskThread
     void Completed(HttpRequest *request);
 
+    /// Called by HttpWorkThread. Queues @c request for HttpDiskThread if it has body data to write to its cache file,
+    /// or if it has @c finished and its cache file needs to be closed or read.
+    void ScheduleDiskAccess(HttpRequest *request, bool finished);
+    /// Called by HttpDiskThread
+    HttpRequest *NextDiskAccess();
+
     float durationNoWork_;
-    uint numMaxThreads_;
-    HttpWorkThreadList threads_;
+    HttpWorkThread *thread_;
+    HttpDiskThread *diskThread_;
+
+    /// Maximum number of simultaneous transfers.
+    uint maxTransfers_;
+    /// Maximum number of connections to a single host.
+    uint maxHostConnections_;
+    /// If HTTP/1.1 pipelining or HTTP/2 multiplexing should be used.
+    bool pipelining_;
 
     Urho3D::Mutex mutexRequests_;
     Urho3D::Mutex mutexCompleted_;
+    Urho3D::Mutex mutexDisk_;
 
     /// Waiting requests.
     /** Accessed from multiple thread,
@@ -66,6 +85,11 @@ private:
     /// Currently executing requests.
     HttpRequestPtrList executing_;
 
+    /// Requests waiting for HttpDiskThread, in the order they were scheduled.
+    /** Accessed from multiple thread,
+        protected by mutexDisk_. The requests are kept alive by executing_. */
+    PODVector<HttpRequest*> diskRequests_;
+
     /** Newly created requests that will be moved
         to requests_ in the next frame update.
         This protects worker threads from starting
@@ -89,6 +113,48 @@ public:
     /// Urho3D::Thread
     void ThreadFunction() override;
 
+    /// Makes the thread exit its loop. Stop must be called afterwards to wait for the thread to finish.
+    void RequestStop();
+
+    /// Interrupts a wait for network activity, so that new requests are picked up immediately.
+    /** Can be called from any thread. */
+    void Wakeup();
+
+private:
+    /// Starts requests from the queue until the transfer limit is reached.
+    void StartTransfers();
+    /// Finishes completed transfers and returns their handles to the pool.
+    void FinishTransfers();
+    /// Hands the received body data of running transfers to HttpDiskThread.
+    void ScheduleDiskWrites();
+    /// Aborts all running transfers and releases curl handles.
+    void Cleanup();
+
+    Curl::RequestHandle *AcquireHandle();
+    void ReleaseHandle(Curl::RequestHandle *handle);
+
+    HttpWorkQueue *queue_;
+
+    /// Curl multi handle. Written only by the work thread, read by Wakeup.
+    Curl::MultiHandle *multi_;
+    Urho3D::Mutex mutexMulti_;
+
+    /// Pooled easy handles. Accessed only in the work thread.
+    PODVector<Curl::RequestHandle*> handles_;
+    /// Requests added to the multi handle. Accessed only in the work thread.
+    PODVector<HttpRequest*> transfers_;
+};
+
+class HttpDiskThread : public Urho3D::Thread
+{
+public:
+    HttpDiskThread(HttpWorkQueue *queue);
+
+    /// Urho3D::Thread
+    /** Processes the requests scheduled with HttpWorkQueue::ScheduleDiskAccess. Once stopped, the thread
+        exits after the already scheduled requests have been processed. */
+    void ThreadFunction() override;
+
 private:
     HttpWorkQueue *queue_;
 };
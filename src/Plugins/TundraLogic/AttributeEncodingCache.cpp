@@ -0,0 +1,84 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "AttributeEncodingCache.h"
+
+#include <cstring>
+
+namespace Tundra
+{
+
+/// Returned for empty serialized data, so that a null pointer always means failed serialization.
+static const u8 cEmptyData = 0;
+
+AttributeEncodingCache::Key::Key() :
+    entityId(0),
+    componentId(0),
+    fullUpdate(false)
+{
+    memset(dirtyAttributes, 0, sizeof dirtyAttributes);
+}
+
+AttributeEncodingCache::Key::Key(entity_id_t entity, component_id_t component, const u8 *dirty) :
+    entityId(entity),
+    componentId(component),
+    fullUpdate(dirty == 0)
+{
+    if (dirty)
+        memcpy(dirtyAttributes, dirty, sizeof dirtyAttributes);
+    else
+        memset(dirtyAttributes, 0, sizeof dirtyAttributes);
+}
+
+bool AttributeEncodingCache::Key::operator ==(const Key &rhs) const
+{
+    return entityId == rhs.entityId && componentId == rhs.componentId && fullUpdate == rhs.fullUpdate &&
+        memcmp(dirtyAttributes, rhs.dirtyAttributes, sizeof dirtyAttributes) == 0;
+}
+
+unsigned AttributeEncodingCache::Key::ToHash() const
+{
+    unsigned hash = entityId * 31 + componentId;
+    hash = (hash << 1) + (fullUpdate ? 1 : 0);
+    for (uint i = 0; i < sizeof dirtyAttributes; ++i)
+        hash = dirtyAttributes[i] + (hash << 6) + (hash << 16) - hash;
+    return hash;
+}
+
+AttributeEncodingCache::AttributeEncodingCache()
+{
+}
+
+void AttributeEncodingCache::Clear()
+{
+    entries_.Clear();
+    data_.Clear();
+}
+
+bool AttributeEncodingCache::Find(const Key &key, const u8 *&data, uint &size) const
+{
+    HashMap<Key, Entry>::ConstIterator iter = entries_.Find(key);
+    if (iter == entries_.End())
+        return false;
+
+    const Entry &entry = iter->second_;
+    data = (entry.valid ? (entry.size ? &data_[entry.offset] : &cEmptyData) : 0);
+    size = entry.size;
+    return true;
+}
+
+void AttributeEncodingCache::Store(const Key &key, const u8 *data, uint size)
+{
+    Entry entry;
+    entry.offset = data_.Size();
+    entry.size = (data ? size : 0);
+    entry.valid = (data != 0);
+    if (entry.size)
+    {
+        data_.Resize(entry.offset + entry.size);
+        memcpy(&data_[entry.offset], data, entry.size);
+    }
+    entries_[key] = entry;
+}
+
+}
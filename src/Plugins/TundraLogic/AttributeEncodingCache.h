@@ -0,0 +1,70 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraLogicApi.h"
+#include "CoreTypes.h"
+
+#include <Urho3D/Container/HashMap.h>
+
+namespace Tundra
+{
+
+/// Serialized attribute data of components, shared by all user connections during one network update tick.
+/** SyncManager serializes the attribute data of a component full update, or of a component's changed attributes,
+    once per tick and copies the bytes into each user connection's messages. The attribute values can not change
+    while a tick is being processed, so the tick acts as the change generation of the data and the cache is
+    cleared at the start of each tick.
+    Find may be called from several threads at once, as long as no thread calls Store or Clear at the same time. */
+class TUNDRALOGIC_API AttributeEncodingCache
+{
+public:
+    /// Identifies a piece of serialized attribute data.
+    struct Key
+    {
+        Key();
+        /// Constructs a key for the attribute data of a component.
+        /** @param dirty Bitmask of the changed attributes (32 bytes), or null for the full update data. */
+        Key(entity_id_t entity, component_id_t component, const u8 *dirty);
+
+        bool operator ==(const Key &rhs) const;
+        unsigned ToHash() const;
+
+        entity_id_t entityId;
+        component_id_t componentId;
+        bool fullUpdate; ///< Full update data with all static and dynamic attributes.
+        u8 dirtyAttributes[32]; ///< Changed attributes, zero for full update data.
+    };
+
+    AttributeEncodingCache();
+
+    /// Forgets all serialized data. The data buffer keeps its capacity for the next tick.
+    void Clear();
+
+    /// Looks up serialized data.
+    /** @param data [out] Set to the serialized data, or null if serializing the data has failed on this tick.
+            The pointer is valid until the next call to Store or Clear.
+        @param size [out] Size of the serialized data in bytes.
+        @return True if the data has been stored on this tick. */
+    bool Find(const Key &key, const u8 *&data, uint &size) const;
+
+    /// Stores serialized data. Pass null @c data to remember that serializing has failed.
+    void Store(const Key &key, const u8 *data, uint size);
+
+    /// Returns number of stored entries.
+    uint NumEntries() const { return entries_.Size(); }
+
+private:
+    /// Location of stored data in data_.
+    struct Entry
+    {
+        uint offset;
+        uint size;
+        bool valid;
+    };
+
+    HashMap<Key, Entry> entries_;
+    PODVector<u8> data_;
+};
+
+}
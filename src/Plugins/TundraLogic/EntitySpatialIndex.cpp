@@ -0,0 +1,157 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "EntitySpatialIndex.h"
+
+#include "Math/MathFunc.h"
+
+#include <cmath>
+
+namespace Tundra
+{
+
+/// Grid coordinates are packed to 21 bits each, with this bias to make them unsigned.
+static const int cCellBias = 1 << 20;
+static const int cCellMax = (1 << 21) - 1;
+
+EntitySpatialIndex::EntitySpatialIndex(float cellSize) :
+    cellSize_(cellSize > 0.f ? cellSize : 32.f)
+{
+}
+
+void EntitySpatialIndex::SetCellSize(float cellSize)
+{
+    if (cellSize <= 0.f || cellSize == cellSize_)
+        return;
+    cellSize_ = cellSize;
+
+    // Re-bucket the entities with the new cell size.
+    HashMap<entity_id_t, Item> entities;
+    entities.Swap(entities_);
+    cells_.Clear();
+    for(HashMap<entity_id_t, Item>::ConstIterator it = entities.Begin(); it != entities.End(); ++it)
+        Update(it->first_, it->second_.position);
+}
+
+u64 EntitySpatialIndex::CellKey(int x, int y, int z)
+{
+    x = Clamp(x + cCellBias, 0, cCellMax);
+    y = Clamp(y + cCellBias, 0, cCellMax);
+    z = Clamp(z + cCellBias, 0, cCellMax);
+    return ((u64)x << 42) | ((u64)y << 21) | (u64)z;
+}
+
+u64 EntitySpatialIndex::CellKey(const float3 &position) const
+{
+    return CellKey((int)floorf(position.x / cellSize_), (int)floorf(position.y / cellSize_), (int)floorf(position.z / cellSize_));
+}
+
+void EntitySpatialIndex::RemoveFromCell(const Item &item)
+{
+    HashMap<u64, PODVector<entity_id_t> >::Iterator cell = cells_.Find(item.cell);
+    if (cell == cells_.End())
+        return;
+
+    // Move the last entity of the cell to the removed slot.
+    PODVector<entity_id_t> &ids = cell->second_;
+    entity_id_t last = ids.Back();
+    ids[item.slot] = last;
+    entities_[last].slot = item.slot;
+    ids.Pop();
+    if (ids.Empty())
+        cells_.Erase(cell);
+}
+
+void EntitySpatialIndex::Update(entity_id_t id, const float3 &position)
+{
+    if (!position.IsFinite())
+    {
+        Remove(id);
+        return;
+    }
+
+    u64 cell = CellKey(position);
+    HashMap<entity_id_t, Item>::Iterator it = entities_.Find(id);
+    if (it != entities_.End())
+    {
+        it->second_.position = position;
+        if (it->second_.cell == cell)
+            return;
+        Item item = it->second_;
+        RemoveFromCell(item);
+    }
+
+    PODVector<entity_id_t> &ids = cells_[cell];
+    Item &item = entities_[id];
+    item.position = position;
+    item.cell = cell;
+    item.slot = ids.Size();
+    ids.Push(id);
+}
+
+void EntitySpatialIndex::Remove(entity_id_t id)
+{
+    HashMap<entity_id_t, Item>::Iterator it = entities_.Find(id);
+    if (it == entities_.End())
+        return;
+    Item item = it->second_;
+    // RemoveFromCell updates the slot of the moved entity, which may be this one.
+    RemoveFromCell(item);
+    entities_.Erase(id);
+}
+
+void EntitySpatialIndex::Clear()
+{
+    entities_.Clear();
+    cells_.Clear();
+}
+
+float3 EntitySpatialIndex::Position(entity_id_t id) const
+{
+    HashMap<entity_id_t, Item>::ConstIterator it = entities_.Find(id);
+    return (it != entities_.End() ? it->second_.position : float3::nan);
+}
+
+void EntitySpatialIndex::QuerySphere(const float3 &center, float radius, PODVector<entity_id_t> &result) const
+{
+    if (entities_.Empty() || !center.IsFinite() || radius < 0.f)
+        return;
+
+    const float radiusSq = radius * radius;
+    // An infinite radius returns all entities.
+    if (radius == FLOAT_INF)
+    {
+        for(HashMap<entity_id_t, Item>::ConstIterator it = entities_.Begin(); it != entities_.End(); ++it)
+            result.Push(it->first_);
+        return;
+    }
+
+    int minX = (int)floorf((center.x - radius) / cellSize_), maxX = (int)floorf((center.x + radius) / cellSize_);
+    int minY = (int)floorf((center.y - radius) / cellSize_), maxY = (int)floorf((center.y + radius) / cellSize_);
+    int minZ = (int)floorf((center.z - radius) / cellSize_), maxZ = (int)floorf((center.z + radius) / cellSize_);
+
+    // If the sphere covers more cells than there are occupied ones, it is cheaper to test every entity.
+    double numCells = (double)(maxX - minX + 1) * (double)(maxY - minY + 1) * (double)(maxZ - minZ + 1);
+    if (numCells > (double)cells_.Size())
+    {
+        for(HashMap<entity_id_t, Item>::ConstIterator it = entities_.Begin(); it != entities_.End(); ++it)
+            if (it->second_.position.DistanceSq(center) <= radiusSq)
+                result.Push(it->first_);
+        return;
+    }
+
+    for(int x = minX; x <= maxX; ++x)
+        for(int y = minY; y <= maxY; ++y)
+            for(int z = minZ; z <= maxZ; ++z)
+            {
+                HashMap<u64, PODVector<entity_id_t> >::ConstIterator cell = cells_.Find(CellKey(x, y, z));
+                if (cell == cells_.End())
+                    continue;
+                const PODVector<entity_id_t> &ids = cell->second_;
+                for(uint i = 0; i < ids.Size(); ++i)
+                    if (entities_.Find(ids[i])->second_.position.DistanceSq(center) <= radiusSq)
+                        result.Push(ids[i]);
+            }
+}
+
+}
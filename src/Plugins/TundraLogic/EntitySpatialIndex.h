@@ -0,0 +1,72 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraLogicApi.h"
+#include "CoreTypes.h"
+#include "Math/float3.h"
+
+#include <Urho3D/Container/HashMap.h>
+
+namespace Tundra
+{
+
+/// Renderer independent spatial index of entity world positions.
+/** Entities are bucketed to a uniform grid of cubic cells, so updating a position is O(1) and a sphere
+    query only visits the cells its bounding box overlaps. Unlike the Urho3D Octree this works on a headless
+    server. SyncManager keeps the index up to date from the Placeable transform changes for interest management. */
+class TUNDRALOGIC_API EntitySpatialIndex
+{
+public:
+    /// @param cellSize Edge length of a grid cell in world units.
+    explicit EntitySpatialIndex(float cellSize = 32.f);
+
+    /// Sets the grid cell size. Rebuilds the grid if there are entities in the index.
+    void SetCellSize(float cellSize);
+
+    /// Returns the grid cell size.
+    float CellSize() const { return cellSize_; }
+
+    /// Adds entity @c id to the index or moves it to @c position.
+    void Update(entity_id_t id, const float3 &position);
+
+    /// Removes entity @c id from the index.
+    void Remove(entity_id_t id);
+
+    /// Removes all entities from the index.
+    void Clear();
+
+    /// Returns if entity @c id is in the index.
+    bool Contains(entity_id_t id) const { return entities_.Contains(id); }
+
+    /// Returns the indexed position of entity @c id, or float3::nan if it is not in the index.
+    float3 Position(entity_id_t id) const;
+
+    /// Returns the number of entities in the index.
+    uint Size() const { return entities_.Size(); }
+
+    /// Appends the entities within @c radius of @c center to @c result. With FLOAT_INF radius, appends all entities.
+    void QuerySphere(const float3 &center, float radius, PODVector<entity_id_t> &result) const;
+
+private:
+    /// Position of an entity and its location in the grid.
+    struct Item
+    {
+        float3 position;
+        u64 cell;
+        uint slot; ///< Index in the cell's vector.
+    };
+
+    /// Returns the key of the cell containing @c position.
+    u64 CellKey(const float3 &position) const;
+    /// Returns the key of cell at the grid coordinates.
+    static u64 CellKey(int x, int y, int z);
+    /// Removes @c item from its cell.
+    void RemoveFromCell(const Item &item);
+
+    float cellSize_;
+    HashMap<entity_id_t, Item> entities_;
+    HashMap<u64, PODVector<entity_id_t> > cells_;
+};
+
+}
@@ -25,6 +25,8 @@
 
 #include <Urho3D/Core/Profiler.h>
 #include <Urho3D/Core/StringUtils.h>
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Core/WorkQueue.h>
 
 #include <cstring>
 
@@ -33,18 +35,75 @@ static std::set<u32> mismatchingComponentTypes;
 
 static size_t oldAttrDataBufferSize = 16 * 1024;
 
+// Sync prioritization: distance (in world units) at which an entity's priority is halved.
+static const float cSyncPriorityHalfDistance = 25.0f;
+// Sync prioritization: lower bound of a relevance factor, so that irrelevant entities are eventually sent due to starvation.
+static const float cSyncPriorityMinRelevance = 0.01f;
+// Interest management: cosine of the half angle of the client's view cone (60 degrees).
+static const float cInterestViewConeCos = 0.5f;
+// Interest management: default radii and update interval (ms) when enabled from the command line.
+static const int cInterestDefaultCriticalRange = 25;
+static const int cInterestDefaultRange = 200;
+static const int cInterestDefaultUpdateInterval = 200;
+
 namespace Tundra
 {
 
-bool SyncManager::WriteComponentFullUpdate(kNet::DataSerializer& ds, ComponentPtr comp)
+/// Sorts prioritized entities to descending priority order.
+bool ComparePrioritizedEntitySyncState(const PrioritizedEntitySyncState &a, const PrioritizedEntitySyncState &b)
+{
+    return a.priority > b.priority;
+}
+
+/// Returns the first Placeable of @c entity without touching any reference counts.
+static Placeable *PlaceableOf(const Entity *entity)
+{
+    const Entity::ComponentMap &components = entity->Components();
+    for(Entity::ComponentMap::ConstIterator i = components.Begin(); i != components.End(); ++i)
+        if (i->second_->TypeId() == Placeable::ComponentTypeId)
+            return static_cast<Placeable*>(i->second_.Get());
+    return nullptr;
+}
+
+/// Remembers the transform of @c comp, if it is a Placeable, as the last one sent to the client.
+/** The rigid body updates are compared against it, so it is set whenever the Transform is sent in full. */
+static void SetSentTransform(EntitySyncState *entityState, IComponent *comp)
+{
+    if (comp->TypeId() != Placeable::ComponentTypeId)
+        return;
+    entityState->transform = static_cast<Placeable*>(comp)->transform.Get();
+    entityState->linearVelocity = float3::zero;
+    entityState->lastNetworkSendTime = kNet::Clock::Tick();
+}
+
+bool SyncManager::WriteComponentFullUpdate(UserSyncJob& job, kNet::DataSerializer& ds, IComponent* comp)
 {
     // Component identification
     ds.AddVLE<kNet::VLE8_16_32>(comp->Id() & UniqueIdGenerator::LAST_REPLICATED_ID);
     ds.AddVLE<kNet::VLE8_16_32>(comp->TypeId());
     ds.AddString(comp->Name().CString());
     
+    uint size = 0;
+    const u8* data = ComponentFullUpdateData(job, comp, size);
+    if (!data)
+        return false;
+
+    // Add the attribute array to the main serializer
+    ds.AddVLE<kNet::VLE8_16_32>(size);
+    ds.AddArray<u8>(data, size);
+    return true;
+}
+
+const u8* SyncManager::ComponentFullUpdateData(UserSyncJob& job, IComponent* comp, uint& size)
+{
+    // The attribute data is the same for all users, so it is serialized only once per tick
+    AttributeEncodingCache::Key key(comp->ParentEntity()->Id(), comp->Id(), 0);
+    const u8* data = 0;
+    if (encodingCache_.Find(key, data, size))
+        return data;
+
     // Create a nested dataserializer for the attributes, so we can survive unknown or incompatible components
-    kNet::DataSerializer attrDs(attrDataBuffer_, NUMELEMS(attrDataBuffer_));
+    kNet::DataSerializer attrDs(job.attrDataBuffer, NUMELEMS(job.attrDataBuffer));
 
     // Static-structured attributes
     unsigned numStaticAttrs = comp->NumStaticAttributes();
@@ -64,16 +123,146 @@ bool SyncManager::WriteComponentFullUpdate(kNet::DataSerializer& ds, ComponentPt
         }
     }
 
-    if (!ValidateAttributeBuffer(false, attrDs, comp))
-        return false;
-    
-    // Add the attribute array to the main serializer
-    ds.AddVLE<kNet::VLE8_16_32>((u32)attrDs.BytesFilled());
-    ds.AddArray<u8>((unsigned char*)attrDataBuffer_, (u32)attrDs.BytesFilled());
-    return true;
+    if (ValidateAttributeBuffer(false, attrDs, comp, 0, &job))
+    {
+        data = (const u8*)job.attrDataBuffer;
+        size = (uint)attrDs.BytesFilled();
+    }
+    else
+        size = 0;
+
+    // Worker threads only read the cache
+    if (!job.deferred)
+        encodingCache_.Store(key, data, size);
+    return data;
+}
+
+const u8* SyncManager::ChangedAttributesData(UserSyncJob& job, IComponent* comp, const u8* dirtyAttributes, const std::vector<u8>& changedAttributes, uint& size)
+{
+    AttributeEncodingCache::Key key(comp->ParentEntity()->Id(), comp->Id(), dirtyAttributes);
+    const u8* data = 0;
+    if (encodingCache_.Find(key, data, size))
+        return data;
+
+    // Create a nested dataserializer for the actual attribute data, so we can skip components
+    kNet::DataSerializer attrDataDs(job.attrDataBuffer, NUMELEMS(job.attrDataBuffer));
+    const AttributeVector& attrs = comp->Attributes();
+
+    // There are changed attributes. Check if it is more optimal to send attribute indices, or the whole bitmask
+    unsigned bitsMethod1 = (unsigned)changedAttributes.size() * 8 + 8;
+    unsigned bitsMethod2 = (unsigned)attrs.Size();
+    // Method 1: indices
+    if (bitsMethod1 <= bitsMethod2)
+    {
+        attrDataDs.Add<kNet::bit>(0);
+        attrDataDs.Add<u8>((u8)changedAttributes.size());
+        for (unsigned i = 0; i < changedAttributes.size(); ++i)
+        {
+            attrDataDs.Add<u8>(changedAttributes[i]);
+            attrs[changedAttributes[i]]->ToBinary(attrDataDs);
+        }
+    }
+    // Method 2: bitmask
+    else
+    {
+        attrDataDs.Add<kNet::bit>(1);
+        for (unsigned i = 0; i < attrs.Size(); ++i)
+        {
+            if (dirtyAttributes[i >> 3] & (1 << (i & 7)))
+            {
+                attrDataDs.Add<kNet::bit>(1);
+                attrs[i]->ToBinary(attrDataDs);
+            }
+            else
+                attrDataDs.Add<kNet::bit>(0);
+        }
+    }
+
+    if (ValidateAttributeBuffer(false, attrDataDs, comp, 0, &job))
+    {
+        data = (const u8*)job.attrDataBuffer;
+        size = (uint)attrDataDs.BytesFilled();
+    }
+    else
+        size = 0;
+
+    // Worker threads only read the cache
+    if (!job.deferred)
+        encodingCache_.Store(key, data, size);
+    return data;
+}
+
+void SyncManager::FillAttributeEncodingCache(UserSyncJob& job)
+{
+    PROFILE(SyncManager_FillAttributeEncodingCache);
+
+    SceneSyncState* state = job.user->syncState.Get();
+    u8 dirtyAttributes[32];
+    for (uint q = 0; q < state->dirtyQueue.Size(); ++q)
+    {
+        EntitySyncState* entityState = state->DirtyEntity(state->dirtyQueue[q]);
+        Entity* entity = (entityState ? entityState->weak.Get() : 0);
+        if (!entity || entityState->removed || entity->IsLocal())
+            continue;
+
+        if (entityState->isNew)
+        {
+            const Entity::ComponentMap& components = entity->Components();
+            for (auto i = components.Begin(); i != components.End(); ++i)
+            {
+                IComponent* comp = i->second_.Get();
+                if (comp->IsReplicated())
+                {
+                    uint size;
+                    ComponentFullUpdateData(job, comp, size);
+                }
+            }
+            continue;
+        }
+
+        for (uint i = 0; i < entityState->components.Size(); ++i)
+        {
+            const ComponentSyncState& compState = entityState->components[i];
+            if (!compState.isInQueue || compState.removed)
+                continue;
+            auto compIter = entity->Components().Find(compState.id);
+            IComponent* comp = (compIter != entity->Components().End() ? compIter->second_.Get() : nullptr);
+            if (!comp || comp->IsLocal() || (!compState.isNew && comp->IsUnacked()))
+                continue;
+
+            uint size;
+            if (compState.isNew)
+            {
+                ComponentFullUpdateData(job, comp, size);
+                continue;
+            }
+
+            // Replicate the dirty bits the way ProcessEntitySyncState will see them: created attributes are not sent as edits
+            const AttributeVector& attrs = comp->Attributes();
+            for (uint j = 0; j < 32; ++j)
+                dirtyAttributes[j] = compState.dirtyAttributes[j] & ~(compState.createdAttributes[j] | compState.removedAttributes[j]);
+
+            job.changedAttributes.clear();
+            for (unsigned attrIndex = 0; attrIndex < attrs.Size(); ++attrIndex)
+            {
+                if (dirtyAttributes[attrIndex >> 3] & (1 << (attrIndex & 7)))
+                {
+                    if (!attrs[attrIndex])
+                    {
+                        // Let ProcessEntitySyncState report the nonexisting attribute
+                        job.changedAttributes.clear();
+                        break;
+                    }
+                    job.changedAttributes.push_back((u8)attrIndex);
+                }
+            }
+            if (job.changedAttributes.size())
+                ChangedAttributesData(job, comp, dirtyAttributes, job.changedAttributes, size);
+        }
+    }
 }
 
-bool SyncManager::ValidateAttributeBuffer(bool fatal, kNet::DataSerializer& ds, ComponentPtr &comp, size_t maxBytes)
+bool SyncManager::ValidateAttributeBuffer(bool fatal, kNet::DataSerializer& ds, IComponent* comp, size_t maxBytes, UserSyncJob* job)
 {
     if (maxBytes == 0)
         maxBytes = oldAttrDataBufferSize;
@@ -97,6 +286,8 @@ bool SyncManager::ValidateAttributeBuffer(bool fatal, kNet::DataSerializer& ds,
         if (fatal)
             /// \todo Better way to handle this?
             throw std::runtime_error(ex.CString());
+        else if (job)
+            job->LogError(ex);
         else
             LogError(ex);
         return false;
@@ -105,6 +296,71 @@ bool SyncManager::ValidateAttributeBuffer(bool fatal, kNet::DataSerializer& ds,
     return true;
 }
 
+UserSyncJob::UserSyncJob() :
+    user(0),
+    scene(0),
+    deferred(false),
+    failed(false),
+    bytesSent(0)
+{
+}
+
+void UserSyncJob::Send(kNet::message_id_t id, kNet::DataSerializer& ds)
+{
+    bytesSent += (uint)ds.BytesFilled();
+    if (!deferred)
+    {
+        user->Send(id, true, true, ds);
+        return;
+    }
+
+    QueuedMessage msg;
+    msg.id = id;
+    msg.offset = messageData.Size();
+    msg.size = (uint)ds.BytesFilled();
+    messages.Push(msg);
+    messageData.Resize(msg.offset + msg.size);
+    if (msg.size)
+        memcpy(&messageData[msg.offset], ds.GetData(), msg.size);
+}
+
+void UserSyncJob::LogWarning(const String& msg)
+{
+    if (deferred)
+        warnings.Push(msg);
+    else
+        Tundra::LogWarning(msg);
+}
+
+void UserSyncJob::LogError(const String& msg)
+{
+    if (deferred)
+        errors.Push(msg);
+    else
+        Tundra::LogError(msg);
+}
+
+void UserSyncJob::Flush()
+{
+    foreach(const String& msg, errors)
+        Tundra::LogError(msg);
+    foreach(const String& msg, warnings)
+        Tundra::LogWarning(msg);
+    errors.Clear();
+    warnings.Clear();
+
+    if (!failed)
+    {
+        for (uint i = 0; i < messages.Size(); ++i)
+        {
+            const QueuedMessage& msg = messages[i];
+            user->Send(msg.id, msg.size ? (const char*)&messageData[msg.offset] : 0, msg.size, true, true);
+        }
+    }
+    messages.Clear();
+    messageData.Clear();
+}
+
 SyncManager::SyncManager(TundraLogic* owner) :
     Object(owner->GetContext()),
     owner_(owner),
@@ -113,10 +369,41 @@ SyncManager::SyncManager(TundraLogic* owner) :
     updateAcc_(0.0),
     maxLinExtrapTime_(3.0f),
     noClientPhysicsHandoff_(false),
-    componentTypeSender_(0)
+    maxBytesPerTick_(0),
+    parallelSync_(false),
+    serializingParallel_(false),
+    serialJob_(new UserSyncJob()),
+    componentTypeSender_(0),
+    interestEnabled_(false),
+    interestDistanceFilter_(false),
+    interestViewFilter_(false),
+    interestRelevance_(false),
+    interestCriticalRange_(0.0f),
+    interestRange_(0.0f),
+    interestRelevanceInterval_(0.0f),
+    interestVisibilityInterval_(0.0f),
+    interestRelevanceAcc_(0.0f),
+    interestVisibilityAcc_(0.0f)
 {
     if (framework_->HasCommandLineParameter("--noclientphysics"))
         noClientPhysicsHandoff_ = true;
+    if (framework_->HasCommandLineParameter("--parallelsync"))
+        parallelSync_ = true;
+
+    StringVector budgetParam = framework_->CommandLineParameters("--syncbytespertick");
+    if (budgetParam.Size() > 0)
+        SetMaxBytesPerTick(ToUInt(budgetParam.Front()));
+
+    StringVector interestParam = framework_->CommandLineParameters("--syncinterestrange");
+    if (interestParam.Size() > 0)
+    {
+        int range = ToInt(interestParam.Front());
+        if (range > 0)
+            UpdateInterestManagerSettings(true, true, true, true, Min(cInterestDefaultCriticalRange, range), range,
+                cInterestDefaultUpdateInterval, cInterestDefaultUpdateInterval);
+        else
+            LogWarning("SyncManager: Invalid --syncinterestrange " + interestParam.Front());
+    }
     
     GetClientExtrapolationTime();
 
@@ -131,6 +418,16 @@ SyncManager::SyncManager(TundraLogic* owner) :
 
 SyncManager::~SyncManager()
 {
+    for(auto i = interpolationEndValues_.Begin(); i != interpolationEndValues_.End(); ++i)
+        delete i->second_;
+}
+
+IAttribute* SyncManager::InterpolationEndValue(IAttribute* attr)
+{
+    IAttribute*& endValue = interpolationEndValues_[attr->TypeId()];
+    if (!endValue)
+        endValue = attr->Clone();
+    return endValue;
 }
 
 void SyncManager::SendCameraUpdateRequest(UserConnectionPtr conn, bool enabled)
@@ -154,6 +451,54 @@ void SyncManager::SetUpdatePeriod(float period)
     GetClientExtrapolationTime();
 }
 
+void SyncManager::SetMaxBytesPerTick(uint bytes)
+{
+    maxBytesPerTick_ = bytes;
+}
+
+void SyncManager::SetParallelSync(bool enabled)
+{
+    parallelSync_ = enabled;
+}
+
+void SyncManager::UpdateInterestManagerSettings(bool enabled, bool eucl, bool ray, bool rel, int critrange, int relrange, int updateint, int raycastint)
+{
+    bool wasEnabled = interestEnabled_;
+    interestEnabled_ = enabled;
+    interestDistanceFilter_ = eucl;
+    interestViewFilter_ = ray;
+    interestRelevance_ = rel;
+    interestCriticalRange_ = (float)Max(critrange, 0);
+    interestRange_ = Max((float)relrange, interestCriticalRange_);
+    interestRelevanceInterval_ = Max(updateint, 0) / 1000.0f;
+    interestVisibilityInterval_ = Max(raycastint, 0) / 1000.0f;
+    // Evaluate the interest with the new settings on the next tick.
+    interestRelevanceAcc_ = interestRelevanceInterval_;
+    interestVisibilityAcc_ = interestVisibilityInterval_;
+
+    if (!owner_->IsServer())
+        return;
+
+    if (enabled && !wasEnabled)
+        RebuildSpatialIndex();
+    else if (!enabled)
+    {
+        spatialIndex_.Clear();
+        spatialIndexDirty_.Clear();
+    }
+
+    UserConnectionList& users = owner_->Server()->UserConnections();
+    for(auto i = users.Begin(); i != users.End(); ++i)
+    {
+        if (!(*i)->syncState)
+            continue;
+        // The filtered entities are left in the dirty queue, so they are sent once the filtering is disabled.
+        (*i)->syncState->visibleEntities.clear();
+        if (enabled != wasEnabled)
+            SendCameraUpdateRequest(*i, enabled);
+    }
+}
+
 void SyncManager::GetClientExtrapolationTime()
 {
     StringVector extrapTimeParam = framework_->CommandLineParameters("--clientextrapolationtime");
@@ -217,6 +562,8 @@ void SyncManager::RegisterToScene(ScenePtr scene)
     }
     
     scene_ = scene;
+    if (interestEnabled_)
+        RebuildSpatialIndex();
     Scene* sceneptr = scene.Get();
     sceneptr->AttributeChanged.Connect(this, &SyncManager::OnAttributeChanged);
     sceneptr->AttributeAdded.Connect(this, &SyncManager::OnAttributeAdded);
@@ -318,7 +665,12 @@ void SyncManager::NewUserConnected(const UserConnectionPtr &user)
     user->syncState->SetParentScene(scene_);
 
     if (owner_->IsServer())
+    {
         SceneStateCreated.Emit(user.Get(), user->syncState.Get());
+        // Request the client's camera location for filtering the entities it is interested in.
+        if (interestEnabled_)
+            SendCameraUpdateRequest(user, true);
+    }
 
     for(auto iter = scene->Begin(); iter != scene->End(); ++iter)
     {
@@ -330,8 +682,14 @@ void SyncManager::NewUserConnected(const UserConnectionPtr &user)
     }
 }
 
+void SyncManager::AssertSceneNotSerializing() const
+{
+    assert(!serializingParallel_ && "SyncManager: The scene was modified while the sync states were serialized in parallel");
+}
+
 void SyncManager::OnAttributeChanged(IComponent* comp, IAttribute* attr, AttributeChange::Type change)
 {
+    AssertSceneNotSerializing();
     assert(comp && attr);
     if (!comp || !attr)
         return;
@@ -350,6 +708,14 @@ void SyncManager::OnAttributeChanged(IComponent* comp, IAttribute* attr, Attribu
         }
     }
     
+    // Server: a moved Placeable moves the entity and its children in the interest management's spatial index.
+    if (isServer && interestEnabled_ && comp->TypeId() == Placeable::ComponentTypeId)
+    {
+        Placeable* placeable = static_cast<Placeable*>(comp);
+        if (attr == &placeable->transform || attr == &placeable->parentRef || attr == &placeable->parentBone)
+            MarkSpatialIndexDirty(comp->ParentEntity());
+    }
+
     // Is this change even supposed to go to the network?
     if (change != AttributeChange::Replicate || comp->IsLocal())
         return;
@@ -377,6 +743,7 @@ void SyncManager::OnAttributeChanged(IComponent* comp, IAttribute* attr, Attribu
 
 void SyncManager::OnAttributeAdded(IComponent* comp, IAttribute* attr, AttributeChange::Type /*change*/)
 {
+    AssertSceneNotSerializing();
     assert(comp && attr);
     if (!comp || !attr)
         return;
@@ -406,6 +773,7 @@ void SyncManager::OnAttributeAdded(IComponent* comp, IAttribute* attr, Attribute
 
 void SyncManager::OnAttributeRemoved(IComponent* comp, IAttribute* attr, AttributeChange::Type /*change*/)
 {
+    AssertSceneNotSerializing();
     assert(comp && attr);
     if (!comp || !attr)
         return;
@@ -435,10 +803,14 @@ void SyncManager::OnAttributeRemoved(IComponent* comp, IAttribute* attr, Attribu
 
 void SyncManager::OnComponentAdded(Entity* entity, IComponent* comp, AttributeChange::Type change)
 {
+    AssertSceneNotSerializing();
     assert(entity && comp);
     if (!entity || !comp)
         return;
 
+    if (interestEnabled_ && comp->TypeId() == Placeable::ComponentTypeId && owner_->IsServer())
+        MarkSpatialIndexDirty(entity);
+
     if ((change != AttributeChange::Replicate) || (comp->IsLocal()))
         return;
     if (entity->IsLocal())
@@ -458,9 +830,14 @@ void SyncManager::OnComponentAdded(Entity* entity, IComponent* comp, AttributeCh
 
 void SyncManager::OnComponentRemoved(Entity* entity, IComponent* comp, AttributeChange::Type change)
 {
+    AssertSceneNotSerializing();
     assert(entity && comp);
     if (!entity || !comp)
         return;
+
+    if (interestEnabled_ && comp->TypeId() == Placeable::ComponentTypeId && owner_->IsServer())
+        MarkSpatialIndexDirty(entity);
+
     if ((change != AttributeChange::Replicate) || (comp->IsLocal()))
         return;
     if (entity->IsLocal())
@@ -480,6 +857,7 @@ void SyncManager::OnComponentRemoved(Entity* entity, IComponent* comp, Attribute
 
 void SyncManager::OnEntityCreated(Entity* entity, AttributeChange::Type change)
 {
+    AssertSceneNotSerializing();
     assert(entity);
     if (!entity)
         return;
@@ -510,9 +888,17 @@ void SyncManager::OnEntityCreated(Entity* entity, AttributeChange::Type change)
 
 void SyncManager::OnEntityRemoved(Entity* entity, AttributeChange::Type change)
 {
+    AssertSceneNotSerializing();
     assert(entity);
     if (!entity)
         return;
+
+    if (interestEnabled_)
+    {
+        spatialIndex_.Remove(entity->Id());
+        spatialIndexDirty_.Erase(entity->Id());
+    }
+
     if (change != AttributeChange::Replicate)
         return;
     if (entity->IsLocal())
@@ -532,6 +918,7 @@ void SyncManager::OnEntityRemoved(Entity* entity, AttributeChange::Type change)
 
 void SyncManager::OnActionTriggered(Entity *entity, const String &action, const StringVector &params, EntityAction::ExecTypeField type)
 {
+    AssertSceneNotSerializing();
     // If we are the server and the local script on this machine has requested a script to be executed on the server, it
     // means we just execute the action locally here, without sending to network.
     bool isServer = owner_->IsServer();
@@ -595,6 +982,7 @@ void SyncManager::OnUserActionTriggered(UserConnection* user, Entity *entity, co
 
 void SyncManager::OnEntityPropertiesChanged(Entity* entity, AttributeChange::Type change)
 {
+    AssertSceneNotSerializing();
     assert(entity);
     if (!entity)
         return;
@@ -618,6 +1006,7 @@ void SyncManager::OnEntityPropertiesChanged(Entity* entity, AttributeChange::Typ
 
 void SyncManager::OnEntityParentChanged(Entity* entity, Entity* newParent, AttributeChange::Type change)
 {
+    AssertSceneNotSerializing();
     assert(entity);
     if (!entity)
         return;
@@ -727,117 +1116,55 @@ float3 HermiteDerivative(const float3 &pos0, const float3 &vel0, const float3 &p
     return h1 * pos0 + h2 * pos1 + h3 * vel0 + h4 * vel1;
 }
 
-/// \todo Uncomment and fix once RigidBody component implemented
-void SyncManager::InterpolateRigidBodies(f64 /*frametime*/, SceneSyncState* /*state*/)
+void SyncManager::InterpolateRigidBodies(f64 frametime, SceneSyncState* state)
 {
-//    ScenePtr scene = scene_.Lock();
-//    if (!scene)
-//        return;
-//
-//    for(std::map<entity_id_t, RigidBodyInterpolationState>::iterator iter = state->entityInterpolations.begin(); 
-//        iter != state->entityInterpolations.end();)
-//    {
-//        EntityPtr e = scene->EntityById(iter->first);
-//        shared_ptr<EC_Placeable> placeable = e ? e->GetComponent<EC_Placeable>() : shared_ptr<EC_Placeable>();
-//        if (!placeable.get())
-//        {
-//            std::map<entity_id_t, RigidBodyInterpolationState>::iterator del = iter++;
-//            state->entityInterpolations.erase(del);
-//            continue;
-//        }
-//
-//        shared_ptr<EC_RigidBody> rigidBody = e->GetComponent<EC_RigidBody>();
-//
-//        RigidBodyInterpolationState &r = iter->second;
-//        if (!r.interpolatorActive)
-//        {
-//            ++iter;
-//            continue;
-//        }
-//
-//        const float interpPeriod = updatePeriod_; // Time in seconds how long interpolating the Hermite spline from [0,1] should take.
-//
-//        // Test: Uncomment to only interpolate.
-////        r.interpTime = std::min(1.0f, r.interpTime + (float)frametime / interpPeriod);
-//        r.interpTime += (float)frametime / interpPeriod;
-//
-//        // Objects without a rigidbody, or with mass 0 never extrapolate (objects with mass 0 are stationary for Bullet).
-//        const bool isNewtonian = rigidBody && rigidBody->mass.Get() > 0;
-//
-//        float3 pos;
-//        if (r.interpTime < 1.0f) // Interpolating between two messages from server.
-//        {
-//            if (isNewtonian)
-//                pos = HermiteInterpolate(r.interpStart.pos, r.interpStart.vel * interpPeriod, r.interpEnd.pos, r.interpEnd.vel * interpPeriod, r.interpTime);
-//            else
-//                pos = HermiteInterpolate(r.interpStart.pos, float3::zero, r.interpEnd.pos, float3::zero, r.interpTime);
-//        }
-//        else // Linear extrapolation if server has not sent an update.
-//        {
-//            if (isNewtonian && maxLinExtrapTime_ > 1.0f)
-//                pos = r.interpEnd.pos + r.interpEnd.vel * (r.interpTime-1.f) * interpPeriod;
-//            else
-//                pos = r.interpEnd.pos;
-//        }
-//        ///\todo Orientation is only interpolated, and capped to end result. Also extrapolate orientation.
-//        Quat rot = Quat::Slerp(r.interpStart.rot, r.interpEnd.rot, Clamp01(r.interpTime));
-//        float3 scale = float3::Lerp(r.interpStart.scale, r.interpEnd.scale, Clamp01(r.interpTime));
-//        
-//        Transform t;
-//        t.SetPos(pos);
-//        t.SetOrientation(rot);
-//        t.SetScale(scale);
-//        placeable->transform.Set(t, AttributeChange::LocalOnly);
-//
-//        // Local simulation steps:
-//        // One fixed update interval: interpolate
-//        // Two subsequent update intervals: linear extrapolation
-//        // All subsequente update intervals: local physics extrapolation.
-//        if (r.interpTime >= maxLinExtrapTime_) // Hand-off to client-side physics?
-//        {
-//            if (rigidBody)
-//            {
-//                if (!noClientPhysicsHandoff_)
-//                {
-//                    bool objectIsInRest = (r.interpEnd.vel.LengthSq() < 1e-4f && r.interpEnd.angVel.LengthSq() < 1e-4f);
-//                    // Now the local client-side physics will take over the simulation of this rigid body, but only if the object
-//                    // is moving. This is because the client shouldn't wake up the object (locally) if it's stationary, but wait for the
-//                    // server-side signal for that event.
-//                    rigidBody->SetClientExtrapolating(objectIsInRest == false);
-//                    // Give starting parameters for the simulation.
-//                    rigidBody->linearVelocity.Set(r.interpEnd.vel, AttributeChange::LocalOnly);
-//                    rigidBody->angularVelocity.Set(r.interpEnd.angVel, AttributeChange::LocalOnly);
-//                }
-//            }
-//            r.interpolatorActive = false;
-//            ++iter;
-//            
-//            // Could remove the interpolation structure here, as inter/extrapolation it is no longer active. However, it is currently
-//            // used to store most recently received entity position  & velocity data.
-//            //iter = state->entityInterpolations.erase(iter); // Finished interpolation.
-//        }
-//        else // Interpolation or linear extrapolation.
-//        {
-//            if (rigidBody)
-//            {
-//                // Ensure that the local side physics is not driving the position of this entity.
-//                rigidBody->SetClientExtrapolating(false);
-//
-//                // Setting these is rather redundant, since Bullet doesn't simulate the entity using these variables. However, other
-//                // (locally simulated) objects can collide to this entity, in which case it's good to have the proper velocities for bullet,
-//                // so that the collision response simulates the appropriate forces/velocities in play.
-//                float3 curVel = float3::Lerp(r.interpStart.vel, r.interpEnd.vel, Clamp01(r.interpTime));
-//                // Test: To set continous velocity based on the Hermite curve, use the following:
-// //               float3 curVel = HermiteDerivative(r.interpStart.pos, r.interpStart.vel*interpPeriod, r.interpEnd.pos, r.interpEnd.vel*interpPeriod, r.interpTime);
-//
-//                rigidBody->linearVelocity.Set(curVel, AttributeChange::LocalOnly);
-//
-//                ///\todo Setup angular velocity.
-//                rigidBody->angularVelocity.Set(float3::zero, AttributeChange::LocalOnly);
-//            }
-//            ++iter;
-//        }
-//    }
+    ScenePtr scene = scene_.Lock();
+    if (!scene || !state)
+        return;
+
+    PROFILE(SyncManager_InterpolateRigidBodies);
+
+    for(std::map<entity_id_t, RigidBodyInterpolationState>::iterator iter = state->entityInterpolations.begin(); 
+        iter != state->entityInterpolations.end();)
+    {
+        EntityPtr e = scene->EntityById(iter->first);
+        Placeable* placeable = e ? e->Component<Placeable>().Get() : nullptr;
+        if (!placeable)
+        {
+            state->entityInterpolations.erase(iter++);
+            continue;
+        }
+
+        RigidBodyInterpolationState &r = iter->second;
+        ++iter;
+        if (!r.interpolatorActive)
+            continue;
+
+        r.interpTime += (float)frametime / r.interpPeriod;
+
+        float3 pos;
+        if (r.interpTime < 1.0f) // Interpolating between two messages from server.
+            pos = HermiteInterpolate(r.interpStart.pos, r.interpStart.vel * r.interpPeriod, r.interpEnd.pos, r.interpEnd.vel * r.interpPeriod, r.interpTime);
+        else if (maxLinExtrapTime_ > 1.0f) // Linear extrapolation if server has not sent an update.
+            pos = r.interpEnd.pos + r.interpEnd.vel * (r.interpTime - 1.f) * r.interpPeriod;
+        else
+            pos = r.interpEnd.pos;
+        ///\todo Orientation is only interpolated, and capped to end result. Also extrapolate orientation.
+        Quat rot = Quat::Slerp(r.interpStart.rot, r.interpEnd.rot, Clamp01(r.interpTime));
+        float3 scale = float3::Lerp(r.interpStart.scale, r.interpEnd.scale, Clamp01(r.interpTime));
+
+        Transform t;
+        t.SetPos(pos);
+        t.SetOrientation(rot);
+        t.SetScale(scale);
+        placeable->transform.Set(t, AttributeChange::LocalOnly);
+
+        // One update interval is interpolated, the subsequent ones are linearly extrapolated. There is no client-side
+        // physics to hand the entity off to, so after that the entity stays at the last received transform.
+        // The interpolation state is kept, as it stores the most recently received transform and packet id.
+        if (r.interpTime >= maxLinExtrapTime_)
+            r.interpolatorActive = false;
+    }
 }
 
 void SyncManager::Update(f64 frametime)
@@ -859,27 +1186,48 @@ void SyncManager::Update(f64 frametime)
     ScenePtr scene = scene_.Lock();
     if (!scene)
         return;
+
+    // The attribute data serialized on the previous tick is out of date.
+    encodingCache_.Clear();
     
     if (owner_->IsServer())
     {
         // If we are server, process all authenticated users
-
-        // Then send out changes to other attributes via the generic sync mechanism.
         UserConnectionList& users = owner_->Server()->UserConnections();
+
+        // Re-evaluate the users' interest at the configured intervals.
+        if (interestEnabled_)
+        {
+            PROFILE(SyncManager_UpdateInterest);
+
+            UpdateSpatialIndex();
+            // This is reached once per network update tick, so the intervals advance by the update period.
+            interestRelevanceAcc_ += updatePeriod_;
+            interestVisibilityAcc_ += updatePeriod_;
+            bool updateRelevance = interestRelevance_ && interestRelevanceAcc_ >= interestRelevanceInterval_;
+            bool updateVisibility = interestVisibilityAcc_ >= interestVisibilityInterval_;
+            if (updateRelevance)
+                interestRelevanceAcc_ = 0.0f;
+            if (updateVisibility)
+                interestVisibilityAcc_ = 0.0f;
+            if (updateRelevance || updateVisibility)
+            {
+                for(auto i = users.Begin(); i != users.End(); ++i)
+                    if ((*i)->syncState)
+                        UpdateInterest((*i)->syncState.Get(), updateVisibility, updateRelevance);
+            }
+        }
+
+        if (parallelSync_ && users.Size() > 1)
+        {
+            ProcessSyncStatesParallel(users);
+            return;
+        }
+
+        // Send out the changes via the rigid body and generic sync mechanisms.
         for(auto i = users.Begin(); i != users.End(); ++i)
             if ((*i)->syncState)
-            {
-                // As of now only native clients understand the optimized rigid body sync message.
-                // This may change with future protocol versions
-                if (dynamic_cast<KNetUserConnection*>(i->Get()))
-                { 
-                    // First send out all changes to rigid bodies.
-                    // After processing this function, the bits related to rigid body states have been cleared,
-                    // so the generic sync will not double-replicate the rigid body positions and velocities.
-                    ReplicateRigidBodyChanges((*i).Get());
-                }
                 ProcessSyncState((*i).Get());
-            }
     }
     else
     {
@@ -889,260 +1237,194 @@ void SyncManager::Update(f64 frametime)
     }
 }
 
-/// \todo Uncomment and fix after RigidBody component implemented
-void SyncManager::ReplicateRigidBodyChanges(UserConnection* /*user*/)
+void SyncManager::ReplicateRigidBodyChanges(UserSyncJob& job)
 {
-//    PROFILE(SyncManager_ReplicateRigidBodyChanges);
-//    
-//    ScenePtr scene = scene_.Lock();
-//    if (!scene)
-//        return;
-//
-//    const int maxMessageSizeBytes = 1400;
-//    kNet::DataSerializer ds(maxMessageSizeBytes);
-//    bool msgReliable = false;
-//    SceneSyncState* state = user->syncState.Get();
-//
-//    QHashIterator<entity_id_t, EntitySyncState*> iter(state->dirtyQueue);
-//    while (iter.hasNext())
-//    {
-//        iter.next();
-//
-//        const int maxRigidBodyMessageSizeBits = 350; // An update for a single rigid body can take at most this many bits. (conservative bound)
-//        // If we filled up this message, send it out and start crafting anothero one.
-//        if (maxMessageSizeBytes * 8 - (int)ds.BitsFilled() <= maxRigidBodyMessageSizeBits)
-//        {
-//            user->Send(cRigidBodyUpdateMessage, msgReliable, true, ds);
-//            ds = kNet::DataSerializer(maxMessageSizeBytes);
-//            msgReliable = false;
-//        }
-//
-//        EntitySyncState &ess = *iter.value();
-//
-//        if (ess.isNew || ess.removed)
-//            continue; // Newly created and removed entities are handled through the traditional sync mechanism.
-//
-//        EntityPtr e = ess.weak.lock();
-//        shared_ptr<EC_Placeable> placeable = (e.get() ? e->GetComponent<EC_Placeable>() : shared_ptr<EC_Placeable>());
-//        if (!placeable.get())
-//            continue;
-//
-//        std::map<component_id_t, ComponentSyncState>::iterator placeableComp = ess.components.find(placeable->Id());
-//
-//        bool transformDirty = false;
-//        if (placeableComp != ess.components.end())
-//        {
-//            ComponentSyncState &pss = placeableComp->second;
-//            if (!pss.isNew && !pss.removed) // Newly created and deleted components are handled through the traditional sync mechanism.
-//            {
-//                transformDirty = (pss.dirtyAttributes[0] & 1) != 0; // The Transform of an EC_Placeable is the first attibute in the component.
-//                pss.dirtyAttributes[0] &= ~1;
-//            }
-//        }
-//        bool velocityDirty = false;
-//        bool angularVelocityDirty = false;
-//        
-//        shared_ptr<EC_RigidBody> rigidBody = e->GetComponent<EC_RigidBody>();
-//        if (rigidBody)
-//        {
-//            std::map<component_id_t, ComponentSyncState>::iterator rigidBodyComp = ess.components.find(rigidBody->Id());
-//            if (rigidBodyComp != ess.components.end())
-//            {
-//                ComponentSyncState &rss = rigidBodyComp->second;
-//                if (!rss.isNew && !rss.removed) // Newly created and deleted components are handled through the traditional sync mechanism.
-//                {
-//                    velocityDirty = (rss.dirtyAttributes[1] & (1 << 5)) != 0;
-//                    angularVelocityDirty = (rss.dirtyAttributes[1] & (1 << 6)) != 0;
-//
-//                    rss.dirtyAttributes[1] &= ~(1 << 5);
-//                    rss.dirtyAttributes[1] &= ~(1 << 6);
-//
-//                    velocityDirty = velocityDirty && (rigidBody->linearVelocity.Get().DistanceSq(ess.linearVelocity) >= 1e-2f);
-//                    angularVelocityDirty = angularVelocityDirty && (rigidBody->angularVelocity.Get().DistanceSq(ess.angularVelocity) >= 1e-1f);
-//
-//                    // If the object enters rest, force an update, and force the update to be sent as reliable, so that the client
-//                    // is guaranteed to receive the message, and will put the object to rest, instead of extrapolating it away indefinitely.
-//                    if (rigidBody->linearVelocity.Get().IsZero(1e-4f) && !ess.linearVelocity.IsZero(1e-4f))
-//                    {
-//                        velocityDirty = true;
-//                        msgReliable = true;
-//                    }
-//                    if (rigidBody->angularVelocity.Get().IsZero(1e-4f) && !ess.angularVelocity.IsZero(1e-4f))
-//                    {
-//                        angularVelocityDirty = true;
-//                        msgReliable = true;
-//                    }
-//                }
-//            }
-//        }
-//
-//        if (!transformDirty && !velocityDirty && !angularVelocityDirty)
-//            continue;
-//
-//        const Transform &t = placeable->transform.Get();
-//
-//        float timeSinceLastSend = kNet::Clock::SecondsSinceF(ess.lastNetworkSendTime);
-//        const float3 predictedClientSidePosition = ess.transform.pos + timeSinceLastSend * ess.linearVelocity;
-//        float error = t.pos.DistanceSq(predictedClientSidePosition);
-//        UNREFERENCED_PARAM(error)
-//        // TEST: To have the server estimate how far the client has simulated, use this.
-////        bool posChanged = transformDirty && (timeSinceLastSend > 0.2f || t.pos.DistanceSq(/*ess.transform.pos*/ predictedClientSidePosition) > 5e-5f);
-//        bool posChanged = transformDirty && t.pos.DistanceSq(ess.transform.pos) > 1e-3f;
-//        bool rotChanged = transformDirty && (t.rot.DistanceSq(ess.transform.rot) > 1e-1f);
-//        bool scaleChanged = transformDirty && (t.scale.DistanceSq(ess.transform.scale) > 1e-3f);
-//
-//        // Detect whether to send compact or full states for each variable.
-//        // 0 - don't send, 1 - send compact, 2 - send full.
-//        int posSendType = posChanged ? (t.pos.Abs().MaxElement() >= 1023.f ? 2 : 1) : 0;
-//        int rotSendType;
-//        int scaleSendType;
-//        int velSendType;
-//        int angVelSendType;
-//
-//        float3x3 rot;
-//        if (rotChanged)
-//        {
-//            rot = t.Orientation3x3();
-//            float3 fwd = rot.Col(2);
-//            float3 up = rot.Col(1);
-//            float3 planeNormal = float3::unitY.Cross(rot.Col(2));
-//            float d = planeNormal.Dot(rot.Col(1));
-//
-//            if (up.Dot(float3::unitY) >= 0.999f)
-//                rotSendType = 1; // Looking upright, 1 DOF.
-//            else if (Abs(d) <= 0.001f && Abs(fwd.Dot(float3::unitY)) < 0.95f && up.Dot(float3::unitY) > 0.f)
-//                rotSendType = 2; // No roll, i.e. 2 DOF. Use this only if not looking too close towards the +Y axis, due to precision issues, and only when object +Y is towards world up.
-//            else
-//                rotSendType = 3; // Full 3 DOF
-//        }
-//        else
-//            rotSendType = 0;
-//
-//        if (scaleChanged)
-//        {
-//            float3 s = t.scale.Abs();
-//            scaleSendType = (s.MaxElement() - s.MinElement() <= 1e-3f) ? 1 : 2; // Uniform scale only?
-//        }
-//        else
-//            scaleSendType = 0;
-//
-//        const float3 &linearVel = rigidBody ? rigidBody->linearVelocity.Get() : float3::zero;
-//        const float3 angVel = rigidBody ? DegToRad(rigidBody->angularVelocity.Get()) : float3::zero;
-//
-//        velSendType = velocityDirty ? (linearVel.LengthSq() >= 64.f ? 2 : 1) : 0;
-//        angVelSendType = angularVelocityDirty ? 1 : 0;
-//
-//        if (posSendType == 0 && rotSendType == 0 && scaleSendType == 0 && velSendType == 0 && angVelSendType == 0)
-//            continue;
-//
-//        size_t bitIdx = ds.BitsFilled();
-//        UNREFERENCED_PARAM(bitIdx)
-//        ds.AddVLE<kNet::VLE8_16_32>(ess.id); // Sends max. 32 bits.
-//
-//        ds.AddArithmeticEncoded(8, posSendType, 3, rotSendType, 4, scaleSendType, 3, velSendType, 3, angVelSendType, 2); // Sends fixed 8 bits.
-//        if (posSendType == 1) // Sends fixed 57 bits.
-//        {
-//            ds.AddSignedFixedPoint(11, 8, t.pos.x);
-//            ds.AddSignedFixedPoint(11, 8, t.pos.y);
-//            ds.AddSignedFixedPoint(11, 8, t.pos.z);
-//        }
-//        else if (posSendType == 2) // Sends fixed 96 bits.
-//        {
-//            ds.Add<float>(t.pos.x);
-//            ds.Add<float>(t.pos.y);
-//            ds.Add<float>(t.pos.z);
-//        }        
-//
-//        if (rotSendType == 1) // Orientation with 1 DOF, only yaw.
-//        {
-//            // The transform is looking straight forward, i.e. the +y vector of the transform local space points straight towards +y in world space.
-//            // Therefore the forward vector has y == 0, so send (x,z) as a 2D vector.
-//            ds.AddNormalizedVector2D(rot.Col(2).x, rot.Col(2).z, 8);  // Sends fixed 8 bits.
-//        }
-//        else if (rotSendType == 2) // Orientation with 2 DOF, yaw and pitch.
-//        {
-//            float3 forward = rot.Col(2);
-//            forward.Normalize();
-//            ds.AddNormalizedVector3D(forward.x, forward.y, forward.z, 9, 8); // Sends fixed 17 bits.
-//        }
-//        else if (rotSendType == 3) // Orientation with 3 DOF, full yaw, pitch and roll.
-//        {
-//            Quat o = t.Orientation();
-//
-//            float3 axis;
-//            float angle;
-//            o.ToAxisAngle(axis, angle);
-//            if (angle >= 3.141592654f) // Remove the quaternion double cover representation by constraining angle to [0, pi].
-//            {
-//                axis = -axis;
-//                angle = 2.f * 3.141592654f - angle;
-//            }
-//
-//            // Sends 10-31 bits.
-//            u32 quantizedAngle = ds.AddQuantizedFloat(0, 3.141592654f, 10, angle);
-//            if (quantizedAngle != 0)
-//                ds.AddNormalizedVector3D(axis.x, axis.y, axis.z, 11, 10);
-//        }
-//
-//        if (scaleSendType == 1) // Sends fixed 32 bytes.
-//        {
-//            ds.Add<float>(t.scale.x);
-//        }
-//        else if (scaleSendType == 2) // Sends fixed 96 bits.
-//        {
-//            ds.Add<float>(t.scale.x);
-//            ds.Add<float>(t.scale.y);
-//            ds.Add<float>(t.scale.z);
-//        }
-//
-//        if (velSendType == 1) // Sends fixed 32 bits.
-//        {
-//            ds.AddVector3D(linearVel.x, linearVel.y, linearVel.z, 11, 10, 3, 8);
-//            ess.linearVelocity = linearVel;
-//        }
-//        else if (velSendType == 2) // Sends fixed 39 bits.
-//        {
-//            ds.AddVector3D(linearVel.x, linearVel.y, linearVel.z, 11, 10, 10, 8);
-//            ess.linearVelocity = linearVel;
-//        }
-//
-//        if (angVelSendType == 1)
-//        {
-//            Quat o = Quat::FromEulerZYX(angVel.z, angVel.y, angVel.x);
-//
-//            float3 axis;
-//            float angle;
-//            o.ToAxisAngle(axis, angle);
-//            if (angle >= 3.141592654f) // Remove the quaternion double cover representation by constraining angle to [0, pi].
-//            {
-//                axis = -axis;
-//                angle = 2.f * 3.141592654f - angle;
-//            }
-//             // Sends at most 31 bits.
-//            u32 quantizedAngle = ds.AddQuantizedFloat(0, 3.141592654f, 10, angle);
-//            if (quantizedAngle != 0)
-//                ds.AddNormalizedVector3D(axis.x, axis.y, axis.z, 11, 10);
-//
-//            ess.angularVelocity = angVel;
-//        }
-//        if (posSendType != 0)
-//            ess.transform.pos = t.pos;
-//        if (rotSendType != 0)
-//            ess.transform.rot = t.rot;
-//        if (scaleSendType != 0)
-//            ess.transform.scale = t.scale;
-//
-////        std::cout << "pos: " << posSendType << ", rot: " << rotSendType << ", scale: " << scaleSendType << ", vel: " << velSendType << ", angvel: " << angVelSendType << std::endl;
-//
-//        size_t bitsEnd = ds.BitsFilled();
-//        UNREFERENCED_PARAM(bitsEnd)
-//        ess.lastNetworkSendTime = kNet::Clock::Tick();
-//    }
-//    if (ds.BytesFilled() > 0)
-//        user->Send(cRigidBodyUpdateMessage, msgReliable, true, ds);
+    PROFILE(SyncManager_ReplicateRigidBodyChanges);
+
+    UserConnection* user = job.user;
+    SceneSyncState* state = user->syncState.Get();
+    if (!job.scene || !state)
+        return;
+
+    const int maxMessageSizeBytes = 1400;
+    const int maxRigidBodyMessageSizeBits = 350; // An update for a single entity can take at most this many bits. (conservative bound)
+    // There is no velocity to signal that an entity has come to rest, so the messages are sent reliably to guarantee
+    // that the client receives the final transform.
+    const bool msgReliable = true;
+    char buffer[maxMessageSizeBytes];
+    kNet::DataSerializer ds(buffer, maxMessageSizeBytes);
+
+    for (uint q = 0; q < state->dirtyQueue.Size(); ++q)
+    {
+        EntitySyncState* ess = state->DirtyEntity(state->dirtyQueue[q]);
+        if (!ess || ess->isNew || ess->removed)
+            continue; // Newly created and removed entities are handled through the generic sync mechanism.
+        if (IsOutOfInterest(state, ess))
+            continue; // Left dirty until the entity enters the client's interest.
+
+        Entity* e = ess->weak.Get();
+        Placeable* placeable = e ? e->Component<Placeable>().Get() : nullptr;
+        if (!placeable)
+            continue;
+
+        // Newly created and removed components are handled through the generic sync mechanism.
+        // The Transform of a Placeable is the first attribute in the component.
+        ComponentSyncState* pss = ess->FindComponent(placeable->Id());
+        if (!pss || !pss->isInQueue || pss->isNew || pss->removed)
+            continue;
+        if ((pss->dirtyAttributes[0] & 1) == 0)
+            continue;
+
+        // The rigid body updates count against the per-tick byte budget like the rest of the sync. The transforms left over
+        // stay dirty and are sent on the following ticks.
+        if (maxBytesPerTick_ && job.bytesSent + ds.BytesFilled() >= maxBytesPerTick_)
+            break;
+
+        // If we filled up this message, send it out and start crafting another one.
+        if (maxMessageSizeBytes * 8 - (int)ds.BitsFilled() <= maxRigidBodyMessageSizeBits)
+        {
+            job.bytesSent += (uint)ds.BytesFilled();
+            user->Send(cRigidBodyUpdateMessage, msgReliable, true, ds);
+            ds.ResetFill();
+        }
+
+        const Transform &t = placeable->transform.Get();
+
+        // Dead reckoning: compare against the transform the client has extrapolated from the last sent state,
+        // and send only the parts that have drifted past the error threshold.
+        const float timeSinceLastSend = kNet::Clock::SecondsSinceF(ess->lastNetworkSendTime);
+        const float3 predictedClientSidePosition = ess->transform.pos + timeSinceLastSend * ess->linearVelocity;
+        bool posChanged = t.pos.DistanceSq(predictedClientSidePosition) > 1e-3f;
+        bool rotChanged = t.rot.DistanceSq(ess->transform.rot) > 1e-1f;
+        bool scaleChanged = t.scale.DistanceSq(ess->transform.scale) > 1e-3f;
+        // When a message is sent anyway, include the parts with smaller changes too, so that they do not stay off on the client.
+        if (posChanged || rotChanged || scaleChanged)
+        {
+            posChanged = posChanged || !t.pos.Equals(ess->transform.pos);
+            rotChanged = rotChanged || !t.rot.Equals(ess->transform.rot);
+            scaleChanged = scaleChanged || !t.scale.Equals(ess->transform.scale);
+        }
+
+        // Detect whether to send compact or full states for each variable.
+        // 0 - don't send, 1 - send compact, 2 - send full.
+        int posSendType = posChanged ? (t.pos.Abs().MaxElement() >= 1023.f ? 2 : 1) : 0;
+        int rotSendType = 0;
+        int scaleSendType = 0;
+        // Velocities are only sent for entities simulated by a rigid body.
+        const int velSendType = 0;
+        const int angVelSendType = 0;
+
+        float3x3 rot;
+        if (rotChanged)
+        {
+            rot = t.Orientation3x3();
+            float3 fwd = rot.Col(2);
+            float3 up = rot.Col(1);
+            float3 planeNormal = float3::unitY.Cross(rot.Col(2));
+            float d = planeNormal.Dot(rot.Col(1));
+
+            if (up.Dot(float3::unitY) >= 0.999f)
+                rotSendType = 1; // Looking upright, 1 DOF.
+            else if (Abs(d) <= 0.001f && Abs(fwd.Dot(float3::unitY)) < 0.95f && up.Dot(float3::unitY) > 0.f)
+                rotSendType = 2; // No roll, i.e. 2 DOF. Use this only if not looking too close towards the +Y axis, due to precision issues, and only when object +Y is towards world up.
+            else
+                rotSendType = 3; // Full 3 DOF
+        }
+
+        if (scaleChanged)
+        {
+            float3 s = t.scale.Abs();
+            scaleSendType = (s.MaxElement() - s.MinElement() <= 1e-3f) ? 1 : 2; // Uniform scale only?
+        }
+
+        if (posSendType == 0 && rotSendType == 0 && scaleSendType == 0)
+        {
+            // The change is too small for the rigid body message. Unless the client already has the exact transform,
+            // leave the dirty bit set so that the generic sync sends the final exact Transform, which also resets
+            // the state compared against here.
+            if (t == ess->transform)
+                pss->dirtyAttributes[0] &= ~1;
+            continue;
+        }
+
+        // Clear the dirty bit so that the generic sync will not double-replicate the Transform.
+        pss->dirtyAttributes[0] &= ~1;
+
+        ds.AddVLE<kNet::VLE8_16_32>(ess->id); // Sends max. 32 bits.
+
+        ds.AddArithmeticEncoded(8, posSendType, 3, rotSendType, 4, scaleSendType, 3, velSendType, 3, angVelSendType, 2); // Sends fixed 8 bits.
+        if (posSendType == 1) // Sends fixed 57 bits.
+        {
+            ds.AddSignedFixedPoint(11, 8, t.pos.x);
+            ds.AddSignedFixedPoint(11, 8, t.pos.y);
+            ds.AddSignedFixedPoint(11, 8, t.pos.z);
+        }
+        else if (posSendType == 2) // Sends fixed 96 bits.
+        {
+            ds.Add<float>(t.pos.x);
+            ds.Add<float>(t.pos.y);
+            ds.Add<float>(t.pos.z);
+        }
+
+        if (rotSendType == 1) // Orientation with 1 DOF, only yaw.
+        {
+            // The transform is looking straight forward, i.e. the +y vector of the transform local space points straight towards +y in world space.
+            // Therefore the forward vector has y == 0, so send (x,z) as a 2D vector.
+            ds.AddNormalizedVector2D(rot.Col(2).x, rot.Col(2).z, 8);  // Sends fixed 8 bits.
+        }
+        else if (rotSendType == 2) // Orientation with 2 DOF, yaw and pitch.
+        {
+            float3 forward = rot.Col(2);
+            forward.Normalize();
+            ds.AddNormalizedVector3D(forward.x, forward.y, forward.z, 9, 8); // Sends fixed 17 bits.
+        }
+        else if (rotSendType == 3) // Orientation with 3 DOF, full yaw, pitch and roll.
+        {
+            Quat o = t.Orientation();
+
+            float3 axis;
+            float angle;
+            o.ToAxisAngle(axis, angle);
+            if (angle >= 3.141592654f) // Remove the quaternion double cover representation by constraining angle to [0, pi].
+            {
+                axis = -axis;
+                angle = 2.f * 3.141592654f - angle;
+            }
+
+            // Sends 10-31 bits.
+            u32 quantizedAngle = ds.AddQuantizedFloat(0, 3.141592654f, 10, angle);
+            if (quantizedAngle != 0)
+                ds.AddNormalizedVector3D(axis.x, axis.y, axis.z, 11, 10);
+        }
+
+        if (scaleSendType == 1) // Sends fixed 32 bits.
+        {
+            ds.Add<float>(t.scale.x);
+        }
+        else if (scaleSendType == 2) // Sends fixed 96 bits.
+        {
+            ds.Add<float>(t.scale.x);
+            ds.Add<float>(t.scale.y);
+            ds.Add<float>(t.scale.z);
+        }
+
+        if (posSendType != 0)
+            ess->transform.pos = t.pos;
+        if (rotSendType != 0)
+            ess->transform.rot = t.rot;
+        if (scaleSendType != 0)
+            ess->transform.scale = t.scale;
+
+        ess->lastNetworkSendTime = kNet::Clock::Tick();
+    }
+    if (ds.BytesFilled() > 0)
+    {
+        job.bytesSent += (uint)ds.BytesFilled();
+        user->Send(cRigidBodyUpdateMessage, msgReliable, true, ds);
+    }
 }
 
-void SyncManager::HandleRigidBodyChanges(UserConnection* source, kNet::packet_id_t /*packetId*/, const char* data, size_t numBytes)
+void SyncManager::HandleRigidBodyChanges(UserConnection* source, kNet::packet_id_t packetId, const char* data, size_t numBytes)
 {
     ScenePtr scene = scene_.Lock();
     if (!scene)
@@ -1153,6 +1435,11 @@ void SyncManager::HandleRigidBodyChanges(UserConnection* source, kNet::packet_id
     if (!state)
         return;
 
+    // Over UDP the messages may arrive out of order, in which case the older updates are discarded.
+    KNetUserConnection* kNetSource = dynamic_cast<KNetUserConnection*>(source);
+    kNet::MessageConnection* conn = kNetSource ? kNetSource->connection.ptr() : (kNet::MessageConnection*)0;
+    const bool isUdp = conn && conn->GetSocket() && conn->GetSocket()->TransportLayer() == kNet::SocketOverUDP;
+
     kNet::DataDeserializer dd(data, numBytes);
     while(dd.BitsLeft() >= 9)
     {
@@ -1255,104 +1542,80 @@ void SyncManager::HandleRigidBodyChanges(UserConnection* source, kNet::packet_id
             }
         }
 
-        if (!e) // Discard this message - we don't have the entity in our scene to which the message applies to.
+        if (!e || !placeable) // Discard this message - we don't have the entity in our scene to which the message applies to.
             continue;
 
         // Did anything change?
-        if (posSendType != 0 || rotSendType != 0 || scaleSendType != 0 || velSendType != 0 || angVelSendType != 0)
+        if (posSendType == 0 && rotSendType == 0 && scaleSendType == 0 && velSendType == 0 && angVelSendType == 0)
+            continue;
+
+        std::map<entity_id_t, RigidBodyInterpolationState>::iterator iter = state->entityInterpolations.find(entityID);
+        if (iter != state->entityInterpolations.end() && isUdp && kNet::PacketIDIsNewerThan(iter->second.lastReceivedPacketCounter, packetId))
+            continue; // This is an out-of-order received packet. Ignore it. (latest-data-guarantee)
+
+        // Record the update time for calculating the update interval
+        // Default update interval if state not found or interval not measured yet
+        EntitySyncState &entityState = state->entities[e->Id()];
+        float updateInterval = updatePeriod_;
+        entityState.UpdateReceived();
+        if (entityState.avgUpdateInterval > 0.0f)
+            updateInterval = entityState.avgUpdateInterval;
+
+        // Add a fudge factor in case there is jitter in packet receipt or the server is too taxed
+        updateInterval *= 1.25f;
+
+        // Create or update the interpolation state. Start from the currently shown transform so that the movement is continuous.
+        const Transform &orig = placeable->transform.Get();
+        if (iter != state->entityInterpolations.end())
         {
-            if (placeable)
-            {
-                // Record the update time for calculating the update interval
-                // Default update interval if state not found or interval not measured yet
-                EntitySyncState &entityState = state->entities[e->Id()];
-                float updateInterval = updatePeriod_;
-                entityState.UpdateReceived();
-                if (entityState.avgUpdateInterval > 0.0f)
-                    updateInterval = entityState.avgUpdateInterval;
-
-                // Add a fudge factor in case there is jitter in packet receipt or the server is too taxed
-                updateInterval *= 1.25f;
-
-                /// \todo This performs a heap allocation per each transform change received from server, which is not ideal
-                IAttribute* endValue = placeable->transform.Clone();
-                Attribute<Transform>* endValueTransform = static_cast<Attribute<Transform>*>(endValue);
-                endValueTransform->Set(t, AttributeChange::Disconnected);
-
-                scene->StartAttributeInterpolation(&placeable->transform, endValueTransform, updateInterval);
-            }
+            RigidBodyInterpolationState &interp = iter->second;
+            float3 curVel;
+            if (interp.interpolatorActive && interp.interpTime < 1.0f)
+                curVel = HermiteDerivative(interp.interpStart.pos, interp.interpStart.vel * interp.interpPeriod, interp.interpEnd.pos,
+                    interp.interpEnd.vel * interp.interpPeriod, interp.interpTime) / interp.interpPeriod;
+            else
+                curVel = interp.interpEnd.vel;
+
+            interp.interpStart.pos = orig.pos;
+            if (posSendType != 0)
+                interp.interpEnd.pos = t.pos;
+            interp.interpStart.rot = orig.Orientation();
+            if (rotSendType != 0)
+                interp.interpEnd.rot = t.Orientation();
+            interp.interpStart.scale = orig.scale;
+            if (scaleSendType != 0)
+                interp.interpEnd.scale = t.scale;
+            interp.interpStart.vel = curVel;
+            if (velSendType != 0)
+                interp.interpEnd.vel = newLinearVel;
+            interp.interpStart.angVel = float3::zero; ///\todo
+            if (angVelSendType != 0)
+                interp.interpEnd.angVel = newAngVel;
+            interp.interpTime = 0.f;
+            interp.interpPeriod = updateInterval;
+            interp.lastReceivedPacketCounter = packetId;
+            interp.interpolatorActive = true;
+        }
+        else
+        {
+            RigidBodyInterpolationState interp;
+            interp.interpStart.pos = orig.pos;
+            interp.interpEnd.pos = t.pos;
+            interp.interpStart.rot = orig.Orientation();
+            interp.interpEnd.rot = t.Orientation();
+            interp.interpStart.scale = orig.scale;
+            interp.interpEnd.scale = t.scale;
+            interp.interpStart.vel = float3::zero;
+            interp.interpEnd.vel = newLinearVel;
+            interp.interpStart.angVel = float3::zero;
+            interp.interpEnd.angVel = newAngVel;
+            interp.interpTime = 0.f;
+            interp.interpPeriod = updateInterval;
+            interp.lastReceivedPacketCounter = packetId;
+            interp.interpolatorActive = true;
+            state->entityInterpolations[entityID] = interp;
         }
     }
-
-//            // Create or update the interpolation state.
-//            Transform orig = placeable->transform.Get();
-//
-//            std::map<entity_id_t, RigidBodyInterpolationState>::iterator iter = serverConnection_->syncState->entityInterpolations.find(entityID);
-//            if (iter != serverConnection_->syncState->entityInterpolations.end())
-//            {
-//                RigidBodyInterpolationState &interp = iter->second;
-//
-//                KNetUserConnection* kNetSource = dynamic_cast<KNetUserConnection*>(source);
-//                kNet::MessageConnection* conn = kNetSource ? kNetSource->connection.ptr() : (kNet::MessageConnection*)0;
-//                if (conn && conn->GetSocket() && conn->GetSocket()->TransportLayer() == kNet::SocketOverUDP)
-//                {
-//                    if (kNet::PacketIDIsNewerThan(interp.lastReceivedPacketCounter, packetId))
-//                        continue; // This is an out-of-order received packet. Ignore it. (latest-data-guarantee)
-//                }
-//                
-//                interp.lastReceivedPacketCounter = packetId;
-//
-//                const float interpPeriod = updatePeriod_; // Time in seconds how long interpolating the Hermite spline from [0,1] should take.
-//                float3 curVel;
-//
-//                if (interp.interpTime < 1.0f)
-//                    curVel = HermiteDerivative(interp.interpStart.pos, interp.interpStart.vel*interpPeriod, interp.interpEnd.pos, interp.interpEnd.vel*interpPeriod, interp.interpTime);
-//                else
-//                    curVel = interp.interpEnd.vel;
-//                float3 curAngVel = float3::zero; ///\todo
-//                interp.interpStart.pos = orig.pos;
-//                if (posSendType != 0)
-//                    interp.interpEnd.pos = t.pos;
-//                interp.interpStart.rot = orig.Orientation();
-//                if (rotSendType != 0)
-//                    interp.interpEnd.rot = t.Orientation();
-//                interp.interpStart.scale = orig.scale;
-//                if (scaleSendType != 0)
-//                    interp.interpEnd.scale = t.scale;
-//                interp.interpStart.vel = curVel;
-//                if (velSendType != 0)
-//                    interp.interpEnd.vel = newLinearVel;
-//                interp.interpStart.angVel = curAngVel;
-//                if (angVelSendType != 0)
-//                    interp.interpEnd.angVel = newAngVel;
-//                interp.interpTime = 0.f;
-//                interp.interpolatorActive = true;
-//
-//                // Objects without a rigidbody, or with mass 0 never extrapolate (objects with mass 0 are stationary for Bullet).
-//                const bool isNewtonian = rigidBody && rigidBody->mass.Get() > 0;
-//                if (!isNewtonian)
-//                    interp.interpStart.vel = interp.interpEnd.vel = float3::zero;
-//            }
-//            else
-//            {
-//                RigidBodyInterpolationState interp;
-//                interp.interpStart.pos = orig.pos;
-//                interp.interpEnd.pos = t.pos;
-//                interp.interpStart.rot = orig.Orientation();
-//                interp.interpEnd.rot = t.Orientation();
-//                interp.interpStart.scale = orig.scale;
-//                interp.interpEnd.scale = t.scale;
-//                interp.interpStart.vel = rigidBody ? rigidBody->linearVelocity.Get() : float3::zero;
-//                interp.interpEnd.vel = newLinearVel;
-//                interp.interpStart.angVel = rigidBody ? rigidBody->angularVelocity.Get() : float3::zero;
-//                interp.interpEnd.angVel = newAngVel;
-//                interp.interpTime = 0.f;
-//                interp.lastReceivedPacketCounter = packetId;
-//                interp.interpolatorActive = true;
-//                serverConnection_->syncState->entityInterpolations[entityID] = interp;
-//            }
-//        }
-//    }
 }
 
 void SyncManager::HandleEditEntityProperties(UserConnection* source, const char* data, size_t numBytes)
@@ -1518,10 +1781,87 @@ void SyncManager::ProcessSyncState(UserConnection* user)
     PROFILE(SyncManager_ProcessSyncState);
     
     ScenePtr scene = scene_.Lock();
-    bool isServer = owner_->IsServer();
 
+    serialJob_->user = user;
+    serialJob_->scene = scene.Get();
+    serialJob_->deferred = false;
+
+    PrepareSyncState(*serialJob_);
+    SerializeSyncState(*serialJob_);
+    FinishSyncState(*serialJob_);
+}
+
+void SyncManager::ProcessSyncStatesParallel(UserConnectionList& users)
+{
+    PROFILE(SyncManager_ProcessSyncStatesParallel);
+
+    ScenePtr scene = scene_.Lock();
+    Urho3D::WorkQueue* workQueue = GetSubsystem<Urho3D::WorkQueue>();
+
+    // Prepare all the jobs on the main thread before queuing any of them: this sends the placeholder components,
+    // reads the scene for prioritization, which touches reference counts, and serializes the attribute data shared
+    // by the users into the encoding cache. None of this may overlap with the worker threads reading the scene and the cache.
+    uint numJobs = 0;
+    for(auto i = users.Begin(); i != users.End(); ++i)
+    {
+        if (!(*i)->syncState)
+            continue;
+        if (numJobs >= parallelJobs_.Size())
+            parallelJobs_.Push(SharedPtr<UserSyncJob>(new UserSyncJob()));
+        UserSyncJob* job = parallelJobs_[numJobs++];
+        job->user = (*i).Get();
+        job->scene = scene.Get();
+        job->deferred = false;
+        PrepareSyncState(*job);
+        FillAttributeEncodingCache(*job);
+        job->deferred = true;
+    }
+
+    // From here until all the jobs have completed the workers read the live scene, there is no snapshot of it.
+    // Nothing may modify the scene meanwhile: the main thread only runs work items inside Complete, and the
+    // scene change handlers assert this, as they would also modify the sync states that the workers are writing.
+    serializingParallel_ = true;
+    for(uint i = 0; i < numJobs; ++i)
+    {
+        SharedPtr<Urho3D::WorkItem> item(new Urho3D::WorkItem());
+        item->workFunction_ = SerializeSyncStateWork;
+        item->start_ = parallelJobs_[i].Get();
+        item->aux_ = this;
+        item->priority_ = Urho3D::M_MAX_UNSIGNED;
+        workQueue->AddWorkItem(item);
+    }
+
+    // Serialize the users' sync states on the worker threads. The main thread participates and returns once all are done.
+    workQueue->Complete(Urho3D::M_MAX_UNSIGNED);
+    serializingParallel_ = false;
+
+    // Hand the finished messages to the connections.
+    for(uint i = 0; i < numJobs; ++i)
+        FinishSyncState(*parallelJobs_[i]);
+}
+
+void SyncManager::SerializeSyncStateWork(const Urho3D::WorkItem* item, unsigned /*threadIndex*/)
+{
+    SyncManager* syncManager = static_cast<SyncManager*>(item->aux_);
+    UserSyncJob* job = static_cast<UserSyncJob*>(item->start_);
+    try
+    {
+        syncManager->SerializeSyncState(*job);
+    }
+    catch(std::exception& e)
+    {
+        // Do not let the exception escape the worker thread. Disconnect the user on the main thread instead.
+        job->LogError("Exception while serializing scene sync state for user " + String(job->user->ConnectionId()) + ": " + String(e.what()));
+        job->failed = true;
+    }
+}
+
+void SyncManager::PrepareSyncState(UserSyncJob& job)
+{
+    UserConnection* user = job.user;
     SceneSyncState* state = user->syncState.Get();
-    
+    bool isServer = owner_->IsServer();
+
     // Send knowledge of registered placeholder components to the remote peer
     if (user->ProtocolVersion() >= ProtocolCustomComponents && state->NeedSendPlaceholderComponents())
     {
@@ -1535,15 +1875,96 @@ void SyncManager::ProcessSyncState(UserConnection* user)
         state->MarkPlaceholderComponentsSent();
     }
 
+    job.bytesSent = 0;
+    job.failed = false;
+
+    // As of now only native clients understand the optimized rigid body sync message.
+    // This may change with future protocol versions.
+    // After processing this function, the Transform dirty bits of the sent Placeables have been cleared,
+    // so the generic sync will not double-replicate them.
+    if (isServer && dynamic_cast<KNetUserConnection*>(user))
+        ReplicateRigidBodyChanges(job);
+
+    // If a byte budget is in use, order the dirty entities by priority.
+    job.prioritizedQueue.Clear();
+    if (maxBytesPerTick_ && state->dirtyQueue.Size() > 0)
+    {
+        PROFILE(SyncManager_PrioritizeDirtyQueue);
+
+        kNet::tick_t now = kNet::Clock::Tick();
+        for (uint i = 0; i < state->dirtyQueue.Size(); ++i)
+        {
+            EntitySyncState *entityState = state->DirtyEntity(state->dirtyQueue[i]);
+            if (!entityState || IsOutOfInterest(state, entityState))
+                continue;
+            PrioritizedEntitySyncState prioritized;
+            prioritized.id = state->dirtyQueue[i];
+            prioritized.priority = EntitySyncPriority(state, entityState, now);
+            job.prioritizedQueue.Push(prioritized);
+        }
+        Urho3D::Sort(job.prioritizedQueue.Begin(), job.prioritizedQueue.End(), ComparePrioritizedEntitySyncState);
+    }
+}
+
+void SyncManager::SerializeSyncState(UserSyncJob& job)
+{
+    SceneSyncState* state = job.user->syncState.Get();
+    bool isServer = owner_->IsServer();
+
     // Process the state's dirty entity queue.
-    /// \todo Limit and prioritize the data sent. For now the whole queue is processed, regardless of whether the connection is being saturated.
     if (state->dirtyQueue.Size() > 0)
     {
-        for (auto iter = state->dirtyQueue.Begin() ; iter != state->dirtyQueue.End() ; ++iter)
-            ProcessEntitySyncState(isServer, user, scene.Get(), state, iter->second_);
+        if (!maxBytesPerTick_)
+        {
+            // No budget, process the whole queue. The entities outside the client's interest stay in the queue.
+            bool filtered = false;
+            for (uint i = 0; i < state->dirtyQueue.Size(); ++i)
+            {
+                // May have been processed already as the parent of a new entity
+                EntitySyncState *entityState = state->DirtyEntity(state->dirtyQueue[i]);
+                if (!entityState)
+                    continue;
+                if (IsOutOfInterest(state, entityState))
+                    filtered = true;
+                else
+                    ProcessEntitySyncState(job, isServer, state, entityState);
+            }
 
-        
-        state->dirtyQueue.Clear();
+            if (filtered)
+                state->CompactDirtyQueue();
+            else
+                state->dirtyQueue.Clear();
+        }
+        else
+        {
+            // Process in priority order until the budget is spent.
+            // The entities left over stay in the dirty queue and get sent on the following ticks.
+            for (uint i = 0; i < job.prioritizedQueue.Size(); ++i)
+            {
+                if (i > 0 && job.bytesSent >= maxBytesPerTick_)
+                    break;
+
+                // May have been processed already as the parent of a new entity
+                EntitySyncState *entityState = state->DirtyEntity(job.prioritizedQueue[i].id);
+                if (entityState)
+                    ProcessEntitySyncState(job, isServer, state, entityState);
+            }
+            state->CompactDirtyQueue();
+        }
+    }
+}
+
+void SyncManager::FinishSyncState(UserSyncJob& job)
+{
+    UserConnection* user = job.user;
+    SceneSyncState* state = user->syncState.Get();
+
+    // Queue the messages of a parallel job to the connection
+    job.Flush();
+    if (job.failed)
+    {
+        user->Disconnect();
+        return;
     }
 
     // Send queued entity actions after scene sync
@@ -1556,18 +1977,20 @@ void SyncManager::ProcessSyncState(UserConnection* user)
     }
 }
 
-void SyncManager::ProcessEntitySyncState(bool isServer, UserConnection* user, Scene *scene, SceneSyncState *sceneState, EntitySyncState *entityState)
+void SyncManager::ProcessEntitySyncState(UserSyncJob &job, bool isServer, SceneSyncState *sceneState, EntitySyncState *entityState)
 {
+    UserConnection *user = job.user;
     entityState->isInQueue = false;
 
     unsigned sceneId = 0;       /// @todo Replace with proper scene ID once multiscene support is in place.
     bool removeState = false;
 
-    EntityPtr entity = entityState->weak.Lock();
+    // Use raw pointers to scene objects: the reference counts must not be touched from the sync worker threads.
+    Entity *entity = entityState->weak.Get();
     if (!entity)
     {
         if (!entityState->removed)
-            LogWarning("Entity " + String(entityState->id) + " has gone missing from the scene without the remove properly signalled. Removing from replication state");
+            job.LogWarning("Entity " + String(entityState->id) + " has gone missing from the scene without the remove properly signalled. Removing from replication state");
         entityState->isNew = false;
         removeState = true;
     }
@@ -1602,22 +2025,23 @@ void SyncManager::ProcessEntitySyncState(bool isServer, UserConnection* user, Sc
 
         removeState = true;
 
-        kNet::DataSerializer ds(removeEntityBuffer_, NUMELEMS(removeEntityBuffer_));
+        kNet::DataSerializer ds(job.removeEntityBuffer, NUMELEMS(job.removeEntityBuffer));
         ds.AddVLE<kNet::VLE8_16_32>(sceneId);
         ds.AddVLE<kNet::VLE8_16_32>(entityState->id & UniqueIdGenerator::LAST_REPLICATED_ID);
-        user->Send(cRemoveEntityMessage, true, true, ds);
+        job.Send(cRemoveEntityMessage, ds);
     }
     // New entity
     else if (entityState->isNew)
     {
         // Check if parent is dirty as a new state and send it first.
-        // Must be done prior to below code using the createEntityBuffer_.
+        // Must be done prior to below code using the createEntityBuffer.
         if (user->ProtocolVersion() >= ProtocolHierarchicScene)
         {
-            entity_id_t parentId = (entity->Parent() ? entity->Parent()->Id() : 0);
+            entity_id_t parentId = (entity->ParentEntity() ? entity->ParentEntity()->Id() : 0);
 
             // Check if parent is dirty as a new state and send it first.
-            if (parentId > 0 && sceneState->dirtyQueue.Contains(parentId))
+            EntitySyncState *parentState = (parentId > 0 ? sceneState->DirtyEntity(parentId) : 0);
+            if (parentState && parentState->isNew)
             {
                 /* This will clear the .isNew etc. booleans in the queue,
                    once the main iteration reaches this parent it will do no
@@ -1625,13 +2049,11 @@ void SyncManager::ProcessEntitySyncState(bool isServer, UserConnection* user, Sc
                    the parent chain is deeper than one level, it will recurse
                    here untill a unparented Entity is found and sent them in the
                    correct order. */
-                EntitySyncState *parentState = sceneState->dirtyQueue[parentId];
-                if (parentState && parentState->isNew)
-                    ProcessEntitySyncState(isServer, user, scene, sceneState, parentState);
+                ProcessEntitySyncState(job, isServer, sceneState, parentState);
             }
         }
         
-        kNet::DataSerializer ds(createEntityBuffer_, NUMELEMS(createEntityBuffer_));
+        kNet::DataSerializer ds(job.createEntityBuffer, NUMELEMS(job.createEntityBuffer));
         
         // Entity identification and temporary flag
         ds.AddVLE<kNet::VLE8_16_32>(sceneId);
@@ -1641,10 +2063,11 @@ void SyncManager::ProcessEntitySyncState(bool isServer, UserConnection* user, Sc
         // If hierarchic scene is supported, send parent entity ID or 0 if unparented. Note that this is a full 32bit ID to handle the unacked range if necessary
         if (user->ProtocolVersion() >= ProtocolHierarchicScene)
         {
-            if (entity->Parent() && entity->Parent()->IsLocal())
-                LogWarning("Replicated entity " + String(entityState->id) + " is parented to a local entity, can not replicate parenting properly over the network");
+            Entity *parent = entity->ParentEntity();
+            if (parent && parent->IsLocal())
+                job.LogWarning("Replicated entity " + String(entityState->id) + " is parented to a local entity, can not replicate parenting properly over the network");
 
-            ds.Add<u32>(entity->Parent() ? entity->Parent()->Id() : 0);
+            ds.Add<u32>(parent ? parent->Id() : 0);
         }
         
         const Entity::ComponentMap& components = entity->Components();
@@ -1661,19 +2084,20 @@ void SyncManager::ProcessEntitySyncState(bool isServer, UserConnection* user, Sc
         bool bufferValid = true;
         for (auto i = components.Begin(); i != components.End(); ++i)
         {
-            ComponentPtr comp = i->second_;
+            IComponent *comp = i->second_.Get();
             if (!comp->IsReplicated())
                 continue;
-            if (bufferValid && !WriteComponentFullUpdate(ds, comp))
+            if (bufferValid && !WriteComponentFullUpdate(job, ds, comp))
             {
                 bufferValid = false;
                 ds.ResetFill();
             }
+            SetSentTransform(entityState, comp);
             // Mark the component undirty in the receiver's syncstate
             sceneState->MarkComponentProcessed(entity->Id(), comp->Id());
         }
         if (bufferValid)
-            user->Send(cCreateEntityMessage, true, true, ds);
+            job.Send(cCreateEntityMessage, ds);
 
         // The create has been processed fully. Clear dirty flags.
         sceneState->MarkEntityProcessed(entity->Id());
@@ -1682,35 +2106,38 @@ void SyncManager::ProcessEntitySyncState(bool isServer, UserConnection* user, Sc
             destroy this entity or it will cause problems later. */
         if (!bufferValid && !isServer)
         {
-            LogError("SyncManager: Failed to send new Entity to the server due to invalid buffer state. " + entity->ToString() + " will be forcefully destroyed from Scene.");
+            job.LogError("SyncManager: Failed to send new Entity to the server due to invalid buffer state. " + entity->ToString() + " will be forcefully destroyed from Scene.");
             sceneState->RemoveFromQueue(entity->Id());
-            sceneState->entities.erase(entity->Id());
-            scene->RemoveEntity(entity->Id(), AttributeChange::LocalOnly);
+            sceneState->entities.Erase(entity->Id());
+            job.scene->RemoveEntity(entity->Id(), AttributeChange::LocalOnly);
         }
     }
     else if (entity)
     {
-        if (!entityState->dirtyQueue.Empty())
+        if (entityState->HasDirtyComponents())
         {
             // Components or attributes have been added, changed, or removed. Prepare the dataserializers
-            kNet::DataSerializer removeCompsDs(removeCompsBuffer_, NUMELEMS(removeCompsBuffer_));
-            kNet::DataSerializer removeAttrsDs(removeAttrsBuffer_, NUMELEMS(removeAttrsBuffer_));
-            kNet::DataSerializer createCompsDs(createCompsBuffer_, NUMELEMS(createCompsBuffer_));
-            kNet::DataSerializer createAttrsDs(createAttrsBuffer_, NUMELEMS(createAttrsBuffer_));
-            kNet::DataSerializer editAttrsDs(editAttrsBuffer_, NUMELEMS(editAttrsBuffer_));
-
-            while (!entityState->dirtyQueue.Empty())
+            kNet::DataSerializer removeCompsDs(job.removeCompsBuffer, NUMELEMS(job.removeCompsBuffer));
+            kNet::DataSerializer removeAttrsDs(job.removeAttrsBuffer, NUMELEMS(job.removeAttrsBuffer));
+            kNet::DataSerializer createCompsDs(job.createCompsBuffer, NUMELEMS(job.createCompsBuffer));
+            kNet::DataSerializer createAttrsDs(job.createAttrsBuffer, NUMELEMS(job.createAttrsBuffer));
+            kNet::DataSerializer editAttrsDs(job.editAttrsBuffer, NUMELEMS(job.editAttrsBuffer));
+
+            // Signed, as a removal at index 0 steps back before the start.
+            for (int ci = 0; ci < (int)entityState->components.Size(); ++ci)
             {
-                ComponentSyncState& compState = *entityState->dirtyQueue.Front();
-                entityState->dirtyQueue.PopFront();
+                ComponentSyncState& compState = entityState->components[ci];
+                if (!compState.isInQueue)
+                    continue;
                 compState.isInQueue = false;
                 
-                ComponentPtr comp = entity->ComponentById(compState.id);
+                auto compIter = entity->Components().Find(compState.id);
+                IComponent *comp = (compIter != entity->Components().End() ? compIter->second_.Get() : nullptr);
                 bool removeCompState = false;
                 if (!comp)
                 {
                     if (!compState.removed)
-                        LogWarning("Component " + String(compState.id) + " of " + entity->ToString() + " has gone missing from the scene without the remove properly signalled. Removing from client replication state->");
+                        job.LogWarning("Component " + String(compState.id) + " of " + entity->ToString() + " has gone missing from the scene without the remove properly signalled. Removing from client replication state->");
                     compState.isNew = false;
                     removeCompState = true;
                 }
@@ -1745,8 +2172,9 @@ void SyncManager::ProcessEntitySyncState(bool isServer, UserConnection* user, Sc
                         createCompsDs.AddVLE<kNet::VLE8_16_32>(entityState->id & UniqueIdGenerator::LAST_REPLICATED_ID);
                     }
                     // Then add the component data
-                    if (!WriteComponentFullUpdate(createCompsDs, comp))
+                    if (!WriteComponentFullUpdate(job, createCompsDs, comp))
                         createCompsDs.ResetFill();
+                    SetSentTransform(entityState, comp);
                     // Mark the component undirty in the receiver's syncstate
                     sceneState->MarkComponentProcessed(entity->Id(), comp->Id());
                 }
@@ -1756,19 +2184,23 @@ void SyncManager::ProcessEntitySyncState(bool isServer, UserConnection* user, Sc
                     const AttributeVector& attrs = comp->Attributes();
 
                     bool attrBufferValid = true;
-                    for (auto i = compState.newAndRemovedAttributes.Begin(); i != compState.newAndRemovedAttributes.End(); ++i)
+                    for (uint i = 0; i < 256; ++i)
                     {
-                        u8 attrIndex = i->first_;
+                        u8 attrIndex = (u8)i;
+                        u8 attrBit = (u8)(1 << (attrIndex & 7));
+                        bool created = (compState.createdAttributes[attrIndex >> 3] & attrBit) != 0;
+                        if (!created && !(compState.removedAttributes[attrIndex >> 3] & attrBit))
+                            continue;
                         // Clear the corresponding dirty flags, so that we don't redundantly send attribute edited data.
-                        compState.dirtyAttributes[attrIndex >> 3] &= ~(1 << (attrIndex & 7));
+                        compState.dirtyAttributes[attrIndex >> 3] &= ~attrBit;
                         
-                        if (i->second_)
+                        if (created)
                         {
                             // Create attribute. Make sure it exists and is dynamic.
                             if (attrIndex >= attrs.Size() || !attrs[attrIndex])
-                                LogError("CreateAttribute for nonexisting attribute index " + String((int)attrIndex) + " was queued for component " + comp->TypeName() + " in " + entity->ToString() + ". Discarding.");
+                                job.LogError("CreateAttribute for nonexisting attribute index " + String((int)attrIndex) + " was queued for component " + comp->TypeName() + " in " + entity->ToString() + ". Discarding.");
                             else if (!attrs[attrIndex]->IsDynamic())
-                                LogError("CreateAttribute for a static attribute index " + String((int)attrIndex) + " was queued for component " + comp->TypeName() + " in " + entity->ToString() + ". Discarding.");
+                                job.LogError("CreateAttribute for a static attribute index " + String((int)attrIndex) + " was queued for component " + comp->TypeName() + " in " + entity->ToString() + ". Discarding.");
                             else
                             {
                                 if (attrBufferValid)
@@ -1787,7 +2219,7 @@ void SyncManager::ProcessEntitySyncState(bool isServer, UserConnection* user, Sc
                                     createAttrsDs.AddString(attr->Name().CString());
                                     attr->ToBinary(createAttrsDs);
 
-                                    attrBufferValid = ValidateAttributeBuffer(false, createAttrsDs, comp);
+                                    attrBufferValid = ValidateAttributeBuffer(false, createAttrsDs, comp, 0, &job);
                                 }
                             }
                         }
@@ -1804,14 +2236,18 @@ void SyncManager::ProcessEntitySyncState(bool isServer, UserConnection* user, Sc
                             removeAttrsDs.Add<u8>(attrIndex);
                         }
                     }
-                    compState.newAndRemovedAttributes.Clear();
+                    for (uint i = 0; i < 32; ++i)
+                    {
+                        compState.createdAttributes[i] = 0;
+                        compState.removedAttributes[i] = 0;
+                    }
 
                     // Buffer in invalid state, reset data so it wont be sent to network.
                     if (!attrBufferValid)
                         createAttrsDs.ResetFill();
 
                     // Now, if remaining dirty bits exist, they must be sent in the edit attributes message. These are the majority of our network data.
-                    changedAttributes_.clear();
+                    job.changedAttributes.clear();
                     unsigned numBytes = ((unsigned)attrs.Size() + 7) >> 3;
                     for (unsigned ib = 0; ib < numBytes; ++ib)
                     {
@@ -1824,24 +2260,24 @@ void SyncManager::ProcessEntitySyncState(bool isServer, UserConnection* user, Sc
                                 {
                                     u8 attrIndex = (u8)((ib * 8) + j);
                                     if (attrIndex < attrs.Size() && attrs[attrIndex])
-                                        changedAttributes_.push_back(attrIndex);
+                                        job.changedAttributes.push_back(attrIndex);
                                     else
-                                        LogError("Attribute change for a nonexisting attribute index " + String((int)attrIndex) + " was queued for component " + comp->TypeName() + " in " + entity->ToString() + ". Discarding.");
+                                        job.LogError("Attribute change for a nonexisting attribute index " + String((int)attrIndex) + " was queued for component " + comp->TypeName() + " in " + entity->ToString() + ". Discarding.");
                                 }
                             }
                         }
                     }
-                    if (changedAttributes_.size())
+                    if (job.changedAttributes.size())
                     {
-                        /// @todo HACK for web clients while ReplicateRigidBodyChanges() is not implemented! 
+                        /// @todo HACK for web clients, which do not understand the rigid body update message sent by ReplicateRigidBodyChanges().
                         /// Don't send out minuscule pos/rot/scale changes as it spams the network.
                         bool sendChanges = true;
                         if (dynamic_cast<KNetUserConnection*>(user) == 0)
                         {
-                            if (comp->TypeId() == Placeable::TypeIdStatic() && changedAttributes_.size() == 1 && changedAttributes_[0] == 0)
+                            if (comp->TypeId() == Placeable::TypeIdStatic() && job.changedAttributes.size() == 1 && job.changedAttributes[0] == 0)
                             {
                                 // Placeable::Transform is the only change!
-                                Placeable *placeable = dynamic_cast<Placeable*>(comp.Get());
+                                Placeable *placeable = dynamic_cast<Placeable*>(comp);
                                 if (placeable)
                                 {
                                     const Transform &t = placeable->transform.Get();
@@ -1870,52 +2306,21 @@ void SyncManager::ProcessEntitySyncState(bool isServer, UserConnection* user, Sc
                             }
                             editAttrsDs.AddVLE<kNet::VLE8_16_32>(compState.id & UniqueIdGenerator::LAST_REPLICATED_ID);
                         
-                            // Create a nested dataserializer for the actual attribute data, so we can skip components
-                            kNet::DataSerializer attrDataDs(attrDataBuffer_, NUMELEMS(attrDataBuffer_));
-                        
-                            // There are changed attributes. Check if it is more optimal to send attribute indices, or the whole bitmask
-                            unsigned bitsMethod1 = (unsigned)changedAttributes_.size() * 8 + 8;
-                            unsigned bitsMethod2 = (unsigned)attrs.Size();
-                            // Method 1: indices
-                            if (bitsMethod1 <= bitsMethod2)
-                            {
-                                attrDataDs.Add<kNet::bit>(0);
-                                attrDataDs.Add<u8>((u8)changedAttributes_.size());
-                                for (unsigned i = 0; i < changedAttributes_.size(); ++i)
-                                {
-                                    attrDataDs.Add<u8>(changedAttributes_[i]);
-                                    attrs[changedAttributes_[i]]->ToBinary(attrDataDs);
-                                }
-                            }
-                            // Method 2: bitmask
-                            else
-                            {
-                                attrDataDs.Add<kNet::bit>(1);
-                                for (unsigned i = 0; i < attrs.Size(); ++i)
-                                {
-                                    if (compState.dirtyAttributes[i >> 3] & (1 << (i & 7)))
-                                    {
-                                        attrDataDs.Add<kNet::bit>(1);
-                                        attrs[i]->ToBinary(attrDataDs);
-                                    }
-                                    else
-                                        attrDataDs.Add<kNet::bit>(0);
-                                }
-                            }
                             // Add the attribute data array to the main serializer
-                            if (ValidateAttributeBuffer(false, attrDataDs, comp))
+                            uint size = 0;
+                            const u8* data = ChangedAttributesData(job, comp, compState.dirtyAttributes, job.changedAttributes, size);
+                            if (data)
                             {
-                                editAttrsDs.AddVLE<kNet::VLE8_16_32>((u32)attrDataDs.BytesFilled());
-                                editAttrsDs.AddArray<u8>((unsigned char*)attrDataBuffer_, (u32)attrDataDs.BytesFilled());
+                                editAttrsDs.AddVLE<kNet::VLE8_16_32>(size);
+                                editAttrsDs.AddArray<u8>(data, size);
 
-                                if (!ValidateAttributeBuffer(false, editAttrsDs, comp, NUMELEMS(editAttrsBuffer_)))
+                                if (!ValidateAttributeBuffer(false, editAttrsDs, comp, NUMELEMS(job.editAttrsBuffer), &job))
                                     editAttrsDs.ResetFill();
+                                else if (compState.dirtyAttributes[0] & 1)
+                                    SetSentTransform(entityState, comp);
                             }
                             else
-                            {
-                                attrDataDs.ResetFill();
                                 editAttrsDs.ResetFill();
-                            }
                         }
 
                         // Now zero out all remaining dirty bits
@@ -1925,43 +2330,47 @@ void SyncManager::ProcessEntitySyncState(bool isServer, UserConnection* user, Sc
                 }
                 
                 if (removeCompState)
-                    entityState->components.erase(compState.id);
+                {
+                    // The last component state is moved in place of the removed one, so visit this index again
+                    entityState->RemoveComponent(compState.id);
+                    --ci;
+                }
             }
             
             // Send the messages which have data
             if (removeCompsDs.BytesFilled())
-                user->Send(cRemoveComponentsMessage, true, true, removeCompsDs);
+                job.Send(cRemoveComponentsMessage, removeCompsDs);
 
             if (removeAttrsDs.BytesFilled())
-                user->Send(cRemoveAttributesMessage, true, true, removeAttrsDs);
+                job.Send(cRemoveAttributesMessage, removeAttrsDs);
 
             if (createCompsDs.BytesFilled())
-                user->Send(cCreateComponentsMessage, true, true, createCompsDs);
+                job.Send(cCreateComponentsMessage, createCompsDs);
 
             if (createAttrsDs.BytesFilled())
-                user->Send(cCreateAttributesMessage, true, true, createAttrsDs);
+                job.Send(cCreateAttributesMessage, createAttrsDs);
 
             if (editAttrsDs.BytesFilled())
-                user->Send(cEditAttributesMessage, true, true, editAttrsDs);
+                job.Send(cEditAttributesMessage, editAttrsDs);
         }
         
         // Check if entity has other property changes (temporary flag)
         if (entityState->hasPropertyChanges)
         {
-            kNet::DataSerializer editPropertiesDs(editAttrsBuffer_, NUMELEMS(editAttrsBuffer_));
+            kNet::DataSerializer editPropertiesDs(job.editAttrsBuffer, NUMELEMS(job.editAttrsBuffer));
             editPropertiesDs.AddVLE<kNet::VLE8_16_32>(sceneId);
             editPropertiesDs.AddVLE<kNet::VLE8_16_32>(entityState->id & UniqueIdGenerator::LAST_REPLICATED_ID);
             editPropertiesDs.Add<u8>(entity->IsTemporary() ? 1 : 0);
-            user->Send(cEditEntityPropertiesMessage, true, true, editPropertiesDs);
+            job.Send(cEditEntityPropertiesMessage, editPropertiesDs);
         }
         if (entityState->hasParentChange && user->ProtocolVersion() >= ProtocolHierarchicScene)
         {
-            EntityPtr parent = entity->Parent();
-            kNet::DataSerializer editParentDs(editAttrsBuffer_, 1024);
+            Entity *parent = entity->ParentEntity();
+            kNet::DataSerializer editParentDs(job.editAttrsBuffer, 1024);
             editParentDs.AddVLE<kNet::VLE8_16_32>(sceneId);
             editParentDs.Add<u32>(entityState->id);
             editParentDs.Add<u32>(parent ? parent->Id() : 0);
-            user->Send(cSetEntityParentMessage, true, true, editParentDs);
+            job.Send(cSetEntityParentMessage, editParentDs);
         }
         
         // The entity has been processed fully. Clear dirty flags.
@@ -1970,7 +2379,148 @@ void SyncManager::ProcessEntitySyncState(bool isServer, UserConnection* user, Sc
     
     // Entity removal has been sent to the client, remove it from the SceneState.
     if (removeState)
-        sceneState->entities.erase(entityState->id);
+        sceneState->entities.Erase(entityState->id);
+}
+
+void SyncManager::RebuildSpatialIndex()
+{
+    spatialIndex_.Clear();
+    spatialIndexDirty_.Clear();
+    ScenePtr scene = scene_.Lock();
+    if (!scene)
+        return;
+
+    const Scene::ComponentIndex &placeables = scene->ComponentsOfType(Placeable::ComponentTypeId);
+    for (uint i = 0; i < placeables.Size(); ++i)
+    {
+        Placeable* placeable = static_cast<Placeable*>(placeables[i]);
+        spatialIndex_.Update(placeable->ParentEntity()->Id(), placeable->WorldPosition());
+    }
+}
+
+void SyncManager::UpdateSpatialIndex()
+{
+    if (spatialIndexDirty_.Empty())
+        return;
+    ScenePtr scene = scene_.Lock();
+    if (!scene)
+        return;
+
+    for (HashSet<entity_id_t>::ConstIterator i = spatialIndexDirty_.Begin(); i != spatialIndexDirty_.End(); ++i)
+    {
+        Entity* entity = scene->EntityById(*i).Get();
+        Placeable* placeable = entity ? entity->Component<Placeable>().Get() : nullptr;
+        if (placeable)
+            spatialIndex_.Update(*i, placeable->WorldPosition());
+        else
+            spatialIndex_.Remove(*i);
+    }
+    spatialIndexDirty_.Clear();
+}
+
+void SyncManager::MarkSpatialIndexDirty(Entity* entity)
+{
+    // The children have been marked already if the entity is dirty.
+    if (!entity || !spatialIndexDirty_.Insert(entity->Id()).second_)
+        return;
+
+    // The world positions of the children follow the parent.
+    Placeable* placeable = entity->Component<Placeable>().Get();
+    if (placeable)
+    {
+        EntityVector children = placeable->Children();
+        for (uint i = 0; i < children.Size(); ++i)
+            MarkSpatialIndexDirty(children[i].Get());
+    }
+    for (uint i = 0; i < entity->NumChildren(); ++i)
+        MarkSpatialIndexDirty(entity->Child(i).Get());
+}
+
+void SyncManager::UpdateInterest(SceneSyncState* state, bool updateVisibility, bool updateRelevance)
+{
+    if (!state->locationInitialized || !state->clientLocation.IsFinite())
+        return;
+
+    const float3 &location = state->clientLocation;
+    interestQuery_.Clear();
+    spatialIndex_.QuerySphere(location, interestDistanceFilter_ ? interestRange_ : FLOAT_INF, interestQuery_);
+
+    float3 forward = float3::zero;
+    if (interestViewFilter_)
+    {
+        ScenePtr scene = scene_.Lock();
+        if (scene)
+            forward = (state->clientOrientation * scene->ForwardVector()).Normalized();
+    }
+
+    // Entities in the spatial index that are not in the visibility map are outside the client's interest.
+    // The relevance of the entities that have left the area of interest is reset likewise.
+    if (updateVisibility)
+        state->visibleEntities.clear();
+    if (updateRelevance)
+        state->relevanceFactors.clear();
+    for (uint i = 0; i < interestQuery_.Size(); ++i)
+    {
+        entity_id_t id = interestQuery_[i];
+        float3 offset = spatialIndex_.Position(id) - location;
+        float distance = offset.Length();
+
+        if (updateVisibility)
+        {
+            bool visible = true;
+            if (interestViewFilter_ && distance > interestCriticalRange_ && forward.IsFinite())
+                visible = forward.Dot(offset) >= cInterestViewConeCos * distance;
+            state->visibleEntities[id] = visible;
+        }
+        // Full relevance in the critical area, falling linearly to zero at the edge of the area of interest.
+        if (updateRelevance)
+        {
+            float range = interestRange_ - interestCriticalRange_;
+            state->relevanceFactors[id] = (distance <= interestCriticalRange_ || range <= 0.0f) ? 1.0f :
+                Clamp(1.0f - (distance - interestCriticalRange_) / range, 0.0f, 1.0f);
+        }
+    }
+}
+
+bool SyncManager::IsOutOfInterest(SceneSyncState* sceneState, EntitySyncState* entityState) const
+{
+    // Removals are always sent. Before the client has reported its location, everything is of interest.
+    // Only the server receives the camera location, so the server connection's state of a client is never filtered.
+    if (!interestEnabled_ || entityState->removed || !sceneState->locationInitialized)
+        return false;
+    // Entities without a position in the world are not filtered.
+    if (!spatialIndex_.Contains(entityState->id))
+        return false;
+    // Not evaluated yet, or outside the area of interest.
+    auto visible = sceneState->visibleEntities.find(entityState->id);
+    return visible == sceneState->visibleEntities.end() || !visible->second;
+}
+
+float SyncManager::EntitySyncPriority(SceneSyncState *sceneState, EntitySyncState *entityState, kNet::tick_t now) const
+{
+    // Removals are cheap and free the client from simulating stale entities, send them first.
+    if (entityState->removed)
+        return FLOAT_INF;
+
+    // Starvation: grows with the amount of update ticks the entity has waited since last being sent.
+    float priority = 1.0f + kNet::Clock::TimespanToSecondsF(entityState->lastSyncTime, now) / updatePeriod_;
+
+    // Relevance set by the interest management or application logic.
+    auto relevance = sceneState->relevanceFactors.find(entityState->id);
+    if (relevance != sceneState->relevanceFactors.end())
+        priority *= Max(relevance->second, cSyncPriorityMinRelevance);
+
+    // Distance to the client. Entities without a Placeable are treated as being at the client location.
+    if (sceneState->locationInitialized && sceneState->clientLocation.IsFinite())
+    {
+        // Raw pointers, the prioritization must not touch reference counts either, see PrepareSyncState.
+        Entity *entity = entityState->weak.Get();
+        Placeable *placeable = entity ? PlaceableOf(entity) : nullptr;
+        if (placeable)
+            priority /= 1.0f + placeable->WorldPosition().Distance(sceneState->clientLocation) / cSyncPriorityHalfDistance;
+    }
+
+    return priority;
 }
 
 bool SyncManager::ValidateAction(UserConnection* source, unsigned /*messageID*/, entity_id_t /*entityID*/)
@@ -2137,7 +2687,7 @@ void SyncManager::HandleCreateEntity(UserConnection* source, const char* data, s
                     " in Entity " + String(entity->Id()) + ". Entity will be ignored!"));
 
                 state->RemoveFromQueue(entity->Id());
-                state->entities.erase(entity->Id());
+                state->entities.Erase(entity->Id());
                 scene->RemoveEntity(entity->Id(), AttributeChange::LocalOnly);
                 return;
             }
@@ -2451,7 +3001,7 @@ void SyncManager::HandleRemoveEntity(UserConnection* source, const char* data, s
 
     // Delete from the sender's syncstate so that we don't echo the delete back needlessly
     state->RemoveFromQueue(entityID); // Be sure to erase from dirty queue so that we don't invoke UDB
-    state->entities.erase(entityID);
+    state->entities.Erase(entityID);
 }
 
 void SyncManager::HandleRemoveComponents(UserConnection* source, const char* data, size_t numBytes)
@@ -2500,7 +3050,7 @@ void SyncManager::HandleRemoveComponents(UserConnection* source, const char* dat
         entity->RemoveComponent(comp, change);
 
         entityState.RemoveFromQueue(compID); // Be sure to erase from dirty queue so that we don't invoke UDB
-        entityState.components.erase(compID);
+        entityState.RemoveComponent(compID);
     }
 }
 
@@ -2584,7 +3134,7 @@ void SyncManager::HandleCreateAttributes(UserConnection* source, const char* dat
         }
         
         // Remove the corresponding add command from the sender's syncstate, so that the attribute add is not echoed back
-        entityState.components[compID].newAndRemovedAttributes.Erase(attrIndex);
+        entityState.GetOrCreateComponent(compID).ClearAttributeCreatedOrRemoved(attrIndex);
     }
     
     // Signal attribute changes after creating and reading all
@@ -2595,7 +3145,7 @@ void SyncManager::HandleCreateAttributes(UserConnection* source, const char* dat
         owner->EmitAttributeChanged(addedAttrs[i], change);
 
         // Remove the dirty bit from sender's syncstate so that we do not echo the change back
-        entityState.components[owner->Id()].dirtyAttributes[attrIndex >> 3] &= ~(1 << (attrIndex & 7));
+        entityState.GetOrCreateComponent(owner->Id()).dirtyAttributes[attrIndex >> 3] &= ~(1 << (attrIndex & 7));
     }
 }
 
@@ -2648,7 +3198,7 @@ void SyncManager::HandleRemoveAttributes(UserConnection* source, const char* dat
         comp->RemoveAttribute(attrIndex, change);
 
         // Remove the corresponding remove command from the sender's syncstate, so that the attribute remove is not echoed back
-        entityState.components[compID].newAndRemovedAttributes.Erase(attrIndex);
+        entityState.GetOrCreateComponent(compID).ClearAttributeCreatedOrRemoved(attrIndex);
     }
 }
 
@@ -2750,9 +3300,9 @@ void SyncManager::HandleEditAttributes(UserConnection* source, const char* data,
                 }
                 else
                 {
-                    IAttribute* endValue = attr->Clone();
+                    IAttribute* endValue = InterpolationEndValue(attr);
                     endValue->FromBinary(attrDs, AttributeChange::Disconnected);
-                    scene->StartAttributeInterpolation(attr, endValue, updateInterval);
+                    scene->StartAttributeInterpolation(attr, *endValue, updateInterval);
                 }
             }
         }
@@ -2782,9 +3332,9 @@ void SyncManager::HandleEditAttributes(UserConnection* source, const char* data,
                     }
                     else
                     {
-                        IAttribute* endValue = attr->Clone();
+                        IAttribute* endValue = InterpolationEndValue(attr);
                         endValue->FromBinary(attrDs, AttributeChange::Disconnected);
-                        scene->StartAttributeInterpolation(attr, endValue, updateInterval);
+                        scene->StartAttributeInterpolation(attr, *endValue, updateInterval);
                     }
                 }
             }
@@ -2799,7 +3349,7 @@ void SyncManager::HandleEditAttributes(UserConnection* source, const char* data,
         owner->EmitAttributeChanged(changedAttrs[i], change);
 
         // Remove the dirty bit from sender's syncstate so that we do not echo the change back
-        entityState.components[owner->Id()].dirtyAttributes[attrIndex >> 3] &= ~(1 << (attrIndex & 7));
+        entityState.GetOrCreateComponent(owner->Id()).dirtyAttributes[attrIndex >> 3] &= ~(1 << (attrIndex & 7));
     }
 }
 
@@ -2829,11 +3379,11 @@ void SyncManager::HandleCreateEntityReply(UserConnection* source, const char* da
     entity_id_t entityID = ds.ReadVLE<kNet::VLE8_16_32>();
     scene->ChangeEntityId(senderEntityID, entityID);
 
-    state->RemoveFromQueue(senderEntityID);                         // Make sure we don't have stale pointers in the dirty queue
+    state->RemoveFromQueue(senderEntityID);                         // Make sure we don't have stale IDs in the dirty queue
     state->entities[entityID] = state->entities[senderEntityID];    // Copy the sync state to the new ID
     state->entities[entityID].id = entityID;                        // Must remember to change ID manually
     state->entities[entityID].weak = scene->EntityById(entityID);   // Refresh the weak ptr
-    state->entities.erase(senderEntityID);                          // Remove old id from the state
+    state->entities.Erase(senderEntityID);                          // Remove old id from the state
     
     //std::cout << "CreateEntityReply, entity " << senderEntityID << " -> " << entityID << std::endl;
 
@@ -2854,9 +3404,11 @@ void SyncManager::HandleCreateEntityReply(UserConnection* source, const char* da
         //std::cout << "CreateEntityReply, component " << senderCompID << " -> " << compID << std::endl;
         
         entity->ChangeComponentId(senderCompID, compID);
-        entityState.components[compID] = entityState.components[senderCompID]; // Copy the sync state to the new ID
-        entityState.components[compID].id = compID; // Must remember to change ID manually
-        entityState.components.erase(senderCompID);
+        ComponentSyncState* compState = entityState.FindComponent(senderCompID);
+        if (compState)
+            compState->id = compID; // Move the sync state to the new ID
+        else
+            entityState.GetOrCreateComponent(compID);
         
         // Send notification
         IComponent* comp = entity->ComponentById(compID).Get();
@@ -2867,8 +3419,8 @@ void SyncManager::HandleCreateEntityReply(UserConnection* source, const char* da
     scene->EmitEntityAcked(entity.Get(), senderEntityID);
 
     // Now mark every component dirty so they will be inspected for changes on the next update
-    for (std::map<component_id_t, ComponentSyncState>::iterator i = entityState.components.begin(); i != entityState.components.end(); ++i)
-        state->MarkComponentDirty(entityID, i->first);
+    for (uint i = 0; i < entityState.components.Size(); ++i)
+        state->MarkComponentDirty(entityID, entityState.components[i].id);
 }
 
 void SyncManager::HandleCreateComponentsReply(UserConnection* source, const char* data, size_t numBytes)
@@ -2893,7 +3445,7 @@ void SyncManager::HandleCreateComponentsReply(UserConnection* source, const char
     unsigned sceneID = ds.ReadVLE<kNet::VLE8_16_32>(); ///\todo Dummy ID. Lookup scene once multiscene is properly supported
     UNREFERENCED_PARAM(sceneID)
     entity_id_t entityID = ds.ReadVLE<kNet::VLE8_16_32>();
-    state->RemoveFromQueue(entityID); // Make sure we don't have stale pointers in the dirty queue
+    state->RemoveFromQueue(entityID); // Make sure we don't have stale IDs in the dirty queue
     
     EntitySyncState& entityState = state->entities[entityID];
     EntityPtr entity = entityState.weak.Lock();
@@ -2912,19 +3464,21 @@ void SyncManager::HandleCreateComponentsReply(UserConnection* source, const char
         //std::cout << "CreateComponentReply, component " << senderCompID << " -> " << compID << std::endl;
         
         entity->ChangeComponentId(senderCompID, compID);
-        entityState.components[compID] = entityState.components[senderCompID]; // Copy the sync state to the new ID
-        entityState.components[compID].id = compID; // Must remember to change ID manually
-        entityState.components.erase(senderCompID);
+        ComponentSyncState* compState = entityState.FindComponent(senderCompID);
+        if (compState)
+            compState->id = compID; // Move the sync state to the new ID
+        else
+            entityState.GetOrCreateComponent(compID);
         
         // Send notification
         IComponent* comp = entity->ComponentById(compID).Get();
         scene->EmitComponentAcked(comp, senderCompID);
     }
     
-    for (auto i = entityState.components.begin(); i != entityState.components.end(); ++i)
+    for (uint i = 0; i < entityState.components.Size(); ++i)
     {
         // Now mark every component dirty so they will be inspected for changes on the next update
-        state->MarkComponentDirty(entityID, i->first);
+        state->MarkComponentDirty(entityID, entityState.components[i].id);
     }
 }
 
@@ -11,15 +11,72 @@
 #include "Signals.h"
 
 #include "SyncState.h"
+#include "AttributeEncodingCache.h"
+#include "EntitySpatialIndex.h"
 #include "SceneFwd.h"
 #include "AttributeChangeType.h"
 #include "EntityAction.h"
 
 #include <Urho3D/Core/Object.h>
+#include <Urho3D/Container/HashSet.h>
+
+namespace Urho3D
+{
+    struct WorkItem;
+}
 
 namespace Tundra
 {
 
+/// Scratch buffers and output of serializing one user connection's scene sync state on a network update tick.
+/** SyncManager uses one job for serial processing, and one job per user connection when the users are serialized
+    in parallel on worker threads. A deferred job stores the serialized messages and log output, which are handed
+    to the connection on the main thread with Flush. */
+struct UserSyncJob : public RefCounted
+{
+    UserSyncJob();
+
+    /// Queue a serialized message to the user, and account its size to the tick's byte budget. Sent immediately unless deferred.
+    void Send(kNet::message_id_t id, kNet::DataSerializer& ds);
+    /// Log a warning, or store it for the main thread if deferred.
+    void LogWarning(const String& msg);
+    /// Log an error, or store it for the main thread if deferred.
+    void LogError(const String& msg);
+    /// Send the deferred messages to the user and print the deferred log output. Must be called on the main thread.
+    void Flush();
+
+    /// Serialized message waiting to be queued to the connection.
+    struct QueuedMessage
+    {
+        kNet::message_id_t id;
+        uint offset; ///< Offset of the message data in messageData.
+        uint size;
+    };
+
+    UserConnection* user; ///< User connection being processed.
+    Scene* scene; ///< Scene being synced.
+    bool deferred; ///< The job is run on a worker thread. Messages and log output are stored for the main thread.
+    bool failed; ///< Serialization threw an exception. The messages are discarded and the user is disconnected.
+    uint bytesSent; ///< Bytes of scene sync data serialized for the user during this tick.
+    PODVector<PrioritizedEntitySyncState> prioritizedQueue; ///< Dirty entities in priority order, filled when a byte budget is in use.
+
+    PODVector<QueuedMessage> messages; ///< Deferred messages.
+    PODVector<u8> messageData; ///< Data of the deferred messages.
+    StringVector warnings; ///< Deferred warnings.
+    StringVector errors; ///< Deferred errors.
+
+    /// Fixed buffers for crafting messages
+    char createEntityBuffer[64 * 1024];
+    char createCompsBuffer[64 * 1024];
+    char editAttrsBuffer[64 * 1024];
+    char createAttrsBuffer[64 * 1024];
+    char attrDataBuffer[64 * 1024];
+    char removeCompsBuffer[1024];
+    char removeEntityBuffer[1024];
+    char removeAttrsBuffer[1024];
+    std::vector<u8> changedAttributes;
+};
+
 /// Performs synchronization of the changes in a scene between the server and the client.
 /** SyncManager and SceneSyncState combined can be used to implement prioritization logic on how and when
     a sync state is filled per client connection. SyncManager object is only exposed to scripting on the server. */
@@ -48,6 +105,25 @@ public:
     /// Get update period
     float GetUpdatePeriod() const { return updatePeriod_; }
 
+    /// Set the maximum amount of scene sync data (bytes) queued per user connection on one network update tick.
+    /** Dirty entities are processed in priority order. Entities that do not fit in the budget are left in
+        the dirty queue and sent on the following ticks. At least one entity is always processed per tick.
+        @param bytes Byte budget, 0 means unlimited (the whole dirty queue is processed on each tick). */
+    void SetMaxBytesPerTick(uint bytes);
+
+    /// Get the per user connection scene sync byte budget. 0 means unlimited.
+    uint MaxBytesPerTick() const { return maxBytesPerTick_; }
+
+    /// Set whether the server serializes the user connections' sync states in parallel on the Urho3D WorkQueue threads.
+    /** Each user gets its own serialization buffers. The messages are queued to the connections on the main thread
+        once all users have been processed. Can also be enabled with the --parallelsync command line parameter.
+        The worker threads read the live scene, not a copy of it, so the scene must not be modified while they run.
+        The main thread is blocked until they finish, and the scene change handlers assert that no change arrives meanwhile. */
+    void SetParallelSync(bool enabled);
+
+    /// Returns whether the user connections' sync states are serialized in parallel.
+    bool IsParallelSync() const { return parallelSync_; }
+
     /// Returns SceneSyncState for a client connection.
     /** @note This slot is only exposed on Server, other wise will return null ptr.
         @param u32 connection ID of the client. */
@@ -55,17 +131,28 @@ public:
     SceneSyncState* SceneState(const UserConnectionPtr &connection) const; /**< @overload @param connection Client connection.*/
 
     /// Upates Interest Manager settings.
-    /** @param enabled If true, the IM scheme is allowed to filter traffic.
-        @param bool eucl If true, the euclidean distance filter is active.
-        @param bool ray If true, the ray visibility filter is active.
-        @param bool rel If true, the relevance filter is active.
-        @param int critrange specifies the radius for the critical area.
-        @param int rayrange specifies the radius for the raycasting.
+    /** The interest of each client is evaluated from the camera location and orientation the client reports,
+        using the spatial index of the Placeable world positions. Entities with a Placeable that are outside
+        the client's interest are left dirty in its sync state and sent once they enter it. Entity removals
+        and entities without a Placeable are always sent.
+        @param enabled If true, the IM scheme is allowed to filter traffic.
+        @param bool eucl If true, the euclidean distance filter is active: entities further than @c relrange are filtered.
+        @param bool ray If true, the view cone filter is active: entities outside the client's view cone and the critical area are filtered.
+        @param bool rel If true, the relevance filter is active: SceneSyncState::relevanceFactors is filled from the distance to the client.
+        @param int critrange specifies the radius for the critical area, where entities are always of interest.
         @param int relrange specifies the radius for the relevance filtering.
-        @param int updateint specifies the update interval for the relevance filtering.
-        @param int raycastint specifies the raycasting interval for the ray visibility filter. */
+        @param int updateint specifies the update interval for the relevance filtering in milliseconds.
+        @param int raycastint specifies the update interval for the view cone filter in milliseconds.
+        @note The ray visibility filter of the original interest manager used the renderer's raycasts, which are not
+        available on a headless server. A view cone test is used instead. */
     void UpdateInterestManagerSettings(bool enabled, bool eucl, bool ray, bool rel, int critrange, int relrange, int updateint, int raycastint);
 
+    /// Returns whether the interest management filters the clients' sync sets.
+    bool IsInterestManagementEnabled() const { return interestEnabled_; }
+
+    /// Returns the spatial index of the entity world positions used by the interest management.
+    const EntitySpatialIndex &SpatialIndex() const { return spatialIndex_; }
+
     void SendCameraUpdateRequest(UserConnectionPtr conn, bool enabled);
 
     // signals
@@ -115,7 +202,15 @@ private:
 
 private:
     /// Craft a component full update, with all static and dynamic attributes.
-    bool WriteComponentFullUpdate(kNet::DataSerializer& ds, ComponentPtr comp);
+    bool WriteComponentFullUpdate(UserSyncJob& job, kNet::DataSerializer& ds, IComponent* comp);
+    /// Returns the attribute data of a component full update. Serialized once per tick and shared by all users.
+    /** Returns null if the data does not fit in the buffer. A deferred job only serializes into its own buffer on a cache miss. */
+    const u8* ComponentFullUpdateData(UserSyncJob& job, IComponent* comp, uint& size);
+    /// Returns the attribute data of an edit attributes message for a component. Serialized once per tick and shared by all users.
+    /** Returns null if the data does not fit in the buffer. A deferred job only serializes into its own buffer on a cache miss. */
+    const u8* ChangedAttributesData(UserSyncJob& job, IComponent* comp, const u8* dirtyAttributes, const std::vector<u8>& changedAttributes, uint& size);
+    /// Serialize the attribute data the job's dirty queue will need into the encoding cache. Called on the main thread before a parallel job is run.
+    void FillAttributeEncodingCache(UserSyncJob& job);
     /// Handle entity action message.
     void HandleEntityAction(UserConnection* source, MsgEntityAction& msg);
     /// Handle create entity message.
@@ -145,14 +240,24 @@ private:
     /// Handle entity parent change message.
     void HandleSetEntityParent(UserConnection* source, const char* data, size_t numBytes);
 
+    /// Handle rigid body update message. Sets up the client-side interpolation of the received transforms.
     void HandleRigidBodyChanges(UserConnection* source, kNet::packet_id_t packetId, const char* data, size_t numBytes);
     
-    void ReplicateRigidBodyChanges(UserConnection* user);
+    /// Sends the dirty Placeable transforms to a native client as quantized rigid body update messages.
+    /** Clears the Transform dirty bit of the sent Placeables, so that the generic sync does not replicate them again.
+        Changes too small for the message are left dirty for the generic sync to send exactly. Called on the main thread
+        from PrepareSyncState; the bytes sent count against the job's budget. */
+    void ReplicateRigidBodyChanges(UserSyncJob& job);
 
+    /// Interpolates the transforms received in rigid body update messages on the client.
     void InterpolateRigidBodies(f64 frametime, SceneSyncState* state);
 
     void ReplicateComponentType(u32 typeId, UserConnection* connection = 0);
 
+    /// Returns an attribute of the same type as @c attr for reading the end value of an interpolation.
+    /** Scene copies the end value, so one attribute per type is reused for all received interpolated attributes. */
+    IAttribute* InterpolationEndValue(IAttribute* attr);
+
     /// Read client extrapolation time parameter from command line and match it to the current sync period.
     void GetClientExtrapolationTime();
 
@@ -160,9 +265,52 @@ private:
     /** @param user User connection to process */
     void ProcessSyncState(UserConnection* user);
 
+    /// Process the sync states of several user connections in parallel on the Urho3D WorkQueue (server only).
+    void ProcessSyncStatesParallel(UserConnectionList& users);
+
+    /// WorkQueue work function for serializing the UserSyncJob in @c item's start_.
+    static void SerializeSyncStateWork(const Urho3D::WorkItem* item, unsigned threadIndex);
+
+    /// Prepare a sync job on the main thread: sends the placeholder component types and prioritizes the dirty queue.
+    /** Must not run while any sync jobs are serialized on the worker threads, so ProcessSyncStatesParallel prepares all
+        the jobs before queuing any of them. */
+    void PrepareSyncState(UserSyncJob& job);
+
+    /// Serialize the dirty entities of the job's user. Touches only the user's sync state and reads the scene,
+    /// so may be run on a worker thread while the main thread is not modifying the scene.
+    void SerializeSyncState(UserSyncJob& job);
+
+    /// Finish a sync job on the main thread: hands over the deferred messages and sends the queued entity actions.
+    void FinishSyncState(UserSyncJob& job);
+
+    /// Asserts that the scene is not being modified while the sync jobs are serialized on the worker threads.
+    void AssertSceneNotSerializing() const;
+
     /// Process @c entityState that belongs to @c sceneState.
     /** This function must only be called if @c entityState is in the @c sceneStates dirtyQueue. */
-    void ProcessEntitySyncState(bool isServer, UserConnection* user, Scene *scene, SceneSyncState *sceneState, EntitySyncState *entityState);
+    void ProcessEntitySyncState(UserSyncJob& job, bool isServer, SceneSyncState *sceneState, EntitySyncState *entityState);
+
+    /// Fills the spatial index from the Placeable world positions of the current scene.
+    void RebuildSpatialIndex();
+
+    /// Updates the spatial index positions of the entities whose Placeable has changed since the last tick.
+    void UpdateSpatialIndex();
+
+    /// Marks @c entity and its children to be updated to the spatial index on the next tick.
+    void MarkSpatialIndexDirty(Entity* entity);
+
+    /// Evaluates the client's interest: fills SceneSyncState::visibleEntities and relevanceFactors.
+    /** @param updateVisibility Re-evaluate the view cone filter.
+        @param updateRelevance Re-evaluate the relevance factors. */
+    void UpdateInterest(SceneSyncState* state, bool updateVisibility, bool updateRelevance);
+
+    /// Returns whether a dirty entity should not be sent to the user owning @c sceneState yet.
+    bool IsOutOfInterest(SceneSyncState* sceneState, EntitySyncState* entityState) const;
+
+    /// Returns the send priority of a dirty entity for the user owning @c sceneState. Higher value is sent first.
+    /** The priority is composed of the entity's distance to SceneSyncState::clientLocation, the time the entity has been
+        waiting since it was last sent and the application supplied SceneSyncState::relevanceFactors. */
+    float EntitySyncPriority(SceneSyncState *sceneState, EntitySyncState *entityState, kNet::tick_t now) const;
     
     /// Validate the scene manipulation action. If returns false, it is ignored
     /** @param source Where the action came from
@@ -170,7 +318,7 @@ private:
         @param entityID What entity it affects */
     bool ValidateAction(UserConnection* source, unsigned messageID, entity_id_t entityID);
     
-    bool ValidateAttributeBuffer(bool fatal, kNet::DataSerializer& ds, ComponentPtr &comp, size_t maxBytes = 0);
+    bool ValidateAttributeBuffer(bool fatal, kNet::DataSerializer& ds, IComponent* comp, size_t maxBytes = 0, UserSyncJob* job = 0);
     
     ScenePtr GetRegisteredScene() const { return scene_.Lock(); }
 
@@ -192,26 +340,55 @@ private:
     float maxLinExtrapTime_;
     /// Disable client physics handoff -flag
     bool noClientPhysicsHandoff_;
+
+    /// Per user connection scene sync byte budget for one update tick, 0 = unlimited
+    uint maxBytesPerTick_;
+    /// Serialize user connections in parallel -flag
+    bool parallelSync_;
+    /// Set while the sync jobs are serialized on the worker threads, during which the scene must not change
+    bool serializingParallel_;
+    /// Job for serial sync state processing
+    SharedPtr<UserSyncJob> serialJob_;
+    /// Jobs for parallel sync state processing, grown to the number of user connections
+    Vector<SharedPtr<UserSyncJob> > parallelJobs_;
+    /// Attribute data serialized on the current update tick, shared by all user connections
+    AttributeEncodingCache encodingCache_;
+
+    /// Interest management -flags
+    bool interestEnabled_;
+    bool interestDistanceFilter_;
+    bool interestViewFilter_;
+    bool interestRelevance_;
+    /// Radius of the critical area where entities are always of interest
+    float interestCriticalRange_;
+    /// Radius of the area of interest
+    float interestRange_;
+    /// Update intervals and time accumulators for the relevance factors and the view cone filter (seconds)
+    float interestRelevanceInterval_;
+    float interestVisibilityInterval_;
+    float interestRelevanceAcc_;
+    float interestVisibilityAcc_;
+    /// Spatial index of the entity world positions, maintained while the interest management is enabled
+    EntitySpatialIndex spatialIndex_;
+    /// Entities whose spatial index position is updated on the next tick
+    HashSet<entity_id_t> spatialIndexDirty_;
+    /// Scratch buffer for spatial queries
+    PODVector<entity_id_t> interestQuery_;
     
     /// "User" representing the server connection (client only)
     KNetUserConnectionPtr serverConnection_;
     
-    /// Fixed buffers for crafting messages
-    char createEntityBuffer_[64 * 1024];
-    char createCompsBuffer_[64 * 1024];
-    char editAttrsBuffer_[64 * 1024];
-    char createAttrsBuffer_[64 * 1024];
+    /// Fixed buffer for reading received attribute data
     char attrDataBuffer_[64 * 1024];
-    char removeCompsBuffer_[1024];
-    char removeEntityBuffer_[1024];
-    char removeAttrsBuffer_[1024];
-    std::vector<u8> changedAttributes_;
 
     /// The sender of a component type. Used to avoid sending component description back to sender
     UserConnection* componentTypeSender_;
 
     /// Set of custom component type id's that were received from the server, to avoid echoing them back in ProcessSyncState
     std::set<u32> componentTypesFromServer_;
+
+    /// Attributes for reading the interpolation end values, by attribute type ID
+    HashMap<u32, IAttribute*> interpolationEndValues_;
 };
 
 }
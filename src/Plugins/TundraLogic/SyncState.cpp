@@ -95,8 +95,7 @@ void SceneSyncState::MarkEntityPending(entity_id_t id)
 
     // If user does not have the entity in the first place, do nothing.
     // Its going to be asked to be added to the state via the permission signals later.
-    auto i = entities.find(id);
-    if (i == entities.end())
+    if (!entities.Contains(id))
         return;
 
     MarkEntityRemoved(id);  // Remove from current sync state (removes entity from client)
@@ -164,7 +163,7 @@ EntitySyncState &SceneSyncState::GetOrCreateEntitySyncState(entity_id_t id)
 void SceneSyncState::Clear()
 {
     dirtyQueue.Clear();
-    entities.clear();
+    entities.Clear();
     pendingEntities_.clear();
     changeRequest_.Reset();
     scene_.Reset();
@@ -173,19 +172,32 @@ void SceneSyncState::Clear()
 
 void SceneSyncState::RemoveFromQueue(entity_id_t id)
 {
-    auto i = entities.find(id);
-    if (i != entities.end())
+    EntitySyncState* entityState = entities.Find(id);
+    if (entityState && entityState->isInQueue)
     {
-        if (i->second.isInQueue)
-        {
-            dirtyQueue.Erase(id);
+        // The ID is left in dirtyQueue, CompactDirtyQueue drops it later
+        entityState->isInQueue = false;
+        for (unsigned i = 0; i < entityState->components.Size(); ++i)
+            entityState->components[i].isInQueue = false;
+    }
+}
 
-            i->second.isInQueue = false;
-            for (auto j = i->second.components.begin(); j != i->second.components.end(); ++j)
-                j->second.isInQueue = false;
-            i->second.dirtyQueue.Clear();
+void SceneSyncState::CompactDirtyQueue()
+{
+    // Keep the first occurrence of each dirty entity. isInQueue is cleared temporarily to detect duplicates.
+    unsigned numKept = 0;
+    for (unsigned i = 0; i < dirtyQueue.Size(); ++i)
+    {
+        EntitySyncState* entityState = DirtyEntity(dirtyQueue[i]);
+        if (entityState)
+        {
+            entityState->isInQueue = false;
+            dirtyQueue[numKept++] = dirtyQueue[i];
         }
     }
+    dirtyQueue.Resize(numKept);
+    for (unsigned i = 0; i < numKept; ++i)
+        entities.Find(dirtyQueue[i])->isInQueue = true;
 }
 
 void SceneSyncState::MarkEntityProcessed(entity_id_t id)
@@ -197,10 +209,7 @@ void SceneSyncState::MarkEntityProcessed(entity_id_t id)
 void SceneSyncState::MarkComponentProcessed(entity_id_t id, component_id_t compId)
 {
     EntitySyncState& entityState = GetOrCreateEntitySyncState(id);
-    ComponentSyncState& compState = entityState.components[compId];
-    if (!compState.id)
-        compState.id = compId;
-    compState.DirtyProcessed();
+    entityState.GetOrCreateComponent(compId).DirtyProcessed();
 }
 
 bool SceneSyncState::MarkEntityDirty(entity_id_t id, bool hasPropertyChanges, bool hasParentChange)
@@ -214,21 +223,32 @@ bool SceneSyncState::MarkEntityDirty(entity_id_t id, bool hasPropertyChanges, bo
         or by some kind of distance etc. metric mentioned above. Once a pending Entity is released to the state it will be sent fully
         with its current state on the server, no information is lost. The client just sees it as a normal new Entity. */
 
+    return DirtyEntityState(id, hasPropertyChanges, hasParentChange) != 0;
+}
+
+EntitySyncState* SceneSyncState::DirtyEntityState(entity_id_t id, bool hasPropertyChanges, bool hasParentChange)
+{
+    EntitySyncState* entityState = entities.Find(id);
+
     // Return if the whole entity change request was rejected
-    if (isServer_ && !ShouldMarkAsDirty(id))
-        return false;
+    if (isServer_ && !ShouldMarkAsDirty(id, entityState != 0))
+        return 0;
 
-    EntitySyncState& entityState = GetOrCreateEntitySyncState(id);
-    if (!entityState.isInQueue)
-    {
-        dirtyQueue.Insert(Urho3D::MakePair(id, &entityState));
-        entityState.isInQueue = true;
-    }
+    if (!entityState)
+        entityState = &GetOrCreateEntitySyncState(id);
+    if (!entityState->isInQueue)
+        QueueEntity(id, *entityState);
     if (hasPropertyChanges)
-        entityState.hasPropertyChanges = true;
+        entityState->hasPropertyChanges = true;
     if (hasParentChange)
-        entityState.hasParentChange = true;
-    return true;
+        entityState->hasParentChange = true;
+    return entityState;
+}
+
+void SceneSyncState::QueueEntity(entity_id_t id, EntitySyncState& entityState)
+{
+    dirtyQueue.Push(id);
+    entityState.isInQueue = true;
 }
 
 void SceneSyncState::MarkEntityRemoved(entity_id_t id)
@@ -238,81 +258,64 @@ void SceneSyncState::MarkEntityRemoved(entity_id_t id)
         RemovePendingEntity(id);
 
     // If user did not have the entity in the first place, do nothing
-    std::map<entity_id_t, EntitySyncState>::iterator i = entities.find(id);
-    if (i == entities.end())
+    EntitySyncState* entityState = entities.Find(id);
+    if (!entityState)
         return;
     // If entity is marked new, it was not sent yet and can be simply removed from the sync state
-    if (i->second.isNew)
+    if (entityState->isNew)
     {
         RemoveFromQueue(id);
-        entities.erase(id);
+        entities.Erase(id);
         return;
     }
     // Else mark as removed and queue the update
-    i->second.removed = true;
-    if (!i->second.isInQueue)
-    {
-        dirtyQueue.Insert(Urho3D::MakePair(id, &i->second));
-        i->second.isInQueue = true;
-    }
+    entityState->removed = true;
+    if (!entityState->isInQueue)
+        QueueEntity(id, *entityState);
 }
 
 void SceneSyncState::MarkComponentDirty(entity_id_t id, component_id_t compId)
 {
-    if (MarkEntityDirty(id))
-    {
-        EntitySyncState& entityState = GetOrCreateEntitySyncState(id);
-        entityState.MarkComponentDirty(compId);
-    }
+    EntitySyncState* entityState = DirtyEntityState(id);
+    if (entityState)
+        entityState->MarkComponentDirty(compId);
 }
 
 void SceneSyncState::MarkComponentRemoved(entity_id_t id, component_id_t compId)
 {
     // If user did not have the entity or component in the first place, do nothing
-    std::map<entity_id_t, EntitySyncState>::iterator i = entities.find(id);
-    if (i != entities.end())
+    EntitySyncState* entityState = entities.Find(id);
+    if (entityState)
     {
         MarkEntityDirty(id);
-        i->second.MarkComponentRemoved(compId);
+        entityState->MarkComponentRemoved(compId);
     }
 }
 
 void SceneSyncState::MarkAttributeDirty(entity_id_t id, component_id_t compId, u8 attrIndex)
 {
-    if (MarkEntityDirty(id))
-    {
-        EntitySyncState& entityState = GetOrCreateEntitySyncState(id);
-        entityState.MarkComponentDirty(compId);
-        ComponentSyncState& compState = entityState.components[compId];
-        compState.MarkAttributeDirty(attrIndex);
-    }
+    EntitySyncState* entityState = DirtyEntityState(id);
+    if (entityState)
+        entityState->MarkComponentDirty(compId).MarkAttributeDirty(attrIndex);
 }
 
 void SceneSyncState::MarkAttributeCreated(entity_id_t id, component_id_t compId, u8 attrIndex)
 {
-    if (MarkEntityDirty(id))
-    {
-        EntitySyncState& entityState = GetOrCreateEntitySyncState(id);
-        entityState.MarkComponentDirty(compId);
-        ComponentSyncState& compState = entityState.components[compId];
-        compState.MarkAttributeCreated(attrIndex);
-    }
+    EntitySyncState* entityState = DirtyEntityState(id);
+    if (entityState)
+        entityState->MarkComponentDirty(compId).MarkAttributeCreated(attrIndex);
 }
 
 void SceneSyncState::MarkAttributeRemoved(entity_id_t id, component_id_t compId, u8 attrIndex)
 {
-    if (MarkEntityDirty(id))
-    {
-        EntitySyncState& entityState = GetOrCreateEntitySyncState(id);
-        entityState.MarkComponentDirty(compId);
-        ComponentSyncState& compState = entityState.components[compId];
-        compState.MarkAttributeRemoved(attrIndex);
-    }
+    EntitySyncState* entityState = DirtyEntityState(id);
+    if (entityState)
+        entityState->MarkComponentDirty(compId).MarkAttributeRemoved(attrIndex);
 }
 
 // Private
 
-bool SceneSyncState::ShouldMarkAsDirty(entity_id_t id)
+bool SceneSyncState::ShouldMarkAsDirty(entity_id_t id, bool hasState)
 {
     if (!isServer_)
         return true;
@@ -324,8 +327,7 @@ bool SceneSyncState::ShouldMarkAsDirty(entity_id_t id)
     // Only request if this entity does not have a sync state yet.
     // Otherwise this id will spam the signal handler on every change if
     // the addition to sync state was accepted.
-    std::map<entity_id_t, EntitySyncState>::iterator i = entities.find(id);
-    if (i == entities.end())
+    if (!hasState)
     {
         PROFILE(SyncState_Emit_AboutToDirtyEntity);
         
@@ -414,21 +416,146 @@ EntitySyncState& SceneSyncState::MarkEntityDirtySilent(entity_id_t id)
     // Verify that this entity is not known to this client state.
     // If it is we need to remove the ptr from any queues and remove the entity state.
     // This ensures the below creates a new EntitySyncState with isNew == true.
-    std::map<entity_id_t, EntitySyncState>::iterator existingIter = entities.find(id);
-    if (existingIter != entities.end())
+    if (entities.Contains(id))
     {
         LogWarning(String("SceneSyncState::MarkEntityDirtySilent: State for Entity " + String(id) + " already exist, removing for full recreation."));
         RemoveFromQueue(id);
-        entities.erase(existingIter);
+        entities.Erase(id);
     }
 
     EntitySyncState& entityState = GetOrCreateEntitySyncState(id);
     if (!entityState.isInQueue)
+        QueueEntity(id, entityState);
+    return entityState;
+}
+
+
+EntitySyncStateMap::EntitySyncStateMap() :
+    numSlots_(0),
+    indexBits_(0),
+    size_(0)
+{
+}
+
+EntitySyncStateMap::~EntitySyncStateMap()
+{
+    Clear();
+}
+
+EntitySyncState* EntitySyncStateMap::Find(entity_id_t id) const
+{
+    if (!size_ || !id)
+        return 0;
+
+    unsigned mask = index_.Size() - 1;
+    for (unsigned pos = HomePosition(id); ; pos = (pos + 1) & mask)
     {
-        dirtyQueue.Insert(Urho3D::MakePair(id, &entityState));
-        entityState.isInQueue = true;
+        const IndexEntry& entry = index_[pos];
+        if (entry.id == id)
+            return &Slot(entry.slot);
+        if (!entry.id)
+            return 0;
+    }
+}
+
+EntitySyncState& EntitySyncStateMap::operator [](entity_id_t id)
+{
+    EntitySyncState* existing = Find(id);
+    if (existing)
+        return *existing;
+
+    // Keep the load factor at most 1/2
+    if ((size_ + 1) * 2 > index_.Size())
+        Rehash(Max(indexBits_ + 1, 6U));
+
+    unsigned slot;
+    if (!freeSlots_.Empty())
+    {
+        slot = freeSlots_.Back();
+        freeSlots_.Pop();
+    }
+    else
+    {
+        if (numSlots_ == blocks_.Size() * cBlockSize)
+            blocks_.Push(new EntitySyncState[cBlockSize]);
+        slot = numSlots_++;
+    }
+
+    unsigned mask = index_.Size() - 1;
+    unsigned pos = HomePosition(id);
+    while (index_[pos].id)
+        pos = (pos + 1) & mask;
+    index_[pos].id = id;
+    index_[pos].slot = slot;
+    ++size_;
+    return Slot(slot);
+}
+
+void EntitySyncStateMap::Erase(entity_id_t id)
+{
+    if (!size_ || !id)
+        return;
+
+    unsigned mask = index_.Size() - 1;
+    unsigned pos = HomePosition(id);
+    while (index_[pos].id != id)
+    {
+        if (!index_[pos].id)
+            return;
+        pos = (pos + 1) & mask;
+    }
+
+    // Reset the state for reuse. Assignment keeps the capacity of the component array.
+    unsigned slot = index_[pos].slot;
+    Slot(slot) = EntitySyncState();
+    freeSlots_.Push(slot);
+    --size_;
+
+    // Backward shift deletion: move the following entries of the probe sequence to fill the hole, so no tombstones are needed.
+    unsigned hole = pos;
+    for (unsigned next = (pos + 1) & mask; index_[next].id; next = (next + 1) & mask)
+    {
+        unsigned home = HomePosition(index_[next].id);
+        // Move the entry if its home position is not cyclically in (hole, next]
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            index_[hole] = index_[next];
+            hole = next;
+        }
+    }
+    index_[hole].id = 0;
+}
+
+void EntitySyncStateMap::Clear()
+{
+    for (unsigned i = 0; i < blocks_.Size(); ++i)
+        delete[] blocks_[i];
+    blocks_.Clear();
+    freeSlots_.Clear();
+    index_.Clear();
+    numSlots_ = 0;
+    indexBits_ = 0;
+    size_ = 0;
+}
+
+void EntitySyncStateMap::Rehash(unsigned bits)
+{
+    PODVector<IndexEntry> oldIndex = index_;
+    indexBits_ = bits;
+    index_.Resize(1U << bits);
+    for (unsigned i = 0; i < index_.Size(); ++i)
+        index_[i].id = 0;
+
+    unsigned mask = index_.Size() - 1;
+    for (unsigned i = 0; i < oldIndex.Size(); ++i)
+    {
+        if (!oldIndex[i].id)
+            continue;
+        unsigned pos = HomePosition(oldIndex[i].id);
+        while (index_[pos].id)
+            pos = (pos + 1) & mask;
+        index_[pos] = oldIndex[i];
     }
-    return entityState;
 }
 
 }
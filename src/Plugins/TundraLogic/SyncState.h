@@ -29,16 +29,16 @@ namespace Tundra
 class SceneSyncState;
 
 /// Component's per-user network sync state
+/** Plain data without dynamic allocations: the dirty, created and removed attribute bits are stored inline. */
 struct ComponentSyncState
 {
     ComponentSyncState() :
+        id(0),
         removed(false),
         isNew(true),
-        isInQueue(false),
-        id(0)
+        isInQueue(false)
     {
-        for (unsigned i = 0; i < 32; ++i)
-            dirtyAttributes[i] = 0;
+        ClearAttributeBits();
     }
     
     void MarkAttributeDirty(u8 attrIndex)
@@ -48,110 +48,158 @@ struct ComponentSyncState
     
     void MarkAttributeCreated(u8 attrIndex)
     {
-        newAndRemovedAttributes[attrIndex] = true;
+        createdAttributes[attrIndex >> 3] |= (1 << (attrIndex & 7));
+        removedAttributes[attrIndex >> 3] &= ~(1 << (attrIndex & 7));
     }
     
     void MarkAttributeRemoved(u8 attrIndex)
     {
-        newAndRemovedAttributes[attrIndex] = false;
+        removedAttributes[attrIndex >> 3] |= (1 << (attrIndex & 7));
+        createdAttributes[attrIndex >> 3] &= ~(1 << (attrIndex & 7));
+    }
+
+    /// Forgets a pending create or remove of a dynamic attribute.
+    void ClearAttributeCreatedOrRemoved(u8 attrIndex)
+    {
+        createdAttributes[attrIndex >> 3] &= ~(1 << (attrIndex & 7));
+        removedAttributes[attrIndex >> 3] &= ~(1 << (attrIndex & 7));
+    }
+
+    /// Returns whether dynamic attributes have been created or removed since last update.
+    bool HasNewOrRemovedAttributes() const
+    {
+        for (unsigned i = 0; i < 32; ++i)
+            if (createdAttributes[i] | removedAttributes[i])
+                return true;
+        return false;
     }
     
     void DirtyProcessed()
+    {
+        ClearAttributeBits();
+        isNew = false;
+    }
+
+    void ClearAttributeBits()
     {
         for (unsigned i = 0; i < 32; ++i)
+        {
             dirtyAttributes[i] = 0;
-        newAndRemovedAttributes.Clear();
-        isNew = false;
+            createdAttributes[i] = 0;
+            removedAttributes[i] = 0;
+        }
     }
     
     u8 dirtyAttributes[32]; ///< Dirty attributes bitfield. A maximum of 256 attributes are supported.
-    Urho3D::HashMap<u8, bool> newAndRemovedAttributes; ///< Dynamic attributes by index that have been removed or created since last update. True = create, false = delete
+    u8 createdAttributes[32]; ///< Dynamic attributes that have been created since last update.
+    u8 removedAttributes[32]; ///< Dynamic attributes that have been removed since last update.
     component_id_t id; ///< Component ID. Duplicated here intentionally to allow recognizing the component without the parent map.
     bool removed; ///< The component has been removed since last update
     bool isNew; ///< The client does not have the component and it must be serialized in full
-    bool isInQueue; ///< The component is already in the entity's dirty queue
+    bool isInQueue; ///< The component is dirty and waits to be processed
 };
 
 /// Entity's per-user network sync state
 struct EntitySyncState
 {
     EntitySyncState() :
+        id(0),
         removed(false),
         isNew(true),
         isInQueue(false),
         hasPropertyChanges(false),
         hasParentChange(false),
-        id(0),
         avgUpdateInterval(0.0f),
-        lastNetworkSendTime(kNet::Clock::Tick())
+        lastNetworkSendTime(kNet::Clock::Tick()),
+        lastSyncTime(lastNetworkSendTime)
     {
     }
-    
-    void RemoveFromQueue(component_id_t id)
+
+    /// Returns a component's sync state, or null if it does not exist.
+    ComponentSyncState* FindComponent(component_id_t compId)
+    {
+        for (unsigned i = 0; i < components.Size(); ++i)
+            if (components[i].id == compId)
+                return &components[i];
+        return 0;
+    }
+
+    /// Returns a component's sync state, creating it if it does not exist.
+    ComponentSyncState& GetOrCreateComponent(component_id_t compId)
     {
-        auto i = components.find(id);
-        if (i != components.end())
+        ComponentSyncState* compState = FindComponent(compId);
+        if (compState)
+            return *compState;
+        components.Push(ComponentSyncState());
+        components.Back().id = compId;
+        return components.Back();
+    }
+
+    /// Removes a component's sync state. The order of the remaining components may change.
+    void RemoveComponent(component_id_t compId)
+    {
+        for (unsigned i = 0; i < components.Size(); ++i)
         {
-            if (i->second.isInQueue)
+            if (components[i].id == compId)
             {
-                for (auto j = dirtyQueue.Begin(); j != dirtyQueue.End(); ++j)
-                {
-                    if ((*j) == &i->second)
-                    {
-                        dirtyQueue.Erase(j);
-                        break;
-                    }
-                }
-                i->second.isInQueue = false;
+                components[i] = components.Back();
+                components.Pop();
+                return;
             }
         }
     }
+
+    /// Returns whether there are dirty components waiting to be processed.
+    bool HasDirtyComponents() const
+    {
+        for (unsigned i = 0; i < components.Size(); ++i)
+            if (components[i].isInQueue)
+                return true;
+        return false;
+    }
     
-    void MarkComponentDirty(component_id_t id)
+    void RemoveFromQueue(component_id_t compId)
     {
-        ComponentSyncState& compState = components[id]; // Creates new if did not exist
-        if (!compState.id)
-            compState.id = id;
-        if (!compState.isInQueue)
-        {
-            dirtyQueue.Push(&compState);
-            compState.isInQueue = true;
-        }
+        ComponentSyncState* compState = FindComponent(compId);
+        if (compState)
+            compState->isInQueue = false;
     }
     
-    void MarkComponentRemoved(component_id_t id)
+    ComponentSyncState& MarkComponentDirty(component_id_t compId)
+    {
+        ComponentSyncState& compState = GetOrCreateComponent(compId);
+        compState.isInQueue = true;
+        return compState;
+    }
+    
+    void MarkComponentRemoved(component_id_t compId)
     {
         // If user did not have the component in the first place, do nothing
-        auto i = components.find(id);
-        if (i == components.end())
+        ComponentSyncState* compState = FindComponent(compId);
+        if (!compState)
             return;
         // If component is marked new, it was not sent yet and can be simply removed from the sync state
-        if (i->second.isNew)
+        if (compState->isNew)
         {
-            RemoveFromQueue(id);
-            components.erase(id);
+            RemoveComponent(compId);
             return;
         }
         // Else mark as removed and queue the update
-        i->second.removed = true;
-        if (!i->second.isInQueue)
-        {
-            dirtyQueue.Push(&i->second);
-            i->second.isInQueue = true;
-        }
+        compState->removed = true;
+        compState->isInQueue = true;
     }
     
     void DirtyProcessed()
     {
-        for (auto i = components.begin(); i != components.end(); ++i)
+        for (unsigned i = 0; i < components.Size(); ++i)
         {
-            i->second.DirtyProcessed();
-            i->second.isInQueue = false;
+            components[i].DirtyProcessed();
+            components[i].isInQueue = false;
         }
-        dirtyQueue.Clear();
         isNew = false;
         hasPropertyChanges = false;
         hasParentChange = false;
+        lastSyncTime = kNet::Clock::Tick();
     }
     
     void UpdateReceived()
@@ -168,15 +216,16 @@ struct EntitySyncState
             avgUpdateInterval = 0.5f * time + 0.5f * avgUpdateInterval;
     }
     
-    Urho3D::List<ComponentSyncState*> dirtyQueue; ///< Dirty components
-    std::map<component_id_t, ComponentSyncState> components; ///< Component syncstates
+    /// Component syncstates, in no particular order. Entities have only a few components, so they are searched linearly.
+    /** The dirty components are the ones with ComponentSyncState::isInQueue set. */
+    PODVector<ComponentSyncState> components;
 
     entity_id_t id; ///< Entity ID. Duplicated here intentionally to allow recognizing the entity without the parent map.
     EntityWeakPtr weak; ///< Entity weak ptr.
 
     bool removed; ///< The entity has been removed since last update
     bool isNew; ///< The client does not have the entity and it must be serialized in full
-    bool isInQueue; ///< The entity is already in the scene's dirty queue
+    bool isInQueue; ///< The entity is dirty and waits to be processed
     bool hasPropertyChanges; ///< The entity has changes into its other properties, such as temporary flag
     bool hasParentChange; ///> The entity's parent has changed
     
@@ -189,6 +238,67 @@ struct EntitySyncState
     float3 linearVelocity;
     float3 angularVelocity;
     kNet::tick_t lastNetworkSendTime;
+
+    kNet::tick_t lastSyncTime; ///< Time when the entity's changes were last sent to the user. Used for starvation in sync prioritization.
+};
+
+/// Entity sync states of a SceneSyncState, indexed by entity ID.
+/** The states are stored in fixed-size blocks, so that their addresses stay valid as the map grows and no allocation
+    is done per entity. The states are found through an open addressing hash index, and the slots of erased states are reused. */
+class TUNDRALOGIC_API EntitySyncStateMap
+{
+public:
+    EntitySyncStateMap();
+    ~EntitySyncStateMap();
+
+    /// Returns the state of an entity, or null if it does not exist.
+    EntitySyncState* Find(entity_id_t id) const;
+
+    /// Returns whether a state exists for an entity.
+    bool Contains(entity_id_t id) const { return Find(id) != 0; }
+
+    /// Returns the state of an entity, creating a default-constructed one if it does not exist.
+    EntitySyncState& operator [](entity_id_t id);
+
+    /// Removes the state of an entity. Pointers to the other states stay valid.
+    void Erase(entity_id_t id);
+
+    /// Removes all states and frees the memory.
+    void Clear();
+
+    /// Returns number of states.
+    unsigned Size() const { return size_; }
+
+private:
+    static const unsigned cBlockSize = 256;
+
+    /// Entry of the hash index. Entity ID 0 marks an empty entry.
+    struct IndexEntry
+    {
+        entity_id_t id;
+        unsigned slot;
+    };
+
+    /// Returns the hash index position where the search for @c id starts.
+    unsigned HomePosition(entity_id_t id) const { return (id * 2654435769u) >> (32 - indexBits_); }
+    /// Returns the state in a storage slot.
+    EntitySyncState& Slot(unsigned slot) const { return blocks_[slot / cBlockSize][slot % cBlockSize]; }
+    /// Rebuilds the hash index with the given number of bits.
+    void Rehash(unsigned bits);
+
+    PODVector<EntitySyncState*> blocks_; ///< Storage blocks of cBlockSize states.
+    PODVector<unsigned> freeSlots_; ///< Storage slots of erased states.
+    unsigned numSlots_; ///< Number of used storage slots, including the free ones.
+    PODVector<IndexEntry> index_; ///< Hash index with linear probing, size is 2^indexBits_.
+    unsigned indexBits_;
+    unsigned size_;
+};
+
+/// Dirty entity and its send priority. Used by SyncManager to order SceneSyncState's dirty queue.
+struct PrioritizedEntitySyncState
+{
+    entity_id_t id;
+    float priority;
 };
 
 struct RigidBodyInterpolationState
@@ -206,6 +316,8 @@ struct RigidBodyInterpolationState
     RigidBodyState interpStart;
     RigidBodyState interpEnd;
     float interpTime;
+    /// Time in seconds how long interpolating the Hermite spline from [0,1] takes, i.e. the measured update interval.
+    float interpPeriod;
 
     // If true, we are using linear inter/extrapolation to move the entity.
     // If false, we have handed off this entity for physics to extrapolate.
@@ -279,10 +391,12 @@ public:
     virtual ~SceneSyncState();
 
     /// Entity sync states
-    std::map<entity_id_t, EntitySyncState> entities; 
+    EntitySyncStateMap entities;
 
-    /// Dirty entities pending processing
-    Urho3D::HashMap<entity_id_t,EntitySyncState*> dirtyQueue;
+    /// Dirty entities pending processing, in the order they were dirtied.
+    /** An entity removed from the queue is only unflagged, so the IDs whose EntitySyncState does not exist
+        or does not have isInQueue set must be skipped. Stale IDs are dropped by CompactDirtyQueue. */
+    PODVector<entity_id_t> dirtyQueue;
 
     /// Entity interpolations
     std::map<entity_id_t, RigidBodyInterpolationState> entityInterpolations;
@@ -355,6 +469,16 @@ public:
     
     void RemoveFromQueue(entity_id_t id);
 
+    /// Returns the state of a dirty entity, or null if the entity is not waiting to be processed.
+    EntitySyncState* DirtyEntity(entity_id_t id) const
+    {
+        EntitySyncState* entityState = entities.Find(id);
+        return (entityState && entityState->isInQueue) ? entityState : 0;
+    }
+
+    /// Removes the processed and removed entities from the dirty queue.
+    void CompactDirtyQueue();
+
     void MarkEntityProcessed(entity_id_t id);
     void MarkComponentProcessed(entity_id_t id, component_id_t compId);
 
@@ -383,7 +507,13 @@ public:
 
 private:
     // Returns if entity with id should be added to the sync state.
-    bool ShouldMarkAsDirty(entity_id_t id);
+    bool ShouldMarkAsDirty(entity_id_t id, bool hasState);
+
+    // Marks entity dirty and returns its state, or null if the entity was not allowed to be dirtied.
+    EntitySyncState* DirtyEntityState(entity_id_t id, bool hasPropertyChanges = false, bool hasParentChange = false);
+
+    // Adds entity to the dirty queue.
+    void QueueEntity(entity_id_t id, EntitySyncState& entityState);
 
     // Fills changeRequest_ with entity data, returns if request is valid. 
     bool FillRequest(entity_id_t id);
@@ -13,6 +13,10 @@
 #include "IRenderer.h"
 #include "SceneAPI.h"
 #include "Scene/Scene.h"
+#include "SceneLoader.h"
+#include "SceneArchive.h"
+#include "Entity.h"
+#include "Placeable.h"
 #include "UserConnectedResponseData.h"
 #include "LoggingFunctions.h"
 
@@ -29,9 +33,16 @@ namespace Tundra
 {
 
 static const unsigned short cDefaultPort = 2345;
+/// Frame time budget for creating the entities of an incrementally loaded scene archive, like the default of SceneLoader.
+static const float cSceneArchiveTimeBudgetMSecs = 10.0f;
+/// Number of root-level entities created from a scene archive at a time.
+static const uint cSceneArchiveBatchSize = 16;
+/// Radius around the main camera whose entities are created from a scene archive first.
+static const float cSceneArchiveNearRadius = 100.0f;
 
 TundraLogic::TundraLogic(Framework* owner) :
-    IModule("TundraLogic", owner)
+    IModule("TundraLogic", owner),
+    sceneArchiveEntities_(0)
 {
 }
 
@@ -56,6 +67,9 @@ void TundraLogic::Initialize()
 
     framework->Console()->RegisterCommand("disconnect", "Disconnects from a server.", client_.Get(), &Client::Logout);
 
+    framework->Console()->RegisterCommand("convertscene", "Converts a scene file between the .txml, .tbin and .tbix formats. Usage: convertscene(input,output,compress)")->ExecutedWith.Connect(
+        this, &TundraLogic::HandleConvertScene);
+
     kristalliProtocol_->Initialize();
 
     // Load startup parameters once we are running.
@@ -86,6 +100,58 @@ void TundraLogic::HandleLogin(const StringVector &params) const
     client_->Login(address, port, username, password, protocol);
 }
 
+void TundraLogic::HandleConvertScene(const StringVector &params)
+{
+    if (params.Size() < 2)
+    {
+        LogError("TundraLogicModule::HandleConvertScene: Not enough parameters. Usage: convertscene(input,output,compress)");
+        return;
+    }
+    const String input = framework->LookupRelativePath(params[0].Trimmed());
+    const String output = params[1].Trimmed();
+    const bool compress = (params.Size() >= 3 ? Urho3D::ToBool(params[2]) : true);
+
+    // Load to a scene of its own without signaling, then save everything in the new format.
+    const String sceneName = "SceneConversion";
+    ScenePtr scene = framework->Scene()->CreateScene(sceneName, false, true, AttributeChange::Disconnected);
+    if (!scene)
+    {
+        LogError("TundraLogicModule::HandleConvertScene: Failed to create a scene for the conversion.");
+        return;
+    }
+
+    Urho3D::HiresTimer timer;
+    Vector<Entity *> entities;
+    if (SceneArchive::IsArchive(framework->GetContext(), input))
+    {
+        SceneArchivePtr archive(new SceneArchive());
+        if (archive->Open(input))
+            entities = archive->LoadAll(scene.Get(), AttributeChange::Disconnected);
+    }
+    else if (input.EndsWith(".tbin", false))
+        entities = scene->LoadSceneBinary(input, false, true, AttributeChange::Disconnected);
+    else
+        entities = scene->LoadSceneXML(input, false, true, AttributeChange::Disconnected);
+
+    bool saved = false;
+    if (!entities.Empty())
+    {
+        if (output.EndsWith(".tbix", false))
+            saved = SceneArchive::Write(scene.Get(), output, compress, true, true);
+        else if (output.EndsWith(".tbin", false))
+            saved = scene->SaveSceneBinary(output, true, true);
+        else
+            saved = scene->SaveSceneXML(output, true, true);
+    }
+    scene.Reset();
+    framework->Scene()->RemoveScene(sceneName, AttributeChange::Disconnected);
+
+    if (saved)
+        LogInfo("Converted " + String(entities.Size()) + " entities from " + input + " to " + output + " in " + String((int)(timer.GetUSec(false) / 1000)) + " msecs.");
+    else
+        LogError("TundraLogicModule::HandleConvertScene: Failed to convert " + input + " to " + output + ".");
+}
+
 void TundraLogic::Uninitialize()
 {
     kristalliProtocol_->Uninitialize();
@@ -93,6 +159,7 @@ void TundraLogic::Uninitialize()
     syncManager_.Reset();
     client_.Reset();
     server_.Reset();
+    sceneArchive_.Reset();
 }
 
 void TundraLogic::Update(float frametime)
@@ -109,7 +176,38 @@ void TundraLogic::Update(float frametime)
     Scene *scene = GetFramework()->Scene()->MainCameraScene();
     if (scene)
         scene->UpdateAttributeInterpolations(frametime);
-    
+    if (sceneArchive_)
+        UpdateSceneArchive();
+}
+
+void TundraLogic::UpdateSceneArchive()
+{
+    ScenePtr scene = sceneArchiveScene_.Lock();
+    if (!scene)
+    {
+        sceneArchive_.Reset();
+        return;
+    }
+
+    Urho3D::HiresTimer timer;
+    // The surroundings of the viewer first, as they may not wait for the rest of the file.
+    Entity *camera = framework->Renderer() ? framework->Renderer()->MainCamera() : 0;
+    Placeable *placeable = (camera && camera->ParentScene() == scene.Get() ? camera->Component<Placeable>().Get() : 0);
+    if (placeable)
+        sceneArchiveEntities_ += sceneArchive_->LoadEntitiesInSphere(scene.Get(), placeable->WorldPosition(), cSceneArchiveNearRadius, AttributeChange::Default).Size();
+
+    // Then the rest of the file in batches, at least one per frame, so that the network sync keeps running in between.
+    do
+    {
+        sceneArchiveEntities_ += sceneArchive_->LoadNext(scene.Get(), cSceneArchiveBatchSize, AttributeChange::Default).Size();
+    }
+    while(sceneArchive_->NumPendingRecords() > 0 && timer.GetUSec(false) < (long long)(cSceneArchiveTimeBudgetMSecs * 1000.0f));
+
+    if (sceneArchive_->NumPendingRecords() == 0)
+    {
+        LogInfo("Loading of scene archive " + sceneArchive_->Filename() + " finished. " + String(sceneArchiveEntities_) + " entities created.");
+        sceneArchive_.Reset();
+    }
 }
 
 void TundraLogic::ReadStartupParameters(float /*time*/)
@@ -189,7 +287,7 @@ void TundraLogic::LoadStartupScene()
     {
         AssetAPI::AssetRefType refType = AssetAPI::ParseAssetRef(file.Trimmed());
         if (refType != AssetAPI::AssetRefExternalUrl)
-            LoadScene(file, false, false);
+            LoadScene(file, false, false, true);
         else
         {
             AssetTransferPtr transfer = framework->Asset()->RequestAsset(file, "Binary", true);
@@ -201,11 +299,11 @@ void TundraLogic::LoadStartupScene()
 
 void TundraLogic::StartupSceneLoaded(AssetPtr sceneAsset)
 {
-    LoadScene(sceneAsset->DiskSource(), false, false);
+    LoadScene(sceneAsset->DiskSource(), false, false, true);
     sceneAsset->Unload();
 }
 
-bool TundraLogic::LoadScene(String filename, bool clearScene, bool useEntityIDsFromFile)
+bool TundraLogic::LoadScene(String filename, bool clearScene, bool useEntityIDsFromFile, bool incremental)
 {
     filename = filename.Trimmed();
     if (filename.Empty())
@@ -224,7 +322,37 @@ bool TundraLogic::LoadScene(String filename, bool clearScene, bool useEntityIDsF
     LogInfo("Loading startup scene from " + filename + " ...");
     Urho3D::HiresTimer timer;
 
+    if (SceneArchive::IsArchive(framework->GetContext(), filename))
+    {
+        // Only the index of the archive is read here. The entities always use the IDs from the file.
+        SceneArchivePtr archive(new SceneArchive());
+        if (!archive->Open(filename))
+            return false;
+        if (clearScene)
+            scene->RemoveAllEntities(true, AttributeChange::Default);
+        if (incremental)
+        {
+            // The entities are created on the following frames, see UpdateSceneArchive.
+            if (sceneArchive_)
+                LogWarning("TundraLogicModule::LoadScene: Loading of scene archive " + sceneArchive_->Filename() + " was not finished when loading " + filename + ".");
+            sceneArchive_ = archive;
+            sceneArchiveScene_ = scene;
+            sceneArchiveEntities_ = 0;
+            return true;
+        }
+        Vector<Entity *> entities = archive->LoadAll(scene, AttributeChange::Default);
+        LogInfo("Loading of startup scene finished. " + String(entities.Size()) + " entities created in " + String((int)(timer.GetUSec(true) / 1000)) + " msecs.");
+        return entities.Size() > 0;
+    }
+
     bool useBinary = filename.Find(".tbin", 0, false) != String::NPOS;
+    if (incremental)
+    {
+        SceneLoaderPtr loader = (useBinary ? scene->BeginLoadSceneBinary(filename, clearScene, useEntityIDsFromFile, AttributeChange::Default) :
+            scene->BeginLoadSceneXML(filename, clearScene, useEntityIDsFromFile, AttributeChange::Default));
+        return loader.Get() != 0;
+    }
+
     Vector<Entity *> entities;
     if (useBinary)
         entities = scene->LoadSceneBinary(filename, clearScene, useEntityIDsFromFile, AttributeChange::Default);
@@ -6,6 +6,7 @@
 #include "TundraLogicApi.h"
 #include "TundraLogicFwd.h"
 #include "AssetFwd.h"
+#include "SceneFwd.h"
 #include "Signals.h"
 
 namespace Tundra
@@ -41,6 +42,11 @@ public:
     /// For console command
     void HandleLogin(const StringVector &params) const;
 
+    /// Converts a scene file to another format. For console command.
+    /** @param params Input file, output file and optionally whether to compress a .tbix output, true by default.
+        The formats are determined by the file extensions. */
+    void HandleConvertScene(const StringVector &params);
+
 private:
     void Load() override;
     void Initialize() override;
@@ -56,11 +62,16 @@ private:
     void LoadStartupScene();
 
     /// Load a scene file into the active (main camera) scene. Return true on success.
-    bool LoadScene(String filename, bool clearScene, bool useEntityIDsFromFile);
+    /** @param incremental If true, the entities are created over several frames so that the network sync keeps running,
+            and true is returned if the load was started. */
+    bool LoadScene(String filename, bool clearScene, bool useEntityIDsFromFile, bool incremental = false);
 
     /// Handle startup scene asset being loaded
     void StartupSceneLoaded(AssetPtr sceneAsset);
 
+    /// Creates the entities of an incrementally loaded scene archive within the frame time budget, those near the main camera first.
+    void UpdateSceneArchive();
+
     /// Handle client connection to server. Add asset storages advertised by the server.
     void ClientConnectedToServer(UserConnectedResponseData *responseData);
 
@@ -80,6 +91,10 @@ private:
     SharedPtr<Tundra::KristalliProtocol> kristalliProtocol_;
     /// Asset storages received from the server upon connecting
     Vector<AssetStorageWeakPtr> storagesReceivedFromServer;
+    /// Scene archive being loaded incrementally, and the scene it is loaded to
+    SceneArchivePtr sceneArchive_;
+    SceneWeakPtr sceneArchiveScene_;
+    uint sceneArchiveEntities_;
 };
 
 }
@@ -46,7 +46,8 @@ void AnimationController::UpdateSignals()
     if (!parent)
         return;
 
-    framework->Frame()->Updated.Connect(this, &AnimationController::Update);
+    // Animations are advanced in one batch for all controllers, on the main thread as they drive the Urho scene graph.
+    framework->Frame()->ComponentUpdateSystem<AnimationController>()->Add(this);
 
     parent->ComponentAdded.Connect(this, &AnimationController::OnComponentStructureChanged);
     parent->ComponentRemoved.Connect(this, &AnimationController::OnComponentStructureChanged);
@@ -0,0 +1,255 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "CameraAssetTransferPrioritizer.h"
+#include "UrhoRenderer.h"
+#include "GraphicsWorld.h"
+#include "Camera.h"
+#include "Placeable.h"
+#include "Mesh.h"
+#include "Entity.h"
+#include "Scene/Scene.h"
+#include "IAssetTransfer.h"
+#include "Geometry/AABB.h"
+#include "Geometry/Sphere.h"
+
+#include <Urho3D/Core/Profiler.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Container/Sort.h>
+
+namespace Tundra
+{
+
+namespace
+{
+    /// Weights of the terms of an entity priority. Visibility dominates, then the screen-space size and the distance.
+    const float cVisibleWeight = 4.f;
+    const float cScreenSizeWeight = 2.f;
+    const float cDistanceWeight = 1.f;
+    /// Distance in world units at which the distance term has halved.
+    const float cDistanceHalving = 100.f;
+    /// Priority of entities without a Placeable, or in another scene than the camera.
+    const float cUnplacedPriority = 0.f;
+    /// Priority of transfers without entities, e.g. scripts and UI assets. Above the invisible entities that are not very near.
+    const float cNoEntityPriority = 3.f;
+
+    /// Small bias by asset type, so that meshes precede their materials and textures at equal priority.
+    float TypeBias(const String &assetType)
+    {
+        if (assetType.Contains("mesh", false))
+            return 0.02f;
+        else if (assetType.Contains("material", false))
+            return 0.01f;
+        return 0.f;
+    }
+}
+
+CameraAssetTransferPrioritizer::CameraAssetTransferPrioritizer(UrhoRenderer *renderer) :
+    renderer_(renderer),
+    transferLimit_(32),
+    frame_(0),
+    call_(0),
+    hasCamera_(false),
+    cameraScene_(0),
+    cameraWorld_(0),
+    tanHalfFov_(1.f)
+{
+}
+
+uint CameraAssetTransferPrioritizer::MaxTransfersPerFrame() const
+{
+    // Without a camera there is nothing to re-rank against, so do not hold transfers back.
+    return renderer_->MainCameraComponent() ? transferLimit_ : 0;
+}
+
+AssetTransferPtrVector CameraAssetTransferPrioritizer::Prioritize(const AssetTransferPtrVector &transfers)
+{
+    PROFILE(CameraAssetTransferPrioritizer_Prioritize);
+
+    Urho3D::Time *time = renderer_->GetSubsystem<Urho3D::Time>();
+    const uint frame = time ? time->GetFrameNumber() : frame_ + 1;
+    if (frame != frame_ || ranked_.Empty())
+        Rerank(frame);
+
+    ++call_;
+
+    // Merge the new transfers into the ranking.
+    Vector<Entry> added;
+    for(uint i = 0; i < transfers.Size(); ++i)
+    {
+        IAssetTransfer *transfer = transfers[i].Get();
+        HashMap<IAssetTransfer *, uint>::ConstIterator iter = indices_.Find(transfer);
+        if (iter != indices_.End())
+        {
+            Entry &entry = ranked_[iter->second_];
+            entry.lastSeenFrame = frame_;
+            entry.lastSeenCall = call_;
+        }
+        else
+        {
+            Entry entry;
+            entry.transfer = transfers[i];
+            entry.priority = TransferPriority(transfer);
+            entry.lastSeenFrame = frame_;
+            entry.lastSeenCall = call_;
+            added.Push(entry);
+        }
+    }
+    if (!added.Empty())
+    {
+        Sort(added.Begin(), added.End(), [](const Entry &a, const Entry &b) { return a.priority > b.priority; });
+        Vector<Entry> merged;
+        merged.Reserve(ranked_.Size() + added.Size());
+        uint r = 0, a = 0;
+        while(r < ranked_.Size() || a < added.Size())
+        {
+            if (a >= added.Size() || (r < ranked_.Size() && ranked_[r].priority >= added[a].priority))
+                merged.Push(ranked_[r++]);
+            else
+                merged.Push(added[a++]);
+        }
+        ranked_.Swap(merged);
+        UpdateIndices();
+    }
+
+    AssetTransferPtrVector sorted;
+    sorted.Reserve(transfers.Size());
+    for(uint i = 0; i < ranked_.Size(); ++i)
+        if (ranked_[i].lastSeenCall == call_)
+            sorted.Push(AssetTransferPtr(ranked_[i].transfer));
+
+    // Duplicates in the input collapse to one entry, in which case keep the input order so that nothing is lost.
+    return sorted.Size() == transfers.Size() ? sorted : transfers;
+}
+
+void CameraAssetTransferPrioritizer::Rerank(uint frame)
+{
+    PROFILE(CameraAssetTransferPrioritizer_Rerank);
+
+    const uint previousFrame = frame_;
+    frame_ = frame;
+    UpdateCamera();
+    entityPriorities_.Clear();
+
+    // Drop the transfers that are gone, or were not pending on the previous frame, and rescore the rest.
+    uint numDescents = 0;
+    uint last = 0;
+    for(uint i = 0; i < ranked_.Size(); ++i)
+    {
+        Entry &entry = ranked_[i];
+        if (entry.transfer.Expired() || entry.lastSeenFrame != previousFrame)
+            continue;
+        entry.priority = TransferPriority(entry.transfer.Get());
+        if (last > 0 && ranked_[last - 1].priority < entry.priority)
+            ++numDescents;
+        if (last != i)
+            ranked_[last] = entry;
+        ++last;
+    }
+    ranked_.Resize(last);
+
+    // The order changes little from frame to frame, so repair it with an insertion sort unless much has moved.
+    if (numDescents > 0)
+    {
+        if (numDescents <= 8)
+        {
+            for(uint i = 1; i < ranked_.Size(); ++i)
+            {
+                if (ranked_[i - 1].priority >= ranked_[i].priority)
+                    continue;
+                Entry entry = ranked_[i];
+                uint j = i;
+                for(; j > 0 && ranked_[j - 1].priority < entry.priority; --j)
+                    ranked_[j] = ranked_[j - 1];
+                ranked_[j] = entry;
+            }
+        }
+        else
+            Sort(ranked_.Begin(), ranked_.End(), [](const Entry &a, const Entry &b) { return a.priority > b.priority; });
+    }
+    UpdateIndices();
+}
+
+void CameraAssetTransferPrioritizer::UpdateCamera()
+{
+    hasCamera_ = false;
+    cameraScene_ = 0;
+    cameraWorld_ = 0;
+
+    Entity *cameraEntity = renderer_->MainCamera();
+    Camera *camera = renderer_->MainCameraComponent();
+    Placeable *placeable = cameraEntity ? cameraEntity->Component<Placeable>().Get() : 0;
+    if (!camera || !placeable)
+        return;
+
+    hasCamera_ = true;
+    cameraScene_ = cameraEntity->ParentScene();
+    cameraWorld_ = cameraScene_ ? cameraScene_->Subsystem<GraphicsWorld>().Get() : 0;
+    frustum_ = camera->ToFrustum();
+    cameraPos_ = placeable->WorldPosition();
+    tanHalfFov_ = Max(tanf(DegToRad(camera->verticalFov.Get()) * 0.5f), 1e-3f);
+}
+
+float CameraAssetTransferPrioritizer::TransferPriority(IAssetTransfer *transfer)
+{
+    const float bias = TypeBias(transfer->assetType);
+    if (!hasCamera_)
+        return bias;
+
+    const HashSet<EntityWeakPtr> &entities = transfer->ReferencingEntities();
+    float priority = -1.f;
+    for(HashSet<EntityWeakPtr>::ConstIterator iter = entities.Begin(); iter != entities.End(); ++iter)
+    {
+        Entity *entity = iter->Get();
+        if (entity)
+            priority = Max(priority, EntityPriority(entity));
+    }
+    return (priority < 0.f ? cNoEntityPriority : priority) + bias;
+}
+
+float CameraAssetTransferPrioritizer::EntityPriority(Entity *entity)
+{
+    HashMap<Entity *, float>::ConstIterator iter = entityPriorities_.Find(entity);
+    if (iter != entityPriorities_.End())
+        return iter->second_;
+
+    float priority = cUnplacedPriority;
+    Placeable *placeable = entity->Component<Placeable>().Get();
+    if (placeable && entity->ParentScene() == cameraScene_)
+    {
+        // Use the mesh bounds once the mesh has loaded, otherwise approximate the size with the scale.
+        float3 center = placeable->WorldPosition();
+        float radius = 0.f;
+        Mesh *mesh = entity->Component<Mesh>().Get();
+        if (mesh)
+        {
+            AABB aabb = mesh->WorldAABB();
+            if (aabb.IsFinite() && !aabb.IsDegenerate())
+            {
+                center = aabb.CenterPoint();
+                radius = aabb.HalfDiagonal().Length();
+            }
+        }
+        if (radius <= 0.f)
+            radius = Max(placeable->WorldScale().Abs().MaxElement() * 0.5f, 0.5f);
+
+        const float distance = Max(center.Distance(cameraPos_) - radius, 1e-2f);
+        // Meshes that have not loaded have no drawable, so they are never in the visible set. Test them against the frustum.
+        const bool visible = (cameraWorld_ && cameraWorld_->IsEntityVisible(entity)) || frustum_.Intersects(Sphere(center, radius));
+        const float screenSize = Min(radius / (distance * tanHalfFov_), 1.f);
+
+        priority = (visible ? cVisibleWeight : 0.f) + cScreenSizeWeight * screenSize +
+            cDistanceWeight * cDistanceHalving / (cDistanceHalving + distance);
+    }
+    entityPriorities_[entity] = priority;
+    return priority;
+}
+
+void CameraAssetTransferPrioritizer::UpdateIndices()
+{
+    indices_.Clear();
+    for(uint i = 0; i < ranked_.Size(); ++i)
+        indices_[ranked_[i].transfer.Get()] = i;
+}
+
+}
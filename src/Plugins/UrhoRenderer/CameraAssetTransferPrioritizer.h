@@ -0,0 +1,85 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "IAssetTransferPrioritizer.h"
+#include "UrhoModuleApi.h"
+#include "UrhoModuleFwd.h"
+#include "SceneFwd.h"
+#include "Math/float3.h"
+#include "Geometry/Frustum.h"
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/Ptr.h>
+
+namespace Tundra
+{
+
+class IAssetTransfer;
+
+/// Prioritizes asset transfers by the distance, screen-space size and visibility of their entities from the main camera.
+/** The priority of a transfer is the highest priority of the entities referencing it, see IAssetTransfer::ReferencingEntities.
+    Entities that are visible in the GraphicsWorld, or whose bounding sphere intersects the camera frustum, come first.
+    Transfers without entities, or without a main camera, are ordered by asset type like DefaultAssetTransferPrioritizer does.
+
+    The ranking persists between frames. Each frame the priorities are recomputed and the previous order is repaired,
+    which is cheap while the camera moves little. New transfers are merged into the ranking as they are requested.
+    While a main camera exists, at most MaxTransfersPerFrame transfers are started per frame, so that the rest can be
+    re-ranked as the camera moves. */
+class URHO_MODULE_API CameraAssetTransferPrioritizer : public IAssetTransferPrioritizer
+{
+public:
+    explicit CameraAssetTransferPrioritizer(UrhoRenderer *renderer);
+
+    /// IAssetTransferPrioritizer override
+    AssetTransferPtrVector Prioritize(const AssetTransferPtrVector &transfers) override;
+
+    /// IAssetTransferPrioritizer override
+    uint MaxTransfersPerFrame() const override;
+
+    /// Sets the maximum number of transfers started per frame while a main camera exists. 0 for no limit. The default is 32.
+    void SetTransferLimit(uint limit) { transferLimit_ = limit; }
+    uint TransferLimit() const { return transferLimit_; } ///< @copydoc SetTransferLimit
+
+private:
+    struct Entry
+    {
+        WeakPtr<IAssetTransfer> transfer;
+        float priority;
+        /// Frame on which the transfer was last given to Prioritize.
+        uint lastSeenFrame;
+        /// Prioritize call in which the transfer was last given.
+        uint lastSeenCall;
+    };
+
+    /// Recomputes the priorities of the ranked transfers and repairs the order. Called once per frame.
+    void Rerank(uint frame);
+    /// Sets up the camera state used by the priority functions.
+    void UpdateCamera();
+    /// Returns the priority of @c transfer, higher first.
+    float TransferPriority(IAssetTransfer *transfer);
+    /// Returns the priority of @c entity, computed once per frame.
+    float EntityPriority(Entity *entity);
+    /// Rebuilds the transfer to ranking position map.
+    void UpdateIndices();
+
+    UrhoRenderer *renderer_;
+    uint transferLimit_;
+
+    /// Transfers in priority order.
+    Vector<Entry> ranked_;
+    HashMap<IAssetTransfer *, uint> indices_;
+    uint frame_;
+    uint call_;
+
+    /// Camera state of the current frame.
+    bool hasCamera_;
+    Scene *cameraScene_;
+    GraphicsWorld *cameraWorld_;
+    Frustum frustum_;
+    float3 cameraPos_;
+    float tanHalfFov_;
+    HashMap<Entity *, float> entityPriorities_;
+};
+
+}
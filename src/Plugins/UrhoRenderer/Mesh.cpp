@@ -310,7 +310,7 @@ void Mesh::AttributesChanged()
     {
         /* Let the listener resolve and cleanup the refs, while us keeping the originals intact.
            Changes are handled in OnMaterialAssetRefsChanged/Failed/Loaded. */
-        materialRefListListener_->HandleChange(materialRefs.Get());
+        materialRefListListener_->HandleChange(materialRefs.Get(), ParentEntity());
     }
     if (skeletonRef.ValueChanged())
     {
@@ -0,0 +1,363 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "MeshSimplifier.h"
+
+#include <Urho3D/Container/HashSet.h>
+#include <Urho3D/Container/Sort.h>
+
+namespace Tundra
+{
+
+namespace
+{
+    /// Sum of squared distances to a set of planes, see Garland & Heckbert, "Surface Simplification Using Quadric Error Metrics".
+    struct Quadric
+    {
+        Quadric() : a00(0.f), a01(0.f), a02(0.f), a11(0.f), a12(0.f), a22(0.f), b0(0.f), b1(0.f), b2(0.f), c(0.f), weight(0.f) {}
+
+        /// Adds the plane n.p + d = 0 with weight w.
+        void AddPlane(const float3 &n, float d, float w)
+        {
+            a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z;
+            a11 += w * n.y * n.y; a12 += w * n.y * n.z; a22 += w * n.z * n.z;
+            b0 += w * n.x * d; b1 += w * n.y * d; b2 += w * n.z * d;
+            c += w * d * d;
+            weight += w;
+        }
+
+        void Add(const Quadric &q)
+        {
+            a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+            b0 += q.b0; b1 += q.b1; b2 += q.b2; c += q.c;
+            weight += q.weight;
+        }
+
+        /// Returns the weighted mean of the squared distances of @c p to the planes.
+        float Error(const float3 &p) const
+        {
+            float e = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z +
+                2.f * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z) +
+                2.f * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+            return e > 0.f && weight > 0.f ? e / weight : 0.f;
+        }
+
+        float a00, a01, a02, a11, a12, a22;
+        float b0, b1, b2;
+        float c;
+        float weight;
+    };
+
+    /// Moves the vertices of position @c from onto position @c to.
+    struct Collapse
+    {
+        uint from;
+        uint to;
+        float error;
+    };
+
+    /// How the vertices of a position may move.
+    enum PositionKind
+    {
+        /// One vertex, surrounded by triangles. Can move onto any neighbouring position.
+        PositionManifold,
+        /// Two vertices with different attributes on a seam that runs through the position. Can move along the seam.
+        PositionSeam,
+        /// On a border, a seam corner or the end of a seam. Never moves.
+        PositionLocked
+    };
+
+    bool PositionLess(const float3 &a, const float3 &b)
+    {
+        if (a.x != b.x)
+            return a.x < b.x;
+        if (a.y != b.y)
+            return a.y < b.y;
+        return a.z < b.z;
+    }
+
+    bool PositionEquals(const float3 &a, const float3 &b)
+    {
+        return a.x == b.x && a.y == b.y && a.z == b.z;
+    }
+
+    u64 EdgeKey(uint a, uint b)
+    {
+        return ((u64)a << 32) | b;
+    }
+}
+
+PODVector<uint> SimplifyMesh(const PODVector<float3> &positions, const PODVector<uint> &indices, uint targetIndexCount, float maxError)
+{
+    PODVector<uint> result(indices);
+    const uint numVertices = positions.Size();
+    if (result.Size() % 3 != 0 || targetIndexCount >= result.Size() || numVertices == 0)
+        return result;
+    for(uint i = 0; i < result.Size(); ++i)
+        if (result[i] >= numVertices)
+            return result;
+
+    // Weld the vertices by position. The vertices of a position, e.g. on both sides of a UV seam, are its wedges,
+    // and are stored in order[positionStarts[id]] ... order[positionStarts[id + 1] - 1].
+    PODVector<uint> order(numVertices);
+    for(uint i = 0; i < numVertices; ++i)
+        order[i] = i;
+    Sort(order.Begin(), order.End(), [&positions](uint a, uint b) { return PositionLess(positions[a], positions[b]); });
+    PODVector<uint> positionIds(numVertices);
+    PODVector<uint> positionStarts;
+    for(uint i = 0; i < numVertices; ++i)
+    {
+        if (i == 0 || !PositionEquals(positions[order[i]], positions[order[i - 1]]))
+            positionStarts.Push(i);
+        positionIds[order[i]] = positionStarts.Size() - 1;
+    }
+    const uint numPositions = positionStarts.Size();
+    positionStarts.Push(numVertices);
+
+    // Triangles with two corners at the same position have no area, and would hide borders and seams. Drop them first.
+    uint numIndices = 0;
+    for(uint i = 0; i < result.Size(); i += 3)
+    {
+        const uint p0 = positionIds[result[i]], p1 = positionIds[result[i + 1]], p2 = positionIds[result[i + 2]];
+        if (p0 == p1 || p1 == p2 || p0 == p2)
+            continue;
+        result[numIndices++] = result[i];
+        result[numIndices++] = result[i + 1];
+        result[numIndices++] = result[i + 2];
+    }
+    result.Resize(numIndices);
+    if (result.Size() <= targetIndexCount)
+        return result;
+
+    // An edge without an opposite edge between the same positions is on a border. An edge whose opposite edge uses
+    // other wedges of the same positions is on an attribute seam.
+    HashSet<u64> vertexEdges;
+    HashSet<u64> positionEdges;
+    for(uint i = 0; i < result.Size(); i += 3)
+    {
+        for(uint e = 0; e < 3; ++e)
+        {
+            const uint a = result[i + e], b = result[i + (e + 1) % 3];
+            vertexEdges.Insert(EdgeKey(a, b));
+            positionEdges.Insert(EdgeKey(positionIds[a], positionIds[b]));
+        }
+    }
+    PODVector<bool> border(numPositions);
+    PODVector<uint> numWedges(numPositions);
+    PODVector<uint> numSeamEdges(numPositions);
+    for(uint i = 0; i < numPositions; ++i)
+    {
+        border[i] = false;
+        numWedges[i] = 0;
+        numSeamEdges[i] = 0;
+    }
+    HashSet<u64> seamEdges;
+    for(uint i = 0; i < result.Size(); i += 3)
+    {
+        for(uint e = 0; e < 3; ++e)
+        {
+            const uint a = result[i + e], b = result[i + (e + 1) % 3];
+            const uint pa = positionIds[a], pb = positionIds[b];
+            if (!positionEdges.Contains(EdgeKey(pb, pa)))
+                border[pa] = border[pb] = true;
+            else if (!vertexEdges.Contains(EdgeKey(b, a)))
+                seamEdges.Insert(pa < pb ? EdgeKey(pa, pb) : EdgeKey(pb, pa));
+        }
+    }
+    for(HashSet<u64>::ConstIterator i = seamEdges.Begin(); i != seamEdges.End(); ++i)
+    {
+        ++numSeamEdges[(uint)(*i >> 32)];
+        ++numSeamEdges[(uint)(*i & 0xffffffff)];
+    }
+    // Only the wedges that are in use count, so unused duplicate vertices do not lock a position.
+    PODVector<bool> used(numVertices);
+    for(uint i = 0; i < numVertices; ++i)
+        used[i] = false;
+    for(uint i = 0; i < result.Size(); ++i)
+        used[result[i]] = true;
+    for(uint i = 0; i < numVertices; ++i)
+        if (used[i])
+            ++numWedges[positionIds[i]];
+    PODVector<u8> kinds(numPositions);
+    for(uint i = 0; i < numPositions; ++i)
+    {
+        if (border[i])
+            kinds[i] = PositionLocked;
+        else if (numWedges[i] == 1 && numSeamEdges[i] == 0)
+            kinds[i] = PositionManifold;
+        else if (numWedges[i] == 2 && numSeamEdges[i] == 2)
+            kinds[i] = PositionSeam;
+        else
+            kinds[i] = PositionLocked;
+    }
+
+    // Area-weighted quadrics of the triangle planes around each position.
+    Vector<Quadric> quadrics(numPositions);
+    float3 minPos = positions[0], maxPos = positions[0];
+    for(uint i = 1; i < numVertices; ++i)
+    {
+        minPos = minPos.Min(positions[i]);
+        maxPos = maxPos.Max(positions[i]);
+    }
+    for(uint i = 0; i < result.Size(); i += 3)
+    {
+        const float3 &p0 = positions[result[i]], &p1 = positions[result[i + 1]], &p2 = positions[result[i + 2]];
+        float3 normal = (p1 - p0).Cross(p2 - p0);
+        const float area = normal.Normalize();
+        if (area <= 0.f)
+            continue;
+        const float d = -normal.Dot(p0);
+        for(uint e = 0; e < 3; ++e)
+            quadrics[positionIds[result[i + e]]].AddPlane(normal, d, area);
+    }
+    const float extent = (maxPos - minPos).Length();
+    const float maxSquaredError = (maxError * extent) * (maxError * extent);
+
+    PODVector<uint> collapseTarget(numVertices);
+    for(uint i = 0; i < numVertices; ++i)
+        collapseTarget[i] = i;
+    PODVector<bool> changed(numPositions);
+    PODVector<uint> triangleOffsets(numVertices + 1);
+    PODVector<uint> vertexTriangles;
+    PODVector<Collapse> collapses;
+    PODVector<uint> wedgeTargets;
+
+    // Each pass collapses the cheapest edges whose neighbourhoods do not overlap, then rebuilds the triangle list.
+    while(result.Size() > targetIndexCount)
+    {
+        const uint numTriangles = result.Size() / 3;
+
+        // Triangles around each vertex.
+        for(uint i = 0; i <= numVertices; ++i)
+            triangleOffsets[i] = 0;
+        for(uint i = 0; i < result.Size(); ++i)
+            ++triangleOffsets[result[i] + 1];
+        for(uint i = 0; i < numVertices; ++i)
+            triangleOffsets[i + 1] += triangleOffsets[i];
+        vertexTriangles.Resize(result.Size());
+        for(uint i = 0; i < result.Size(); ++i)
+            vertexTriangles[triangleOffsets[result[i]]++] = i / 3;
+        for(uint i = numVertices; i > 0; --i)
+            triangleOffsets[i] = triangleOffsets[i - 1];
+        triangleOffsets[0] = 0;
+
+        // An interior edge is in two triangles, once in each direction, so take it from the triangle where it ascends.
+        collapses.Clear();
+        for(uint i = 0; i < result.Size(); i += 3)
+        {
+            for(uint e = 0; e < 3; ++e)
+            {
+                const uint a = positionIds[result[i + e]], b = positionIds[result[i + (e + 1) % 3]];
+                if (a > b)
+                    continue;
+                for(uint dir = 0; dir < 2; ++dir)
+                {
+                    Collapse collapse;
+                    collapse.from = dir ? b : a;
+                    collapse.to = dir ? a : b;
+                    if (kinds[collapse.from] == PositionLocked ||
+                        (kinds[collapse.from] == PositionSeam && !seamEdges.Contains(EdgeKey(a, b))))
+                        continue;
+                    // The collapsed position has the planes of both positions.
+                    Quadric quadric = quadrics[collapse.from];
+                    quadric.Add(quadrics[collapse.to]);
+                    collapse.error = quadric.Error(positions[order[positionStarts[collapse.to]]]);
+                    if (collapse.error <= maxSquaredError)
+                        collapses.Push(collapse);
+                }
+            }
+        }
+        if (collapses.Empty())
+            break;
+        Sort(collapses.Begin(), collapses.End(), [](const Collapse &a, const Collapse &b) { return a.error < b.error; });
+
+        for(uint i = 0; i < numPositions; ++i)
+            changed[i] = false;
+        // A collapse removes about two triangles.
+        const uint trianglesToRemove = (result.Size() - targetIndexCount + 2) / 3;
+        uint trianglesRemoved = 0;
+        uint numCollapsed = 0;
+        for(uint c = 0; c < collapses.Size() && trianglesRemoved < trianglesToRemove; ++c)
+        {
+            const Collapse &collapse = collapses[c];
+            if (changed[collapse.from] || changed[collapse.to])
+                continue;
+
+            // Each wedge moves onto the wedge of the target position that it shares an edge with. A wedge that
+            // touches two target wedges would mix the attributes of both sides of a seam, so it rejects the collapse,
+            // as does a remaining triangle that would flip.
+            const float3 &target = positions[order[positionStarts[collapse.to]]];
+            bool valid = true;
+            uint removed = 0;
+            wedgeTargets.Clear();
+            for(uint w = positionStarts[collapse.from]; w < positionStarts[collapse.from + 1] && valid; ++w)
+            {
+                const uint vertex = order[w];
+                if (triangleOffsets[vertex] == triangleOffsets[vertex + 1])
+                    continue;
+                uint wedgeTarget = numVertices;
+                for(uint t = triangleOffsets[vertex]; t < triangleOffsets[vertex + 1] && valid; ++t)
+                {
+                    const uint *tri = &result[vertexTriangles[t] * 3];
+                    uint corner = 3;
+                    for(uint k = 0; k < 3; ++k)
+                        if (positionIds[tri[k]] == collapse.to)
+                            corner = k;
+                    if (corner < 3)
+                    {
+                        valid = wedgeTarget == numVertices || wedgeTarget == tri[corner];
+                        wedgeTarget = tri[corner];
+                        ++removed;
+                        continue;
+                    }
+                    const float3 &p0 = positions[tri[0]], &p1 = positions[tri[1]], &p2 = positions[tri[2]];
+                    const float3 before = (p1 - p0).Cross(p2 - p0);
+                    const float3 q0 = tri[0] == vertex ? target : p0;
+                    const float3 q1 = tri[1] == vertex ? target : p1;
+                    const float3 q2 = tri[2] == vertex ? target : p2;
+                    const float3 after = (q1 - q0).Cross(q2 - q0);
+                    valid = before.LengthSq() <= 0.f || after.Dot(before) > 0.25f * after.Length() * before.Length();
+                }
+                valid = valid && wedgeTarget != numVertices;
+                wedgeTargets.Push(vertex);
+                wedgeTargets.Push(wedgeTarget);
+            }
+            if (!valid || wedgeTargets.Empty())
+                continue;
+
+            for(uint i = 0; i < wedgeTargets.Size(); i += 2)
+            {
+                const uint vertex = wedgeTargets[i];
+                collapseTarget[vertex] = wedgeTargets[i + 1];
+                // The triangles around the removed position change, so their positions are left alone until the next pass.
+                for(uint t = triangleOffsets[vertex]; t < triangleOffsets[vertex + 1]; ++t)
+                {
+                    const uint *tri = &result[vertexTriangles[t] * 3];
+                    changed[positionIds[tri[0]]] = changed[positionIds[tri[1]]] = changed[positionIds[tri[2]]] = true;
+                }
+            }
+            quadrics[collapse.to].Add(quadrics[collapse.from]);
+            trianglesRemoved += removed;
+            ++numCollapsed;
+        }
+        if (numCollapsed == 0)
+            break;
+
+        // Apply the collapses and drop the triangles that became degenerate.
+        numIndices = 0;
+        for(uint i = 0; i < numTriangles * 3; i += 3)
+        {
+            const uint v0 = collapseTarget[result[i]], v1 = collapseTarget[result[i + 1]], v2 = collapseTarget[result[i + 2]];
+            if (positionIds[v0] == positionIds[v1] || positionIds[v1] == positionIds[v2] || positionIds[v0] == positionIds[v2])
+                continue;
+            result[numIndices++] = v0;
+            result[numIndices++] = v1;
+            result[numIndices++] = v2;
+        }
+        result.Resize(numIndices);
+    }
+
+    return result;
+}
+
+}
@@ -0,0 +1,28 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "CoreTypes.h"
+#include "UrhoModuleApi.h"
+#include "Math/float3.h"
+
+namespace Tundra
+{
+
+/// Simplifies a triangle list by collapsing its edges in the order of their quadric error.
+/** The vertices are not moved or created: each collapse moves a vertex onto a neighbouring vertex, so the result
+    indexes the original vertices and can share their vertex buffer, like the LOD levels of a mesh do. The vertices are
+    welded by position, and the collapse error is the quadric error of both positions at the target. A position whose
+    vertices lie on a UV or normal seam only moves along the seam, each vertex onto the vertex on its side of the seam.
+    Seam corners and ends, and vertices on open borders, are never removed, which keeps the texturing and the silhouette
+    intact. Degenerate triangles are dropped.
+
+    Runs in the calling thread and touches no Urho3D objects, so it can be used in an asset decode job.
+    @param positions Vertex positions.
+    @param indices Triangle list indices to @c positions.
+    @param targetIndexCount Number of indices to simplify down to.
+    @param maxError Largest allowed collapse error, as a distance relative to the diagonal of the bounding box of @c positions.
+    @return The simplified indices. Has more than @c targetIndexCount indices if the error limit was reached first. */
+PODVector<uint> URHO_MODULE_API SimplifyMesh(const PODVector<float3> &positions, const PODVector<uint> &indices, uint targetIndexCount, float maxError);
+
+}
@@ -46,11 +46,16 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "LoggingFunctions.h"
 #include "OgreMeshAsset.h"
 #include "OgreMeshDefines.h"
+#include "IAssetDecodeJob.h"
+#include "Framework.h"
+#include "MeshSimplifier.h"
 
 #include <Urho3D/Graphics/Model.h>
 #include <Urho3D/Core/Profiler.h>
 #include <Urho3D/IO/MemoryBuffer.h>
 #include <Urho3D/IO/VectorBuffer.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
 #include <Urho3D/Graphics/VertexBuffer.h>
 #include <Urho3D/Graphics/IndexBuffer.h>
 #include <Urho3D/Core/StringUtils.h>
@@ -243,6 +248,7 @@ static void ReadPoseVertices(Urho3D::Deserializer& stream, Pose *pose);
 static void ReadAnimations(Urho3D::Deserializer& stream, Ogre::Mesh *mesh, float version);
 static void ReadAnimation(Urho3D::Deserializer& stream, Animation *anim, float version);
 static void ReadAnimationKeyFrames(Urho3D::Deserializer& stream, Animation *anim, VertexAnimationTrack *track, float version);
+static bool IndicesInRange(const Ogre::IndexData *indexData, uint numVertices);
 
 static String ReadLine(Urho3D::Deserializer& stream)
 {
@@ -366,9 +372,7 @@ static void ReadMesh(Urho3D::Deserializer& stream, Ogre::Mesh *mesh, float versi
 
 static void ReadMeshLodInfo(Urho3D::Deserializer& stream, Ogre::Mesh *mesh)
 {
-    // Assimp does not acknowledge LOD levels as far as I can see it. This info is just skipped.
-    // @todo Put this stuff to scene/mesh custom properties. If manual mesh the app can use the information.
-    ReadLine(stream); // strategy name
+    String strategy = ReadLine(stream);
     u16 numLods = stream.ReadUShort();
     bool manual = stream.ReadBool();
     
@@ -380,7 +384,7 @@ static void ReadMeshLodInfo(Urho3D::Deserializer& stream, Ogre::Mesh *mesh)
             throw std::runtime_error("M_MESH_LOD does not contain a M_MESH_LOD_USAGE for each LOD level");
         }
 
-        SkipBytes(stream, sizeof(float)); // User value
+        float userValue = stream.ReadFloat();
 
         if (manual)
         {
@@ -389,6 +393,7 @@ static void ReadMeshLodInfo(Urho3D::Deserializer& stream, Ogre::Mesh *mesh)
                 throw std::runtime_error("Manual M_MESH_LOD_USAGE does not contain M_MESH_LOD_MANUAL");
             }
                 
+            // Manual LOD levels refer to other mesh assets, which are not loaded. Only the full detail level is used.
             ReadLine(stream); // manual mesh name (ref to another mesh)
         }
         else
@@ -400,17 +405,36 @@ static void ReadMeshLodInfo(Urho3D::Deserializer& stream, Ogre::Mesh *mesh)
                     throw std::runtime_error("Generated M_MESH_LOD_USAGE does not contain M_MESH_LOD_GENERATED");
                 }
 
-                uint indexCount = stream.ReadUInt();
-                bool is32bit = stream.ReadBool();
+                SubMesh *submesh = mesh->subMeshes[si];
+                IndexData *lodData = new IndexData();
+                submesh->lodIndexData.Push(lodData);
+                lodData->count = stream.ReadUInt();
+                lodData->faceCount = static_cast<uint>(lodData->count / 3);
+                lodData->is32bit = stream.ReadBool();
 
-                if (indexCount > 0)
+                // Compare the count instead of the byte size, which could overflow for a corrupt count.
+                if (lodData->count > (stream.GetSize() - stream.GetPosition()) / lodData->IndexSize()) {
+                    throw std::runtime_error("M_MESH_LOD_GENERATED index count exceeds the mesh data");
+                }
+                if (lodData->count > 0)
                 {
-                    uint len = indexCount * (is32bit ? sizeof(uint) : sizeof(u16));
-                    SkipBytes(stream, len);
+                    uint len = lodData->count * lodData->IndexSize();
+                    lodData->buffer.Resize(len);
+                    stream.Read(&lodData->buffer[0], len);
+                }
+
+                // The LOD levels share the vertices of the full detail level.
+                const VertexData *vertexData = submesh->usesSharedVertexData ? mesh->sharedVertexData : submesh->vertexData;
+                if (!vertexData || !IndicesInRange(lodData, vertexData->count)) {
+                    throw std::runtime_error("M_MESH_LOD_GENERATED contains indices out of the vertex range of the submesh");
                 }
             }
+            mesh->lodValues.Push(userValue);
         }
     }
+
+    if (!mesh->lodValues.Empty())
+        mesh->lodStrategy = strategy;
 }
 
 static void ReadMeshSkeletonLink(Urho3D::Deserializer& stream, Ogre::Mesh *mesh)
@@ -1141,52 +1165,457 @@ static SharedPtr<Urho3D::VertexBuffer> MakeVertexBuffer(Urho3D::Context* context
     return ret;
 }
 
-OgreMeshAsset::OgreMeshAsset(AssetAPI *owner, const String &type_, const String &name_) :
-    IMeshAsset(owner, type_, name_)
+/// Load-time LOD generation settings, read from the command line.
+struct MeshLodSettings
 {
+    MeshLodSettings() :
+        levels(0),
+        reduction(0.5f),
+        distance(8.0f)
+    {
+    }
+
+    /// Number of LOD levels to generate for meshes that have none. 0 disables the generation. --meshLodLevels
+    uint levels;
+    /// Fraction of the triangles of the previous level to keep on each level. --meshLodReduction
+    float reduction;
+    /// Distance of the first LOD level in mesh bounding radii. Doubles on each level. --meshLodDistance
+    float distance;
+};
+
+/// Largest simplification error as an angle seen from the LOD distance, in radians. About two pixels on a 1080p screen.
+static const float cLodAngularError = 0.0015f;
+
+/// Identifies the cached LOD data of a mesh.
+static const char *cLodCacheFileId = "TLOD";
+static const uint cLodCacheVersion = 1;
+
+static MeshLodSettings ReadMeshLodSettings(Framework *framework)
+{
+    MeshLodSettings settings;
+    StringVector param = framework->CommandLineParameters("--meshLodLevels");
+    if (param.Size() > 0)
+        settings.levels = Urho3D::ToUInt(param.Front());
+    param = framework->CommandLineParameters("--meshLodReduction");
+    if (param.Size() > 0)
+    {
+        float reduction = Urho3D::ToFloat(param.Front());
+        if (reduction > 0.0f && reduction < 1.0f)
+            settings.reduction = reduction;
+    }
+    param = framework->CommandLineParameters("--meshLodDistance");
+    if (param.Size() > 0)
+    {
+        float distance = Urho3D::ToFloat(param.Front());
+        if (distance > 0.0f)
+            settings.distance = distance;
+    }
+    return settings;
 }
 
-bool OgreMeshAsset::DeserializeFromData(const u8 *data_, uint numBytes, bool /*allowAsynchronous*/)
+/// 32-bit FNV-1a hash of the data, continuing from @c hash.
+static u32 HashData(const void *data, uint numBytes, u32 hash = 2166136261U)
 {
-    PROFILE(OgreMeshAsset_LoadFromFileInMemory);
+    const u8 *bytes = static_cast<const u8*>(data);
+    for(uint i = 0; i < numBytes; ++i)
+        hash = (hash ^ bytes[i]) * 16777619U;
+    return hash;
+}
 
-    /// Force an unload of previous data first.
-    Unload();
+/// Returns the diagonal length of the bounding box of @c positions, as used by SimplifyMesh.
+static float Extent(const PODVector<float3> &positions)
+{
+    if (positions.Empty())
+        return 0.0f;
+    float3 minPos = positions[0], maxPos = positions[0];
+    for(uint i = 1; i < positions.Size(); ++i)
+    {
+        minPos = minPos.Min(positions[i]);
+        maxPos = maxPos.Max(positions[i]);
+    }
+    return (maxPos - minPos).Length();
+}
 
-    Urho3D::MemoryBuffer buffer(data_, numBytes);
+static float BoundingRadius(const Ogre::Mesh *mesh)
+{
+    float radius = (mesh->max - mesh->min).Length() * 0.5f;
+    // Meshes without a M_MESH_BOUNDS chunk fall back to unit size.
+    return radius > 0.0f ? radius : 1.0f;
+}
 
-    u16 id = ReadHeader(buffer, false);
-    if (id != HEADER_CHUNK_ID)
+/// Converts the LOD strategy values of @c mesh to Urho geometry LOD distances.
+/** Pixel count strategies are converted with the distance at which the bounding sphere of the mesh covers that many
+    pixels on a 1920x1080 screen with a 45 degree vertical field of view, so they are only approximate. */
+static PODVector<float> LodDistances(const Ogre::Mesh *mesh)
+{
+    PODVector<float> distances;
+    const bool pixelCount = mesh->lodStrategy.Contains("pixel", false);
+    const bool screenRatio = mesh->lodStrategy.Contains("ratio", false);
+    const float radius = BoundingRadius(mesh);
+    float previous = 0.0f;
+    for(uint i = 0; i < mesh->lodValues.Size(); ++i)
     {
-        LogError("OgreMeshAsset::DeserializeFromData: Invalid Ogre Mesh file header in " + Name());
-        return false;
+        float distance = mesh->lodValues[i];
+        if (pixelCount)
+        {
+            // Projected area of the bounding sphere is pi * r^2 * P00 * P11 * width * height / (4 * d^2).
+            const float pixels = Max(screenRatio ? distance * 1920.0f * 1080.0f : distance, 1.0f);
+            distance = radius * 2311.0f / sqrtf(pixels);
+        }
+        // Urho uses the first LOD level whose distance is not reached, so the distances must not decrease.
+        distance = Max(distance, previous);
+        distances.Push(distance);
+        previous = distance;
     }
+    return distances;
+}
 
-    /// @todo Check what we can actually support.
-    String versionStr = ReadLine(buffer);
-    versionStr = versionStr.Substring(versionStr.Find('v') + 1);
-    float version = Urho3D::ToFloat(versionStr);
+/// Returns the positions of @c vertexData, or an empty vector if they are missing or not VET_FLOAT3.
+static PODVector<float3> ReadPositions(Ogre::VertexData *vertexData)
+{
+    PODVector<float3> positions;
+    Ogre::VertexElement *element = vertexData ? vertexData->GetVertexElement(Ogre::VertexElement::VES_POSITION) : 0;
+    if (!element || element->type != Ogre::VertexElement::VET_FLOAT3 || !vertexData->count)
+        return positions;
+    Vector<u8> *vb = vertexData->VertexBuffer(element->source);
+    uint stride = vertexData->VertexSize(element->source);
+    if (!vb || vb->Size() < (vertexData->count - 1) * stride + element->offset + sizeof(float3))
+        return positions;
+
+    positions.Resize(vertexData->count);
+    const u8 *src = &vb->At(0) + element->offset;
+    for(uint i = 0; i < vertexData->count; ++i, src += stride)
+        memcpy(&positions[i], src, sizeof(float3));
+    return positions;
+}
 
-    id = ReadHeader(buffer);
-    if (id != M_MESH)
+static PODVector<uint> ReadIndices(const Ogre::IndexData *indexData)
+{
+    PODVector<uint> indices;
+    if (!indexData->count || indexData->buffer.Size() < indexData->count * indexData->IndexSize())
+        return indices;
+
+    indices.Resize(indexData->count);
+    if (indexData->is32bit)
+        memcpy(&indices[0], &indexData->buffer[0], indexData->count * sizeof(uint));
+    else
     {
-        LogError("OgreMeshAsset::DeserializeFromData: header was not followed by M_MESH chunk in " + Name());
-        return false;
+        const u16 *src = reinterpret_cast<const u16*>(&indexData->buffer[0]);
+        for(uint i = 0; i < indexData->count; ++i)
+            indices[i] = src[i];
+    }
+    return indices;
+}
+
+/// Returns whether all indices of @c indexData are below @c numVertices.
+static bool IndicesInRange(const Ogre::IndexData *indexData, uint numVertices)
+{
+    if (!indexData->count)
+        return true;
+    if (indexData->is32bit)
+    {
+        const uint *src = reinterpret_cast<const uint*>(&indexData->buffer[0]);
+        for(uint i = 0; i < indexData->count; ++i)
+            if (src[i] >= numVertices)
+                return false;
+    }
+    else
+    {
+        const u16 *src = reinterpret_cast<const u16*>(&indexData->buffer[0]);
+        for(uint i = 0; i < indexData->count; ++i)
+            if (src[i] >= numVertices)
+                return false;
+    }
+    return true;
+}
+
+static Ogre::IndexData *MakeIndexData(const PODVector<uint> &indices, bool is32bit)
+{
+    Ogre::IndexData *indexData = new Ogre::IndexData();
+    indexData->count = indices.Size();
+    indexData->faceCount = indexData->count / 3;
+    indexData->is32bit = is32bit;
+    indexData->buffer.Resize(indexData->count * indexData->IndexSize());
+    if (!indexData->count)
+        return indexData;
+    if (is32bit)
+        memcpy(&indexData->buffer[0], &indices[0], indexData->count * sizeof(uint));
+    else
+    {
+        u16 *dest = reinterpret_cast<u16*>(&indexData->buffer[0]);
+        for(uint i = 0; i < indexData->count; ++i)
+            dest[i] = static_cast<u16>(indices[i]);
+    }
+    return indexData;
+}
+
+/// Generates up to @c settings.levels LOD levels for the triangle list submeshes of @c mesh by simplifying each level from the previous one.
+/** The levels only index the existing vertices, so they share the vertex buffers of the full detail level.
+    A level is left out if no submesh could be simplified within its error limit. */
+static void GenerateLods(Ogre::Mesh *mesh, const MeshLodSettings &settings)
+{
+    const uint subMeshCount = mesh->NumSubMeshes();
+    const float radius = BoundingRadius(mesh);
+    PODVector<float3> sharedPositions = ReadPositions(mesh->sharedVertexData);
+    Vector<PODVector<float3> > positions(subMeshCount);
+    Vector<PODVector<uint> > indices(subMeshCount);
+    PODVector<float> extents(subMeshCount);
+    for(uint i = 0; i < subMeshCount; ++i)
+    {
+        extents[i] = 0.0f;
+        Ogre::SubMesh *subMesh = mesh->subMeshes[i];
+        if (subMesh->operationType != Ogre::ISubMesh::OT_TRIANGLE_LIST || !subMesh->indexData)
+            continue;
+        positions[i] = subMesh->usesSharedVertexData ? sharedPositions : ReadPositions(subMesh->vertexData);
+        if (!positions[i].Empty())
+        {
+            indices[i] = ReadIndices(subMesh->indexData);
+            extents[i] = Extent(positions[i]);
+        }
+    }
+
+    float distance = settings.distance;
+    for(uint level = 0; level < settings.levels; ++level, distance *= 2.0f)
+    {
+        // Keep the error at the LOD distance, distance * radius, under cLodAngularError.
+        const float maxDistanceError = cLodAngularError * distance * radius;
+        Vector<Ogre::IndexData*> levelData(subMeshCount);
+        bool reduced = false;
+        for(uint i = 0; i < subMeshCount; ++i)
+        {
+            levelData[i] = 0;
+            if (indices[i].Empty() || extents[i] <= 0.0f)
+                continue;
+            // SimplifyMesh takes the error relative to the extents of the submesh vertices.
+            const float maxError = maxDistanceError / extents[i];
+            uint targetIndexCount = static_cast<uint>(indices[i].Size() * settings.reduction) / 3 * 3;
+            PODVector<uint> simplified = SimplifyMesh(positions[i], indices[i], targetIndexCount, maxError);
+            if (simplified.Size() >= indices[i].Size())
+                continue;
+            levelData[i] = MakeIndexData(simplified, mesh->subMeshes[i]->indexData->is32bit);
+            indices[i].Swap(simplified);
+            reduced = true;
+        }
+        if (!reduced)
+            continue;
+
+        for(uint i = 0; i < subMeshCount; ++i)
+            mesh->subMeshes[i]->lodIndexData.Push(levelData[i]);
+        mesh->lodValues.Push(distance * radius);
+    }
+    if (!mesh->lodValues.Empty())
+        mesh->lodStrategy = "distance";
+}
+
+static void WriteLodCache(Urho3D::Serializer &dest, const Ogre::Mesh *mesh)
+{
+    dest.WriteFileID(cLodCacheFileId);
+    dest.WriteUInt(cLodCacheVersion);
+    dest.WriteUInt(mesh->lodValues.Size());
+    for(uint level = 0; level < mesh->lodValues.Size(); ++level)
+        dest.WriteFloat(mesh->lodValues[level]);
+    dest.WriteUInt(mesh->NumSubMeshes());
+    for(uint level = 0; level < mesh->lodValues.Size(); ++level)
+    {
+        for(uint i = 0; i < mesh->NumSubMeshes(); ++i)
+        {
+            const Ogre::IndexData *indexData = mesh->subMeshes[i]->lodIndexData[level];
+            dest.WriteBool(indexData != 0);
+            if (!indexData)
+                continue;
+            dest.WriteBool(indexData->is32bit);
+            dest.WriteUInt(indexData->count);
+            if (!indexData->buffer.Empty())
+                dest.Write(&indexData->buffer[0], indexData->buffer.Size());
+        }
     }
+}
 
-    SharedPtr<Ogre::Mesh> mesh(new Ogre::Mesh());
-    try
+/// Reads LOD levels written by WriteLodCache into @c mesh. Returns false and leaves @c mesh without LOD levels if the data does not match it.
+static bool ReadLodCache(Urho3D::Deserializer &source, Ogre::Mesh *mesh)
+{
+    if (source.ReadFileID() != cLodCacheFileId || source.ReadUInt() != cLodCacheVersion)
+        return false;
+    uint numLevels = source.ReadUInt();
+    for(uint level = 0; level < numLevels && !source.IsEof(); ++level)
+        mesh->lodValues.Push(source.ReadFloat());
+    bool ok = mesh->lodValues.Size() == numLevels && source.ReadUInt() == mesh->NumSubMeshes();
+    for(uint level = 0; level < numLevels && ok; ++level)
     {
-        ReadMesh(buffer, mesh, version);
+        for(uint i = 0; i < mesh->NumSubMeshes() && ok; ++i)
+        {
+            Ogre::SubMesh *subMesh = mesh->subMeshes[i];
+            if (!source.ReadBool())
+            {
+                subMesh->lodIndexData.Push(0);
+                continue;
+            }
+            Ogre::IndexData *indexData = new Ogre::IndexData();
+            subMesh->lodIndexData.Push(indexData);
+            indexData->is32bit = source.ReadBool();
+            indexData->count = source.ReadUInt();
+            indexData->faceCount = indexData->count / 3;
+            // Compare the count instead of the byte size, which could overflow for a corrupt count.
+            const Ogre::VertexData *vertexData = subMesh->usesSharedVertexData ? mesh->sharedVertexData : subMesh->vertexData;
+            ok = vertexData && (!subMesh->indexData || indexData->is32bit == subMesh->indexData->is32bit) &&
+                indexData->count % 3 == 0 && indexData->count <= (source.GetSize() - source.GetPosition()) / indexData->IndexSize();
+            uint numBytes = (ok ? indexData->count * indexData->IndexSize() : 0);
+            if (ok && numBytes)
+            {
+                indexData->buffer.Resize(numBytes);
+                ok = source.Read(&indexData->buffer[0], numBytes) == numBytes && IndicesInRange(indexData, vertexData->count);
+            }
+        }
     }
-    catch (std::exception& e)
+    if (!ok)
     {
-        LogError("OgreMeshAsset::DeserializeFromData: " + String(e.what()));
+        for(uint i = 0; i < mesh->NumSubMeshes(); ++i)
+        {
+            Ogre::SubMesh *subMesh = mesh->subMeshes[i];
+            for(uint level = 0; level < subMesh->lodIndexData.Size(); ++level)
+                delete subMesh->lodIndexData[level];
+            subMesh->lodIndexData.Clear();
+        }
+        mesh->lodValues.Clear();
         return false;
     }
+    if (numLevels)
+        mesh->lodStrategy = "distance";
+    return true;
+}
+
+OgreMeshAsset::OgreMeshAsset(AssetAPI *owner, const String &type_, const String &name_) :
+    IMeshAsset(owner, type_, name_)
+{
+}
+
+/// Parses the Ogre mesh chunks in a worker thread. The Urho model and its GPU buffers are created in Commit.
+/** If the mesh has no LOD levels and LOD generation is enabled, the levels are read from the asset cache,
+    or generated and stored to the cache in Commit. The cache file is read directly, as the AssetCache index
+    may only be accessed in the main thread. */
+class OgreMeshAsset::DecodeJob : public IAssetDecodeJob
+{
+public:
+    DecodeJob(OgreMeshAsset *asset, const u8 *data, uint numBytes, const MeshLodSettings &lodSettings_, const String &lodCacheDirectory_) :
+        IAssetDecodeJob(asset, data, numBytes),
+        context(asset->GetContext()),
+        assetName(asset->Name()),
+        lodSettings(lodSettings_),
+        lodCacheDirectory(lodCacheDirectory_),
+        lodCached(false)
+    {
+    }
+
+    bool Decode() override
+    {
+        Urho3D::MemoryBuffer buffer(&data[0], data.Size());
+
+        u16 id = ReadHeader(buffer, false);
+        if (id != HEADER_CHUNK_ID)
+        {
+            error = "Invalid Ogre Mesh file header";
+            return false;
+        }
+
+        /// @todo Check what we can actually support.
+        String versionStr = ReadLine(buffer);
+        versionStr = versionStr.Substring(versionStr.Find('v') + 1);
+        float version = Urho3D::ToFloat(versionStr);
+
+        id = ReadHeader(buffer);
+        if (id != M_MESH)
+        {
+            error = "Header was not followed by M_MESH chunk";
+            return false;
+        }
+
+        mesh = new Ogre::Mesh();
+        try
+        {
+            ReadMesh(buffer, mesh, version);
+        }
+        catch (std::exception& e)
+        {
+            error = e.what();
+            return false;
+        }
+
+        if (lodSettings.levels > 0 && mesh->lodValues.Empty())
+        {
+            if (!lodCacheDirectory.Empty())
+            {
+                // The generated levels depend on the mesh data and the settings, so key the cache entry with both.
+                u32 hash = HashData(&data[0], data.Size());
+                hash = HashData(&lodSettings, sizeof(lodSettings), hash);
+                lodCacheRef = assetName + ".lod" + String(hash);
+                const String lodCachePath = lodCacheDirectory + AssetAPI::SanitateAssetRef(lodCacheRef);
+                if (context->GetSubsystem<Urho3D::FileSystem>()->FileExists(lodCachePath))
+                {
+                    Urho3D::File file(context, lodCachePath, Urho3D::FILE_READ);
+                    lodCached = file.IsOpen() && ReadLodCache(file, mesh);
+                }
+            }
+            if (!lodCached)
+            {
+                GenerateLods(mesh, lodSettings);
+                Urho3D::VectorBuffer cacheData;
+                WriteLodCache(cacheData, mesh);
+                lodCacheData = cacheData.GetBuffer();
+            }
+        }
+        return true;
+    }
+
+    bool Commit() override
+    {
+        OgreMeshAsset *asset = static_cast<OgreMeshAsset*>(Asset());
+        AssetCache *cache = asset->GetAssetAPI()->Cache();
+        if (!lodCacheRef.Empty() && cache)
+        {
+            if (lodCached)
+                cache->FindInCache(lodCacheRef); // Refresh the access time of the entry
+            else if (!lodCacheData.Empty())
+                cache->StoreAsset(&lodCacheData[0], lodCacheData.Size(), lodCacheRef);
+        }
+        return asset->CreateModel(mesh);
+    }
+
+private:
+    SharedPtr<Ogre::Mesh> mesh;
+    Urho3D::Context *context;
+    String assetName;
+    MeshLodSettings lodSettings;
+    /// Asset cache directory, empty if there is no cache.
+    String lodCacheDirectory;
+    /// Asset cache entry of the generated LOD levels, and whether they were read from it.
+    String lodCacheRef;
+    bool lodCached;
+    /// Generated LOD levels to store in the asset cache.
+    PODVector<u8> lodCacheData;
+};
+
+bool OgreMeshAsset::DeserializeFromData(const u8 *data_, uint numBytes, bool allowAsynchronous)
+{
+    PROFILE(OgreMeshAsset_LoadFromFileInMemory);
+
+    MeshLodSettings lodSettings = ReadMeshLodSettings(assetAPI->GetFramework());
+    String lodCacheDirectory;
+    if (lodSettings.levels > 0 && assetAPI->Cache())
+        lodCacheDirectory = assetAPI->Cache()->CacheDirectory();
+
+    return assetAPI->DecodeAsset(AssetDecodeJobPtr(new DecodeJob(this, data_, numBytes, lodSettings, lodCacheDirectory)), allowAsynchronous);
+}
+
+bool OgreMeshAsset::CreateModel(Ogre::Mesh *mesh)
+{
+    PROFILE(OgreMeshAsset_CreateModel);
+
+    /// Force an unload of previous data first.
+    Unload();
 
     model = new Urho3D::Model(GetContext());
     uint subMeshCount = mesh->NumSubMeshes();
+    PODVector<float> lodDistances = LodDistances(mesh);
     model->SetNumGeometries(subMeshCount);
     Urho3D::BoundingBox bounds;
 
@@ -1210,7 +1639,7 @@ bool OgreMeshAsset::DeserializeFromData(const u8 *data_, uint numBytes, bool /*a
         Ogre::SubMesh* subMesh = mesh->subMeshes[i];
         if (!subMesh->indexData)
         {
-            LogWarning("OgreMeshAsset::DeserializeFromData: missing index data on submesh " + String(i) + " in " + Name());
+            LogWarning("OgreMeshAsset::CreateModel: missing index data on submesh " + String(i) + " in " + Name());
             continue;
         }
 
@@ -1238,8 +1667,30 @@ bool OgreMeshAsset::DeserializeFromData(const u8 *data_, uint numBytes, bool /*a
 
         geom->SetDrawRange(ConvertPrimitiveType(subMesh->operationType), 0, ib->GetIndexCount());
         allBoneMappings.Push(subMesh->usesSharedVertexData ? sharedBoneMapping : submeshBoneMapping);
-        model->SetNumGeometryLodLevels(i, 1);
+        model->SetNumGeometryLodLevels(i, 1 + lodDistances.Size());
         model->SetGeometry(i, 0, geom);
+
+        // The LOD levels share the vertex buffer of the full detail level. A level without own indices reuses the previous ones.
+        SharedPtr<Urho3D::IndexBuffer> lodIb = ib;
+        for (uint level = 0; level < lodDistances.Size(); ++level)
+        {
+            Ogre::IndexData *lodData = level < subMesh->lodIndexData.Size() ? subMesh->lodIndexData[level] : 0;
+            if (lodData)
+            {
+                lodIb = new Urho3D::IndexBuffer(GetContext());
+                lodIb->SetShadowed(true);
+                lodIb->SetSize(lodData->count, lodData->is32bit);
+                if (lodIb->GetIndexCount())
+                    lodIb->SetData(&lodData->buffer[0]);
+                ibs.Push(lodIb);
+            }
+            SharedPtr<Urho3D::Geometry> lodGeom(new Urho3D::Geometry(GetContext()));
+            lodGeom->SetVertexBuffer(0, geom->GetVertexBuffer(0));
+            lodGeom->SetIndexBuffer(lodIb);
+            lodGeom->SetDrawRange(ConvertPrimitiveType(subMesh->operationType), 0, lodIb->GetIndexCount());
+            lodGeom->SetLodDistance(lodDistances[level]);
+            model->SetGeometry(i, level + 1, lodGeom);
+        }
         model->SetGeometryBoneMappings(allBoneMappings);
     }
 
@@ -1286,14 +1737,14 @@ bool OgreMeshAsset::DeserializeFromData(const u8 *data_, uint numBytes, bool /*a
             // Destination vertex buffer index
             if (poseVbMapping.Find(pose->target) == poseVbMapping.End())
             {
-                LogWarning("OgreMeshAsset::DeserializeFromData: found pose referring to unknown vertex buffer target");
+                LogWarning("OgreMeshAsset::CreateModel: found pose referring to unknown vertex buffer target");
                 continue;
             }
             
             uint dest = poseVbMapping[pose->target];
             if (dest >= vbs.Size())
             {
-                LogWarning("OgreMeshAsset::DeserializeFromData: found pose referring to out-of-range vertex buffer target");
+                LogWarning("OgreMeshAsset::CreateModel: found pose referring to out-of-range vertex buffer target");
                 continue;
             }
 
@@ -1347,7 +1798,7 @@ bool OgreMeshAsset::DeserializeFromData(const u8 *data_, uint numBytes, bool /*a
             }
 
             if (hasOutOfRangeVertices)
-                LogWarning("OgreMeshAsset::DeserializeFromData: pose had references to out-of-range vertices. These have been skipped.");
+                LogWarning("OgreMeshAsset::CreateModel: pose had references to out-of-range vertices. These have been skipped.");
             bufferMorph.dataSize_ = morphData.GetSize();
             bufferMorph.vertexCount_ = goodVertices;
             if (bufferMorph.dataSize_)
@@ -1369,8 +1820,6 @@ bool OgreMeshAsset::DeserializeFromData(const u8 *data_, uint numBytes, bool /*a
     // Set the vertex & index buffers so that morph data copying and model saving will work correctly
     model->SetVertexBuffers(vbs, morphRangeStarts, morphRangeCounts);
     model->SetIndexBuffers(ibs);
-
-    assetAPI->AssetLoadCompleted(Name());
     return true;
 }
 
@@ -11,6 +11,9 @@ namespace Tundra
 {
 
 /// Represents a mesh asset loaded from Ogre binary format
+/** Generated LOD levels in the mesh file become geometry LOD levels of the model. Meshes without LOD levels get
+    generated ones with the --meshLodLevels, --meshLodReduction and --meshLodDistance command line parameters,
+    which are stored in the asset cache. */
 class URHO_MODULE_API OgreMeshAsset : public IMeshAsset
 {
     OBJECT(OgreMeshAsset);
@@ -20,6 +23,12 @@ public:
 
     /// Load mesh from memory. IAsset override.
     bool DeserializeFromData(const u8 *data_, uint numBytes, bool allowAsynchronous) override;
+
+private:
+    class DecodeJob;
+
+    /// Creates the Urho model and its GPU buffers from parsed Ogre mesh data, replacing the previous model.
+    bool CreateModel(Ogre::Mesh *mesh);
 };
 
 }
@@ -388,6 +388,8 @@ void Mesh::Reset()
         SAFE_DELETE(poses[i])
     }
     poses.Clear();
+    lodStrategy.Clear();
+    lodValues.Clear();
 }
 
 uint Mesh::NumSubMeshes() const
@@ -430,6 +432,10 @@ void SubMesh::Reset()
 {
     SAFE_DELETE(vertexData)
     SAFE_DELETE(indexData)
+    for(uint i=0, len=lodIndexData.Size(); i<len; ++i) {
+        SAFE_DELETE(lodIndexData[i])
+    }
+    lodIndexData.Clear();
 }
 
 // Animation
@@ -533,6 +533,10 @@ public:
 
     /// Index data.
     IndexData *indexData;
+
+    /// Index data of the LOD levels after the full detail level, see Mesh::lodValues.
+    /** A null entry uses the indices of the previous level. */
+    Vector<IndexData*> lodIndexData;
 };
 typedef Vector<SubMesh*> SubMeshList;
 
@@ -576,6 +580,13 @@ public:
     /// Mesh bounds
     float3 min;
     float3 max;
+
+    /// LOD strategy name, e.g. "distance" or "pixel_count". Empty if the mesh has no LOD levels.
+    String lodStrategy;
+
+    /// Strategy values at which the LOD levels after the full detail level start, see SubMesh::lodIndexData.
+    /** Distances for the distance strategies, and screen-space pixel counts or ratios for the pixel count strategies. */
+    PODVector<float> lodValues;
 };
 
 }
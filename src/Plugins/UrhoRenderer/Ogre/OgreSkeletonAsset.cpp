@@ -7,6 +7,7 @@
 #include "AssetAPI.h"
 #include "UrhoRenderer.h"
 #include "OgreMeshDefines.h"
+#include "IAssetDecodeJob.h"
 #include "Math/float3.h"
 #include "Math/Quat.h"
 
@@ -114,15 +115,15 @@ static void SkipBytes(Urho3D::Deserializer& stream, uint numBytes)
     stream.Seek(stream.GetPosition() + numBytes);
 }
 
-static void ReadSkeleton(Urho3D::Deserializer& stream, Skeleton *skeleton);
+static void ReadSkeleton(Urho3D::Deserializer& stream, Skeleton *skeleton, StringVector &warnings);
 static void ReadBone(Urho3D::Deserializer& stream, Skeleton *skeleton);
-static void ReadBoneParent(Urho3D::Deserializer& stream, Skeleton *skeleton);
+static void ReadBoneParent(Urho3D::Deserializer& stream, Skeleton *skeleton, StringVector &warnings);
 static void ReadSkeletonAnimation(Urho3D::Deserializer& stream, Skeleton *skeleton);
 static void ReadSkeletonAnimationTrack(Urho3D::Deserializer& stream, Skeleton *skeleton, Animation *dest);
 static void ReadSkeletonAnimationKeyFrame(Urho3D::Deserializer& stream, VertexAnimationTrack *dest);
 static void ReadSkeletonAnimationLink(Urho3D::Deserializer& stream, Skeleton *skeleton);
 
-static void ReadSkeleton(Urho3D::Deserializer& stream, Skeleton *skeleton)
+static void ReadSkeleton(Urho3D::Deserializer& stream, Skeleton *skeleton, StringVector &warnings)
 {
     u16 id = ReadHeader(stream, false);
     if (id != HEADER_CHUNK_ID) {
@@ -156,7 +157,7 @@ static void ReadSkeleton(Urho3D::Deserializer& stream, Skeleton *skeleton)
             }
             case SKELETON_BONE_PARENT:
             {
-                ReadBoneParent(stream, skeleton);
+                ReadBoneParent(stream, skeleton, warnings);
                 break;
             }
             case SKELETON_ANIMATION:
@@ -203,7 +204,7 @@ static void ReadBone(Urho3D::Deserializer& stream, Skeleton *skeleton)
     skeleton->bones.Push(bone);
 }
 
-static void ReadBoneParent(Urho3D::Deserializer& stream, Skeleton *skeleton)
+static void ReadBoneParent(Urho3D::Deserializer& stream, Skeleton *skeleton, StringVector &warnings)
 {
     u16 childId = stream.ReadUShort();
     u16 parentId = stream.ReadUShort();
@@ -214,7 +215,7 @@ static void ReadBoneParent(Urho3D::Deserializer& stream, Skeleton *skeleton)
     if (child && parent)
         parent->AddChild(child);
     else
-        LogWarning("Failed to find bones for parenting: Child id " + String(childId) + " for parent id " + String(parentId));
+        warnings.Push("Failed to find bones for parenting: Child id " + String(childId) + " for parent id " + String(parentId));
 }
 
 static void ReadSkeletonAnimation(Urho3D::Deserializer& stream, Skeleton *skeleton)
@@ -308,26 +309,59 @@ OgreSkeletonAsset::~OgreSkeletonAsset()
 {
 }
 
-bool OgreSkeletonAsset::DeserializeFromData(const u8 *data_, uint numBytes, bool /*allowAsynchronous*/)
+/// Parses the Ogre skeleton chunks in a worker thread. The Urho skeleton and animations are created in Commit.
+class OgreSkeletonAsset::DecodeJob : public IAssetDecodeJob
 {
-    PROFILE(OgreSkeletonAsset_LoadFromFileInMemory);
-
-    /// Force an unload of previous data first.
-    Unload();
-
-    Urho3D::MemoryBuffer buffer(data_, numBytes);
+public:
+    DecodeJob(OgreSkeletonAsset *asset, const u8 *data, uint numBytes) :
+        IAssetDecodeJob(asset, data, numBytes)
+    {
+    }
 
-    SharedPtr<Ogre::Skeleton> ogreSkel(new Ogre::Skeleton());
-    try
+    bool Decode() override
     {
-        ReadSkeleton(buffer, ogreSkel);
+        Urho3D::MemoryBuffer buffer(&data[0], data.Size());
+
+        skeleton = new Ogre::Skeleton();
+        try
+        {
+            ReadSkeleton(buffer, skeleton, warnings);
+        }
+        catch (std::exception& e)
+        {
+            error = e.what();
+            return false;
+        }
+        return true;
     }
-    catch (std::exception& e)
+
+    bool Commit() override
     {
-        LogError("OgreSkeletonAsset::DeserializeFromData: " + String(e.what()));
-        return false;
+        // The parser can not log in a worker thread
+        for (uint i = 0; i < warnings.Size(); ++i)
+            LogWarning(warnings[i]);
+        return static_cast<OgreSkeletonAsset*>(Asset())->CreateSkeleton(skeleton);
     }
 
+private:
+    SharedPtr<Ogre::Skeleton> skeleton;
+    StringVector warnings;
+};
+
+bool OgreSkeletonAsset::DeserializeFromData(const u8 *data_, uint numBytes, bool allowAsynchronous)
+{
+    PROFILE(OgreSkeletonAsset_LoadFromFileInMemory);
+
+    return assetAPI->DecodeAsset(AssetDecodeJobPtr(new DecodeJob(this, data_, numBytes)), allowAsynchronous);
+}
+
+bool OgreSkeletonAsset::CreateSkeleton(Ogre::Skeleton *ogreSkel)
+{
+    PROFILE(OgreSkeletonAsset_CreateSkeleton);
+
+    /// Force an unload of previous data first.
+    Unload();
+
     // Fill Urho bone structure
     Vector<Urho3D::Bone>& bones = skeleton.GetModifiableBones();
     bones.Resize(ogreSkel->bones.Size());
@@ -395,7 +429,7 @@ bool OgreSkeletonAsset::DeserializeFromData(const u8 *data_, uint numBytes, bool
             }
             if (!urhoBone)
             {
-                LogWarning("OgreSkeletonAsset::DeserializeFromData: found animation track referring to a non-existent bone " + urhoTrack.name_ + ", skipping");
+                LogWarning("OgreSkeletonAsset::CreateSkeleton: found animation track referring to a non-existent bone " + urhoTrack.name_ + ", skipping");
                 continue;
             }
 
@@ -420,8 +454,6 @@ bool OgreSkeletonAsset::DeserializeFromData(const u8 *data_, uint numBytes, bool
         animations[animName] = urhoAnim;
     }
 
-    // Inform load has finished.
-    assetAPI->AssetLoadCompleted(Name());
     return true;
 }
 
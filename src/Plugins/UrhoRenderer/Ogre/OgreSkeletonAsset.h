@@ -42,6 +42,11 @@ protected:
     void DoUnload() override;
 
 private:
+    class DecodeJob;
+
+    /// Creates the Urho skeleton and animations from parsed Ogre skeleton data, replacing the previous ones.
+    bool CreateSkeleton(Ogre::Skeleton *ogreSkel);
+
     Urho3D::Skeleton skeleton;
     HashMap<String, SharedPtr<Urho3D::Animation> > animations;
 };
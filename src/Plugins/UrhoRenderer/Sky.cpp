@@ -117,7 +117,7 @@ void Sky::AttributesChanged()
         materialAsset_->HandleAssetRefChange(&materialRef);
 
     if (textureRefs.ValueChanged() && textureRefListListener_)
-        textureRefListListener_->HandleChange(textureRefs.Get());
+        textureRefListListener_->HandleChange(textureRefs.Get(), ParentEntity());
 
     if (distance.ValueChanged())
     {
@@ -6,6 +6,7 @@
 #include <Urho3D/Core/Profiler.h>
 #include "LoggingFunctions.h"
 #include "TextureAsset.h"
+#include "IAssetDecodeJob.h"
 
 #include "Crunch/crn_decomp.h"
 #include "Crunch/dds_defs.h"
@@ -31,60 +32,79 @@ TextureAsset::~TextureAsset()
     Unload();
 }
 
-bool TextureAsset::DeserializeFromData(const u8 *data_, uint numBytes, bool /*allowAsynchronous*/)
+/// Decodes the image, decompressing CRN data to DDS first, in a worker thread. The GPU texture is created in Commit.
+class TextureAsset::DecodeJob : public IAssetDecodeJob
 {
-    PROFILE(TextureAsset_LoadFromFileInMemory);
-
-    bool success = false;
-
-    // Delete previous data first
-    Unload();
-    texture = new Urho3D::Texture2D(context_);
-
-    if (!Name().EndsWith(".crn", false))
+public:
+    DecodeJob(TextureAsset *asset, const u8 *data, uint numBytes) :
+        IAssetDecodeJob(asset, data, numBytes),
+        context(asset->GetContext()),
+        crn(asset->Name().EndsWith(".crn", false))
     {
-        Urho3D::MemoryBuffer imageBuffer(data_, numBytes);
-        SharedPtr<Urho3D::Image> image(new Urho3D::Image(context_));
-        success = image->Load(imageBuffer);
-        if (success)
-        {
-            DetermineMipsToSkip(image, texture);
-            success = texture->SetData(image);
-        }
     }
-    else
+
+    bool Decode() override
     {
         Vector<u8> ddsData;
-        success = DecompressCRNtoDDS(data_, numBytes, ddsData);
-        if (success)
+        const u8 *imageData = &data[0];
+        uint imageNumBytes = data.Size();
+        if (crn)
         {
-            Urho3D::MemoryBuffer imageBuffer(&ddsData[0], ddsData.Size());
-            SharedPtr<Urho3D::Image> image(new Urho3D::Image(context_));
-            success = image->Load(imageBuffer);
-            if (success)
-            {
-                DetermineMipsToSkip(image, texture);
-                success = texture->SetData(image);
-            }
+            if (!DecompressCRNtoDDS(&data[0], data.Size(), ddsData, error))
+                return false;
+            imageData = &ddsData[0];
+            imageNumBytes = ddsData.Size();
         }
+
+        Urho3D::MemoryBuffer imageBuffer(imageData, imageNumBytes);
+        image = new Urho3D::Image(context);
+        if (!image->Load(imageBuffer))
+        {
+            error = "Failed to load texture image data";
+            return false;
+        }
+        return true;
     }
 
-    if (success)
+    bool Commit() override
     {
-        // Once data has been loaded, subscribe to device reset events to be able to restore the data if necessary
-        SubscribeToEvent(Urho3D::E_DEVICERESET, HANDLER(TextureAsset, HandleDeviceReset));
-        assetAPI->AssetLoadCompleted(Name());
+        return static_cast<TextureAsset*>(Asset())->CreateTexture(image);
     }
-    else
+
+private:
+    Urho3D::Context *context;
+    SharedPtr<Urho3D::Image> image;
+    bool crn;
+};
+
+bool TextureAsset::DeserializeFromData(const u8 *data_, uint numBytes, bool allowAsynchronous)
+{
+    PROFILE(TextureAsset_LoadFromFileInMemory);
+
+    return assetAPI->DecodeAsset(AssetDecodeJobPtr(new DecodeJob(this, data_, numBytes)), allowAsynchronous);
+}
+
+bool TextureAsset::CreateTexture(Urho3D::Image *image)
+{
+    PROFILE(TextureAsset_CreateTexture);
+
+    // Delete previous data first
+    Unload();
+    texture = new Urho3D::Texture2D(context_);
+
+    DetermineMipsToSkip(image, texture);
+    if (!texture->SetData(image))
     {
-        LogError("TextureAsset::DeserializeFromData: Failed to load texture asset " + Name());
         texture.Reset();
+        return false;
     }
 
-    return success;
+    // Once data has been loaded, subscribe to device reset events to be able to restore the data if necessary
+    SubscribeToEvent(Urho3D::E_DEVICERESET, HANDLER(TextureAsset, HandleDeviceReset));
+    return true;
 }
 
-bool TextureAsset::DecompressCRNtoDDS(const u8 *crnData, uint crnNumBytes, Vector<u8> &ddsData) const
+bool TextureAsset::DecompressCRNtoDDS(const u8 *crnData, uint crnNumBytes, Vector<u8> &ddsData, String &error)
 {
     PROFILE(TextureAsset_DecompressCRNtoDDS);
 
@@ -92,14 +112,14 @@ bool TextureAsset::DecompressCRNtoDDS(const u8 *crnData, uint crnNumBytes, Vecto
     crnd::crn_texture_info textureInfo;
     if (!crnd::crnd_get_texture_info((void*)crnData, (crnd::uint32)crnNumBytes, &textureInfo))
     {
-        LogError("CRN texture info parsing failed, invalid input data.");
+        error = "CRN texture info parsing failed, invalid input data.";
         return false;
     }
     // Begin unpack
     crnd::crnd_unpack_context crnContext = crnd::crnd_unpack_begin((void*)crnData, (crnd::uint32)crnNumBytes);
     if (!crnContext)
     {
-        LogError("CRN texture data unpacking failed, invalid input data.");
+        error = "CRN texture data unpacking failed, invalid input data.";
         return false;
     }
 
@@ -177,7 +197,7 @@ bool TextureAsset::DecompressCRNtoDDS(const u8 *crnData, uint crnNumBytes, Vecto
 
     if (ddsData.Empty())
     {
-        LogError("CRN uncompression failed!");
+        error = "CRN uncompression failed!";
         return false;
     }
     return true;
@@ -216,10 +236,10 @@ size_t TextureAsset::Width() const
 
 void TextureAsset::HandleDeviceReset(StringHash /*eventType*/, VariantMap& /*eventData*/)
 {
-    if (texture && texture->IsDataLost() && DiskSource().Trimmed().Length())
+    if (texture && texture->IsDataLost() && HasReloadSource())
     {
         LogDebug("TextureAsset::HandleDeviceReset: Restoring texture data for " + Name() + " from disk source");
-        LoadFromFile(DiskSource().Trimmed());
+        LoadFromCache();
     }
 }
 
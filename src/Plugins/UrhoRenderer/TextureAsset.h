@@ -42,9 +42,15 @@ protected:
     SharedPtr<Urho3D::Texture2D> texture;
 
 private:
+    class DecodeJob;
+
     void HandleDeviceReset(StringHash eventType, VariantMap& eventData);
 
-    bool DecompressCRNtoDDS(const u8 *crnData, uint crnNumBytes, Vector<u8> &ddsData) const;
+    /// Decompresses CRN data to DDS. Thread-safe, failure is described in @c error.
+    static bool DecompressCRNtoDDS(const u8 *crnData, uint crnNumBytes, Vector<u8> &ddsData, String &error);
+
+    /// Creates the GPU texture from decoded image data, replacing the previous texture.
+    bool CreateTexture(Urho3D::Image *image);
 
     int MaxTextureSize() const;
     void DetermineMipsToSkip(Urho3D::Image* image, Urho3D::Texture2D* texture) const;
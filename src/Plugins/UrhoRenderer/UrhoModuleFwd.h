@@ -32,6 +32,7 @@ namespace Tundra
     class TextureAsset;
     class IOgreMaterialProcessor;
     class IMaterialAsset;
+    class CameraAssetTransferPrioritizer;
 
     typedef SharedPtr<GraphicsWorld> GraphicsWorldPtr;
     typedef WeakPtr<GraphicsWorld> GraphicsWorldWeakPtr;
@@ -41,5 +42,7 @@ namespace Tundra
     namespace Ogre
     {
         class MaterialParser;
+        class Mesh;
+        class Skeleton;
     }
 }
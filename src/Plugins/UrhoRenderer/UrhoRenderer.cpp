@@ -31,6 +31,8 @@
 #include "Ogre/DefaultOgreMaterialProcessor.h"
 #include "Ogre/OgreParticleAsset.h"
 #include "GenericAssetFactory.h"
+#include "DefaultAssetTransferPrioritizer.h"
+#include "CameraAssetTransferPrioritizer.h"
 
 #include <Urho3D/Core/CoreEvents.h>
 #include <Urho3D/Core/ProcessUtils.h>
@@ -97,6 +99,10 @@ void UrhoRenderer::Initialize()
     framework->Scene()->SceneCreated.Connect(this, &UrhoRenderer::CreateGraphicsWorld);
     framework->Scene()->SceneAboutToBeRemoved.Connect(this, &UrhoRenderer::RemoveGraphicsWorld);
 
+    // Load the assets of what the main camera sees first.
+    transferPrioritizer = new CameraAssetTransferPrioritizer(this);
+    framework->Asset()->SetAssetTransferPrioritizer(AssetTransferPrioritizerPtr(transferPrioritizer.Get()));
+
     // Enable the main (full-screen) viewport
     Urho3D::Renderer* rend = GetSubsystem<Urho3D::Renderer>();
     if (rend)
@@ -121,6 +127,9 @@ void UrhoRenderer::Initialize()
 void UrhoRenderer::Uninitialize()
 {
     framework->RegisterRenderer(0);
+    if (transferPrioritizer && framework->Asset()->AssetTransferPrioritizer().Get() == transferPrioritizer.Get())
+        framework->Asset()->SetAssetTransferPrioritizer(AssetTransferPrioritizerPtr(new DefaultAssetTransferPrioritizer()));
+    transferPrioritizer.Reset();
     Urho3D::Renderer* rend = GetSubsystem<Urho3D::Renderer>();
     // Let go of the viewport that we created. If done later at Urho Context destruction time, may cause a crash
     if (rend)
@@ -149,6 +158,11 @@ void UrhoRenderer::HandleScreenModeChange(StringHash /*eventType*/, VariantMap&
     }
 }
 
+CameraAssetTransferPrioritizer* UrhoRenderer::TransferPrioritizer() const
+{
+    return transferPrioritizer;
+}
+
 Entity *UrhoRenderer::MainCamera()
 {
     Entity *mainCameraEntity = activeMainCamera.Get();
@@ -57,6 +57,9 @@ public:
     /// Find an available material processor for a material. Return null if none acceptable.
     IOgreMaterialProcessor* FindOgreMaterialProcessor(const Ogre::MaterialParser& material) const;
 
+    /// Returns the asset transfer prioritizer installed to the Asset API while the renderer is initialized.
+    CameraAssetTransferPrioritizer* TransferPrioritizer() const;
+
 private:
     void Load() override;
     void Initialize() override;
@@ -74,6 +77,9 @@ private:
 
     /// Registered Ogre material processors.
     Vector<SharedPtr<IOgreMaterialProcessor> > materialProcessors;
+
+    /// Prioritizes asset transfers by the main camera.
+    SharedPtr<CameraAssetTransferPrioritizer> transferPrioritizer;
 };
 
 }
@@ -76,8 +76,8 @@ WaterPlane::~WaterPlane()
 
     if (waterPlane_)
     {
-        framework->Frame()->Updated.Disconnect(this, &WaterPlane::Update);
-        
+        // The WaterPlane system drops destroyed instances by itself. Do not touch it here, as that would create it
+        // anew if the frame systems have already been released on shutdown.
         RestoreFog();
         Detach();
     
@@ -121,7 +121,7 @@ void WaterPlane::UpdateSignals()
 
         materialAsset_->Loaded.Connect(this, &WaterPlane::OnMaterialAssetLoaded);
 
-        framework->Frame()->Updated.Connect(this, &WaterPlane::Update);
+        framework->Frame()->ComponentUpdateSystem<WaterPlane>()->Add(this);
     }
 
     // Make sure we attach to the Placeable if exists.
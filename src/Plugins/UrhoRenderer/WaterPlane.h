@@ -10,6 +10,7 @@
 #include "Math/Quat.h"
 #include "AssetReference.h"
 #include "AssetFwd.h"
+#include "FrameworkFwd.h"
 
 namespace Tundra
 {
@@ -161,6 +162,8 @@ private:
     /// Called if parent entity has set.
     void Create();
 
+    /// Updated by the WaterPlane system of FrameAPI.
+    friend class ComponentSystem<WaterPlane>;
     void Update(float frametime);
 
     /// Called when the parent entity has been set.
@@ -12,17 +12,23 @@
 #include "AssetCache.h"
 #include "LoggingFunctions.h"
 
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Core/StringUtils.h>
 #include <Urho3D/IO/FileSystem.h>
 #include <zzip/zzip.h>
+#include <zzip/lib.h>
 
 namespace Tundra
 {
 
 ZipAssetBundle::ZipAssetBundle(AssetAPI *owner, const String &type, const String &name) :
     IAssetBundle(owner, type, name),
-    worker_(0),
     archive_(0),
     fileCount_(-1),
+    inMemory_(false),
+    nextExtract_(0),
+    workersRunning_(0),
     done_(false),
     success_(false)
 {
@@ -35,9 +41,12 @@ ZipAssetBundle::~ZipAssetBundle()
 
 void ZipAssetBundle::DoUnload()
 {
+    StopThreads();
     Close();
-    StopThread();
+    assetAPI_->GetFramework()->Frame()->Updated.Disconnect(this, &ZipAssetBundle::CheckDone);
 
+    files_.Clear();
+    extractOrder_.Clear();
     fileCount_ = -1;
 }
 
@@ -64,18 +73,11 @@ bool ZipAssetBundle::DeserializeFromDiskSource()
     }
 
     /* We want to detect if the extracted files are already up to date to save time.
-       If the last modified date for the sub asset is the same as the parent zip file, 
-       we don't extract it. If the zip is re-downloaded from source everything will get unpacked even
-       if only one file would have changed inside it. We could do uncompressed size comparisons
-       but that is not a absolute guarantee that the file has not changed. We'll be on the safe side
-       to unpack the whole zip file. Zip files are meant for deploying the scene and should be touched
-       rather rarely. Note that local:// refs are unpacked to cache but the zips disk source is not in the
-       cache. Meaning that local:// zip files will always be extracted fully even if the disk source
-       was not changed, we don't have a mechanism to get the last modified date properly except from
-       the asset cache. For local scenes this should be fine as there is no real need to
-       zip the scene up as you already have the disk sources right there in the storage.
-       The last modified query will fail if the file is open with zziplib, do it first. */
-    uint zipLastModified = assetAPI_->Cache()->LastModified(Name());
+       The zip central directory has the CRC32 of each file. It is verified against the extracted
+       data and stored as the ETag of the extracted cache file, and a file is extracted only if
+       the cache file is missing or was extracted from different content. This way only the changed files of a re-downloaded
+       zip get unpacked, and local:// zip files are not extracted fully on every load. */
+    inMemory_ = assetAPI_->GetFramework()->HasCommandLineParameter("--zipInMemory");
 
     const String diskSourceInternal = Urho3D::GetInternalPath(DiskSource());
 
@@ -87,38 +89,44 @@ bool ZipAssetBundle::DeserializeFromDiskSource()
         return false;
     }
     
-    int uncompressing = 0;
+    AssetCache *cache = assetAPI_->Cache();
+    uint uncompressing = 0;
     
     ZZIP_DIRENT archiveEntry;
-    while(zzip_dir_read(archive_, &archiveEntry))
+    for(;;)
     {
+        // ZZIP_DIRENT and ZZIP_STAT carry no CRC32, so it is read from the central directory header that struct zzip_dir
+        // in zzip/lib.h points to. zzip_dir_read advances to the next header, so take the current one first.
+        const struct zzip_dir_hdr *header = archive_->hdr;
+        if (!header || !zzip_dir_read(archive_, &archiveEntry))
+            break;
+
         String relativePath = Urho3D::GetInternalPath(archiveEntry.d_name);
         if (!relativePath.EndsWith("/"))
         {
-            String subAssetRef = GetFullAssetReference(relativePath);
-            
             ZipArchiveFile file;
             file.relativePath = relativePath;
-            file.cachePath = Urho3D::GetInternalPath(assetAPI_->Cache()->DiskSourceByRef(subAssetRef));
-            file.lastModified = assetAPI_->Cache()->LastModified(subAssetRef);
             file.compressedSize = archiveEntry.d_csize;
             file.uncompressedSize = archiveEntry.st_size;
-            
-            /* Mark this file for extraction. If both cache files have valid dates
-               and they differ extract. If they have the same date stamp skip extraction.
-               Note that file.lastModified will be non-valid for non cached files so we 
-               will cover also missing files. */
-            file.doExtract = (zipLastModified > 0 && file.lastModified > 0) ? (zipLastModified != file.lastModified) : true;
-            if (file.doExtract)
-                uncompressing++;
+            file.crc32 = header->d_crc32;
+
+            if (!inMemory_)
+            {
+                String subAssetRef = GetFullAssetReference(relativePath);
+                file.cachePath = Urho3D::GetInternalPath(cache->DiskSourceByRef(subAssetRef));
+                file.doExtract = (cache->ETag(subAssetRef) != ContentTag(file) || !FileSystem()->FileExists(file.cachePath));
+                if (file.doExtract)
+                    uncompressing++;
+            }
 
             files_.Push(file);
             fileCount_++;
         }
     }
     
-    // Close the zzip directory ptr
-    Close();
+    // Keep the archive open if sub assets are read from it, otherwise the workers open it themselves.
+    if (!inMemory_)
+        Close();
     
     // If the zip file was empty we don't want IsLoaded to fail on the files_ check.
     // The bundle loaded fine but there was no content, log a warning.
@@ -130,18 +138,57 @@ bool ZipAssetBundle::DeserializeFromDiskSource()
         return true;
     }
     
-    // Don't spin the worker if all sub assets are up to date in cache.
+    // Don't spin the workers if all sub assets are up to date in cache.
     if (uncompressing > 0)
-    {   
-        // Now that the file info has been read, continue in a worker thread.
-        LogDebug("ZipAssetBundle: File information read for " + Name() + ". File count: " + String(files_.Size()) + ". Starting worker thread to uncompress " + String(uncompressing) + " files.");
-        
-        // ZipWorker is a QRunnable we can pass to QThreadPool, it will handle scheduling it and deletes it when done.
-        worker_ = new ZipWorker(this, zipLastModified, diskSourceInternal, files_);   
-        if (!worker_->Run())
+    {
+        // Hand out the largest files first so that the workers finish at about the same time.
+        extractOrder_.Clear();
+        for(uint i = 0; i < files_.Size(); ++i)
+            if (files_[i].doExtract)
+                extractOrder_.Push(i);
+        ZipFileVector &files = files_;
+        Urho3D::Sort(extractOrder_.Begin(), extractOrder_.End(), [&files](uint a, uint b) {
+            return files[a].uncompressedSize > files[b].uncompressedSize;
+        });
+
+        uint numThreads = Urho3D::GetNumLogicalCPUs();
+        if (numThreads > uncompressing)
+            numThreads = uncompressing;
+        if (numThreads < 1)
+            numThreads = 1;
+
+        // Now that the file info has been read, continue in worker threads.
+        LogDebug("ZipAssetBundle: File information read for " + Name() + ". File count: " + String(files_.Size()) + ". Starting " + String(numThreads) +
+            " worker threads to uncompress " + String(uncompressing) + " files.");
+
+        {
+            Urho3D::MutexLock m(mutexDone_);
+            nextExtract_ = 0;
+            workersRunning_ = numThreads;
+            done_ = false;
+            success_ = true;
+        }
+        for(uint i = 0; i < numThreads; ++i)
+        {
+            ZipWorker *worker = new ZipWorker(this, diskSourceInternal);
+            if (!worker->Run())
+            {
+                LogError("ZipAssetBundle: Failed to start worker thread for " + Name());
+                delete worker;
+                // Let the already started workers finish, they will see the failure and stop early.
+                Urho3D::MutexLock m(mutexDone_);
+                workersRunning_ -= numThreads - i;
+                success_ = false;
+                if (workersRunning_ == 0)
+                    done_ = true;
+                break;
+            }
+            workers_.Push(worker);
+        }
+        if (workers_.Empty())
         {
-            LogError("ZipAssetBundle: Failed to start worker thread for " + Name());
             files_.Clear();
+            extractOrder_.Clear();
             return false;
         }
 
@@ -162,25 +209,76 @@ bool ZipAssetBundle::DeserializeFromData(const u8* /*data*/, uint /*numBytes*/)
 
 Vector<u8> ZipAssetBundle::GetSubAssetData(const String &subAssetName)
 {
-    /* Makes no sense to keep the whole zip file contents in memory as only
-       few files could be wanted from a 100mb bundle. Additionally all asset would take 2x the memory.
-       We could make this function also open the zip file and uncompress the data for every sub asset request. 
-       But that would be rather pointless, not to mention slower, as we already have the unpacked individual 
-       assets on disk. If the unpacking to disk changes we might need to rethink this. */
+    /* By default the whole zip is not kept in memory as only few files could be wanted
+       from a 100mb bundle, and the unpacked individual assets are already on disk.
+       With --zipInMemory the archive is kept open and the sub asset is uncompressed
+       straight to memory, which avoids writing and reading the asset cache altogether. */
+    Vector<u8> data;
+    if (inMemory_)
+        return ReadSubAssetFromArchive(subAssetName, data) ? data : Vector<u8>();
 
     String filePath = GetSubAssetDiskSource(subAssetName);
     if (filePath.Empty())
         return Vector<u8>();
 
-    Vector<u8> data;
     return LoadFileToVector(filePath, data) ? data : Vector<u8>();
 }
 
 String ZipAssetBundle::GetSubAssetDiskSource(const String &subAssetName)
 {
+    // Sub assets that are served from memory have no disk source. They are reloaded from
+    // this bundle, see IAsset::LoadFromCache.
+    if (inMemory_)
+        return "";
     return assetAPI_->Cache()->FindInCache(GetFullAssetReference(subAssetName));
 }
 
+bool ZipAssetBundle::ReadSubAssetFromArchive(const String &subAssetName, Vector<u8> &data)
+{
+    if (!archive_)
+        return false;
+
+    const ZipArchiveFile *archiveFile = 0;
+    foreach(const ZipArchiveFile &file, files_)
+    {
+        if (file.relativePath.Compare(subAssetName, false) == 0)
+        {
+            archiveFile = &file;
+            break;
+        }
+    }
+    if (!archiveFile)
+        return false;
+    const uint size = archiveFile->uncompressedSize;
+
+    ZZIP_FILE *zzipFile = zzip_file_open(archive_, subAssetName.CString(), ZZIP_ONLYZIP | ZZIP_CASELESS);
+    if (!zzipFile || CheckAndLogArchiveError(archive_))
+        return false;
+
+    // The uncompressed size is known from the central directory, read it with one call.
+    data.Resize(size);
+    zzip_ssize_t read = (size > 0 ? zzip_read(zzipFile, &data[0], size) : 0);
+    zzip_file_close(zzipFile);
+    if (read < 0 || (uint)read != size)
+    {
+        LogError("ZipAssetBundle: Failed to uncompress " + subAssetName + " from " + Name());
+        data.Clear();
+        return false;
+    }
+    if (UpdateCrc32(0, size > 0 ? &data[0] : 0, size) != archiveFile->crc32)
+    {
+        LogError("ZipAssetBundle: CRC32 mismatch in " + subAssetName + " from " + Name() + ", the archive is corrupted.");
+        data.Clear();
+        return false;
+    }
+    return true;
+}
+
+String ZipAssetBundle::ContentTag(const ZipArchiveFile &file)
+{
+    return Urho3D::ToString("zip-crc32:%08x:%u", file.crc32, file.uncompressedSize);
+}
+
 String ZipAssetBundle::GetFullAssetReference(const String &subAssetName)
 {
     return Name() + "#" + subAssetName;
@@ -194,19 +292,46 @@ bool ZipAssetBundle::IsLoaded() const
 void ZipAssetBundle::CheckDone(float /*frametime*/)
 {
     // Invoked in main thread context
+    bool success = false;
     {
         Urho3D::MutexLock m(mutexDone_);
         if (!done_)
             return;
+        success = success_;
+    }
+    StopThreads();
 
-        if (success_)
-            Loaded.Emit(this);
-        else
-            Failed.Emit(this);
+    // Let the asset cache index know of the extracted files, also when extracting some of them failed.
+    // The CRC32 is stored only for completely extracted files, so the rest are extracted again next time.
+    AssetCache *cache = assetAPI_->Cache();
+    if (cache)
+    {
+        foreach(const ZipArchiveFile &file, files_)
+        {
+            if (!file.doExtract)
+                continue;
+            String subAssetRef = GetFullAssetReference(file.relativePath);
+            cache->UpdateEntry(subAssetRef);
+            cache->SetETag(subAssetRef, file.extracted ? ContentTag(file) : String());
+        }
     }
-    StopThread();
 
     assetAPI_->GetFramework()->Frame()->Updated.Disconnect(this, &ZipAssetBundle::CheckDone);
+
+    if (success)
+        Loaded.Emit(this);
+    else
+        Failed.Emit(this);
+}
+
+ZipArchiveFile *ZipAssetBundle::NextFileToExtract()
+{
+    // Invoked in worker thread context
+
+    Urho3D::MutexLock m(mutexDone_);
+    if (!success_ || nextExtract_ >= extractOrder_.Size())
+        return 0;
+    return &files_[extractOrder_[nextExtract_++]];
 }
 
 void ZipAssetBundle::WorkerDone(bool successful)
@@ -214,15 +339,22 @@ void ZipAssetBundle::WorkerDone(bool successful)
     // Invoked in worker thread context
     
     Urho3D::MutexLock m(mutexDone_);
-    done_ = true;
-    success_ = successful;
+    if (!successful)
+        success_ = false;
+    if (workersRunning_ > 0)
+        workersRunning_--;
+    if (workersRunning_ == 0)
+        done_ = true;
 }
 
-void ZipAssetBundle::StopThread()
+void ZipAssetBundle::StopThreads()
 {
-    if (worker_)
-        worker_->Stop();
-    SAFE_DELETE(worker_);
+    foreach(ZipWorker *worker, workers_)
+    {
+        worker->Stop();
+        delete worker;
+    }
+    workers_.Clear();
 }
 
 Urho3D::Context *ZipAssetBundle::Context() const
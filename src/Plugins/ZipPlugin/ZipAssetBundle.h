@@ -43,7 +43,10 @@ public:
     /** Our current zziplib implementation requires disk source for processing.
         So we fail DeserializeFromData and try our best here to.
         This function unpacks the archive content to asset cache to normal cache files
-        and provides the sub asset data via GetSubAssetData and GetSubAssetDiskSource. */
+        and provides the sub asset data via GetSubAssetData and GetSubAssetDiskSource.
+        Only the files whose CRC32 differs from the one stored for the cache file are extracted,
+        using several worker threads. With --zipInMemory nothing is extracted, the archive is kept open
+        and the sub assets are uncompressed to memory on request. */
     bool DeserializeFromDiskSource() override;
 
     /// IAssetBundle override.
@@ -74,16 +77,26 @@ private:
     /// Closes zip file.
     void Close();
 
-    /// Check if worker has completed.
+    /// Check if workers have completed.
     void CheckDone(float frametime);
 
-    /// Handler for asynch loading completion.
+    /// Returns the next file to extract, or null if there is none or extraction has failed.
+    /** Invoked in worker thread context. */
+    ZipArchiveFile *NextFileToExtract();
+
+    /// Handler for asynch loading completion of one worker.
     /** Invoked in worker thread context. */
     void WorkerDone(bool successful);
 
-    /// Stops and destroys thread.
+    /// Stops and destroys threads.
     /** @note Only call in main thread context. */
-    void StopThread();
+    void StopThreads();
+
+    /// Uncompresses a sub asset from the open archive.
+    bool ReadSubAssetFromArchive(const String &subAssetName, Vector<u8> &data);
+
+    /// Returns the cache ETag that identifies the content of @c file.
+    static String ContentTag(const ZipArchiveFile &file);
 
     Urho3D::Context *Context() const;
     Urho3D::FileSystem *FileSystem() const;
@@ -94,14 +107,22 @@ private:
     /// Zip sub assets.
     ZipFileVector files_;
 
-    /// Worker
-    ZipWorker *worker_;
+    /// Workers
+    Vector<ZipWorker*> workers_;
+
+    /// Indexes to files_ of the files to extract, largest first.
+    PODVector<uint> extractOrder_;
 
     /// Count of files inside this zip.
     int fileCount_;
 
-    /// Mutex for polling completion of worker thread.
+    /// If true the sub assets are served from the open archive instead of the asset cache.
+    bool inMemory_;
+
+    /// Mutex for handing out files to the workers and polling their completion.
     Urho3D::Mutex mutexDone_;
+    uint nextExtract_;
+    uint workersRunning_;
     bool done_;
     bool success_;
 };
@@ -48,4 +48,22 @@ static bool CheckAndLogArchiveError(ZZIP_DIR *archive)
     return true;
 }
 
+/// Updates the zip CRC32 @c crc with @c numBytes of @c data. Start with a @c crc of 0.
+/** Uses a 16-entry table, two lookups per byte, which keeps the table constant and needs no initialization. */
+static uint UpdateCrc32(uint crc, const u8 *data, uint numBytes)
+{
+    static const uint table[16] =
+    {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    crc = ~crc;
+    for(uint i = 0; i < numBytes; ++i)
+    {
+        crc = table[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+        crc = table[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+    }
+    return ~crc;
+}
+
 }
@@ -16,12 +16,15 @@ namespace Tundra
     /// @cond PRIVATE
     struct ZipArchiveFile
     {
+        ZipArchiveFile() : compressedSize(0), uncompressedSize(0), crc32(0), doExtract(false), extracted(false) {}
+
         String relativePath;
         String cachePath;
         uint compressedSize;
         uint uncompressedSize;
-        uint lastModified;
+        uint crc32;         ///< CRC32 of the uncompressed data, from the zip central directory.
         bool doExtract;
+        bool extracted;     ///< Set by ZipWorker when the file has been written to cachePath.
     };
     typedef Vector<ZipArchiveFile> ZipFileVector;
     /// @endcond
@@ -10,23 +10,15 @@
 
 #include <Urho3D/IO/File.h>
 #include <Urho3D/IO/FileSystem.h>
-#include <Urho3D/Container/Sort.h>
 
 #include <zzip/zzip.h>
 
 namespace Tundra
 {
 
-bool ArchiveFileSizeCompare(const ZipArchiveFile &f1, const ZipArchiveFile &f2)
-{
-    return (f1.uncompressedSize < f2.uncompressedSize);
-}
-
-ZipWorker::ZipWorker(ZipAssetBundle *owner, uint zipLastModified, const String &diskSource, const ZipFileVector &files) :
+ZipWorker::ZipWorker(ZipAssetBundle *owner, const String &diskSource) :
     owner_(owner),
-    zipLastModified_(zipLastModified),
     diskSource_(diskSource),
-    files_(files),
     archive_(0)
 {
 }
@@ -47,80 +39,94 @@ void ZipWorker::ThreadFunction()
         return;
     }
 
-    Urho3D::FileSystem *fs = owner_->FileSystem();
-    
-    // Sort by size so we can resize the buffer less often.
-    Urho3D::Sort(files_.Begin(), files_.End(), ArchiveFileSizeCompare);
-
-    // Read file contents
+    // The bundle hands out the files largest first, so that the workers finish at about the same time.
     bool success = true;
-    zzip_ssize_t chunkLen = 0;
-    zzip_ssize_t chunkRead = 0;
-    Vector<u8> buffer;
-
-    foreach(const ZipArchiveFile &file, files_)
+    while(shouldRun_)
     {
-        if (!file.doExtract)
-            continue;
-
-        // Open file from zip
-        ZZIP_FILE *zzipFile = zzip_file_open(archive_, file.relativePath.CString(), ZZIP_ONLYZIP | ZZIP_CASELESS);
-        if (!zzipFile || CheckAndLogArchiveError(archive_))
+        ZipArchiveFile *file = owner_->NextFileToExtract();
+        if (!file)
+            break;
+        file->extracted = Extract(*file);
+        if (!file->extracted)
         {
             success = false;
             break;
         }
+    }
 
-        // Create cache file
-        Urho3D::File cacheFile(owner_->Context(), file.cachePath, Urho3D::FILE_WRITE);
-        if (!cacheFile.IsOpen())
-        {
-            LogError("ZipWorker: Failed to open cache file: " + file.cachePath + ". Cannot unzip " + file.relativePath);
-            continue;
-        }
+    // Close the zzip directory ptr
+    Close();
 
-        // Detect file size and adjust buffer (quite naive atm but is a slight speed improvement)
-        if (file.uncompressedSize > 1000*1024)
-            chunkLen = 500*1024;
-        else if (file.uncompressedSize > 500*1024)
-            chunkLen = 250*1024;
-        else if (file.uncompressedSize > 100*1024)
-            chunkLen = 50*1024;
-        else if (file.uncompressedSize > 20*1024)
-            chunkLen = 10*1024;
-        else
-            chunkLen = 5*1024;
-
-        if (buffer.Size() < (uint)chunkLen)
-            buffer.Resize(chunkLen);
-
-        // Read zip file content to cache file
-        while (0 < (chunkRead = zzip_read(zzipFile, &buffer[0], chunkLen)))
-        {
-            if (cacheFile.Write((void*)&buffer[0], (uint)chunkRead) != (uint)chunkRead)
-            {
-                LogError("Failed to write cache file + " + file.cachePath);
-                success = false;
-                break;
-            }
-        }
+    owner_->WorkerDone(success);
+}
 
-        // Close zip and cache file.
+bool ZipWorker::Extract(const ZipArchiveFile &file)
+{
+    // Open file from zip
+    ZZIP_FILE *zzipFile = zzip_file_open(archive_, file.relativePath.CString(), ZZIP_ONLYZIP | ZZIP_CASELESS);
+    if (!zzipFile || CheckAndLogArchiveError(archive_))
+        return false;
+
+    // Create cache file
+    Urho3D::File cacheFile(owner_->Context(), file.cachePath, Urho3D::FILE_WRITE);
+    if (!cacheFile.IsOpen())
+    {
+        LogError("ZipWorker: Failed to open cache file: " + file.cachePath + ". Cannot unzip " + file.relativePath);
         zzip_file_close(zzipFile);
-        cacheFile.Close();
+        return false;
+    }
 
-        if (!success)
+    // Detect file size and adjust buffer (quite naive atm but is a slight speed improvement)
+    zzip_ssize_t chunkLen = 0;
+    if (file.uncompressedSize > 1000*1024)
+        chunkLen = 500*1024;
+    else if (file.uncompressedSize > 500*1024)
+        chunkLen = 250*1024;
+    else if (file.uncompressedSize > 100*1024)
+        chunkLen = 50*1024;
+    else if (file.uncompressedSize > 20*1024)
+        chunkLen = 10*1024;
+    else
+        chunkLen = 5*1024;
+
+    if (buffer_.Size() < (uint)chunkLen)
+        buffer_.Resize(chunkLen);
+
+    // Read zip file content to cache file
+    bool success = true;
+    uint crc = 0;
+    uint size = 0;
+    zzip_ssize_t chunkRead = 0;
+    while (0 < (chunkRead = zzip_read(zzipFile, &buffer_[0], chunkLen)))
+    {
+        if (cacheFile.Write((void*)&buffer_[0], (uint)chunkRead) != (uint)chunkRead)
+        {
+            LogError("Failed to write cache file + " + file.cachePath);
+            success = false;
             break;
-
-        // Update last modified same to the parent zip file.
-        if (success && zipLastModified_ > 0)
-            fs->SetLastModifiedTime(file.cachePath, zipLastModified_);
+        }
+        crc = UpdateCrc32(crc, &buffer_[0], (uint)chunkRead);
+        size += (uint)chunkRead;
+    }
+    if (chunkRead < 0)
+    {
+        LogError("ZipWorker: Failed to uncompress " + file.relativePath);
+        success = false;
     }
 
-    // Close the zzip directory ptr
-    Close();
+    // Close zip and cache file.
+    zzip_file_close(zzipFile);
+    cacheFile.Close();
 
-    owner_->WorkerDone(success);
+    // The cache ETag claims the content matches the CRC32 of the central directory, so verify it.
+    if (success && (crc != file.crc32 || size != file.uncompressedSize))
+    {
+        LogError("ZipWorker: CRC32 or size mismatch in " + file.relativePath + ", the archive is corrupted.");
+        success = false;
+    }
+    if (!success)
+        owner_->FileSystem()->Delete(file.cachePath);
+    return success;
 }
 
 void ZipWorker::Close()
@@ -15,24 +15,28 @@ namespace Tundra
 {
 
 /// Worker thread that unpacks zip file contents.
+/** ZipAssetBundle runs several workers at once. Each worker opens the archive for itself and
+    extracts the files it is handed by the bundle until there are none left. */
 class TUNDRA_ZIP_API ZipWorker : public Urho3D::Thread
 {
 public:
-    ZipWorker(ZipAssetBundle *owner, uint zipLastModified, const String &diskSource, const ZipFileVector &files);
+    ZipWorker(ZipAssetBundle *owner, const String &diskSource);
     ~ZipWorker();
 
     /// Urho3D::Thread override
     void ThreadFunction() override;
-    
+
 private:
+    /// Extracts @c file from the archive to its cache path.
+    bool Extract(const ZipArchiveFile &file);
+
     void Close();
 
     ZipAssetBundle *owner_;
-    
+
     String diskSource_;
-    ZipFileVector files_;
     zzip_dir *archive_;
-    uint zipLastModified_;
+    Vector<u8> buffer_;
 };
 
 }
@@ -14,12 +14,14 @@
 #include "IAssetTypeFactory.h"
 #include "IAssetBundleTypeFactory.h"
 #include "IAssetUploadTransfer.h"
+#include "IAssetDecodeJob.h"
 
 #include "DefaultAssetTransferPrioritizer.h"
 #include "GenericAssetFactory.h"
 #include "NullAssetFactory.h"
 #include "LocalAssetProvider.h"
 #include "AssetCache.h"
+#include "ParsedAssetRef.h"
 
 #include "Framework.h"
 #include "LoggingFunctions.h"
@@ -31,15 +33,82 @@
 #include <Urho3D/IO/FileSystem.h>
 #include <Urho3D/IO/File.h>
 #include <Urho3D/IO/FileWatcher.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/Core/Timer.h>
 
 namespace Tundra
 {
 
+/// Runs the Decode stage of an asset decode job in a worker thread. The work item keeps the job alive until the work queue is done with it.
+struct AssetDecodeWorkItem : public Urho3D::WorkItem
+{
+    AssetDecodeJobPtr job;
+};
+
+/// Reads the file of an asset in a worker thread. The asset is then loaded from the data in the main thread with
+/// IAsset::LoadFromFileInMemory, which may in turn decode it asynchronously. Created by AssetAPI::DecodeAssetFile.
+class AssetFileReadJob : public IAssetDecodeJob
+{
+public:
+    AssetFileReadJob(IAsset *asset, const String &file_) : IAssetDecodeJob(asset, 0, 0), file(file_), context(asset->GetContext()) {}
+
+    bool Decode() override
+    {
+        Urho3D::File source(context);
+        if (!source.Open(file, Urho3D::FILE_READ) || !source.IsOpen())
+        {
+            error = "Failed to open file \"" + file + "\" for reading";
+            return false;
+        }
+        unsigned fileSize = source.GetSize();
+        if (fileSize == 0)
+        {
+            error = "File \"" + file + "\" is empty";
+            return false;
+        }
+        data.Resize(fileSize);
+        if (source.Read(&data[0], fileSize) != fileSize)
+        {
+            error = "Failed to read " + String(fileSize) + " bytes from file \"" + file + "\"";
+            data.Clear();
+            return false;
+        }
+        return true;
+    }
+
+    /// Not used, AssetAPI::FinishAssetDecode loads the asset from the data instead.
+    bool Commit() override { return false; }
+
+    String file;
+
+private:
+    Urho3D::Context *context;
+};
+
+static void DecodeAssetWork(const Urho3D::WorkItem* item, unsigned /*threadIndex*/)
+{
+    IAssetDecodeJob* job = static_cast<IAssetDecodeJob*>(item->start_);
+    // The result would be discarded.
+    if (job->IsCancelled())
+        return;
+    try
+    {
+        job->decoded = job->Decode();
+    }
+    catch(std::exception& e)
+    {
+        job->error = e.what();
+        job->decoded = false;
+    }
+}
+
 AssetAPI::AssetAPI(Framework *framework, bool headless) :
     Object(framework->GetContext()),
     fw(framework),
     isHeadless(headless),
-    assetCache(0)
+    assetCache(0),
+    commitTimeBudget_(5.0f),
+    asyncLoad_(true)
 {
     transferPrioritizer_ = new DefaultAssetTransferPrioritizer();
 
@@ -59,6 +128,11 @@ AssetAPI::AssetAPI(Framework *framework, bool headless) :
         LogWarning("--accept_unknown_local_sources: this format of the command-line parameter is deprecated and support for it will be removed. Use --acceptUnknownLocalSources instead.");
     if (fw->HasCommandLineParameter("--no_async_asset_load"))
         LogWarning("--no_async_asset_load: this format of the command-line parameter is deprecated and support for it will be removed. Use --noAsyncAssetLoad instead.");
+    if (fw->HasCommandLineParameter("--noAsyncAssetLoad") || fw->HasCommandLineParameter("--no_async_asset_load"))
+        asyncLoad_ = false;
+    StringVector budgetParam = fw->CommandLineParameters("--assetCommitBudget");
+    if (budgetParam.Size() > 0)
+        SetAssetCommitTimeBudget(Urho3D::ToFloat(budgetParam.Front()));
     if (fw->HasCommandLineParameter("--clear-asset-cache"))
         LogWarning("--clear-asset-cache: this format of the command-line parameter is deprecated and support for it will be removed. Use --clearAssetCache instead.");
 }
@@ -451,6 +525,23 @@ AssetAPI::AssetRefType AssetAPI::ParseAssetRef(String assetRef, String *outProto
     return refType;
 }
 
+ParsedAssetRefPtr AssetAPI::InternAssetRef(const String &assetRef) const
+{
+    // Limit the memory use for a long-running application that keeps generating new refs.
+    static const uint cMaxInternedRefs = 65536;
+
+    HashMap<String, ParsedAssetRefPtr>::ConstIterator iter = internedRefs_.Find(assetRef);
+    if (iter != internedRefs_.End())
+        return iter->second_;
+
+    PROFILE(AssetAPI_InternAssetRef);
+    if (internedRefs_.Size() >= cMaxInternedRefs)
+        internedRefs_.Clear();
+    ParsedAssetRefPtr parsed(new ParsedAssetRef(assetRef));
+    internedRefs_[assetRef] = parsed;
+    return parsed;
+}
+
 String AssetAPI::ExtractFilenameFromAssetRef(String ref)
 {
     String filename;
@@ -513,6 +604,7 @@ bool AssetAPI::ForgetAsset(AssetPtr asset, bool removeDiskSource)
     // Do an explicit unload of the asset before deletion (the dtor of each asset has to do unload as well, but this handles the cases where
     // some object left a dangling strong ref to an asset).
     asset->Unload();
+    RemoveAssetDependencies(asset->Name());
 
     // Remove any pending transfers for this asset.
     AssetTransferMap::iterator transferIter = FindTransferIterator(asset->Name());
@@ -701,6 +793,11 @@ void AssetAPI::ForgetAllAssets()
     readyTransfers.Clear();
     readySubTransfers.Clear();
 
+    // Drop the asynchronous decodes. The work queue keeps the jobs of the decodes still running alive until they finish.
+    for(uint i = 0; i < decodeItems_.Size(); ++i)
+        static_cast<AssetDecodeWorkItem*>(decodeItems_[i].Get())->job->Cancel();
+    decodeItems_.Clear();
+
     // ForgetBundle removes the bundle it is given to from the assetBundles map, so this loop terminates.
     // All bundle sub assets are unloaded from the assets map below.
     while(!assetBundles.empty())
@@ -714,6 +811,7 @@ void AssetAPI::ForgetAllAssets()
     assets.clear();
    
     // Abort all current transfers.
+    pendingTransfers_.Clear();
     while(!currentTransfers.empty())
     {
         AssetTransferPtr abortTransfer = currentTransfers.begin()->second;
@@ -747,7 +845,8 @@ void AssetAPI::Reset()
     defaultStorage.Reset();
     readyTransfers.Clear();
     readySubTransfers.Clear();
-    assetDependencies.Clear();
+    dependencyGraph_.Clear();
+    internedRefs_.Clear();
     currentUploadTransfers.clear();
     currentTransfers.clear();
     providers.Clear();
@@ -795,8 +894,10 @@ AssetTransferPtr AssetAPI::RequestAsset(String assetRef, String assetType, bool
         return AssetTransferPtr();
 
     // Parse out full reference, main asset ref and sub asset ref.
-    String fullAssetRef, subAssetPart, mainAssetPart;
-    ParseAssetRef(assetRef, 0, 0, 0, 0, 0, 0, 0, &subAssetPart, &fullAssetRef, &mainAssetPart);
+    ParsedAssetRefPtr parsedRef = InternAssetRef(assetRef);
+    const String &fullAssetRef = parsedRef->fullRef;
+    const String &subAssetPart = parsedRef->subAssetName;
+    const String &mainAssetPart = parsedRef->fullRefNoSubAssetName;
     
     // Detect if the requested asset is a sub asset. Replace the lookup ref with the parent bundle reference.
     // Note that bundle handling has its own code paths as we need to load the bundle first before
@@ -1049,8 +1150,9 @@ AssetProviderPtr AssetAPI::ProviderForAssetRef(String assetRef, String assetType
         assetType = ResourceTypeForAssetRef(assetRef.ToLower());
 
     // If the assetRef is by local filename without a reference to a provider or storage, use the default asset storage in the system for this assetRef.
-    String namedStorage;
-    AssetRefType assetRefType = ParseAssetRef(assetRef, 0, &namedStorage);
+    ParsedAssetRefPtr parsedRef = InternAssetRef(assetRef);
+    const String &namedStorage = parsedRef->namedStorage;
+    AssetRefType assetRefType = parsedRef->type;
     if (assetRefType == AssetRefRelativePath)
     {
         AssetStoragePtr defaultStorage = DefaultAssetStorage();
@@ -1087,11 +1189,11 @@ String AssetAPI::ResolveAssetRef(String context, String assetRef) const
         return assetRef; // Use the ref as-is, there's an existing asset to map this string to.
 
     // If the assetRef is by local filename without a reference to a provider or storage, use the default asset storage in the system for this assetRef.
-    String assetPath;
-    String namedStorage;
-    String fullRef;
-    AssetRefType assetRefType = ParseAssetRef(assetRef, 0, &namedStorage, 0, &assetPath, 0, 0, 0, 0, &fullRef);
-    assetRef = fullRef; // The first thing we do is normalize the form of the ref. This means e.g. adding 'http://' in front of refs that look like 'www.server.com/'.
+    ParsedAssetRefPtr parsedRef = InternAssetRef(assetRef);
+    const String &assetPath = parsedRef->pathFilenameSubAssetName;
+    const String &namedStorage = parsedRef->namedStorage;
+    AssetRefType assetRefType = parsedRef->type;
+    assetRef = parsedRef->fullRef; // The first thing we do is normalize the form of the ref. This means e.g. adding 'http://' in front of refs that look like 'www.server.com/'.
     
     switch(assetRefType)
     {
@@ -1111,12 +1213,13 @@ String AssetAPI::ResolveAssetRef(String context, String assetRef) const
             else
             {
                 // Join the context to form a full url, e.g. context: "http://myserver.com/path/myasset.material", ref: "texture.png" returns "http://myserver.com/path/texture.png".
-                String contextPath;
-                String contextNamedStorage;
-                String contextProtocolSpecifier;
-                String contextSubAssetPart;
-                String contextMainPart;
-                AssetRefType contextRefType = ParseAssetRef(context, &contextProtocolSpecifier, &contextNamedStorage, 0, 0, 0, &contextPath, 0, &contextSubAssetPart, 0, &contextMainPart);
+                ParsedAssetRefPtr parsedContext = InternAssetRef(context);
+                const String &contextPath = parsedContext->path;
+                const String &contextNamedStorage = parsedContext->namedStorage;
+                const String &contextProtocolSpecifier = parsedContext->protocol;
+                const String &contextSubAssetPart = parsedContext->subAssetName;
+                const String &contextMainPart = parsedContext->fullRefNoSubAssetName;
+                AssetRefType contextRefType = parsedContext->type;
                 if (contextRefType == AssetRefRelativePath || contextRefType == AssetRefInvalid)
                 {
                     LogError("Asset ref context \"" + contextPath + "\" is a relative path and cannot be used as a context for lookup for ref \"" + assetRef + "\"!");
@@ -1284,6 +1387,7 @@ AssetPtr AssetAPI::CreateNewAsset(String type, String name, AssetStoragePtr stor
 
     // Remember this asset in the global AssetAPI storage.
     assets[name] = asset;
+    asset->Unloaded.Connect(this, &AssetAPI::OnAssetUnloaded);
 
     ///\bug DiskSource and DiskSourceType are not set yet.
     {
@@ -1494,14 +1598,25 @@ void AssetAPI::Update(float frametime)
             else
                 LogErrorF("AssetAPI: IAssetTransferPrioritizer implementation returned incorrect amount of transfers. Returned %d when expecting %d", sorted.Size(), pendingTransfers_.Size());
         }
-        foreach(AssetTransferPtr transfer, pendingTransfers_)
+        // The prioritizer may limit the number of transfers started per frame. The rest are prioritized again on the next frame.
+        const uint maxExecuted = (transferPrioritizer_ ? transferPrioritizer_->MaxTransfersPerFrame() : 0);
+        uint numExecuted = 0;
+        uint numHandled = 0;
+        for(; numHandled < pendingTransfers_.Size() && (maxExecuted == 0 || numExecuted < maxExecuted); ++numHandled)
         {
+            AssetTransferPtr transfer = pendingTransfers_[numHandled];
+            // Skip the transfers that were forgotten while waiting for their turn. They do not count against the limit.
+            AssetTransferMap::const_iterator iter = currentTransfers.find(transfer->source.ref);
+            if (iter == currentTransfers.end() || iter->second != transfer)
+                continue;
+
             if (transfer->provider)
                 transfer->provider->ExecuteTransfer(transfer);
             else
                 LogErrorF("AssetAPI: Cannot execute asset transfer '%s' as it has no provider", transfer->SourceUrl().CString());
+            ++numExecuted;
         }
-        pendingTransfers_.Clear();
+        pendingTransfers_.Erase(0, numHandled);
     }
 
     // Update providers
@@ -1542,6 +1657,13 @@ void AssetAPI::Update(float frametime)
         }
         readySubTransfers.Clear();
     }
+
+    // Commit the assets that have been decoded in the worker threads.
+    if (decodeItems_.Size() > 0)
+        CommitDecodedAssets();
+
+    if (assetCache)
+        assetCache->Update(frametime);
 }
 
 String GuaranteeTrailingSlash(const String &source)
@@ -1664,6 +1786,8 @@ void AssetAPI::AssetTransferCompleted(IAssetTransfer *transfer_)
             String bundleDiskSource = transfer->DiskSource(); // The asset provider may have specified an explicit filename to use as a disk source.
             if (transfer->CachingAllowed() && transfer->rawAssetData.Size() > 0 && assetCache)
                 bundleDiskSource = assetCache->StoreAsset(&transfer->rawAssetData[0], transfer->rawAssetData.Size(), transfer->source.ref);
+            else if (assetCache && bundleDiskSource == assetCache->DiskSourceByRef(transfer->source.ref))
+                assetCache->UpdateEntry(transfer->source.ref, transfer->rawAssetData.Size() > 0 ? &transfer->rawAssetData[0] : 0, transfer->rawAssetData.Size());
             assetBundle->SetDiskSource(bundleDiskSource);
 
             // The bundle has now been downloaded and cached (if allowed by policy).
@@ -1723,6 +1847,9 @@ void AssetAPI::AssetTransferCompleted(IAssetTransfer *transfer_)
         String assetDiskSource = transfer->DiskSource(); // The asset provider may have specified an explicit filename to use as a disk source.
         if (transfer->CachingAllowed() && transfer->rawAssetData.Size() > 0 && assetCache)
             assetDiskSource = assetCache->StoreAsset(&transfer->rawAssetData[0], transfer->rawAssetData.Size(), transfer->source.ref);
+        // The provider wrote the cache file itself, eg. HttpAssetProvider. Let the cache index know of it.
+        else if (assetCache && assetDiskSource == assetCache->DiskSourceByRef(transfer->source.ref))
+            assetCache->UpdateEntry(transfer->source.ref, transfer->rawAssetData.Size() > 0 ? &transfer->rawAssetData[0] : 0, transfer->rawAssetData.Size());
 
         // If disksource is still empty, forcibly look up if the asset exists in the cache now.
         if (assetDiskSource.Empty() && assetCache)
@@ -1741,8 +1868,8 @@ void AssetAPI::AssetTransferCompleted(IAssetTransfer *transfer_)
         const u8 *data = (transfer->rawAssetData.Size() > 0 ? &transfer->rawAssetData[0] : 0);
         if (data)
             success = transfer->asset->LoadFromFileInMemory(data, transfer->rawAssetData.Size());
-        else
-            success = transfer->asset->LoadFromFile(transfer->asset->DiskSource());
+        else // The provider wrote the data only to the disk source, eg. a large HTTP download. Read and decode it in a worker thread.
+            success = transfer->asset->LoadFromFile(transfer->asset->DiskSource(), true);
 
         // If the load from either of in memory data or file data failed, update the internal state.
         // Otherwise the transfer will be left dangling in currentTransfers. For successful loads
@@ -1835,6 +1962,7 @@ void AssetAPI::AssetLoadCompleted(const String assetRef)
 
     if (asset.Get())
     {
+        // Updates the dependency graph and emits Loaded if there are no pending dependencies.
         asset->LoadCompleted();
 
         // Add to watch this path for changed, note this does nothing if the path is already added
@@ -1874,6 +2002,119 @@ void AssetAPI::AssetLoadFailed(const String assetRef)
         LogError("AssetAPI: Asset '" + assetRef + "' load failed, but no corresponding transfer or existing asset is being tracked!");
 }
 
+bool AssetAPI::DecodeAsset(const AssetDecodeJobPtr &job, bool allowAsynchronous)
+{
+    IAsset *asset = job->Asset();
+    if (!asset)
+        return false;
+
+    // A newer load of the same asset supersedes the one in progress.
+    if (asset->pendingDecode)
+        asset->pendingDecode->Cancel();
+    asset->pendingDecode.Reset();
+
+    Urho3D::WorkQueue *workQueue = GetSubsystem<Urho3D::WorkQueue>();
+    if (!allowAsynchronous || !asyncLoad_ || !workQueue)
+    {
+        PROFILE(AssetAPI_DecodeAsset);
+        job->decoded = job->Decode();
+        return FinishAssetDecode(job.Get());
+    }
+
+    SharedPtr<AssetDecodeWorkItem> item(new AssetDecodeWorkItem());
+    item->job = job;
+    item->workFunction_ = DecodeAssetWork;
+    item->start_ = job.Get();
+    // Lowest priority, so that waiting for the per-frame work of other systems does not wait for the decodes.
+    item->priority_ = 0;
+    asset->pendingDecode = job;
+    decodeItems_.Push(item);
+    workQueue->AddWorkItem(item);
+    return true;
+}
+
+void AssetAPI::SetAssetCommitTimeBudget(float milliseconds)
+{
+    commitTimeBudget_ = (milliseconds > 0.0f ? milliseconds : 0.0f);
+}
+
+void AssetAPI::CommitDecodedAssets()
+{
+    PROFILE(AssetAPI_CommitDecodedAssets);
+
+    const long long budgetUSec = (long long)(commitTimeBudget_ * 1000.0f);
+    Urho3D::HiresTimer timer;
+    bool committed = false;
+    for(uint i = 0; i < decodeItems_.Size();)
+    {
+        if (!decodeItems_[i]->completed_)
+        {
+            ++i;
+            continue;
+        }
+        // Always commit at least one asset per frame, so that loading progresses regardless of the budget.
+        if (committed && timer.GetUSec(false) >= budgetUSec)
+            break;
+
+        AssetDecodeJobPtr job = static_cast<AssetDecodeWorkItem*>(decodeItems_[i].Get())->job;
+        decodeItems_.Erase(i);
+
+        // The asset has been destroyed, unloaded or is being loaded again.
+        AssetPtr asset(job->Asset());
+        if (!asset)
+            continue;
+        if (job->IsCancelled())
+        {
+            // Unless the asset has been loaded again, or a newer load is in progress, fail its transfer, which would otherwise never complete.
+            if (!asset->pendingDecode && !asset->IsLoaded())
+            {
+                AssetTransferMap::iterator transferIter = FindTransferIterator(asset->Name());
+                if (transferIter != currentTransfers.end())
+                    AssetTransferFailed(transferIter->second.Get(), "Asset was unloaded before it finished loading.");
+            }
+            continue;
+        }
+        asset->pendingDecode.Reset();
+
+        committed = true;
+        if (!FinishAssetDecode(job.Get()))
+            AssetLoadFailed(asset->Name());
+    }
+}
+
+bool AssetAPI::FinishAssetDecode(IAssetDecodeJob *job)
+{
+    IAsset *asset = job->Asset();
+
+    // The asset file has been read, load the asset from its data. A successful load is completed by the asset.
+    AssetFileReadJob *readJob = dynamic_cast<AssetFileReadJob*>(job);
+    if (readJob)
+    {
+        if (!readJob->decoded)
+        {
+            LogError("AssetAPI: Failed to load asset \"" + asset->Name() + "\" from file: " + readJob->error);
+            return false;
+        }
+        return asset->LoadFromFileInMemory(&readJob->data[0], readJob->data.Size(), true);
+    }
+    bool success = job->decoded && job->Commit();
+    if (!success)
+    {
+        LogError("AssetAPI: Failed to decode asset \"" + asset->Name() + "\"" + (job->error.Empty() ? String() : ": " + job->error));
+        // Do not leave the previous contents in place, as a synchronous load would have replaced them.
+        asset->Unload();
+        return false;
+    }
+
+    AssetLoadCompleted(asset->Name());
+    return true;
+}
+
+bool AssetAPI::DecodeAssetFile(IAsset *asset, const String &filename)
+{
+    return DecodeAsset(AssetDecodeJobPtr(new AssetFileReadJob(asset, filename)), true);
+}
+
 void AssetAPI::AssetBundleLoadCompleted(IAssetBundle *bundle)
 {
     LogDebug("Asset bundle load completed: " + bundle->Name());
@@ -1972,20 +2213,21 @@ void AssetAPI::NotifyAssetDependenciesChanged(AssetPtr asset)
 {
     PROFILE(AssetAPI_NotifyAssetDependenciesChanged);
 
-    /// Delete all old stored asset dependencies for this asset.
-    RemoveAssetDependencies(asset->Name());
-
     Vector<AssetReference> refs = asset->FindReferences();
+    Vector<AssetDependencyGraph::Dependency> dependencies;
+    dependencies.Reserve(refs.Size());
     for(uint i = 0; i < refs.Size(); ++i)
     {
-        // Turn named storage (and default storage) specifiers to absolute specifiers.
-        String ref = refs[i].ref;
-        if (ref.Empty())
+        if (refs[i].ref.Empty())
             continue;
 
-        // Remember this assetref for future lookup.
-        assetDependencies.Push(MakePair(asset->Name(), ref));
+        // We silently ignore this dependency when counting pending dependencies if the asset type in question is disabled.
+        bool disabled = dynamic_cast<NullAssetFactory*>(AssetTypeFactory(ResourceTypeForAssetRef(refs[i])).Get()) != 0;
+        dependencies.Push(MakePair(refs[i].ref, disabled));
     }
+
+    // Replaces all old stored asset dependencies for this asset.
+    dependencyGraph_.SetDependencies(asset->Name(), dependencies);
 }
 
 void AssetAPI::RequestAssetDependencies(AssetPtr asset)
@@ -1994,6 +2236,9 @@ void AssetAPI::RequestAssetDependencies(AssetPtr asset)
     // Make sure we have most up-to-date internal view of the asset dependencies.
     NotifyAssetDependenciesChanged(asset);
 
+    // The dependencies are prioritized like the asset itself, by the entities referring to it now and later.
+    AssetTransferPtr dependentTransfer = PendingTransfer(asset->Name());
+
     Vector<AssetReference> refs = asset->FindReferences();
     for(uint i = 0; i < refs.Size(); ++i)
     {
@@ -2005,7 +2250,9 @@ void AssetAPI::RequestAssetDependencies(AssetPtr asset)
         if (!existing || !existing->IsLoaded())
         {
 //            LogDebug("Asset " + asset->ToString() + " depends on asset " + ref.ref + " (type=\"" + ref.type + "\") which has not been loaded yet. Requesting..");
-            RequestAsset(ref);
+            AssetTransferPtr transfer = RequestAsset(ref);
+            if (transfer && dependentTransfer)
+                dependentTransfer->AddDependency(transfer.Get());
         }
     }
 }
@@ -2013,12 +2260,7 @@ void AssetAPI::RequestAssetDependencies(AssetPtr asset)
 void AssetAPI::RemoveAssetDependencies(String asset)
 {
     PROFILE(AssetAPI_RemoveAssetDependencies);
-    for(uint i = 0; i < assetDependencies.Size(); ++i)
-        if (String::Compare(assetDependencies[i].first_.CString(), asset.CString(), false) == 0)
-        {
-            assetDependencies.Erase(assetDependencies.Begin() + i);
-            --i;
-        }
+    dependencyGraph_.RemoveDependencies(asset);
 }
 
 Vector<AssetPtr> AssetAPI::FindDependents(String dependee)
@@ -2026,14 +2268,12 @@ Vector<AssetPtr> AssetAPI::FindDependents(String dependee)
     PROFILE(AssetAPI_FindDependents);
 
     Vector<AssetPtr> dependents;
-    for(uint i = 0; i < assetDependencies.Size(); ++i)
+    StringVector refs = dependencyGraph_.Dependents(dependee);
+    for(uint i = 0; i < refs.Size(); ++i)
     {
-        if (String::Compare(assetDependencies[i].second_.CString(), dependee.CString(), false) == 0)
-        {
-            AssetMap::iterator iter = assets.find(assetDependencies[i].first_);
-            if (iter != assets.end())
-                dependents.Push(iter->second);
-        }
+        AssetMap::iterator iter = assets.find(refs[i]);
+        if (iter != assets.end())
+            dependents.Push(iter->second);
     }
     return dependents;
 }
@@ -2041,81 +2281,12 @@ Vector<AssetPtr> AssetAPI::FindDependents(String dependee)
 int AssetAPI::NumPendingDependencies(AssetPtr asset) const
 {
     PROFILE(AssetAPI_NumPendingDependencies);
-    int numDependencies = 0;
-
-    Vector<AssetReference> refs = asset->FindReferences();
-    for(uint i = 0; i < refs.Size(); ++i)
-    {
-        String ref = refs[i].ref;
-        if (ref.Empty())
-            continue;
-
-        // We silently ignore this dependency if the asset type in question is disabled.
-        if (dynamic_cast<NullAssetFactory*>(AssetTypeFactory(ResourceTypeForAssetRef(refs[i])).Get()))
-            continue;
-
-        AssetPtr existing = FindAsset(refs[i].ref);
-        if (!existing)
-        {
-            // Not loaded, just mark the single one
-            ++numDependencies;
-        }
-        else
-        {
-            // If asset is empty, count it as an unloaded dependency
-            if (existing->IsEmpty())
-                ++numDependencies;
-            else
-            {
-                if (!existing->IsLoaded())
-                    ++numDependencies;
-                // Ask the dependencies of the dependency, we want all of the asset
-                // down the chain to be loaded before we load the base asset
-                // Note: if the dependency is unloaded, it may or may not be able to tell the dependencies correctly
-                numDependencies += NumPendingDependencies(existing);
-            }
-        }
-    }
-
-    return numDependencies;
+    return asset ? (int)dependencyGraph_.NumPendingDependencies(asset->Name()) : 0;
 }
 
 bool AssetAPI::HasPendingDependencies(AssetPtr asset) const
 {
-    PROFILE(AssetAPI_HasPendingDependencies);
-
-    Vector<AssetReference> refs = asset->FindReferences();
-    for(uint i = 0; i < refs.Size(); ++i)
-    {
-        if (refs[i].ref.Empty())
-            continue;
-
-        // We silently ignore this dependency if the asset type in question is disabled.
-        if (dynamic_cast<NullAssetFactory*>(AssetTypeFactory(ResourceTypeForAssetRef(refs[i])).Get()))
-            continue;
-
-        AssetPtr existing = FindAsset(refs[i].ref);
-        if (!existing) // Not loaded, just mark the single one
-            return true;
-        else
-        {            
-            if (existing->IsEmpty())
-                return true; // If asset is empty, count it as an unloaded dependency
-            else
-            {
-                if (!existing->IsLoaded())
-                    return true;
-                // Ask the dependencies of the dependency, we want all of the asset
-                // down the chain to be loaded before we load the base asset
-                // Note: if the dependency is unloaded, it may or may not be able to tell the dependencies correctly
-                bool dependencyHasDependencies = HasPendingDependencies(existing);
-                if (dependencyHasDependencies)
-                    return true;
-            }
-        }
-    }
-
-    return false;
+    return asset && dependencyGraph_.HasPendingDependencies(asset->Name());
 }
 
 void AssetAPI::HandleAssetDiscovery(const String &assetRef, const String &assetType)
@@ -2221,6 +2392,16 @@ void AssetAPI::OnAssetLoaded(AssetPtr asset)
     }
 }
 
+void AssetAPI::OnAssetUnloaded(IAsset *asset)
+{
+    dependencyGraph_.SetLoaded(asset->Name(), false);
+}
+
+void AssetAPI::NotifyAssetLoadedStateChanged(IAsset *asset)
+{
+    dependencyGraph_.SetLoaded(asset->Name(), asset->IsLoaded());
+}
+
 void AssetAPI::OnAssetDiskSourceChanged(const String &path)
 {
     Urho3D::FileSystem* fileSystem = GetSubsystem<Urho3D::FileSystem>();
@@ -2359,12 +2540,8 @@ String AssetAPI::ResourceTypeForAssetRef(const AssetReference &ref) const
 
 String AssetAPI::ResourceTypeForAssetRef(String assetRef) const
 {
-    String filenameParsed;
-    String subAssetFilename;
-    ParseAssetRef(assetRef, 0, 0, 0, 0, 0, 0, &filenameParsed, &subAssetFilename);
-    if (!subAssetFilename.Empty())
-        filenameParsed = subAssetFilename;
-    String filename = filenameParsed.Trimmed();
+    ParsedAssetRefPtr parsedRef = InternAssetRef(assetRef);
+    String filename = (!parsedRef->subAssetName.Empty() ? parsedRef->subAssetName : parsedRef->filename).Trimmed();
 
     // Query all registered asset factories if they provide this asset type.
     for(uint i=0; i<assetTypeFactories.Size(); ++i)
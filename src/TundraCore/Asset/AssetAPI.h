@@ -10,11 +10,13 @@
 #include "IAssetTypeFactory.h"
 #include "IAssetTransfer.h"
 #include "IAssetBundle.h"
+#include "AssetDependencyGraph.h"
 #include "CoreStringUtils.h"
 #include "Signals.h"
 
 #include <Urho3D/Core/Object.h>
 #include <map>
+#include <unordered_map>
 #include <string>
 
 namespace Tundra
@@ -39,11 +41,11 @@ HashMap<String, String> TUNDRACORE_API ParseAssetRefArgs(const String &url, Stri
 /// If an empty string is submitted, and empty string will be output, so that an empty string won't suddenly point to the filesystem root.
 String TUNDRACORE_API GuaranteeTrailingSlash(const String &source);
 
-typedef std::map<String, AssetPtr, StringCompareCaseInsensitive> AssetMap; ///<  Maps asset names to their AssetPtrs.
-typedef std::map<String, AssetTransferPtr, StringCompareCaseInsensitive> AssetTransferMap;
+typedef std::unordered_map<String, AssetPtr, StringHashCaseInsensitive, StringEqualCaseInsensitive> AssetMap; ///<  Maps asset names to their AssetPtrs.
+typedef std::unordered_map<String, AssetTransferPtr, StringHashCaseInsensitive, StringEqualCaseInsensitive> AssetTransferMap;
 typedef Vector<AssetStoragePtr> AssetStorageVector;
-typedef std::map<String, AssetBundlePtr, StringCompareCaseInsensitive> AssetBundleMap; ///<  Maps asset bundle names to their AssetBundlePtrs.
-typedef std::map<String, AssetBundleMonitorPtr, StringCompareCaseInsensitive> AssetBundleMonitorMap;
+typedef std::unordered_map<String, AssetBundlePtr, StringHashCaseInsensitive, StringEqualCaseInsensitive> AssetBundleMap; ///<  Maps asset bundle names to their AssetBundlePtrs.
+typedef std::unordered_map<String, AssetBundleMonitorPtr, StringHashCaseInsensitive, StringEqualCaseInsensitive> AssetBundleMonitorMap;
 
 /// Implements asset download and upload functionality.
 /** Registers LocalAssetProvider and BinaryAssetFactory by default. */
@@ -125,6 +127,30 @@ public:
     /** Typically inside IAsset::DeserializeFromData or later on if it is loading asynchronously. */
     void AssetLoadFailed(const String assetRef);
 
+    /// Decodes asset data with the given job. Called by the IAsset implementations from DeserializeFromData.
+    /** If allowAsynchronous is true and asynchronous asset loading is enabled, IAssetDecodeJob::Decode is run in a worker thread.
+        IAssetDecodeJob::Commit and AssetLoadCompleted (or AssetLoadFailed) follow in the main thread on a later frame, within the
+        per-frame commit time budget. Otherwise the job is run to completion immediately, and AssetLoadCompleted is called on success.
+        @return False if the asset failed to load immediately, true otherwise. Return this from DeserializeFromData. */
+    bool DecodeAsset(const AssetDecodeJobPtr &job, bool allowAsynchronous);
+
+    /// Reads @c filename in a worker thread, and then loads @c asset from the data with IAsset::LoadFromFileInMemory, allowing it
+    /// to be decoded asynchronously too. Called by IAsset::LoadFromFile. Returns false if the asset failed to load immediately.
+    bool DecodeAssetFile(IAsset *asset, const String &filename);
+
+    /// Sets the main thread time in milliseconds that may be spent per frame committing asynchronously decoded assets.
+    /** At least one decoded asset is committed each frame regardless of the budget. */
+    void SetAssetCommitTimeBudget(float milliseconds);
+
+    /// Returns the per-frame asset commit time budget in milliseconds. @see SetAssetCommitTimeBudget
+    float AssetCommitTimeBudget() const { return commitTimeBudget_; }
+
+    /// Returns true if assets are decoded in worker threads. Disabled with the --noAsyncAssetLoad command line parameter.
+    bool IsAsynchronousLoadEnabled() const { return asyncLoad_; }
+
+    /// Returns the number of asynchronous asset decodes that have not been committed yet.
+    uint NumPendingAssetDecodes() const { return decodeItems_.Size(); }
+
     /// Called by each AssetProvider to notify the Asset API that an asset upload transfer has completed. Do not call this function from client code.
     void AssetUploadTransferCompleted(IAssetUploadTransfer *transfer);
 
@@ -132,9 +158,12 @@ public:
 
     void NotifyAssetDependenciesChanged(AssetPtr asset);
 
+    /// Updates whether @c asset is loaded in the dependency graph. Called by IAsset::LoadCompleted.
+    void NotifyAssetLoadedStateChanged(IAsset *asset);
+
     bool IsHeadless() const { return isHeadless; }
 
-    /// Returns all the currently loaded assets which depend on the asset dependeeAssetRef.
+    /// Returns all the currently loaded assets which depend directly on the asset dependeeAssetRef.
     Vector<AssetPtr> FindDependents(String dependeeAssetRef);
 
     /// Specifies the different possible results for AssetAPI::ResolveLocalAssetPath.
@@ -177,6 +206,12 @@ public:
         String *outPath_Filename_SubAssetName = 0, String *outPath_Filename = 0, String *outPath = 0, String *outFilename = 0, String *outSubAssetName = 0,
         String *outFullRef = 0, String *outFullRefNoSubAssetName = 0);
 
+    /// Returns the given assetRef parsed into its pieces by ParseAssetRef.
+    /** The parsed refs are kept, so that parsing a ref again is a hash lookup. Prefer this over ParseAssetRef for the refs
+        that are handled repeatedly, e.g. on each request or resolve of the ref.
+        @note Not thread-safe, as the parsed refs are kept unguarded. Call only from the main thread. */
+    ParsedAssetRefPtr InternAssetRef(const String &assetRef) const;
+
     typedef Vector<Pair<String, String> > AssetDependenciesMap;
     
     /// Sanitates an assetref so that it can be used as a filename for caching.
@@ -321,7 +356,8 @@ public:
     static String ExtractFilenameFromAssetRef(String ref);
 
     /// Returns an asset type name of the given assetRef. e.g. "asset.png" -> "Texture".
-    /** The Asset type name is a unique type identifier string each asset type has. */
+    /** The Asset type name is a unique type identifier string each asset type has.
+        @note Call only from the main thread, as the ref is interned, see InternAssetRef. */
     String ResourceTypeForAssetRef(String assetRef) const;
     String ResourceTypeForAssetRef(const AssetReference &ref) const; /**< @overload */
 
@@ -329,7 +365,8 @@ public:
     /** For example: context: "local://myasset.material", ref: "texture.png" returns "local://texture.png".
         context: "http://myserver.com/path/myasset.material", ref: "texture.png" returns "http://myserver.com/path/texture.png".
         The context string may be left empty, in which case the current default storage (DefaultAssetStorage) is used as the context.
-        If ref is an absolute asset reference, it is returned unmodified (no need for context). */
+        If ref is an absolute asset reference, it is returned unmodified (no need for context).
+        @note Call only from the main thread, as the refs are interned, see InternAssetRef. */
     String ResolveAssetRef(String context, String ref) const;
 
     /// Given an assetRef, turns it into a native OS file path to the asset.
@@ -412,12 +449,14 @@ public:
     /// Starts an asset transfer for each dependency the given asset has.
     void RequestAssetDependencies(AssetPtr transfer);
 
-    /// A utility function that counts the number of dependencies the given asset has to other assets that have not been loaded in.
+    /// A utility function that counts the number of direct and indirect dependencies the given asset has to other assets that have not been loaded in.
+    /** Each dependency is counted once, even if several assets in the dependency chain refer to it. */
     int NumPendingDependencies(AssetPtr asset) const;
 
     /// A utility function that returns true if the given asset still has some unloaded dependencies left to process.
     /// @note For performance reasons, calling this function is highly advisable instead of calling NumPendingDependencies, if it is only
-    ///       desirable to known whether the asset has any pending dependencies or not.
+    ///       desirable to known whether the asset has any pending dependencies or not. This is a constant time lookup from the
+    ///       dependency graph, whereas NumPendingDependencies walks all the dependencies of the asset.
     bool HasPendingDependencies(AssetPtr asset) const;
 
     /// Handle discovery of a new asset through the AssetDiscovery network message
@@ -438,8 +477,8 @@ public:
     /// A utility function that counts the number of current asset transfers.
     size_t NumCurrentTransfers() const { return currentTransfers.size(); }
     
-    /// Return the current asset dependency map (debugging)
-    const AssetDependenciesMap& DebugGetAssetDependencies() const { return assetDependencies; }
+    /// Return the current asset dependencies as (dependent, dependency) pairs (debugging)
+    AssetDependenciesMap DebugGetAssetDependencies() const { return dependencyGraph_.Edges(); }
     
     /// Return ready asset transfers (debugging)
     const Vector<AssetTransferPtr>& DebugGetReadyTransfers() const { return readyTransfers; }
@@ -482,6 +521,9 @@ private:
     /// The Asset API listens on each asset when they get loaded, to track the completion of the dependencies of other loaded assets.
     void OnAssetLoaded(AssetPtr asset);
 
+    /// Marks the asset unloaded in the dependency graph.
+    void OnAssetUnloaded(IAsset *asset);
+
     /// The Asset API reloads all assets from file when their disk source contents change.
     void OnAssetDiskSourceChanged(const String &path);
 
@@ -494,6 +536,12 @@ private:
     /// Listens to the IAssetBundle Failed signal.
     void AssetBundleLoadFailed(IAssetBundle *bundle);
 
+    /// Commits the asynchronously decoded assets within the per-frame time budget.
+    void CommitDecodedAssets();
+
+    /// Commits a decoded job to its asset and signals AssetLoadCompleted. Returns false on failure, after unloading the asset.
+    bool FinishAssetDecode(IAssetDecodeJob *job);
+
 private:
     AssetTransferMap::iterator FindTransferIterator(String assetRef);
     AssetTransferMap::const_iterator FindTransferIterator(String assetRef) const;
@@ -506,7 +554,7 @@ private:
         Deletes the asset cache and the disk watcher. Called by Framework. */
     void Reset();
 
-    /// Removes from AssetDependenciesMap all dependencies the given asset has.
+    /// Removes from the dependency graph all dependencies the given asset has.
     void RemoveAssetDependencies(String asset);
 
     /// Handle discovery of a new asset, when the storage is already known. This is used internally for optimization, so that providers don't need to be queried
@@ -535,13 +583,12 @@ private:
     /// Stores all the currently ongoing asset bundle monitors.
     AssetBundleMonitorMap bundleMonitors;
 
-    typedef std::map<String, AssetUploadTransferPtr, StringCompareCaseInsensitive> AssetUploadTransferMap;
+    typedef std::unordered_map<String, AssetUploadTransferPtr, StringHashCaseInsensitive, StringEqualCaseInsensitive> AssetUploadTransferMap;
     /// Stores all the currently ongoing asset uploads, maps full assetRefs to the asset upload transfer structures.
     AssetUploadTransferMap currentUploadTransfers;
 
-    /// Keeps track of all the dependencies each asset has to each other asset.
-    /// \todo Find a more effective data structure for this. Needs something like boost::bimap but for multi-indices.
-    AssetDependenciesMap assetDependencies;
+    /// Keeps track of all the dependencies each asset has to each other asset, and which assets have pending dependencies.
+    AssetDependencyGraph dependencyGraph_;
 
     /// Stores a list of asset requests to assets that have already been downloaded into the system. These requests don't go to the asset providers
     /// to process, but are internally filled by the Asset API. This member vector is needed to be able to delay the requests and virtual completions
@@ -571,18 +618,30 @@ private:
         String assetType;
         AssetTransferPtr transfer;
     };
-    typedef std::map<String, PendingDownloadRequest, StringCompareCaseInsensitive> PendingDownloadRequestMap;
+    typedef std::unordered_map<String, PendingDownloadRequest, StringHashCaseInsensitive, StringEqualCaseInsensitive> PendingDownloadRequestMap;
     PendingDownloadRequestMap pendingDownloadRequests;
 
     /// Stores all the already loaded assets in the system.
     AssetMap assets;
 
+    /// The refs parsed by InternAssetRef, keyed by the ref as given. Accessed only from the main thread.
+    mutable HashMap<String, ParsedAssetRefPtr> internedRefs_;
+
     /// Stores all the already loaded asset bundles in the system.
     AssetBundleMap assetBundles;
 
     /// Specifies all the registered asset providers in the system.
     Vector<AssetProviderPtr> providers;
 
+    /// Asynchronous asset decodes in the order they were started. Owned here until the worker has finished and the result is committed.
+    Vector<SharedPtr<Urho3D::WorkItem> > decodeItems_;
+
+    /// Main thread time in milliseconds that may be spent committing decoded assets per frame.
+    float commitTimeBudget_;
+
+    /// Whether DecodeAsset may run the decoding in worker threads.
+    bool asyncLoad_;
+
     Framework *fw;
     SharedPtr<AssetCache> assetCache;
 };
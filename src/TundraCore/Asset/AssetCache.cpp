@@ -10,15 +10,59 @@
 #include "Framework.h"
 #include "LoggingFunctions.h"
 
+#include <Urho3D/Core/Profiler.h>
 #include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/Container/HashSet.h>
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Core/StringUtils.h>
+
+#include <ctime>
 
 namespace Tundra
 {
 
+/// Name of the index file in the cache directory.
+static const char *cIndexFilename = "assetcache.idx";
+static const char *cIndexFileId = "TACI";
+static const uint cIndexFileVersion = 1;
+/// Minimum interval in seconds between writes of a changed index, so that the changes survive an unclean shutdown.
+static const float cIndexSaveInterval = 30.0f;
+
+/// 32-bit FNV-1a hash of the data. Never returns 0, which denotes an unknown hash.
+static u32 HashData(const u8 *data, uint numBytes)
+{
+    u32 hash = 2166136261U;
+    for(uint i = 0; i < numBytes; ++i)
+        hash = (hash ^ data[i]) * 16777619U;
+    return hash != 0 ? hash : 1;
+}
+
+static unsigned CurrentTime()
+{
+    return (unsigned)time(0);
+}
+
+/// Cache file name and its last access time, for sorting the entries for eviction.
+struct CacheAccess
+{
+    String filename;
+    unsigned lastAccess;
+};
+
+static bool CmpCacheAccess(const CacheAccess &a, const CacheAccess &b)
+{
+    return a.lastAccess < b.lastAccess;
+}
+
 AssetCache::AssetCache(AssetAPI *owner, String assetCacheDirectory) : 
     Object(owner->GetContext()),
     assetAPI(owner),
-    cacheDirectory(GuaranteeTrailingSlash(Urho3D::GetInternalPath(assetCacheDirectory)))
+    cacheDirectory(GuaranteeTrailingSlash(Urho3D::GetInternalPath(assetCacheDirectory))),
+    totalSize(0),
+    maxSize(0),
+    indexDirty(false),
+    timeSinceSave(0.0f)
 {
     Urho3D::FileSystem* fileSystem = GetSubsystem<Urho3D::FileSystem>();
     if (!Urho3D::IsAbsolutePath(cacheDirectory))
@@ -28,6 +72,12 @@ AssetCache::AssetCache(AssetAPI *owner, String assetCacheDirectory) :
     if (!fileSystem->DirExists(cacheDirectory))
         fileSystem->CreateDir(cacheDirectory);
 
+    StringVector sizeParam = owner->GetFramework()->CommandLineParameters("--assetCacheSize");
+    if (sizeParam.Size() > 0)
+        maxSize = (u64)Urho3D::ToUInt(sizeParam.Front()) * 1024 * 1024;
+
+    LoadIndex();
+
     // Check --clearAssetCache start param
     if (owner->GetFramework()->HasCommandLineParameter("--clearAssetCache") ||
         owner->GetFramework()->HasCommandLineParameter("--clear-asset-cache")) /**< @todo Remove support for the deprecated parameter version at some point. */
@@ -35,16 +85,31 @@ AssetCache::AssetCache(AssetAPI *owner, String assetCacheDirectory) :
         LogInfo("AssetCache: Removing all data and metadata files from cache, found 'clearAssetCache' from the startup params!");
         ClearAssetCache();
     }
+    else if (maxSize > 0)
+        Evict("");
+}
+
+AssetCache::~AssetCache()
+{
+    SaveIndex();
+}
+
+void AssetCache::Update(float frametime)
+{
+    timeSinceSave += frametime;
+    if (indexDirty && timeSinceSave >= cIndexSaveInterval)
+        SaveIndex();
 }
 
 String AssetCache::FindInCache(const String &assetRef)
 {
-    Urho3D::FileSystem* fileSystem = GetSubsystem<Urho3D::FileSystem>();
-    String absolutePath = DiskSourceByRef(assetRef);
-    if (fileSystem->FileExists(absolutePath))
-        return absolutePath;
-    else // The file is not in cache, return an empty string to denote that.
+    Entry *entry = FindEntry(assetRef);
+    if (!entry) // The file is not in cache, return an empty string to denote that.
         return "";
+
+    entry->lastAccess = CurrentTime();
+    indexDirty = true;
+    return DiskSourceByRef(assetRef);
 }
 
 String AssetCache::DiskSourceByRef(const String &assetRef)
@@ -71,34 +136,42 @@ String AssetCache::StoreAsset(const u8 *data, uint numBytes, const String &asset
     String absolutePath = DiskSourceByRef(assetName);
     bool success = SaveAssetFromMemoryToFile(data, numBytes, absolutePath);
     if (success)
+    {
+        String filename = AssetAPI::SanitateAssetRef(assetName);
+        SetEntry(filename, numBytes, GetSubsystem<Urho3D::FileSystem>()->GetLastModifiedTime(absolutePath), HashData(data, numBytes));
+        Evict(filename);
         return absolutePath;
+    }
     return "";
 }
 
 unsigned AssetCache::LastModified(const String &assetRef)
 {
-    Urho3D::FileSystem* fileSystem = GetSubsystem<Urho3D::FileSystem>();
-    String absolutePath = FindInCache(assetRef);
-    if (absolutePath.Empty())
-        return 0;
-    return fileSystem->GetLastModifiedTime(absolutePath);
+    const Entry *entry = FindEntry(assetRef);
+    return entry ? entry->lastModified : 0;
 }
 
 bool AssetCache::SetLastModified(const String & assetRef, unsigned dateTime)
 {
+    Entry *entry = FindEntry(assetRef);
+    if (!entry)
+        return false;
     Urho3D::FileSystem* fileSystem = GetSubsystem<Urho3D::FileSystem>();
-    String absolutePath = FindInCache(assetRef);
-    if (absolutePath.Empty())
+    if (!fileSystem->SetLastModifiedTime(DiskSourceByRef(assetRef), dateTime))
         return false;
-    return fileSystem->SetLastModifiedTime(absolutePath, dateTime);
+    entry->lastModified = dateTime;
+    indexDirty = true;
+    return true;
 }
 
 void AssetCache::DeleteAsset(const String &assetRef)
 {
     String absolutePath = DiskSourceByRef(assetRef);
     Urho3D::FileSystem* fileSystem = GetSubsystem<Urho3D::FileSystem>();
+    // The file may have been written without an index entry yet, so check the disk as well.
     if (fileSystem->FileExists(absolutePath))
         fileSystem->Delete(absolutePath);
+    RemoveEntry(AssetAPI::SanitateAssetRef(assetRef));
 }
 
 void AssetCache::ClearAssetCache()
@@ -108,6 +181,244 @@ void AssetCache::ClearAssetCache()
     fileSystem->ScanDir(filenames, cacheDirectory, "*.*", Urho3D::SCAN_FILES, true);
     foreach(String file, filenames)
         fileSystem->Delete(cacheDirectory + file);
+
+    entries.Clear();
+    totalSize = 0;
+    indexDirty = true;
+}
+
+void AssetCache::UpdateEntry(const String &assetRef, const u8 *data, uint numBytes)
+{
+    String filename = AssetAPI::SanitateAssetRef(assetRef);
+    String absolutePath = cacheDirectory + filename;
+    Urho3D::FileSystem* fileSystem = GetSubsystem<Urho3D::FileSystem>();
+    if (!fileSystem->FileExists(absolutePath))
+    {
+        RemoveEntry(filename);
+        return;
+    }
+
+    uint size = numBytes;
+    if (!data)
+    {
+        Urho3D::File file(GetContext(), absolutePath, Urho3D::FILE_READ);
+        size = file.IsOpen() ? file.GetSize() : 0;
+    }
+    SetEntry(filename, size, fileSystem->GetLastModifiedTime(absolutePath), data ? HashData(data, numBytes) : 0);
+    Evict(filename);
+}
+
+String AssetCache::ETag(const String &assetRef) const
+{
+    const Entry *entry = FindEntry(assetRef);
+    return entry ? entry->etag : String();
+}
+
+bool AssetCache::SetETag(const String &assetRef, const String &etag)
+{
+    Entry *entry = FindEntry(assetRef);
+    if (!entry)
+        return false;
+    entry->etag = etag;
+    indexDirty = true;
+    return true;
+}
+
+u32 AssetCache::ContentHash(const String &assetRef) const
+{
+    const Entry *entry = FindEntry(assetRef);
+    return entry ? entry->hash : 0;
+}
+
+void AssetCache::SetMaxSize(u64 bytes)
+{
+    maxSize = bytes;
+    Evict("");
+}
+
+AssetCache::Entry *AssetCache::FindEntry(const String &assetRef)
+{
+    HashMap<String, Entry>::Iterator iter = entries.Find(AssetAPI::SanitateAssetRef(assetRef));
+    return iter != entries.End() ? &iter->second_ : 0;
+}
+
+const AssetCache::Entry *AssetCache::FindEntry(const String &assetRef) const
+{
+    HashMap<String, Entry>::ConstIterator iter = entries.Find(AssetAPI::SanitateAssetRef(assetRef));
+    return iter != entries.End() ? &iter->second_ : 0;
+}
+
+AssetCache::Entry &AssetCache::SetEntry(const String &filename, uint size, unsigned lastModified, u32 hash)
+{
+    Entry &entry = entries[filename];
+    totalSize -= entry.size;
+    totalSize += size;
+    entry.size = size;
+    entry.lastModified = lastModified;
+    entry.lastAccess = CurrentTime();
+    entry.hash = hash;
+    indexDirty = true;
+    return entry;
+}
+
+void AssetCache::RemoveEntry(const String &filename)
+{
+    HashMap<String, Entry>::Iterator iter = entries.Find(filename);
+    if (iter == entries.End())
+        return;
+    totalSize -= iter->second_.size;
+    entries.Erase(iter);
+    indexDirty = true;
+}
+
+void AssetCache::Evict(const String &keep)
+{
+    if (maxSize == 0 || totalSize <= maxSize)
+        return;
+
+    PROFILE(AssetCache_Evict);
+
+    // Evict down to 90% of the maximum size, so that the next few stores do not need to evict again.
+    const u64 targetSize = maxSize - maxSize / 10;
+
+    Vector<CacheAccess> candidates;
+    candidates.Reserve(entries.Size());
+    for(HashMap<String, Entry>::ConstIterator iter = entries.Begin(); iter != entries.End(); ++iter)
+    {
+        CacheAccess access;
+        access.filename = iter->first_;
+        access.lastAccess = iter->second_.lastAccess;
+        candidates.Push(access);
+    }
+    Urho3D::Sort(candidates.Begin(), candidates.End(), CmpCacheAccess);
+
+    Urho3D::FileSystem* fileSystem = GetSubsystem<Urho3D::FileSystem>();
+    uint numEvicted = 0;
+    u64 evictedSize = 0;
+    for(uint i = 0; i < candidates.Size() && totalSize > targetSize; ++i)
+    {
+        const String &filename = candidates[i].filename;
+        if (filename == keep)
+            continue;
+        // Keep the disk sources of loaded assets, they are needed for reloading, and the files extracted from loaded bundles,
+        // which the bundles serve their sub assets from.
+        String assetRef = AssetAPI::DesanitateAssetRef(filename);
+        uint subAssetPos = assetRef.Find('#');
+        String bundleRef = (subAssetPos != String::NPOS ? assetRef.Substring(0, subAssetPos) : assetRef);
+        if (assetAPI->FindAsset(assetRef) || assetAPI->FindBundle(bundleRef))
+            continue;
+
+        evictedSize += entries[filename].size;
+        fileSystem->Delete(cacheDirectory + filename);
+        RemoveEntry(filename);
+        ++numEvicted;
+    }
+
+    if (numEvicted > 0)
+        LogDebug("AssetCache: Evicted " + String(numEvicted) + " files, " + String((uint)(evictedSize / 1024)) + " KB, from the cache.");
+}
+
+void AssetCache::LoadIndex()
+{
+    PROFILE(AssetCache_LoadIndex);
+
+    Urho3D::FileSystem* fileSystem = GetSubsystem<Urho3D::FileSystem>();
+
+    // One directory listing tells which of the indexed files still exist.
+    StringVector filenames;
+    fileSystem->ScanDir(filenames, cacheDirectory, "*", Urho3D::SCAN_FILES, false);
+    HashSet<String> existing;
+    foreach(const String &filename, filenames)
+    {
+        if (filename != cIndexFilename && !filename.StartsWith("temporary_"))
+            existing.Insert(filename);
+    }
+
+    entries.Clear();
+    totalSize = 0;
+    indexDirty = false;
+
+    String indexPath = cacheDirectory + cIndexFilename;
+    if (fileSystem->FileExists(indexPath))
+    {
+        Urho3D::File file(GetContext(), indexPath, Urho3D::FILE_READ);
+        if (file.IsOpen() && file.ReadFileID() == cIndexFileId && file.ReadUInt() == cIndexFileVersion)
+        {
+            uint numEntries = file.ReadVLE();
+            for(uint i = 0; i < numEntries && !file.IsEof(); ++i)
+            {
+                String filename = file.ReadString();
+                Entry entry;
+                entry.size = file.ReadUInt();
+                entry.lastModified = file.ReadUInt();
+                entry.lastAccess = file.ReadUInt();
+                entry.hash = file.ReadUInt();
+                entry.etag = file.ReadString();
+                if (existing.Erase(filename))
+                {
+                    // The file may have been changed while we were not running, in which case its hash and entity tag are not valid.
+                    String absolutePath = cacheDirectory + filename;
+                    Urho3D::File cacheFile(GetContext(), absolutePath, Urho3D::FILE_READ);
+                    uint size = cacheFile.IsOpen() ? cacheFile.GetSize() : 0;
+                    unsigned lastModified = fileSystem->GetLastModifiedTime(absolutePath);
+                    if (size != entry.size || lastModified != entry.lastModified)
+                    {
+                        entry.size = size;
+                        entry.lastModified = lastModified;
+                        entry.hash = 0;
+                        entry.etag.Clear();
+                        indexDirty = true;
+                    }
+                    entries[filename] = entry;
+                    totalSize += entry.size;
+                }
+                else
+                    indexDirty = true; // Deleted while we were not running.
+            }
+        }
+        else
+            LogWarning("AssetCache: Ignoring invalid cache index file " + indexPath);
+    }
+
+    // Files that are not in the index, for example because the previous run did not shut down cleanly.
+    for(HashSet<String>::ConstIterator iter = existing.Begin(); iter != existing.End(); ++iter)
+    {
+        String absolutePath = cacheDirectory + *iter;
+        Urho3D::File file(GetContext(), absolutePath, Urho3D::FILE_READ);
+        if (!file.IsOpen())
+            continue;
+        Entry &entry = SetEntry(*iter, file.GetSize(), fileSystem->GetLastModifiedTime(absolutePath), 0);
+        entry.lastAccess = entry.lastModified;
+    }
+}
+
+void AssetCache::SaveIndex()
+{
+    if (!indexDirty)
+        return;
+
+    Urho3D::File file(GetContext(), cacheDirectory + cIndexFilename, Urho3D::FILE_WRITE);
+    if (!file.IsOpen())
+    {
+        LogWarning("AssetCache: Failed to write cache index file " + cacheDirectory + cIndexFilename);
+        return;
+    }
+
+    file.WriteFileID(cIndexFileId);
+    file.WriteUInt(cIndexFileVersion);
+    file.WriteVLE(entries.Size());
+    for(HashMap<String, Entry>::ConstIterator iter = entries.Begin(); iter != entries.End(); ++iter)
+    {
+        const Entry &entry = iter->second_;
+        file.WriteString(iter->first_);
+        file.WriteUInt(entry.size);
+        file.WriteUInt(entry.lastModified);
+        file.WriteUInt(entry.lastAccess);
+        file.WriteUInt(entry.hash);
+        file.WriteString(entry.etag);
+    }
+    indexDirty = false;
+    timeSinceSave = 0.0f;
 }
 
 }
@@ -7,17 +7,23 @@
 #include "AssetFwd.h"
 
 #include <Urho3D/Core/Object.h>
+#include <Urho3D/Container/HashMap.h>
 
 namespace Tundra
 {
 
 /// Implements a disk cache for asset files to avoid re-downloading assets between runs.
+/** The cache keeps an index of the cached files with their size, modification time, HTTP entity tag, last access time
+    and content hash, so that lookups do not touch the file system. The index is saved to the cache directory periodically
+    and on shutdown, and reconciled with the directory contents on startup. If a maximum size is set, the least recently used files are
+    evicted when the cache grows larger than that. */
 class TUNDRACORE_API AssetCache : public Object
 {
     OBJECT(AssetCache);
 
 public:
     explicit AssetCache(AssetAPI *owner, String assetCacheDirectory);
+    ~AssetCache();
 
     /// Returns the absolute path on the local file system that contains a cached copy of the given asset ref.
     /// If the given asset file does not exist in the cache, an empty string is returned.
@@ -61,8 +67,70 @@ public:
     /// Get the cache directory. Returned path is guaranteed to have a trailing slash /.
     /// @return String absolute path to the caches data directory
     String CacheDirectory() const;
-    
+
+    /// Adds or updates the index entry of a file that was written to DiskSourceByRef(assetRef) by someone else than StoreAsset.
+    /** @param data The contents of the file, if known. Used for computing the content hash. */
+    void UpdateEntry(const String &assetRef, const u8 *data = 0, uint numBytes = 0);
+
+    /// Returns the HTTP entity tag stored for the cached asset, or an empty string if there is none.
+    String ETag(const String &assetRef) const;
+
+    /// Stores the HTTP entity tag of the cached asset. Returns false if the asset is not in the cache.
+    bool SetETag(const String &assetRef, const String &etag);
+
+    /// Returns the hash of the cached asset data, or 0 if the asset is not in the cache or the hash is not known.
+    u32 ContentHash(const String &assetRef) const;
+
+    /// Sets the maximum total size of the cached files in bytes. 0 means unlimited.
+    /** The default can be set in megabytes with the --assetCacheSize command-line parameter.
+        Files of assets that are currently loaded are not evicted. */
+    void SetMaxSize(u64 bytes);
+
+    /// Returns the maximum total size of the cached files in bytes, or 0 if unlimited.
+    u64 MaxSize() const { return maxSize; }
+
+    /// Returns the total size of the cached files in bytes.
+    u64 TotalSize() const { return totalSize; }
+
+    /// Returns the number of cached files.
+    uint NumEntries() const { return entries.Size(); }
+
+    /// Writes the index to the cache directory, if it has changed. Called automatically when the cache is destroyed.
+    void SaveIndex();
+
+    /// Writes the changed index every once in a while. Called by AssetAPI each frame.
+    void Update(float frametime);
+
 private:
+    /// Index entry of a cached file.
+    struct Entry
+    {
+        Entry() : size(0), lastModified(0), lastAccess(0), hash(0) {}
+
+        uint size;
+        unsigned lastModified;  ///< Seconds since 1.1.1970.
+        unsigned lastAccess;    ///< Seconds since 1.1.1970.
+        u32 hash;               ///< Hash of the file contents, 0 if not known.
+        String etag;
+    };
+
+    /// Returns the index entry of @c assetRef, or null if the asset is not in the cache.
+    Entry *FindEntry(const String &assetRef);
+    const Entry *FindEntry(const String &assetRef) const;
+
+    /// Adds or replaces the entry of cache file @c filename.
+    Entry &SetEntry(const String &filename, uint size, unsigned lastModified, u32 hash);
+
+    /// Removes the entry of cache file @c filename.
+    void RemoveEntry(const String &filename);
+
+    /// Reads the index, and adds and removes entries to match the files in the cache directory.
+    void LoadIndex();
+
+    /// Deletes least recently used files until the cache fits the maximum size.
+    /** @param keep Cache file that is not deleted. */
+    void Evict(const String &keep);
+
 #ifdef WIN32
     /// Windows specific helper to open a file handle to absolutePath
     void *OpenFileHandle(const String &absolutePath);
@@ -72,6 +140,21 @@ private:
 
     /// AssetAPI ptr.
     AssetAPI *assetAPI;
+
+    /// Index entries, keyed by cache file name.
+    HashMap<String, Entry> entries;
+
+    /// Sum of the file sizes in entries.
+    u64 totalSize;
+
+    /// Maximum total size, 0 if unlimited.
+    u64 maxSize;
+
+    /// Whether entries has changed since the index was last read or written.
+    bool indexDirty;
+
+    /// Seconds since the index was last written.
+    float timeSinceSave;
 };
 
 }
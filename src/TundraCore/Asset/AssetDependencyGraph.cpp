@@ -0,0 +1,274 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "AssetDependencyGraph.h"
+#include "LoggingFunctions.h"
+
+#include <Urho3D/Core/Profiler.h>
+
+namespace Tundra
+{
+
+AssetDependencyGraph::Node *AssetDependencyGraph::FindNode(const String &asset)
+{
+    NodeMap::Iterator iter = nodes_.Find(NodeKey(asset));
+    return iter != nodes_.End() ? &iter->second_ : 0;
+}
+
+const AssetDependencyGraph::Node *AssetDependencyGraph::FindNode(const String &asset) const
+{
+    NodeMap::ConstIterator iter = nodes_.Find(NodeKey(asset));
+    return iter != nodes_.End() ? &iter->second_ : 0;
+}
+
+AssetDependencyGraph::Node &AssetDependencyGraph::GetOrCreateNode(const String &asset, const String &key)
+{
+    NodeMap::Iterator iter = nodes_.Find(key);
+    if (iter != nodes_.End())
+        return iter->second_;
+
+    Node &node = nodes_[key];
+    node.name = asset;
+    return node;
+}
+
+void AssetDependencyGraph::SetDependencies(const String &asset, const Vector<Dependency> &dependencies)
+{
+    PROFILE(AssetDependencyGraph_SetDependencies);
+
+    const String key = NodeKey(asset);
+    // The HashMap nodes stay in place when other nodes are inserted, so the reference remains valid below.
+    Node &node = GetOrCreateNode(asset, key);
+    const bool wasReady = node.Ready();
+
+    StringVector removed;
+    for(HashSet<String>::ConstIterator iter = node.dependencies.Begin(); iter != node.dependencies.End(); ++iter)
+    {
+        NodeMap::Iterator dependency = nodes_.Find(*iter);
+        if (dependency != nodes_.End())
+            dependency->second_.dependents.Erase(key);
+        removed.Push(*iter);
+    }
+    node.dependencies.Clear();
+    node.cyclicDependencies.Clear();
+    node.numPending = 0;
+
+    for(uint i = 0; i < dependencies.Size(); ++i)
+    {
+        const String &ref = dependencies[i].first_;
+        if (ref.Empty())
+            continue;
+        const String dependencyKey = NodeKey(ref);
+        if (dependencyKey == key || node.dependencies.Contains(dependencyKey))
+            continue;
+
+        Node &dependency = GetOrCreateNode(ref, dependencyKey);
+        if (dependency.ignored != dependencies[i].second_)
+        {
+            const bool dependencyWasReady = dependency.Ready();
+            dependency.ignored = dependencies[i].second_;
+            PropagateReadiness(dependency, dependencyWasReady);
+        }
+
+        // Nothing can depend on the asset indirectly if nothing depends on it directly.
+        if (!node.dependents.Empty() && DependsOn(dependencyKey, key))
+        {
+            LogWarning("AssetDependencyGraph: Dependency of " + asset + " on " + ref + " closes a cycle, it is not waited for.");
+            node.cyclicDependencies.Insert(dependencyKey);
+        }
+        node.dependencies.Insert(dependencyKey);
+        dependency.dependents.Insert(key);
+        if (!dependency.Ready() && !node.cyclicDependencies.Contains(dependencyKey))
+            ++node.numPending;
+    }
+
+    PropagateReadiness(node, wasReady);
+
+    for(uint i = 0; i < removed.Size(); ++i)
+        PruneNode(removed[i]);
+    PruneNode(key);
+}
+
+void AssetDependencyGraph::RemoveDependencies(const String &asset)
+{
+    if (FindNode(asset))
+        SetDependencies(asset, Vector<Dependency>());
+}
+
+void AssetDependencyGraph::SetLoaded(const String &asset, bool loaded)
+{
+    const String key = NodeKey(asset);
+    if (!loaded && !nodes_.Contains(key))
+        return;
+
+    Node &node = GetOrCreateNode(asset, key);
+    if (node.loaded == loaded)
+        return;
+
+    const bool wasReady = node.Ready();
+    node.loaded = loaded;
+    PropagateReadiness(node, wasReady);
+
+    if (!loaded)
+        PruneNode(key);
+}
+
+void AssetDependencyGraph::PropagateReadiness(Node &node, bool wasReady)
+{
+    if (node.Ready() == wasReady)
+        return;
+
+    // A change in one direction can only cause changes in the same direction further up, so each node changes at most once.
+    PODVector<Node *> changed;
+    changed.Push(&node);
+    while(changed.Size() > 0)
+    {
+        Node *current = changed.Back();
+        changed.Pop();
+        const bool ready = current->Ready();
+        const String currentKey = NodeKey(current->name);
+
+        for(HashSet<String>::ConstIterator iter = current->dependents.Begin(); iter != current->dependents.End(); ++iter)
+        {
+            NodeMap::Iterator dependentIter = nodes_.Find(*iter);
+            if (dependentIter == nodes_.End())
+                continue;
+
+            Node &dependent = dependentIter->second_;
+            if (dependent.cyclicDependencies.Contains(currentKey))
+                continue;
+            const bool dependentWasReady = dependent.Ready();
+            if (!ready)
+                ++dependent.numPending;
+            else if (dependent.numPending > 0)
+                --dependent.numPending;
+            if (dependent.Ready() != dependentWasReady)
+                changed.Push(&dependent);
+        }
+    }
+}
+
+bool AssetDependencyGraph::DependsOn(const String &from, const String &to) const
+{
+    HashSet<String> visited;
+    StringVector unwalked;
+    unwalked.Push(from);
+    while(unwalked.Size() > 0)
+    {
+        const String current = unwalked.Back();
+        unwalked.Pop();
+        if (current == to)
+            return true;
+        NodeMap::ConstIterator iter = nodes_.Find(current);
+        if (iter == nodes_.End())
+            continue;
+        for(HashSet<String>::ConstIterator dep = iter->second_.dependencies.Begin(); dep != iter->second_.dependencies.End(); ++dep)
+        {
+            if (!visited.Contains(*dep))
+            {
+                visited.Insert(*dep);
+                unwalked.Push(*dep);
+            }
+        }
+    }
+    return false;
+}
+
+void AssetDependencyGraph::PruneNode(const String &key)
+{
+    NodeMap::Iterator iter = nodes_.Find(key);
+    if (iter != nodes_.End() && !iter->second_.loaded && iter->second_.dependencies.Empty() && iter->second_.dependents.Empty())
+        nodes_.Erase(iter);
+}
+
+bool AssetDependencyGraph::HasPendingDependencies(const String &asset) const
+{
+    const Node *node = FindNode(asset);
+    return node && node->numPending > 0;
+}
+
+uint AssetDependencyGraph::NumPendingDependencies(const String &asset) const
+{
+    const Node *node = FindNode(asset);
+    if (!node)
+        return 0;
+
+    uint numPending = 0;
+    HashSet<String> visited;
+    PODVector<const Node *> unwalked;
+    unwalked.Push(node);
+    while(unwalked.Size() > 0)
+    {
+        const Node *current = unwalked.Back();
+        unwalked.Pop();
+        for(HashSet<String>::ConstIterator iter = current->dependencies.Begin(); iter != current->dependencies.End(); ++iter)
+        {
+            if (visited.Contains(*iter))
+                continue;
+            visited.Insert(*iter);
+            NodeMap::ConstIterator dependency = nodes_.Find(*iter);
+            if (dependency == nodes_.End() || dependency->second_.ignored)
+                continue;
+            if (!dependency->second_.loaded)
+                ++numPending;
+            unwalked.Push(&dependency->second_);
+        }
+    }
+    return numPending;
+}
+
+bool AssetDependencyGraph::IsReady(const String &asset) const
+{
+    const Node *node = FindNode(asset);
+    return node && node->Ready();
+}
+
+StringVector AssetDependencyGraph::Dependents(const String &asset) const
+{
+    StringVector dependents;
+    const Node *node = FindNode(asset);
+    if (!node)
+        return dependents;
+
+    for(HashSet<String>::ConstIterator iter = node->dependents.Begin(); iter != node->dependents.End(); ++iter)
+    {
+        NodeMap::ConstIterator dependent = nodes_.Find(*iter);
+        if (dependent != nodes_.End())
+            dependents.Push(dependent->second_.name);
+    }
+    return dependents;
+}
+
+StringVector AssetDependencyGraph::Dependencies(const String &asset) const
+{
+    StringVector dependencies;
+    const Node *node = FindNode(asset);
+    if (!node)
+        return dependencies;
+
+    for(HashSet<String>::ConstIterator iter = node->dependencies.Begin(); iter != node->dependencies.End(); ++iter)
+    {
+        NodeMap::ConstIterator dependency = nodes_.Find(*iter);
+        if (dependency != nodes_.End())
+            dependencies.Push(dependency->second_.name);
+    }
+    return dependencies;
+}
+
+Vector<Pair<String, String> > AssetDependencyGraph::Edges() const
+{
+    Vector<Pair<String, String> > edges;
+    for(NodeMap::ConstIterator iter = nodes_.Begin(); iter != nodes_.End(); ++iter)
+    {
+        const Node &node = iter->second_;
+        for(HashSet<String>::ConstIterator dep = node.dependencies.Begin(); dep != node.dependencies.End(); ++dep)
+        {
+            NodeMap::ConstIterator dependency = nodes_.Find(*dep);
+            if (dependency != nodes_.End())
+                edges.Push(MakePair(node.name, dependency->second_.name));
+        }
+    }
+    return edges;
+}
+
+}
@@ -0,0 +1,103 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraCoreApi.h"
+#include "CoreTypes.h"
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/HashSet.h>
+#include <Urho3D/Container/Pair.h>
+#include <Urho3D/Container/Str.h>
+
+namespace Tundra
+{
+
+/// Bidirectional graph of the dependencies between assets, used by AssetAPI.
+/** The nodes are keyed by the lowercase asset ref, so lookups are case-insensitive like the AssetAPI asset map.
+    The full ref is used rather than its hash, as two refs with colliding hashes must not share a node.
+    A node is ready when its asset is loaded and all of its dependencies are ready. Each node keeps count of its
+    dependencies that are not ready, and the counts are updated incrementally when an asset is loaded or unloaded,
+    or when the dependencies of an asset change. Whether an asset has pending dependencies is then a single lookup.
+
+    A dependency that would close a cycle, i.e. on an asset that already depends on the dependent directly or indirectly,
+    is kept in the graph but never counted as pending, so that the assets of the cycle become ready once they are all
+    loaded. The dependency stays uncounted until the dependencies of its dependent are set again. */
+class TUNDRACORE_API AssetDependencyGraph
+{
+public:
+    /// Asset ref of a dependency, and whether it is ignored, i.e. never pending, for example because its asset type is disabled.
+    typedef Pair<String, bool> Dependency;
+
+    /// Replaces the dependencies of @c asset.
+    void SetDependencies(const String &asset, const Vector<Dependency> &dependencies);
+
+    /// Removes all dependencies of @c asset.
+    void RemoveDependencies(const String &asset);
+
+    /// Sets whether @c asset is loaded.
+    void SetLoaded(const String &asset, bool loaded);
+
+    /// Returns whether a dependency of @c asset, or any of their dependencies, is not loaded.
+    bool HasPendingDependencies(const String &asset) const;
+
+    /// Returns the number of direct and indirect dependencies of @c asset that are not loaded. Each dependency is counted once.
+    uint NumPendingDependencies(const String &asset) const;
+
+    /// Returns whether @c asset is loaded and has no pending dependencies.
+    bool IsReady(const String &asset) const;
+
+    /// Returns the refs of the assets that depend directly on @c asset.
+    StringVector Dependents(const String &asset) const;
+
+    /// Returns the refs of the direct dependencies of @c asset.
+    StringVector Dependencies(const String &asset) const;
+
+    /// Returns all dependencies as (dependent, dependency) pairs.
+    Vector<Pair<String, String> > Edges() const;
+
+    /// Returns the number of assets in the graph.
+    uint NumNodes() const { return nodes_.Size(); }
+
+    /// Removes all nodes.
+    void Clear() { nodes_.Clear(); }
+
+private:
+    struct Node
+    {
+        Node() : loaded(false), ignored(false), numPending(0) {}
+
+        bool Ready() const { return ignored || (loaded && numPending == 0); }
+
+        String name;
+        HashSet<String> dependencies;
+        /// Dependencies that closed a cycle when added, and are not counted in numPending.
+        HashSet<String> cyclicDependencies;
+        HashSet<String> dependents;
+        bool loaded;
+        bool ignored;
+        /// Number of dependencies that are not ready.
+        uint numPending;
+    };
+    typedef HashMap<String, Node> NodeMap;
+
+    /// Returns the node key of @c asset.
+    static String NodeKey(const String &asset) { return asset.ToLower(); }
+
+    Node *FindNode(const String &asset);
+    const Node *FindNode(const String &asset) const;
+    Node &GetOrCreateNode(const String &asset, const String &key);
+
+    /// Returns whether the node @c from depends on the node @c to directly or indirectly.
+    bool DependsOn(const String &from, const String &to) const;
+
+    /// Updates the pending counts of the dependents of @c node, and theirs in turn, if the readiness of @c node has changed.
+    void PropagateReadiness(Node &node, bool wasReady);
+
+    /// Removes the node @c key if it is not loaded and has no dependencies or dependents.
+    void PruneNode(const String &key);
+
+    NodeMap nodes_;
+};
+
+}
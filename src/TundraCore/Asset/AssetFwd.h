@@ -7,6 +7,7 @@
 namespace Urho3D
 {
 class FileWatcher;
+class WorkItem;
 }
 
 namespace Tundra
@@ -49,9 +50,16 @@ typedef WeakPtr<IAssetStorage> AssetStorageWeakPtr;
 class IAssetUploadTransfer;
 typedef SharedPtr<IAssetUploadTransfer> AssetUploadTransferPtr;
 
+class IAssetDecodeJob;
+typedef SharedPtr<IAssetDecodeJob> AssetDecodeJobPtr;
+typedef WeakPtr<IAssetDecodeJob> AssetDecodeJobWeakPtr;
+
 struct AssetReference;
 struct AssetReferenceList;
 
+class ParsedAssetRef;
+typedef SharedPtr<ParsedAssetRef> ParsedAssetRefPtr;
+
 class IAssetTypeFactory;
 typedef SharedPtr<IAssetTypeFactory> AssetTypeFactoryPtr;
 
@@ -8,6 +8,7 @@
 #include "IComponent.h"
 #include "Framework.h"
 #include "AssetAPI.h"
+#include "ParsedAssetRef.h"
 #include "FrameAPI.h"
 #include "IAsset.h"
 #include "IAssetTransfer.h"
@@ -38,10 +39,10 @@ void AssetRefListener::HandleAssetRefChange(IAttribute *assetRef, const String&
             (assetRef == 0 ? "null" : assetRef->TypeName()) + " instead).");
         return;
     }
-    HandleAssetRefChange(attr->Owner()->GetFramework()->Asset(), attr->Get().ref, assetType);
+    HandleAssetRefChange(attr->Owner()->GetFramework()->Asset(), attr->Get().ref, assetType, attr->Owner()->ParentEntity());
 }
 
-void AssetRefListener::HandleAssetRefChange(AssetAPI *assetApi, String assetRef, const String& assetType)
+void AssetRefListener::HandleAssetRefChange(AssetAPI *assetApi, String assetRef, const String& assetType, Entity *entity)
 {
     // Disconnect from any previous transfer we might be listening to
     if (!currentTransfer.Expired())
@@ -70,9 +71,7 @@ void AssetRefListener::HandleAssetRefChange(AssetAPI *assetApi, String assetRef,
     // Resolve the protocol for generated:// assets. These assets are never meant to be
     // requested from AssetAPI, they cannot be fetched from anywhere. They can only be either
     // loaded or we must wait for something to load/create them.
-    String protocolPart = "";
-    assetApi->ParseAssetRef(assetRef, &protocolPart);
-    if (protocolPart.ToLower() == "generated")
+    if (assetApi->InternAssetRef(assetRef)->protocol.Compare("generated", false) == 0)
     {
         AssetPtr loadedAsset = assetApi->FindAsset(assetRef);
         if (loadedAsset.Get() && loadedAsset->IsLoaded())
@@ -101,6 +100,7 @@ void AssetRefListener::HandleAssetRefChange(AssetAPI *assetApi, String assetRef,
             return;
         }
         currentWaitingRef = assetRef;
+        transfer->AddReferencingEntity(entity);
 
         transfer->Succeeded.Connect(this, &AssetRefListener::OnTransferSucceeded);
         transfer->Failed.Connect(this, &AssetRefListener::OnTransferFailed);
@@ -174,7 +174,7 @@ AssetRefListListener::AssetRefListListener(AssetAPI *assetAPI) :
         LogError("AssetRefListListener: Null AssetAPI* given to ctor!");
 }
 
-void AssetRefListListener::HandleChange(const AssetReferenceList &refs)
+void AssetRefListListener::HandleChange(const AssetReferenceList &refs, Entity *entity)
 {
     if (!assetAPI_)
         return;
@@ -231,7 +231,7 @@ void AssetRefListListener::HandleChange(const AssetReferenceList &refs)
     {
         const AssetReference &ref = current_[i];
         if (!ref.ref.Empty())
-            listeners_[i]->HandleAssetRefChange(assetAPI_, ref.ref, ref.type);
+            listeners_[i]->HandleAssetRefChange(assetAPI_, ref.ref, ref.type, entity);
     }
 }
 
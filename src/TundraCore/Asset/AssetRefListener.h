@@ -13,6 +13,7 @@ namespace Tundra
 {
 
 class IAttribute;
+class Entity;
 
 /// Tracks and notifies about asset change events.
 class TUNDRACORE_API AssetRefListener : public RefCounted
@@ -21,14 +22,15 @@ public:
     AssetRefListener();
 
     /// Issues a new asset request to the given AssetReference.
-    /// @param assetRef A pointer to an attribute of type AssetReference.
+    /// @param assetRef A pointer to an attribute of type AssetReference. The parent entity of its component is recorded as the requester.
     /// @param assetType Optional asset type name
     void HandleAssetRefChange(IAttribute *assetRef, const String& assetType = "");
 
     /// Issues a new asset request to the given assetRef URL.
     /// @param assetApi Pass a pointer to the system Asset API into this function (This utility object doesn't keep reference to framework).
     /// @param assetType Optional asset type name
-    void HandleAssetRefChange(AssetAPI *assetApi, String assetRef, const String& assetType = "");
+    /// @param entity Optional entity that refers to the asset, used by the asset transfer prioritizer.
+    void HandleAssetRefChange(AssetAPI *assetApi, String assetRef, const String& assetType = "", Entity *entity = 0);
     
     /// Returns the asset currently stored in this asset reference.
     AssetPtr Asset() const;
@@ -65,8 +67,9 @@ public:
 
     /// Handles change to refs.
     /** Checks if there are actual changes against last change.
-        Requests Assets and emits signals. */
-    void HandleChange(const AssetReferenceList &refs);
+        Requests Assets and emits signals.
+        @param entity Optional entity that refers to the assets, used by the asset transfer prioritizer. */
+    void HandleChange(const AssetReferenceList &refs, Entity *entity = 0);
 
     /// Returns current known states assets.
     /** Returned vector will match in size with known state.
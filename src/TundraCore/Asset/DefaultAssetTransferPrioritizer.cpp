@@ -7,48 +7,30 @@
 namespace Tundra
 {
 
-struct TypeIndex
-{
-    uint index;
-    uint num;
-
-    TypeIndex() : index(0), num(0) {}
-
-    uint Current()
-    {
-        return index + num;
-    }
-};
-
 DefaultAssetTransferPrioritizer::DefaultAssetTransferPrioritizer()
 {
 }
 
 AssetTransferPtrVector DefaultAssetTransferPrioritizer::Prioritize(const AssetTransferPtrVector &transfers)
 {
-    /** @todo Add prioritizing with distance to active camera when EntityWeakPtr info is available in transfers.
-        @todo Add more types? Should scripts go last or first?
-        @todo Possibly add option for this function to communicate pending tranfers for a longer time if they are eg. 1km away from camera. */
-    TypeIndex iMesh;
-    TypeIndex iMaterial;
-
+    /// @todo Add more types? Should scripts go last or first?
+    // Collect the types into separate lists and concatenate them, instead of inserting into the middle of one list.
     AssetTransferPtrVector sorted;
+    AssetTransferPtrVector materials;
+    AssetTransferPtrVector others;
+    sorted.Reserve(transfers.Size());
     for(auto iter = transfers.Begin(); iter != transfers.End(); ++iter)
     {
         const AssetTransferPtr &transfer = (*iter);
         if (transfer->assetType.Contains("mesh", false))
-        {
-            sorted.Insert(iMesh.Current(), transfer);
-            iMesh.num++;
-        }
+            sorted.Push(transfer);
         else if (transfer->assetType.Contains("material", false))
-        {
-            sorted.Insert(iMesh.Current() + iMaterial.Current(), transfer);
-            iMaterial.num++;
-        }
+            materials.Push(transfer);
         else
-            sorted.Push(transfer);
+            others.Push(transfer);
     }
+    sorted.Push(materials);
+    sorted.Push(others);
     return sorted;
 }
 
@@ -3,6 +3,8 @@
 #include "StableHeaders.h"
 
 #include "IAsset.h"
+#include "IAssetDecodeJob.h"
+#include "IAssetBundle.h"
 #include "AssetAPI.h"
 #include "IAssetStorage.h"
 #include "IAssetProvider.h"
@@ -15,7 +17,7 @@ namespace Tundra
 {
 
 IAsset::IAsset(AssetAPI *owner, const String &type_, const String &name_) :
-Object(owner->GetContext()), assetAPI(owner), type(type_), name(name_), diskSourceType(Programmatic), modified(false)
+Object(owner->GetContext()), assetAPI(owner), type(type_), name(name_), diskSourceType(Programmatic), modified(false), referencesChanged(false)
 {
     assert(assetAPI);
 }
@@ -38,7 +40,14 @@ void IAsset::SetDiskSourceType(SourceType type)
 bool IAsset::LoadFromCache()
 {
     // If asset did not have dependencies, this causes Loaded() to be emitted
-    bool success = LoadFromFile(DiskSource());
+    bool success = false;
+    if (diskSource.Empty() && diskSourceType == Bundle)
+    {
+        Vector<u8> data = SubAssetDataFromBundle();
+        success = !data.Empty() && LoadFromFileInMemory(&data[0], data.Size(), false);
+    }
+    else
+        success = LoadFromFile(DiskSource());
     if (!success)
         return false;
 
@@ -50,9 +59,39 @@ bool IAsset::LoadFromCache()
     return success;
 }
 
+bool IAsset::HasReloadSource() const
+{
+    if (!diskSource.Empty())
+        return true;
+    if (diskSourceType != Bundle)
+        return false;
+    String bundleRef;
+    AssetAPI::ParseAssetRef(name, 0, 0, 0, 0, 0, 0, 0, 0, 0, &bundleRef);
+    return assetAPI->FindBundle(bundleRef).Get() != 0;
+}
+
+Vector<u8> IAsset::SubAssetDataFromBundle() const
+{
+    String subAssetName, bundleRef;
+    AssetAPI::ParseAssetRef(name, 0, 0, 0, 0, 0, 0, 0, &subAssetName, 0, &bundleRef);
+    AssetBundlePtr bundle = assetAPI->FindBundle(bundleRef);
+    if (!bundle || subAssetName.Empty())
+    {
+        LogError("IAsset::LoadFromCache: Cannot reload sub asset " + name + ", its bundle is not loaded.");
+        return Vector<u8>();
+    }
+    return bundle->GetSubAssetData(subAssetName);
+}
+
 void IAsset::Unload()
 {
 //    LogDebug("IAsset::Unload called for asset \"" + name.toStdString() + "\".");
+    // Discard the result of an asynchronous load that is still in progress.
+    if (pendingDecode)
+    {
+        pendingDecode->Cancel();
+        pendingDecode.Reset();
+    }
     DoUnload();
     Unloaded.Emit(this);
 }
@@ -137,7 +176,7 @@ AssetPtr IAsset::Clone(String newAssetName) const
     return newAsset;
 }
 
-bool IAsset::LoadFromFile(String filename)
+bool IAsset::LoadFromFile(String filename, bool allowAsynchronous)
 {
     PROFILE(IAsset_LoadFromFile);
 
@@ -148,6 +187,9 @@ bool IAsset::LoadFromFile(String filename)
         return false;
     }
 
+    if (allowAsynchronous && assetAPI->IsAsynchronousLoadEnabled())
+        return assetAPI->DecodeAssetFile(this, filename);
+
     Vector<u8> fileData;
     profile.Start(AssetProfile::DiskRead);
     bool success = LoadFileToVector(filename, fileData);
@@ -179,6 +221,7 @@ bool IAsset::LoadFromFileInMemory(const u8 *data, uint numBytes, bool allowAsync
     }
 
     profile.Start(AssetProfile::Load);
+    referencesChanged = true;
     return DeserializeFromData(data, numBytes, allowAsynchronous);
 }
 
@@ -195,8 +238,17 @@ void IAsset::LoadCompleted()
     PROFILE(IAsset_LoadCompleted);
     profile.Done(AssetProfile::Load);
 
-    // If asset was loaded successfully, and there are no pending dependencies, emit Loaded() now.
+    // Update the dependency graph before checking for pending dependencies. This is done here rather than in
+    // AssetAPI::AssetLoadCompleted, so that also the loads that bypass it, and the reloads, are reflected in the graph.
     AssetPtr thisAsset(this);
+    if (referencesChanged && IsLoaded())
+    {
+        referencesChanged = false;
+        assetAPI->NotifyAssetDependenciesChanged(thisAsset);
+    }
+    assetAPI->NotifyAssetLoadedStateChanged(this);
+
+    // If asset was loaded successfully, and there are no pending dependencies, emit Loaded() now.
     if (IsLoaded() && !assetAPI->HasPendingDependencies(thisAsset))
         Loaded.Emit(thisAsset);
 }
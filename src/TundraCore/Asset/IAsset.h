@@ -47,6 +47,8 @@ public:
 
     /// @cond PRIVATE
     AssetProfile profile;
+    /// Asynchronous decode in progress, if any. Managed by AssetAPI::DecodeAsset.
+    AssetDecodeJobWeakPtr pendingDecode;
     /// @endcond
 
     enum SourceType
@@ -82,11 +84,17 @@ public:
     SourceType DiskSourceType() const { return diskSourceType; }
     
     /// Loads this asset from the given file on the local filesystem. Returns true if loading succeeds, false otherwise.
-    virtual bool LoadFromFile(String filename);
+    /** If @c allowAsynchronous is true and asynchronous asset loading is enabled, the file is read and decoded in worker threads,
+        and the asset is loaded on a later frame like with LoadFromFileInMemory. */
+    virtual bool LoadFromFile(String filename, bool allowAsynchronous = false);
 
     /// Forces a reload of this asset from its disk source. Returns true if loading succeeded, false otherwise.
+    /** A sub asset that has no disk source, because its bundle serves the sub assets from memory, is reloaded from the loaded bundle. */
     bool LoadFromCache();
 
+    /// Returns true if this asset can be reloaded with LoadFromCache.
+    bool HasReloadSource() const;
+
     /// Unloads this asset from memory.
     /** After calling this function, this asset still can be queried for its Type(), Name() and CacheFile(),
         but its dependencies cannot be determined and it cannot be used in any other way. */
@@ -171,7 +179,7 @@ public:
     bool LoadFromFileInMemory(const u8 *data, uint numBytes, bool allowAsynchronous = true);
 
     /// Called when this asset is loaded by AssetAPI::AssetLoadCompleted and DependencyLoaded functions.
-    /// Emits Loaded() signal if all the dependencies have been loaded, otherwise does nothing.
+    /// Updates the AssetAPI dependency graph, and emits Loaded() signal if all the dependencies have been loaded, otherwise does nothing.
     void LoadCompleted();
 
     /// Called whenever another asset this asset depends on is loaded.
@@ -206,12 +214,17 @@ protected:
         The parameter is set to false when the requesting code is expecting the asset to be loaded when this function returns.
         @note Implementation has to call AssetAPI::AssetLoadCompleted after loaded successfully (both synchronous and asynchronous).
         AssetAPI::AssetLoadCompleted can be called inside this function, how ever just returning true is not enough.
-        AssetAPI::AssetLoadFailed will be called automatically if false is returned. */
+        AssetAPI::AssetLoadFailed will be called automatically if false is returned.
+        Implementations that can decode their data in a worker thread can create an IAssetDecodeJob and return AssetAPI::DecodeAsset,
+        which takes care of the above. */
     virtual bool DeserializeFromData(const u8 *data, uint numBytes, bool allowAsynchronous) = 0;
 
     /// Private-implementation of the unloading of an asset.
     virtual void DoUnload() = 0;
 
+    /// Returns the data of this sub asset from its loaded bundle, or an empty vector if the bundle is not loaded.
+    Vector<u8> SubAssetDataFromBundle() const;
+
     AssetAPI *assetAPI;
 
     /// Specifies the provider this asset was downloaded from. May be null.
@@ -234,6 +247,9 @@ protected:
     
     /// Modified in memory -status of the asset.
     bool modified;
+
+    /// The asset data has been (re)loaded since the dependency graph was last refreshed, so its references may have changed.
+    bool referencesChanged;
 };
 
 }
@@ -0,0 +1,40 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "IAssetDecodeJob.h"
+#include "IAsset.h"
+
+#include <cstring>
+
+namespace Tundra
+{
+
+IAssetDecodeJob::IAssetDecodeJob(IAsset *asset_, const u8 *data_, uint numBytes) :
+    decoded(false),
+    asset(asset_),
+    cancelled(false)
+{
+    if (data_ && numBytes)
+    {
+        data.Resize(numBytes);
+        memcpy(&data[0], data_, numBytes);
+    }
+}
+
+IAssetDecodeJob::~IAssetDecodeJob()
+{
+}
+
+void IAssetDecodeJob::Cancel()
+{
+    Urho3D::MutexLock lock(mutex);
+    cancelled = true;
+}
+
+bool IAssetDecodeJob::IsCancelled() const
+{
+    Urho3D::MutexLock lock(mutex);
+    return cancelled;
+}
+
+}
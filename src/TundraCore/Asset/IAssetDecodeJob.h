@@ -0,0 +1,60 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraCoreApi.h"
+#include "CoreTypes.h"
+#include "AssetFwd.h"
+
+#include <Urho3D/Container/RefCounted.h>
+#include <Urho3D/Container/Str.h>
+#include <Urho3D/Core/Mutex.h>
+
+namespace Tundra
+{
+
+/// Decodes the data of an asset in two stages, so that the CPU-heavy part can be run in a worker thread.
+/** An asset implementation creates a job in IAsset::DeserializeFromData and passes it to AssetAPI::DecodeAsset.
+    Decode parses and decompresses the data into an intermediate form held by the job, and Commit applies that to
+    the asset in the main thread, which is where GPU resources are created. */
+class TUNDRACORE_API IAssetDecodeJob : public RefCounted
+{
+public:
+    /// Copies the asset data, as the caller's buffer does not outlive an asynchronous decode.
+    IAssetDecodeJob(IAsset *asset, const u8 *data, uint numBytes);
+    virtual ~IAssetDecodeJob();
+
+    /// Parses and decompresses the asset data. Return false and set error on failure.
+    /** May be called in a worker thread, so this must not touch the asset, the Asset API, the log or any GPU resources. */
+    virtual bool Decode() = 0;
+
+    /// Applies the decoded data to the asset. Return false and set error on failure.
+    /** Called in the main thread after a successful Decode, if the asset still exists and the job has not been cancelled. */
+    virtual bool Commit() = 0;
+
+    /// Returns the asset being loaded, or null if the asset has been destroyed.
+    IAsset *Asset() const { return asset.Get(); }
+
+    /// Discards the decoded data. Called when the asset is unloaded or reloaded before the job is committed.
+    void Cancel();
+
+    /// Returns whether the job has been cancelled. May be called from the worker thread.
+    bool IsCancelled() const;
+
+    /// The raw asset data.
+    PODVector<u8> data;
+
+    /// Description of the failure, logged by the Asset API.
+    String error;
+
+    /// Result of Decode.
+    bool decoded;
+
+private:
+    AssetWeakPtr asset;
+    /// Guards cancelled, which is read by the worker thread.
+    mutable Urho3D::Mutex mutex;
+    bool cancelled;
+};
+
+}
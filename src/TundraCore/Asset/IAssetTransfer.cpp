@@ -4,6 +4,7 @@
 #include "IAssetTransfer.h"
 #include "IAssetProvider.h"
 #include "IAsset.h"
+#include "Entity.h"
 
 #include "LoggingFunctions.h"
 
@@ -20,6 +21,30 @@ IAssetTransfer::~IAssetTransfer()
 {
 }
 
+void IAssetTransfer::AddReferencingEntity(Entity *entity)
+{
+    EntityWeakPtr weakEntity(entity);
+    // Stop at entities that are already known, which also ends the recursion on circular dependencies.
+    if (!entity || referencingEntities.Contains(weakEntity))
+        return;
+    referencingEntities.Insert(weakEntity);
+    for(uint i = 0; i < dependencies.Size(); ++i)
+        if (!dependencies[i].Expired())
+            dependencies[i]->AddReferencingEntity(entity);
+}
+
+void IAssetTransfer::AddDependency(IAssetTransfer *transfer)
+{
+    if (!transfer || transfer == this)
+        return;
+    WeakPtr<IAssetTransfer> weakTransfer(transfer);
+    if (!dependencies.Contains(weakTransfer))
+        dependencies.Push(weakTransfer);
+    for(HashSet<EntityWeakPtr>::ConstIterator iter = referencingEntities.Begin(); iter != referencingEntities.End(); ++iter)
+        if (!iter->Expired())
+            transfer->AddReferencingEntity(iter->Get());
+}
+
 void IAssetTransfer::EmitAssetDownloaded()
 {
     Downloaded.Emit(this);
@@ -5,10 +5,12 @@
 #include "TundraCoreApi.h"
 #include "CoreTypes.h"
 #include "AssetFwd.h"
+#include "SceneFwd.h"
 #include "AssetReference.h"
 #include "IAsset.h"
 #include "Signals.h"
 
+#include <Urho3D/Container/HashSet.h>
 #include <Urho3D/Container/RefCounted.h>
 #include <Urho3D/Container/Str.h>
 
@@ -90,6 +92,16 @@ public:
     /** @note Will be null until Succeeded is emitted */
     AssetPtr Asset() const;
 
+    /// Adds an entity that refers to the asset, for prioritizing the transfer. Called by AssetRefListener.
+    void AddReferencingEntity(Entity *entity);
+
+    /// Adds @c transfer of an asset that this asset depends on.
+    /** The dependency is given the entities that refer to this asset, also the ones added later, so that it is prioritized like this transfer. */
+    void AddDependency(IAssetTransfer *transfer);
+
+    /// Returns the entities that refer to the asset. Some of them may have expired.
+    const HashSet<EntityWeakPtr> &ReferencingEntities() const { return referencingEntities; }
+
     /// @todo Returns the current transfer progress in the range [0, 1].
     // float Progress() const;
 
@@ -112,6 +124,8 @@ public:
 private:
     String diskSource;
     bool cachingAllowed;
+    HashSet<EntityWeakPtr> referencingEntities;
+    Vector<WeakPtr<IAssetTransfer> > dependencies;
 };
 
 /// Virtual asset transfer for assets that have already been loaded, but are re-requested
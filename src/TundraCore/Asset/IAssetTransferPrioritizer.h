@@ -21,6 +21,10 @@ public:
     /** Called by AssetAPI. If the returned list does not match @c transfers size,
         the original will be used so that no transfers are lost. */
     virtual AssetTransferPtrVector Prioritize(const AssetTransferPtrVector &transfers) = 0;
+
+    /// Returns the maximum number of prioritized transfers AssetAPI starts per frame, or 0 for no limit.
+    /** The transfers over the limit stay pending, and are given to Prioritize again on the next frame along with the new ones. */
+    virtual uint MaxTransfersPerFrame() const { return 0; }
 };
 
 }
@@ -8,6 +8,7 @@
 #include "IAssetUploadTransfer.h"
 #include "IAssetTransfer.h"
 #include "AssetAPI.h"
+#include "ParsedAssetRef.h"
 #include "IAsset.h"
 
 #include "Framework.h"
@@ -20,20 +21,43 @@
 #include <Urho3D/Core/Timer.h>
 #include <Urho3D/Core/StringUtils.h>
 #include <Urho3D/IO/FileWatcher.h>
+#include <Urho3D/Math/StringHash.h>
 
 namespace Tundra
 {
 
 LocalAssetProvider::LocalAssetProvider(Framework* framework_) :
     IAssetProvider(framework_->GetContext()),
-    framework(framework_)
+    framework(framework_),
+    readQueue(0),
+    maxPendingReads(8),
+    downloadsPrioritized(true)
 {
     enableRequestsOutsideStorages = (framework_->HasCommandLineParameter("--acceptUnknownLocalSources") ||
         framework_->HasCommandLineParameter("--accept_unknown_local_sources"));  /**< @todo Remove support for the deprecated underscore version at some point. */
+
+    StringVector maxReadsParam = framework_->CommandLineParameters("--maxLocalAssetReads");
+    if (maxReadsParam.Size() > 0 && Urho3D::ToUInt(maxReadsParam.Front()) > 0)
+        maxPendingReads = Urho3D::ToUInt(maxReadsParam.Front());
+
+    // With asynchronous asset loading disabled, the files are read in the main thread as well.
+    if (!framework_->HasCommandLineParameter("--noAsyncAssetLoad") && !framework_->HasCommandLineParameter("--no_async_asset_load"))
+        readQueue = new LocalAssetReadQueue(GetContext(), maxPendingReads);
 }
 
 LocalAssetProvider::~LocalAssetProvider()
 {
+    // Waits for the reads in progress, which still refer to pendingReads.
+    delete readQueue;
+    readQueue = 0;
+    pendingReads.Clear();
+}
+
+void LocalAssetProvider::SetMaxPendingFileReads(uint count)
+{
+    maxPendingReads = (count > 0 ? count : 1);
+    if (readQueue)
+        readQueue->SetMaxThreads(maxPendingReads);
 }
 
 String LocalAssetProvider::Name() const
@@ -44,7 +68,7 @@ String LocalAssetProvider::Name() const
 
 bool LocalAssetProvider::IsValidRef(String assetRef, String) const
 {
-    AssetAPI::AssetRefType refType = AssetAPI::ParseAssetRef(assetRef.Trimmed());
+    AssetAPI::AssetRefType refType = framework->Asset()->InternAssetRef(assetRef)->type;
     if (refType == AssetAPI::AssetRefLocalPath || refType == AssetAPI::AssetRefLocalUrl)
         return true;
 
@@ -72,7 +96,7 @@ AssetTransferPtr LocalAssetProvider::CreateTransfer(String assetRef, String asse
         if (!storage)
         {
             // Detect absolute urls, which we should forbid in this case
-            AssetAPI::AssetRefType refType = AssetAPI::ParseAssetRef(assetRef.Trimmed());
+            AssetAPI::AssetRefType refType = framework->Asset()->InternAssetRef(assetRef)->type;
             if (refType == AssetAPI::AssetRefLocalPath)
             {
                 LogError("LocalAssetProvider::RequestAsset: Discarding asset request to path \"" + assetRef +
@@ -93,6 +117,7 @@ AssetTransferPtr LocalAssetProvider::CreateTransfer(String assetRef, String asse
 void LocalAssetProvider::ExecuteTransfer(AssetTransferPtr transfer)
 {
     pendingDownloads.Push(transfer);
+    downloadsPrioritized = false;
 }
 
 bool LocalAssetProvider::AbortTransfer(IAssetTransfer *transfer)
@@ -112,14 +137,27 @@ bool LocalAssetProvider::AbortTransfer(IAssetTransfer *transfer)
             return true;
         }
     }
+    for (uint i = 0; i < pendingReads.Size(); ++i)
+    {
+        PendingFileRead &pending = pendingReads[i];
+        if (pending.transfer.Get() == transfer && !pending.read->cancelled)
+        {
+            framework->Asset()->AssetTransferAborted(transfer);
+
+            // The read can not be interrupted. Its result is discarded when it completes.
+            pending.read->cancelled = true;
+            return true;
+        }
+    }
     return false;
 }
 
 String LocalAssetProvider::GetPathForAsset(const String &assetRef, LocalAssetStoragePtr *storage) const
 {
-    String path;
-    String path_filename;
-    AssetAPI::AssetRefType refType = AssetAPI::ParseAssetRef(assetRef.Trimmed(), 0, 0, 0, 0, &path_filename, &path);
+    ParsedAssetRefPtr parsedRef = framework->Asset()->InternAssetRef(assetRef);
+    const String &path = parsedRef->path;
+    const String &path_filename = parsedRef->pathFilename;
+    AssetAPI::AssetRefType refType = parsedRef->type;
     if (refType == AssetAPI::AssetRefLocalPath)
     {
         // If the asset ref has already been converted to an absolute path, simply return the assetRef as is.
@@ -166,7 +204,7 @@ String LocalAssetProvider::GetPathForAsset(const String &assetRef, LocalAssetSto
     return "";
 }
 
-void LocalAssetProvider::Update(float /*frametime*/)
+void LocalAssetProvider::Update(float frametime)
 {
     PROFILE(LocalAssetProvider_Update);
 
@@ -178,6 +216,9 @@ void LocalAssetProvider::Update(float /*frametime*/)
     CompletePendingFileUploads();
     CompletePendingFileDownloads();
     CheckForPendingFileSystemChanges();
+
+    if (readQueue)
+        readQueue->Update(frametime, !pendingReads.Empty());
 }
 
 void LocalAssetProvider::DeleteAssetFromStorage(String assetRef)
@@ -269,6 +310,8 @@ LocalAssetStoragePtr LocalAssetProvider::AddStorageDirectory(String directory, S
     storage->SetReplicated(replicated);
     if (!trustedStateStr.Empty())
         storage->trustState = IAssetStorage::TrustStateFromString(trustedStateStr);
+    if (!framework->HasCommandLineParameter("--noAssetIndexFiles"))
+        storage->SetIndexFile(GuaranteeTrailingSlash(framework->UserDataDirectory()) + "assetindex/" + Urho3D::StringHash(directory.ToLower()).ToString() + ".idx");
 
 // On Android, we get spurious file change notifications. Disable watcher for now.
 #ifndef ANDROID
@@ -330,73 +373,170 @@ void LocalAssetProvider::CompletePendingFileDownloads()
     if (pendingUploads.Size() > 0)
         return;
 
+    if (!downloadsPrioritized)
+        PrioritizePendingDownloads();
+
     const int maxLoadMSecs = 16;
     Urho3D::HiresTimer downloadTimer;
 
-    while(pendingDownloads.Size() > 0)
+    // Without the I/O threads the files are read here, one at a time in priority order.
+    // Throttle asset loading to at most 16 msecs/frame. This applies to failed refs as well, as there can be a lot of them.
+    if (!readQueue)
     {
-        PROFILE(LocalAssetProvider_ProcessPendingDownload);
+        while(pendingDownloads.Size() > 0)
+        {
+            PROFILE(LocalAssetProvider_ProcessPendingDownload);
 
-        AssetTransferPtr transfer = pendingDownloads.Back();
-        pendingDownloads.Pop();
-            
-        String ref = transfer->source.ref;
+            StartFileRead(pendingDownloads.Front());
+            pendingDownloads.Erase(0);
+            FinishFileRead(pendingReads.Back());
+            pendingReads.Pop();
 
-        String path_filename;
-        String file;
-        AssetAPI::AssetRefType refType = AssetAPI::ParseAssetRef(ref.Trimmed(), 0, 0, 0, 0, &path_filename);
+            if (downloadTimer.GetUSec(false) / 1000 > maxLoadMSecs)
+                break;
+        }
+        return;
+    }
 
-        LocalAssetStoragePtr storage;
+    // Start reading the files of the highest priority downloads.
+    uint numStarted = 0;
+    while(numStarted < pendingDownloads.Size() && pendingReads.Size() < maxPendingReads)
+        StartFileRead(pendingDownloads[numStarted++]);
+    if (numStarted > 0)
+        pendingDownloads.Erase(0, numStarted);
+
+    // Finish the transfers whose file has been read, in priority order.
+    for(uint i = 0; i < pendingReads.Size();)
+    {
+        if (!readQueue->IsCompleted(pendingReads[i].read))
+        {
+            ++i;
+            continue;
+        }
+
+        PROFILE(LocalAssetProvider_ProcessPendingDownload);
 
-        if (refType == AssetAPI::AssetRefLocalPath)
+        if (!FinishFileRead(pendingReads[i]))
         {
-            file = path_filename;
+            ++i;
+            continue;
         }
-        else // Using a local relative path, like "local://asset.ref" or "asset.ref".
+        pendingReads.Erase(i);
+
+        // Throttle asset loading to at most 16 msecs/frame. This applies to failed refs as well, as there can be a lot of them.
+        if (downloadTimer.GetUSec(false) / 1000 > maxLoadMSecs)
+            break;
+    }
+}
+
+void LocalAssetProvider::PrioritizePendingDownloads()
+{
+    downloadsPrioritized = true;
+    if (pendingDownloads.Size() < 2)
+        return;
+
+    AssetTransferPrioritizerPtr prioritizer = framework->Asset()->AssetTransferPrioritizer().Lock();
+    if (!prioritizer)
+        return;
+
+    AssetTransferPtrVector sorted = prioritizer->Prioritize(pendingDownloads);
+    if (sorted.Size() == pendingDownloads.Size())
+        pendingDownloads = sorted;
+}
+
+void LocalAssetProvider::StartFileRead(const AssetTransferPtr &transfer)
+{
+    PendingFileRead pending;
+    pending.transfer = transfer;
+    pending.read = new LocalAssetRead();
+
+    ParsedAssetRefPtr parsedRef = framework->Asset()->InternAssetRef(transfer->source.ref);
+    const String &path_filename = parsedRef->pathFilename;
+    AssetAPI::AssetRefType refType = parsedRef->type;
+    if (refType == AssetAPI::AssetRefLocalPath)
+    {
+        pending.read->file = path_filename;
+    }
+    else // Using a local relative path, like "local://asset.ref" or "asset.ref".
+    {
+        AssetAPI::AssetRefType urlRefType = framework->Asset()->InternAssetRef(path_filename)->type;
+        if (urlRefType == AssetAPI::AssetRefLocalPath)
+            pending.read->file = path_filename; // 'file://C:/path/to/asset/asset.png'.
+        else // The ref is of form 'file://relativePath/asset.png'.
         {
-            AssetAPI::AssetRefType urlRefType = AssetAPI::ParseAssetRef(path_filename);
-            if (urlRefType == AssetAPI::AssetRefLocalPath)
-                file = path_filename; // 'file://C:/path/to/asset/asset.png'.
-            else // The ref is of form 'file://relativePath/asset.png'.
+            // The I/O thread checks the storage directories without recursion, like GetPathForAsset does first.
+            pending.read->filename = path_filename;
+            for (uint i = 0; i < storages.Size(); ++i)
             {
-                String path = GetPathForAsset(path_filename, &storage);
-                if (path.Empty())
-                {
-                    String reason = "Failed to find local asset with filename \"" + ref + "\"!";
-                    framework->Asset()->AssetTransferFailed(transfer.Get(), reason);
-                    // Also throttle asset loading here. This is needed in the case we have a lot of failed refs.
-                    //if (GetCurrentClockTime() - startTime >= GetCurrentClockFreq() * maxLoadMSecs / 1000)
-                    //    break;
-                    continue;
-                }
-            
-                file = GuaranteeTrailingSlash(path) + path_filename;
+                pending.read->directories.Push(storages[i]->directory);
+                pending.storages.Push(storages[i]);
             }
         }
+    }
 
-        bool success = LoadFileToVector(file, transfer->rawAssetData);
-        if (!success)
+    if (readQueue)
+        readQueue->Schedule(pending.read);
+    else
+        LocalAssetReadQueue::Read(GetContext(), pending.read);
+    pendingReads.Push(pending);
+}
+
+bool LocalAssetProvider::FinishFileRead(PendingFileRead &pending)
+{
+    LocalAssetRead *read = pending.read;
+    if (read->cancelled)
+        return true;
+
+    AssetTransferPtr transfer = pending.transfer;
+    const String &ref = transfer->source.ref;
+
+    if (!read->found)
+    {
+        // Not found in the storage root directories. The recursive lookup uses the storages' file caches,
+        // which are only accessed in the main thread.
+        LocalAssetStoragePtr storage;
+        String path = GetPathForAsset(read->filename, &storage);
+        if (path.Empty())
         {
-            String reason = "Failed to read asset data for asset \"" + ref + "\" from file \"" + file + "\"";
+            String reason = "Failed to find local asset with filename \"" + ref + "\"!";
             framework->Asset()->AssetTransferFailed(transfer.Get(), reason);
-            // Also throttle asset loading here. This is needed in the case we have a lot of failed refs.
-            if (downloadTimer.GetUSec(false) / 1000 > maxLoadMSecs)
-                break;
-            continue;
+            return true;
         }
-        
-        // Tell the Asset API that this asset should not be cached into the asset cache, and instead the original filename should be used
-        // as a disk source, rather than generating a cache file for it.
-        transfer->SetCachingBehavior(false, file);
-        transfer->storage = storage;
 
-        // Signal the Asset API that this asset is now successfully downloaded.
-        framework->Asset()->AssetTransferCompleted(transfer.Get());
+        // Read the file that was found.
+        read->file = GuaranteeTrailingSlash(path) + read->filename;
+        read->directories.Clear();
+        read->directoryIndex = 0;
+        pending.storages.Clear();
+        pending.storages.Push(storage);
+        if (readQueue)
+        {
+            readQueue->Schedule(read);
+            return false;
+        }
+        LocalAssetReadQueue::Read(GetContext(), read);
+    }
 
-        // Throttle asset loading to at most 16 msecs/frame.
-        if (downloadTimer.GetUSec(false) / 1000 > maxLoadMSecs)
-            break;
+    if (!read->success)
+    {
+        String reason = "Failed to read asset data for asset \"" + ref + "\" from file \"" + read->file + "\"";
+        if (!read->error.Empty())
+            reason += ": " + read->error;
+        framework->Asset()->AssetTransferFailed(transfer.Get(), reason);
+        return true;
     }
+
+    transfer->rawAssetData.Swap(read->data);
+
+    // Tell the Asset API that this asset should not be cached into the asset cache, and instead the original filename should be used
+    // as a disk source, rather than generating a cache file for it.
+    transfer->SetCachingBehavior(false, read->file);
+    if (read->directoryIndex >= 0 && read->directoryIndex < (int)pending.storages.Size())
+        transfer->storage = pending.storages[read->directoryIndex];
+
+    // Signal the Asset API that this asset is now successfully downloaded.
+    framework->Asset()->AssetTransferCompleted(transfer.Get());
+    return true;
 }
 
 AssetStoragePtr LocalAssetProvider::TryCreateStorage(HashMap<String, String> &storageParams, bool /*fromNetwork*/)
@@ -467,7 +607,7 @@ AssetStoragePtr LocalAssetProvider::StorageForAssetRef(const String &assetRef) c
 {
     PROFILE(LocalAssetProvider_GetStorageForAssetRef);
 
-    AssetAPI::AssetRefType refType = AssetAPI::ParseAssetRef(assetRef.Trimmed());
+    AssetAPI::AssetRefType refType = framework->Asset()->InternAssetRef(assetRef)->type;
     if (refType != AssetAPI::AssetRefLocalPath && refType != AssetAPI::AssetRefLocalUrl)
         return AssetStoragePtr();
 
@@ -534,6 +674,7 @@ void LocalAssetProvider::CheckForPendingFileSystemChanges()
         {
             file = storage->directory + file;
             LogInfo(file);
+            storage->UpdateFileIndex(file);
             if (!storage->AutoDiscoverable())
             {
                 LogWarning("Received file change notification for storage of which auto-discovery is false.");
@@ -571,6 +712,7 @@ void LocalAssetProvider::CheckForPendingFileSystemChanges()
                 }
             }
         }
+        storage->SaveChangedFileIndex();
     }
 }
 
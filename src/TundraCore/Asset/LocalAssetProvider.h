@@ -5,6 +5,7 @@
 #include "TundraCoreApi.h"
 #include "IAssetProvider.h"
 #include "AssetFwd.h"
+#include "LocalAssetReadQueue.h"
 
 namespace Tundra
 {
@@ -53,6 +54,14 @@ public:
     /// IAssetProvider override.
     AssetUploadTransferPtr UploadAssetFromFileInMemory(const u8 *data, uint numBytes, AssetStoragePtr destination, const String &assetName) override;
 
+    /// Sets the maximum number of asset files that are read in the I/O threads at the same time.
+    /** The default is 8, and can be set with the --maxLocalAssetReads command-line parameter. With --noAsyncAssetLoad
+        the files are read in the main thread instead, for at most 16 milliseconds per frame. */
+    void SetMaxPendingFileReads(uint count);
+
+    /// Returns the maximum number of asset files that are read in the I/O threads at the same time.
+    uint MaxPendingFileReads() const { return maxPendingReads; }
+
 private:
     /// IAssetProvider override.
     AssetStoragePtr TryCreateStorage(HashMap<String, String> &storageParams, bool fromNetwork) override;
@@ -67,9 +76,27 @@ private:
     /// @param storage [out] Receives the local storage that contains the asset.
     String GetPathForAsset(const String &localFilename, LocalAssetStoragePtr *storage) const;
 
-    /// Takes all the pending file download transfers and finishes them.
+    /// An asset file read that is in progress in the I/O threads.
+    struct PendingFileRead
+    {
+        AssetTransferPtr transfer;
+        LocalAssetReadPtr read;
+        /// Storages corresponding to read->directories.
+        Vector<LocalAssetStoragePtr> storages;
+    };
+
+    /// Starts reading the pending file downloads in the I/O threads, and finishes the transfers whose file has been read.
     void CompletePendingFileDownloads();
 
+    /// Sorts the pending downloads with the IAssetTransferPrioritizer of the Asset API.
+    void PrioritizePendingDownloads();
+
+    /// Starts reading the file of @c transfer in the I/O threads.
+    void StartFileRead(const AssetTransferPtr &transfer);
+
+    /// Finishes a transfer whose file read has completed. Returns false if the read was restarted.
+    bool FinishFileRead(PendingFileRead &pending);
+
     /// Takes all the pending file upload transfers and finishes them.
     void CompletePendingFileUploads();
 
@@ -83,6 +110,10 @@ private:
     Vector<LocalAssetStoragePtr> storages;          ///< Asset directories to search, may be recursive or not
     Vector<AssetUploadTransferPtr> pendingUploads;  ///< The following asset uploads are pending to be completed by this provider.
     Vector<AssetTransferPtr> pendingDownloads;      ///< The following asset downloads are pending to be completed by this provider.
+    Vector<PendingFileRead> pendingReads;           ///< Downloads whose file is being read, in priority order.
+    LocalAssetReadQueue *readQueue;                 ///< I/O threads for reading the files, or null if the files are read in the main thread.
+    uint maxPendingReads;                           ///< Maximum size of pendingReads.
+    bool downloadsPrioritized;                      ///< False if downloads have been added after pendingDownloads was last prioritized.
 
     /// If true, assets outside any known local storages are allowed. Otherwise, requests to them will fail.
     bool enableRequestsOutsideStorages;
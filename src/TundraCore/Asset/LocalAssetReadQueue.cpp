@@ -0,0 +1,224 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "LocalAssetReadQueue.h"
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+
+namespace Tundra
+{
+
+/// Seconds the threads are kept alive without work.
+static const float DurationKeepAliveThreads = 10.f;
+/// Milliseconds an idle thread sleeps before checking for reads again. Reads are scheduled and collected once per frame.
+static const uint IdleSleepMSec = 2;
+
+LocalAssetReadQueue::LocalAssetReadQueue(Urho3D::Context *context, uint maxThreads) :
+    context_(context),
+    maxThreads_(maxThreads > 0 ? maxThreads : 1),
+    durationNoWork_(0.f)
+{
+}
+
+LocalAssetReadQueue::~LocalAssetReadQueue()
+{
+    // The reads that have not been started are owned by the caller, so they are simply forgotten.
+    {
+        Urho3D::MutexLock lock(mutex_);
+        requests_.Clear();
+    }
+    // Waits for the reads in progress.
+    StopThreads();
+    JoinStoppedThreads(true);
+}
+
+void LocalAssetReadQueue::Schedule(LocalAssetRead *read)
+{
+    uint numRequests = 0;
+    {
+        Urho3D::MutexLock lock(mutex_);
+        read->completed = false;
+        requests_.Push(read);
+        numRequests = requests_.Size();
+    }
+    durationNoWork_ = 0.f;
+    StartThreads(numRequests);
+}
+
+bool LocalAssetReadQueue::IsCompleted(const LocalAssetRead *read)
+{
+    Urho3D::MutexLock lock(mutex_);
+    return read->completed;
+}
+
+void LocalAssetReadQueue::Update(float frametime, bool hasWork)
+{
+    if (!stoppedThreads_.Empty())
+        JoinStoppedThreads(false);
+
+    if (hasWork)
+    {
+        durationNoWork_ = 0.f;
+        return;
+    }
+
+    // Don't stop the threads immediately, more work usually follows. Spinning up threads is not free.
+    durationNoWork_ += frametime;
+    if (durationNoWork_ > DurationKeepAliveThreads && threads_.Size() > 0)
+        StopThreads();
+}
+
+void LocalAssetReadQueue::SetMaxThreads(uint maxThreads)
+{
+    maxThreads_ = (maxThreads > 0 ? maxThreads : 1);
+    if (threads_.Size() > maxThreads_)
+        StopThreads(maxThreads_);
+}
+
+void LocalAssetReadQueue::StartThreads(uint count)
+{
+    if (count > maxThreads_)
+        count = maxThreads_;
+
+    while(threads_.Size() < count)
+    {
+        LocalAssetReadThread *thread = new LocalAssetReadThread(this);
+        if (thread->Run())
+            threads_.Push(thread);
+        else
+        {
+            delete thread;
+            break;
+        }
+    }
+}
+
+void LocalAssetReadQueue::StopThreads(uint keep)
+{
+    // The remaining threads keep picking up the scheduled reads, or new threads are started by the next Schedule.
+    while(threads_.Size() > keep)
+    {
+        LocalAssetReadThread *thread = threads_.Back();
+        threads_.Pop();
+        thread->RequestStop();
+        stoppedThreads_.Push(thread);
+    }
+}
+
+void LocalAssetReadQueue::JoinStoppedThreads(bool wait)
+{
+    for(uint i = 0; i < stoppedThreads_.Size();)
+    {
+        LocalAssetReadThread *thread = stoppedThreads_[i];
+        bool exited = wait;
+        if (!exited)
+        {
+            Urho3D::MutexLock lock(mutex_);
+            exited = thread->exited_;
+        }
+        if (!exited)
+        {
+            ++i;
+            continue;
+        }
+        thread->Stop();
+        delete thread;
+        stoppedThreads_.Erase(i);
+    }
+}
+
+LocalAssetRead *LocalAssetReadQueue::Next()
+{
+    Urho3D::MutexLock lock(mutex_);
+    if (requests_.Empty())
+        return nullptr;
+    LocalAssetRead *read = requests_.Front();
+    requests_.Erase(0);
+    return read;
+}
+
+void LocalAssetReadQueue::Completed(LocalAssetRead *read)
+{
+    Urho3D::MutexLock lock(mutex_);
+    read->completed = true;
+}
+
+void LocalAssetReadQueue::Read(Urho3D::Context *context, LocalAssetRead *read)
+{
+    Urho3D::FileSystem *fileSystem = context->GetSubsystem<Urho3D::FileSystem>();
+
+    String file = read->file;
+    if (file.Empty())
+    {
+        // Resolve the file from the storage directories. This is a stat per directory, which is slow on network storage.
+        for(uint i = 0; i < read->directories.Size(); ++i)
+        {
+            String candidate = read->directories[i] + read->filename;
+            if (fileSystem && fileSystem->FileExists(candidate))
+            {
+                read->directoryIndex = (int)i;
+                file = candidate;
+                break;
+            }
+        }
+        if (file.Empty())
+        {
+            read->found = false;
+            read->success = false;
+            return;
+        }
+        read->file = file;
+    }
+    read->found = true;
+
+    Urho3D::File source(context);
+    if (!source.Open(file, Urho3D::FILE_READ) || !source.IsOpen())
+    {
+        read->error = "Failed to open file \"" + file + "\" for reading";
+        read->success = false;
+        return;
+    }
+
+    // Read the whole file with one call straight into the destination buffer.
+    unsigned fileSize = source.GetSize();
+    read->data.Resize(fileSize);
+    if (fileSize > 0 && source.Read(&read->data[0], fileSize) != fileSize)
+    {
+        read->error = "Failed to read " + String(fileSize) + " bytes from file \"" + file + "\"";
+        read->data.Clear();
+        read->success = false;
+        return;
+    }
+    read->success = true;
+}
+
+// LocalAssetReadThread
+
+LocalAssetReadThread::LocalAssetReadThread(LocalAssetReadQueue *queue) :
+    queue_(queue),
+    exited_(false)
+{
+}
+
+void LocalAssetReadThread::ThreadFunction()
+{
+    while(shouldRun_)
+    {
+        LocalAssetRead *read = queue_->Next();
+        if (!read)
+        {
+            Urho3D::Time::Sleep(IdleSleepMSec);
+            continue;
+        }
+        LocalAssetReadQueue::Read(queue_->context_, read);
+        queue_->Completed(read);
+    }
+
+    Urho3D::MutexLock lock(queue_->mutex_);
+    exited_ = true;
+}
+
+}
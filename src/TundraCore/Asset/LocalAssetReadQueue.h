@@ -0,0 +1,136 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraCoreApi.h"
+#include "CoreTypes.h"
+
+#include <Urho3D/Container/RefCounted.h>
+#include <Urho3D/Container/Str.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/Core/Thread.h>
+
+namespace Urho3D
+{
+    class Context;
+}
+
+namespace Tundra
+{
+
+class LocalAssetReadThread;
+
+/// A local asset file read that is performed by LocalAssetReadQueue.
+/** The main thread fills in the request, after which only the worker thread touches the read until it is completed. */
+class TUNDRACORE_API LocalAssetRead : public RefCounted
+{
+public:
+    LocalAssetRead() : directoryIndex(-1), success(false), found(false), cancelled(false), completed(false) {}
+
+    /// Absolute path of the file. If empty, filename is looked up from directories.
+    String file;
+    /// File name relative to the storage directories.
+    String filename;
+    /// Storage directories that are searched, non-recursively, in order.
+    StringVector directories;
+
+    /// Index of the directory in which filename was found, or -1.
+    int directoryIndex;
+    /// The file contents.
+    Vector<u8> data;
+    /// Description of the failure.
+    String error;
+    /// Whether the file was read successfully.
+    bool success;
+    /// Whether the file was found. If false, the main thread may continue with a recursive lookup.
+    bool found;
+
+    /// Set by the main thread when the transfer is aborted. The result of the read is then discarded.
+    bool cancelled;
+
+private:
+    friend class LocalAssetReadQueue;
+
+    /// Set by the worker thread, protected by the queue mutex.
+    bool completed;
+};
+
+typedef SharedPtr<LocalAssetRead> LocalAssetReadPtr;
+
+/// Pool of I/O threads that resolve and read local asset files for LocalAssetProvider.
+/** Reads are started in the order they are scheduled. Threads are started on demand, up to the given maximum,
+    and stopped after a while without work. Stopped threads finish their current read and are joined in a later
+    Update once they have exited, so that stopping them does not block the frame. */
+class TUNDRACORE_API LocalAssetReadQueue
+{
+public:
+    LocalAssetReadQueue(Urho3D::Context *context, uint maxThreads);
+    ~LocalAssetReadQueue();
+
+    /// Starts the read in a worker thread. The caller must keep @c read alive until it has completed.
+    void Schedule(LocalAssetRead *read);
+
+    /// Returns whether a scheduled read has completed. Once it has, the caller may access the read again.
+    bool IsCompleted(const LocalAssetRead *read);
+
+    /// Stops idle threads and joins the threads that have exited. Called by LocalAssetProvider each frame.
+    void Update(float frametime, bool hasWork);
+
+    /// Sets the maximum number of worker threads.
+    void SetMaxThreads(uint maxThreads);
+
+    /// Reads the file described by @c read. Called in a worker thread.
+    static void Read(Urho3D::Context *context, LocalAssetRead *read);
+
+private:
+    friend class LocalAssetReadThread;
+
+    void StartThreads(uint count);
+    /// Signals all but @c keep threads to stop. They are joined by JoinStoppedThreads once they have exited.
+    void StopThreads(uint keep = 0);
+    /// Joins the stopped threads that have exited, or all stopped threads if @c wait is true.
+    void JoinStoppedThreads(bool wait);
+
+    /// Called by LocalAssetReadThread. Returns the next read, or null if there is none.
+    LocalAssetRead *Next();
+    /// Called by LocalAssetReadThread.
+    void Completed(LocalAssetRead *read);
+
+    Urho3D::Context *context_;
+    uint maxThreads_;
+    float durationNoWork_;
+    Vector<LocalAssetReadThread*> threads_;
+    /// Threads that have been signalled to stop, but not joined yet.
+    Vector<LocalAssetReadThread*> stoppedThreads_;
+
+    /// Protects requests_, the completed flags of the reads and the exited flags of the threads.
+    Urho3D::Mutex mutex_;
+    /// Reads waiting for a thread.
+    PODVector<LocalAssetRead*> requests_;
+};
+
+/// @cond PRIVATE
+
+class LocalAssetReadThread : public Urho3D::Thread
+{
+public:
+    explicit LocalAssetReadThread(LocalAssetReadQueue *queue);
+
+    /// Urho3D::Thread override.
+    void ThreadFunction() override;
+
+    /// Makes the thread exit after its current read, without waiting for it.
+    void RequestStop() { shouldRun_ = false; }
+
+private:
+    friend class LocalAssetReadQueue;
+
+    LocalAssetReadQueue *queue_;
+    /// Set when ThreadFunction returns, protected by the queue mutex.
+    bool exited_;
+};
+
+/// @endcond
+
+}
@@ -12,14 +12,28 @@
 #include <Urho3D/IO/FileSystem.h>
 #include <Urho3D/IO/FileWatcher.h>
 #include <Urho3D/Core/StringUtils.h>
+#include <Urho3D/Core/Timer.h>
 
 namespace Tundra
 {
 
+/// Identifies the index files written by LocalAssetStorage::SaveFileIndex.
+static const char *cIndexFileId = "TLAI";
+static const uint cIndexFileVersion = 1;
+/// Without a file watcher the index can not be kept current, so a lookup miss walks through the storage at most this often.
+static const unsigned cRescanIntervalMSecs = 5000;
+/// File change notifications usually come in bursts, so the changed index is saved once none have arrived for this long.
+static const unsigned cIndexSaveDelayMSecs = 2000;
+
 LocalAssetStorage::LocalAssetStorage(Urho3D::Context* context, bool writable_, bool liveUpdate_, bool autoDiscoverable_) :
     IAssetStorage(context),
     recursive(true),
-    changeWatcher(0)
+    changeWatcher(0),
+    indexBuilt(false),
+    indexStale(false),
+    lastScanTime(0),
+    indexDirty(false),
+    lastIndexChangeTime(0)
 {
     // Override the parameters for the base class.
     writable = writable_;
@@ -30,6 +44,8 @@ LocalAssetStorage::LocalAssetStorage(Urho3D::Context* context, bool writable_, b
 LocalAssetStorage::~LocalAssetStorage()
 {
     RemoveWatcher();
+    if (indexDirty && !indexStale && !indexFile.Empty())
+        SaveFileIndex();
 }
 
 void LocalAssetStorage::LoadAllAssetsOfType(AssetAPI *assetAPI, const String &suffix, const String &assetType)
@@ -76,7 +92,10 @@ void LocalAssetStorage::RefreshAssetRefs()
 
 void LocalAssetStorage::CacheStorageContents()
 {
-    cachedFiles.clear();
+    PROFILE(LocalAssetStorage_CacheStorageContents);
+
+    std::map<String, String, StringCompareCaseInsensitive> files;
+    missingFiles.clear();
     Urho3D::FileSystem* fileSystem = GetSubsystem<Urho3D::FileSystem>();
     StringVector filenames;
     fileSystem->ScanDir(filenames, directory, "*.*", Urho3D::SCAN_FILES, recursive);
@@ -94,14 +113,224 @@ void LocalAssetStorage::CacheStorageContents()
 ///\todo This is an often-received error condition if the user is not aware, but also occurs naturally in built-in Ogre Media storages.
 /// Fix this check to occur somehow nicer (without additional constraints to asset load time) without a hardcoded check
 /// against the storage name.
-            if (cachedFiles.find(localName) != cachedFiles.end())
-                LogWarning("Warning: Asset Storage \"" + Name() + "\" contains ambiguous assets \"" + cachedFiles[localName] + "\" and \"" + diskSource + "\" in two different subdirectories!");
+            if (files.find(localName) != files.end())
+                LogWarning("Warning: Asset Storage \"" + Name() + "\" contains ambiguous assets \"" + files[localName] + "\" and \"" + diskSource + "\" in two different subdirectories!");
+
+            files[localName] = diskSource;
+        }
+    }
+
+    bool changed = (files != cachedFiles);
+    cachedFiles.swap(files);
+    indexBuilt = true;
+    indexStale = false;
+    lastScanTime = Urho3D::Time::GetSystemTime();
+
+    if (!indexFile.Empty())
+    {
+        // The modification times of the directories tell on the next run whether the index is still valid.
+        // A rescan that found the same files in unmodified directories leaves the saved index as it is.
+        std::map<String, unsigned> directories;
+        ScanDirectoryTimes(directories);
+        if (changed || indexDirty || directories != indexDirectories)
+        {
+            indexDirectories.swap(directories);
+            SaveFileIndex();
+        }
+    }
+}
+
+void LocalAssetStorage::ScanDirectoryTimes(std::map<String, unsigned> &directories) const
+{
+    Urho3D::FileSystem* fileSystem = GetSubsystem<Urho3D::FileSystem>();
+    StringVector names;
+    names.Push("");
+    if (recursive)
+        fileSystem->ScanDir(names, directory, "*", Urho3D::SCAN_DIRS, true);
+    directories.clear();
+    foreach(const String &dir, names)
+        directories[dir] = fileSystem->GetLastModifiedTime(Urho3D::RemoveTrailingSlash(directory + dir));
+}
+
+void LocalAssetStorage::BuildFileIndex()
+{
+    if (!indexBuilt && LoadFileIndex())
+    {
+        indexBuilt = true;
+        indexStale = false;
+        lastScanTime = Urho3D::Time::GetSystemTime();
+        return;
+    }
+    CacheStorageContents();
+}
+
+bool LocalAssetStorage::FileIndexNeedsRescan() const
+{
+    // The file watcher keeps the index current.
+    if (changeWatcher)
+        return false;
+    return Urho3D::Time::GetSystemTime() - lastScanTime >= cRescanIntervalMSecs;
+}
+
+bool LocalAssetStorage::LoadFileIndex()
+{
+    if (indexFile.Empty())
+        return false;
+
+    PROFILE(LocalAssetStorage_LoadFileIndex);
+
+    Urho3D::FileSystem* fileSystem = GetSubsystem<Urho3D::FileSystem>();
+    if (!fileSystem->FileExists(indexFile))
+        return false;
+
+    Urho3D::File file(GetContext(), indexFile, Urho3D::FILE_READ);
+    if (!file.IsOpen() || file.ReadFileID() != cIndexFileId || file.ReadUInt() != cIndexFileVersion)
+        return false;
+    if (file.ReadString() != directory || file.ReadBool() != recursive)
+        return false;
+
+    // Any file added, removed or renamed since the index was saved has changed the modification time of its directory.
+    std::map<String, unsigned> directories;
+    uint numDirectories = file.ReadVLE();
+    for(uint i = 0; i < numDirectories && !file.IsEof(); ++i)
+    {
+        String dir = file.ReadString();
+        unsigned modified = file.ReadUInt();
+        if (fileSystem->GetLastModifiedTime(Urho3D::RemoveTrailingSlash(directory + dir)) != modified)
+        {
+            LogDebug("LocalAssetStorage: Directory \"" + directory + dir + "\" has been modified, not using the saved index of storage " + ToString());
+            return false;
+        }
+        directories[dir] = modified;
+    }
+
+    std::map<String, String, StringCompareCaseInsensitive> files;
+    uint numFiles = file.ReadVLE();
+    for(uint i = 0; i < numFiles; ++i)
+    {
+        if (file.IsEof())
+            return false;
+        String localName = file.ReadString();
+        files[localName] = directory + file.ReadString();
+    }
+
+    cachedFiles.swap(files);
+    indexDirectories.swap(directories);
+    indexDirty = false;
+    missingFiles.clear();
+    LogDebug("LocalAssetStorage: Loaded index of " + String((uint)cachedFiles.size()) + " files for storage " + ToString());
+    return true;
+}
+
+void LocalAssetStorage::SaveFileIndex()
+{
+    indexDirty = false;
+
+    Urho3D::FileSystem* fileSystem = GetSubsystem<Urho3D::FileSystem>();
+    String indexDirectory = Urho3D::GetPath(indexFile);
+    if (!fileSystem->DirExists(indexDirectory) && !fileSystem->CreateDir(indexDirectory))
+    {
+        LogWarning("LocalAssetStorage: Could not create directory \"" + indexDirectory + "\" for the index of storage " + ToString());
+        return;
+    }
+
+    Urho3D::File file(GetContext(), indexFile, Urho3D::FILE_WRITE);
+    if (!file.IsOpen())
+    {
+        LogWarning("LocalAssetStorage: Could not write the index of storage " + ToString() + " to \"" + indexFile + "\"");
+        return;
+    }
+
+    file.WriteFileID(cIndexFileId);
+    file.WriteUInt(cIndexFileVersion);
+    file.WriteString(directory);
+    file.WriteBool(recursive);
+
+    file.WriteVLE((uint)indexDirectories.size());
+    for(auto iter = indexDirectories.begin(); iter != indexDirectories.end(); ++iter)
+    {
+        file.WriteString(iter->first);
+        file.WriteUInt(iter->second);
+    }
+
+    file.WriteVLE((uint)cachedFiles.size());
+    for(auto iter = cachedFiles.begin(); iter != cachedFiles.end(); ++iter)
+    {
+        file.WriteString(iter->first);
+        file.WriteString(iter->second.StartsWith(directory) ? iter->second.Substring(directory.Length()) : iter->second);
+    }
+}
 
-            cachedFiles[localName] = diskSource;
+void LocalAssetStorage::UpdateFileIndex(const String &absoluteFilename)
+{
+    if (!indexBuilt)
+        return;
+
+    Urho3D::FileSystem* fileSystem = GetSubsystem<Urho3D::FileSystem>();
+    if (fileSystem->DirExists(absoluteFilename))
+    {
+        // A directory may have been moved here with its contents, which are not reported separately.
+        indexStale = true;
+        return;
+    }
+
+    String localName = Urho3D::GetFileNameAndExtension(absoluteFilename);
+    if (localName.Empty() || absoluteFilename.Contains(".git") || absoluteFilename.Contains(".svn") || absoluteFilename.Contains(".hg"))
+        return;
+
+    bool changed = false;
+    if (fileSystem->FileExists(absoluteFilename))
+    {
+        auto iter = cachedFiles.find(localName);
+        if (iter == cachedFiles.end() || iter->second != absoluteFilename)
+        {
+            cachedFiles[localName] = absoluteFilename;
+            changed = true;
         }
+        missingFiles.erase(localName);
+    }
+    else
+    {
+        auto iter = cachedFiles.find(localName);
+        if (iter != cachedFiles.end() && iter->second.Compare(absoluteFilename, false) == 0)
+        {
+            cachedFiles.erase(iter);
+            changed = true;
+        }
+        else if (iter == cachedFiles.end())
+            indexStale = true; // A directory that was removed or moved away is reported like a deleted file.
+    }
+
+    // Adding or removing the file changed the modification time of its directory, which the saved index must match.
+    String dir = Urho3D::RemoveTrailingSlash(Urho3D::GetPath(absoluteFilename));
+    dir = dir.Length() > directory.Length() ? dir.Substring(directory.Length()) : String();
+    auto dirIter = indexDirectories.find(dir);
+    if (dirIter != indexDirectories.end())
+    {
+        unsigned modified = fileSystem->GetLastModifiedTime(Urho3D::RemoveTrailingSlash(directory + dir));
+        if (dirIter->second != modified)
+        {
+            dirIter->second = modified;
+            changed = true;
+        }
+    }
+
+    if (changed)
+    {
+        indexDirty = true;
+        lastIndexChangeTime = Urho3D::Time::GetSystemTime();
     }
 }
 
+void LocalAssetStorage::SaveChangedFileIndex()
+{
+    // A stale index is rebuilt, and saved, on the next lookup miss.
+    if (!indexDirty || indexStale || indexFile.Empty())
+        return;
+    if (Urho3D::Time::GetSystemTime() - lastIndexChangeTime >= cIndexSaveDelayMSecs)
+        SaveFileIndex();
+}
+
 String LocalAssetStorage::GetFullPathForAsset(const String &assetname, bool recursiveLookup)
 {
     Urho3D::FileSystem* fileSystem = GetSubsystem<Urho3D::FileSystem>();
@@ -113,17 +342,28 @@ String LocalAssetStorage::GetFullPathForAsset(const String &assetname, bool recu
     {
         if (!recursive || !recursiveLookup)
             return "";
-        else
+
+        // A due rescan also forgets the missing files, so that files added since the last scan are found.
+        if (!indexBuilt || indexStale)
+            BuildFileIndex();
+        else if (FileIndexNeedsRescan())
             CacheStorageContents();
-    }
+        else if (missingFiles.find(assetname) != missingFiles.end())
+            return "";
 
-    iter = cachedFiles.find(assetname);
-    if (iter != cachedFiles.end())
-    {
-        if (fileSystem->FileExists(iter->second))
-            return Urho3D::GetPath(iter->second);
+        iter = cachedFiles.find(assetname);
+        if (iter == cachedFiles.end())
+        {
+            missingFiles.insert(assetname);
+            return "";
+        }
     }
 
+    if (fileSystem->FileExists(iter->second))
+        return Urho3D::GetPath(iter->second);
+
+    // The file has been removed without the index being notified.
+    cachedFiles.erase(iter);
     return "";
 }
 
@@ -7,6 +7,7 @@
 #include "CoreStringUtils.h"
 
 #include <map>
+#include <set>
 
 namespace Tundra
 {
@@ -85,14 +86,67 @@ public:
     void EmitAssetChanged(String absoluteFilename, IAssetStorage::ChangeType change);
 
     /// Walks through this storage on disk and creates a cached index of all the filenames inside this storage.
+    /** The index is saved to the index file, if one has been set and the files or directories have changed since it was last saved. */
     void CacheStorageContents();
 
+    /// Keeps the index current with a file change notification from changeWatcher.
+    /** @param absoluteFilename Absolute path of the changed file or directory. */
+    void UpdateFileIndex(const String &absoluteFilename);
+
+    /// Saves the index to the index file if file change notifications have changed it, and the changes have settled for a while.
+    /** Called by LocalAssetProvider after processing the notifications. */
+    void SaveChangedFileIndex();
+
+    /// Sets the file the index of the storage contents is persisted to. If empty, the index is not persisted.
+    /** The persisted index is used instead of walking through the storage, if no directory of the storage
+        has been modified since the index was saved. */
+    void SetIndexFile(const String &filename) { indexFile = filename; }
+
 private:
     friend class LocalAssetProvider;
 
+    /// Loads the index from the index file, or walks through the storage if that fails.
+    void BuildFileIndex();
+
+    /// Returns whether a lookup miss of a file that is not yet known to be missing should walk through the storage again.
+    bool FileIndexNeedsRescan() const;
+
+    /// Reads cachedFiles from the index file. Returns false if the file does not exist or is out of date.
+    bool LoadFileIndex();
+
+    /// Writes cachedFiles and indexDirectories to the index file.
+    void SaveFileIndex();
+
+    /// Fills @c directories with the directories of the storage, relative to it, and their modification times.
+    void ScanDirectoryTimes(std::map<String, unsigned> &directories) const;
+
     /// Maps a file basename 'asset.mesh' to its full path 'c:\project\assets\asset.mesh'.
     /// Used to quickly lookup known assets by basename instead of having to do an expensive recursive directory search.
     std::map<String, String, StringCompareCaseInsensitive> cachedFiles;
+
+    /// Basenames that have not been found in the storage. Lookups of these do not walk through the storage again until a rescan is due.
+    std::set<String, StringCompareCaseInsensitive> missingFiles;
+
+    /// File the index is persisted to.
+    String indexFile;
+
+    /// Modification times of the storage directories, relative to the storage, as saved to the index file.
+    std::map<String, unsigned> indexDirectories;
+
+    /// Set when file change notifications have changed the index since it was saved.
+    bool indexDirty;
+
+    /// System time of the last change to the index that has not been saved, in milliseconds.
+    unsigned lastIndexChangeTime;
+
+    /// Whether cachedFiles has been filled.
+    bool indexBuilt;
+
+    /// Set when a change notification could not be applied to the index, for example when a directory was moved.
+    bool indexStale;
+
+    /// System time of the last walk through the storage, in milliseconds.
+    unsigned lastScanTime;
 };
 
 }
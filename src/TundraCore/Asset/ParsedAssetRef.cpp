@@ -0,0 +1,17 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "ParsedAssetRef.h"
+
+namespace Tundra
+{
+
+ParsedAssetRef::ParsedAssetRef(const String &assetRef) :
+    ref(assetRef)
+{
+    type = AssetAPI::ParseAssetRef(assetRef, &protocol, &namedStorage, &protocolPath, &pathFilenameSubAssetName, &pathFilename,
+        &path, &filename, &subAssetName, &fullRef, &fullRefNoSubAssetName);
+    hash = StringHash(fullRef);
+}
+
+}
@@ -0,0 +1,44 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraCoreApi.h"
+#include "AssetAPI.h"
+
+#include <Urho3D/Container/RefCounted.h>
+#include <Urho3D/Math/StringHash.h>
+
+namespace Tundra
+{
+
+/// Asset reference parsed into its parts with AssetAPI::ParseAssetRef.
+/** Obtained from AssetAPI::InternAssetRef, which keeps the parsed refs so that the refs that are resolved, requested and
+    looked up over and over again when loading a scene are parsed only once. The parts are the out parameters of
+    AssetAPI::ParseAssetRef, see it for examples. */
+class TUNDRACORE_API ParsedAssetRef : public RefCounted
+{
+public:
+    /// Parses @c assetRef.
+    explicit ParsedAssetRef(const String &assetRef);
+
+    /// The ref as given.
+    String ref;
+    /// The parsed type of the ref.
+    AssetAPI::AssetRefType type;
+
+    String protocol; ///< "http://server.com/asset.png" -> "http".
+    String namedStorage; ///< "myStorage:asset.png" -> "myStorage".
+    String protocolPath; ///< "http://server.com/path/folder2/asset.png" -> "http://server.com/path/folder2/".
+    String pathFilenameSubAssetName; ///< "local://path/folder/asset.zip#subAsset" -> "path/folder/asset.zip#subAsset".
+    String pathFilename; ///< "local://path/folder/asset.zip#subAsset" -> "path/folder/asset.zip".
+    String path; ///< "local://path/folder/asset.zip#subAsset" -> "path/folder/".
+    String filename; ///< "local://path/folder/asset.zip#subAsset" -> "asset.zip".
+    String subAssetName; ///< "local://path/folder/asset.zip#subAsset" -> "subAsset".
+    String fullRef; ///< Canonicalized form of the ref.
+    String fullRefNoSubAssetName; ///< Canonicalized form of the ref without the sub asset name.
+
+    /// Case-insensitive hash of fullRef.
+    StringHash hash;
+};
+
+}
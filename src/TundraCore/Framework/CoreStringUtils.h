@@ -6,6 +6,7 @@
 #include "CoreTypes.h"
 
 #include <Urho3D/Container/Str.h>
+#include <Urho3D/Math/StringHash.h>
 
 namespace kNet { class DataSerializer; class DataDeserializer; }
 
@@ -21,6 +22,25 @@ struct TUNDRACORE_API StringCompareCaseInsensitive
     }
 };
 
+/// Can be used as a custom hash in std::unordered_map or similar when wanting case-insensitive lookup.
+/** Use with StringEqualCaseInsensitive. The hash is the case-folded StringHash of the string. */
+struct TUNDRACORE_API StringHashCaseInsensitive
+{
+    size_t operator()(const String &str) const
+    {
+        return StringHash(str).Value();
+    }
+};
+
+/// Can be used as a custom key equality in std::unordered_map or similar when wanting case-insensitive lookup.
+struct TUNDRACORE_API StringEqualCaseInsensitive
+{
+    bool operator()(const String &a, const String &b) const
+    {
+        return a.Compare(b, false) == 0;
+    }
+};
+
 /// Reads an UTF-8 encoded String from a data stream
 String TUNDRACORE_API ReadUtf8String(kNet::DataDeserializer &dd);
 
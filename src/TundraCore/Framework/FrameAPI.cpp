@@ -8,15 +8,20 @@
 #include "StableHeaders.h"
 #include "FrameAPI.h"
 #include "Framework.h"
+#include "LoggingFunctions.h"
 
 #include <Urho3D/Core/Profiler.h>
+#include <Urho3D/Core/WorkQueue.h>
 
 namespace Tundra
 {
 
 FrameAPI::FrameAPI(Framework *fw) :
     Object(fw->GetContext()),
-    currentFrameNumber(0)
+    currentFrameNumber(0),
+    numSystemPhases(0),
+    systemsChanged(false),
+    systemFrametime(0.0f)
 {
 }
 
@@ -26,6 +31,9 @@ FrameAPI::~FrameAPI()
 
 void FrameAPI::Reset()
 {
+    systems.Clear();
+    numSystemPhases = 0;
+    systemsChanged = false;
 }
 
 float FrameAPI::WallClockTime() const
@@ -42,10 +50,134 @@ DelayedSignal& FrameAPI::DelayedExecute(float time)
     return newSignal;
 }
 
+void FrameAPI::RegisterSystem(const SharedPtr<FrameSystem> &system)
+{
+    if (!system)
+        return;
+    if (System(system->Name()))
+    {
+        LogWarning("FrameAPI::RegisterSystem: A system named " + system->Name() + " is already registered.");
+        return;
+    }
+
+    ScheduledSystem scheduled;
+    scheduled.system = system;
+    scheduled.workItem = new Urho3D::WorkItem();
+    scheduled.workItem->workFunction_ = UpdateSystemWork;
+    scheduled.workItem->start_ = system.Get();
+    scheduled.workItem->aux_ = this;
+    scheduled.workItem->priority_ = Urho3D::M_MAX_UNSIGNED;
+    // Not run until scheduled on the next frame.
+    scheduled.phase = Urho3D::M_MAX_UNSIGNED;
+    scheduled.removed = false;
+    systems.Push(scheduled);
+    systemsChanged = true;
+}
+
+void FrameAPI::UnregisterSystem(FrameSystem *system)
+{
+    // The system may be running, it is dropped when the systems are scheduled the next time.
+    for(uint i = 0; i < systems.Size(); ++i)
+    {
+        if (systems[i].system == system && !systems[i].removed)
+        {
+            systems[i].removed = true;
+            systemsChanged = true;
+            return;
+        }
+    }
+}
+
+FrameSystem *FrameAPI::System(const String &name) const
+{
+    for(uint i = 0; i < systems.Size(); ++i)
+        if (!systems[i].removed && systems[i].system->Name() == name)
+            return systems[i].system.Get();
+    return 0;
+}
+
+void FrameAPI::ScheduleSystems()
+{
+    for(uint i = 0; i < systems.Size();)
+    {
+        if (systems[i].removed)
+            systems.Erase(i);
+        else
+            ++i;
+    }
+
+    // Each system runs in the phase after the last earlier registered system it conflicts with.
+    numSystemPhases = 0;
+    for(uint i = 0; i < systems.Size(); ++i)
+    {
+        uint phase = 0;
+        for(uint j = 0; j < i; ++j)
+            if (systems[j].phase >= phase && systems[i].system->ConflictsWith(*systems[j].system))
+                phase = systems[j].phase + 1;
+        systems[i].phase = phase;
+        systems[i].system->dependenciesChanged_ = false;
+        if (phase + 1 > numSystemPhases)
+            numSystemPhases = phase + 1;
+    }
+    systemsChanged = false;
+}
+
+void FrameAPI::UpdateSystemWork(const Urho3D::WorkItem *item, unsigned /*threadIndex*/)
+{
+    FrameSystem *system = static_cast<FrameSystem*>(item->start_);
+    FrameAPI *frame = static_cast<FrameAPI*>(item->aux_);
+    system->Update(frame->systemFrametime);
+}
+
+void FrameAPI::UpdateSystems(float frametime)
+{
+    if (systems.Empty())
+        return;
+
+    PROFILE(FrameAPI_UpdateSystems);
+
+    if (!systemsChanged)
+    {
+        for(uint i = 0; i < systems.Size(); ++i)
+            systemsChanged |= systems[i].system->dependenciesChanged_;
+    }
+    if (systemsChanged)
+        ScheduleSystems();
+
+    systemFrametime = frametime;
+    Urho3D::WorkQueue *workQueue = GetSubsystem<Urho3D::WorkQueue>();
+    const bool parallel = workQueue && workQueue->GetNumThreads() > 0;
+
+    for(uint phase = 0; phase < numSystemPhases; ++phase)
+    {
+        // Hand the thread-safe systems of the phase to the worker threads, and run the rest on the main thread meanwhile.
+        bool queued = false;
+        for(uint i = 0; i < systems.Size(); ++i)
+        {
+            if (parallel && systems[i].phase == phase && systems[i].system->IsThreadSafe())
+            {
+                workQueue->AddWorkItem(systems[i].workItem);
+                queued = true;
+            }
+        }
+        for(uint i = 0; i < systems.Size(); ++i)
+        {
+            if (systems[i].phase != phase || systems[i].removed || (parallel && systems[i].system->IsThreadSafe()))
+                continue;
+            // Keep a reference, the system may unregister itself.
+            SharedPtr<FrameSystem> system = systems[i].system;
+            system->Update(frametime);
+        }
+        if (queued)
+            workQueue->Complete(Urho3D::M_MAX_UNSIGNED);
+    }
+}
+
 void FrameAPI::Update(float frametime)
 {
     PROFILE(FrameAPI_Update);
 
+    UpdateSystems(frametime);
     Updated.Emit(frametime);
     PostFrameUpdate.Emit(frametime);
 
@@ -9,11 +9,17 @@
 #include "TundraCoreApi.h"
 #include "CoreTypes.h"
 #include "Signals.h"
+#include "FrameSystem.h"
 
 #include <Urho3D/Core/Object.h>
 #include <Urho3D/Core/Timer.h>
 #include <Urho3D/Container/List.h>
 
+namespace Urho3D
+{
+    struct WorkItem;
+}
+
 namespace Tundra
 {
 
@@ -33,7 +39,8 @@ public:
     FrameAPI object can be used to:
     -retrieve signal every time frame has been processed
     -retrieve the wall clock time of Framework
-    -trigger delayed signals when spesified amount of time has elapsed. */
+    -trigger delayed signals when spesified amount of time has elapsed.
+    -run batch updates of systems, see FrameSystem. */
 class TUNDRACORE_API FrameAPI : public Object
 {
     OBJECT(FrameAPI);
@@ -50,6 +57,30 @@ class TUNDRACORE_API FrameAPI : public Object
     /** @note It is best not to tie any timing-specific animation to this number, but instead use WallClockTime(). */
     int FrameNumber() const { return currentFrameNumber; }
 
+    /// Registers a system to be updated each frame before the Updated signal.
+    /** Systems are scheduled according to their declared dependencies, see FrameSystem. */
+    void RegisterSystem(const SharedPtr<FrameSystem> &system);
+
+    /// Unregisters a system.
+    void UnregisterSystem(FrameSystem *system);
+
+    /// Returns a registered system by name, or null if not found.
+    FrameSystem *System(const String &name) const;
+
+    /// Returns the system updating the instances of component type @c T, creating and registering it on first use.
+    /** The system writes the component type name. Further dependencies can be declared on the returned system. */
+    template <typename T>
+    ComponentSystem<T> *ComponentUpdateSystem(bool threadSafe = false)
+    {
+        FrameSystem *existing = System(T::TypeNameStatic());
+        if (existing)
+            return static_cast<ComponentSystem<T>*>(existing);
+        SharedPtr<ComponentSystem<T> > system(new ComponentSystem<T>(T::TypeNameStatic(), threadSafe));
+        system->Writes(T::TypeNameStatic());
+        RegisterSystem(system);
+        return system.Get();
+    }
+
     /// Emitted when it is time for client code to update their applications.
     /** Scripts and client C++ code can hook into this signal to perform custom per-frame processing.
         This signal is typically used to perform *logic* updates for e.g. game state, networking and other processing.
@@ -81,10 +112,34 @@ private:
     /** @param frametime Time elapsed since last frame. */
     void Update(float frametime);
 
+    /// Runs the registered systems, phase by phase.
+    void UpdateSystems(float frametime);
+
+    /// Assigns the systems to phases so that the systems of a phase do not conflict, and drops the unregistered systems.
+    void ScheduleSystems();
+
+    /// Work function for running a thread-safe system on a worker thread.
+    static void UpdateSystemWork(const Urho3D::WorkItem *item, unsigned threadIndex);
+
+    /// A registered system and its schedule.
+    struct ScheduledSystem
+    {
+        SharedPtr<FrameSystem> system;
+        SharedPtr<Urho3D::WorkItem> workItem;
+        uint phase;
+        bool removed;
+    };
+
     // Wallclock high-res timer
     mutable Urho3D::HiresTimer wallClock;
     int currentFrameNumber;
     List<DelayedSignal> delayedSignals;
+    /// Registered systems in registration order.
+    Vector<ScheduledSystem> systems;
+    uint numSystemPhases;
+    bool systemsChanged;
+    /// Frame time passed to the systems running on the worker threads.
+    float systemFrametime;
 };
 
 }
@@ -0,0 +1,55 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   FrameSystem.cpp
+    @brief  Batch per-frame updates scheduled by FrameAPI. */
+
+#include "StableHeaders.h"
+#include "FrameSystem.h"
+
+namespace Tundra
+{
+
+FrameSystem::FrameSystem(const String &name, bool threadSafe) :
+    name_(name),
+    threadSafe_(threadSafe),
+    dependenciesChanged_(false)
+{
+}
+
+FrameSystem::~FrameSystem()
+{
+}
+
+void FrameSystem::Reads(const String &resource)
+{
+    StringHash hash(resource);
+    if (!reads_.Contains(hash))
+    {
+        reads_.Push(hash);
+        dependenciesChanged_ = true;
+    }
+}
+
+void FrameSystem::Writes(const String &resource)
+{
+    StringHash hash(resource);
+    if (!writes_.Contains(hash))
+    {
+        writes_.Push(hash);
+        dependenciesChanged_ = true;
+    }
+}
+
+bool FrameSystem::ConflictsWith(const FrameSystem &other) const
+{
+    for(uint i = 0; i < writes_.Size(); ++i)
+        if (other.writes_.Contains(writes_[i]) || other.reads_.Contains(writes_[i]))
+            return true;
+    for(uint i = 0; i < other.writes_.Size(); ++i)
+        if (reads_.Contains(other.writes_[i]))
+            return true;
+    return false;
+}
+
+}
@@ -0,0 +1,135 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   FrameSystem.h
+    @brief  Batch per-frame updates scheduled by FrameAPI. */
+
+#pragma once
+
+#include "TundraCoreApi.h"
+#include "CoreTypes.h"
+
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Container/RefCounted.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Math/StringHash.h>
+
+namespace Tundra
+{
+
+/// A per-frame batch update scheduled by FrameAPI.
+/** Instead of every instance of e.g. a component type connecting to FrameAPI::Updated, a system updates all of its
+    instances at once. Systems are registered with FrameAPI::RegisterSystem and updated each frame before the Updated
+    signal is emitted.
+
+    A system declares the resources it reads and writes with Reads and Writes, for example the component type names
+    whose state it accesses. Systems that do not conflict, i.e. neither writes a resource the other one reads or writes,
+    may run at the same time. Thread-safe systems run on the worker threads, the others on the main thread. Conflicting
+    systems run in their registration order. */
+class TUNDRACORE_API FrameSystem : public RefCounted
+{
+public:
+    /// @param name Name of the system, used for profiling and FrameAPI::System.
+    /// @param threadSafe Whether Update can be run on a worker thread.
+    explicit FrameSystem(const String &name, bool threadSafe = false);
+    virtual ~FrameSystem();
+
+    /// Updates the system.
+    /** @param frametime Elapsed time in seconds since the last frame. */
+    virtual void Update(float frametime) = 0;
+
+    /// Declares that the system reads @c resource.
+    void Reads(const String &resource);
+
+    /// Declares that the system writes @c resource. A written resource may also be read.
+    void Writes(const String &resource);
+
+    /// Returns whether the system cannot run at the same time as @c other.
+    bool ConflictsWith(const FrameSystem &other) const;
+
+    /// Returns the name of the system.
+    const String &Name() const { return name_; }
+
+    /// Returns whether the system can be run on a worker thread.
+    bool IsThreadSafe() const { return threadSafe_; }
+
+private:
+    friend class FrameAPI;
+
+    String name_;
+    bool threadSafe_;
+    PODVector<StringHash> reads_;
+    PODVector<StringHash> writes_;
+    /// Set when the dependencies change, so that FrameAPI rebuilds its schedule.
+    bool dependenciesChanged_;
+};
+
+/// Updates all instances of component type @c T with T::Update(frametime).
+/** Obtain the system with FrameAPI::ComponentUpdateSystem<T> and Add each instance once, typically when the component has
+    been attached to its parent entity. The instances are kept in a contiguous vector of weak pointers, and destroyed
+    instances are dropped on the next update, so a component does not need to remove itself on destruction.
+    Add is idempotent, so it can be called whenever the component (re)connects its signals.
+    @note If an instance is destroyed during the update, the last instance may be skipped for that frame. */
+template <typename T>
+class ComponentSystem : public FrameSystem
+{
+public:
+    explicit ComponentSystem(const String &name, bool threadSafe = false) :
+        FrameSystem(name, threadSafe)
+    {
+    }
+
+    /// Adds @c instance to be updated each frame. Adding an instance that is already added does nothing.
+    void Add(T *instance)
+    {
+        if (!instance)
+            return;
+        for(uint i = 0; i < instances_.Size(); ++i)
+            if (instances_[i].Get() == instance)
+                return;
+        instances_.Push(WeakPtr<T>(instance));
+    }
+
+    /// Removes @c instance.
+    void Remove(T *instance)
+    {
+        for(uint i = 0; i < instances_.Size(); ++i)
+        {
+            if (instances_[i].Get() == instance)
+            {
+                RemoveAt(i);
+                return;
+            }
+        }
+    }
+
+    /// Returns the number of instances.
+    uint NumInstances() const { return instances_.Size(); }
+
+    void Update(float frametime) override
+    {
+        for(uint i = 0; i < instances_.Size();)
+        {
+            T *instance = instances_[i].Get();
+            if (!instance)
+            {
+                RemoveAt(i);
+                continue;
+            }
+            instance->Update(frametime);
+            ++i;
+        }
+    }
+
+private:
+    void RemoveAt(uint index)
+    {
+        if (index + 1 < instances_.Size())
+            instances_[index] = instances_.Back();
+        instances_.Pop();
+    }
+
+    Vector<WeakPtr<T> > instances_;
+};
+
+}
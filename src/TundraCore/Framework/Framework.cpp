@@ -247,6 +247,8 @@ void Framework::Uninitialize()
     // Delete scenes, assets and factories before unloading modules
     scene->Reset();
     asset->Reset();
+    // Frame systems may be implemented in plugins, release them before the plugins are unloaded.
+    frame->Reset();
 
     LogDebug("Unloading");
     for(uint i = 0; i < modules.Size(); ++i)
@@ -16,6 +16,8 @@ namespace Tundra
     class PluginAPI;
     class ConfigAPI;
     class FrameAPI;
+    class FrameSystem;
+    template <typename T> class ComponentSystem;
     class SceneAPI;
     class ConsoleAPI;
     class AssetAPI;
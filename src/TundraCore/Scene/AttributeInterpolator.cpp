@@ -0,0 +1,528 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   AttributeInterpolator.cpp
+    @brief  Runs the attribute interpolations of a scene in per-type batches. */
+
+#include "StableHeaders.h"
+
+#include "AttributeInterpolator.h"
+#include "IAttribute.h"
+#include "IComponent.h"
+#include "Math/Transform.h"
+#include "Math/Color.h"
+
+#include <Math/Quat.h>
+#include <Math/float2.h>
+#include <Math/float3.h>
+#include <Math/float4.h>
+#include <Math/MathFunc.h>
+
+#include <cmath>
+
+namespace Tundra
+{
+
+namespace
+{
+
+/// Attribute types that are interpolated in batches.
+struct BatchType
+{
+    u32 typeId;
+    uint numLerp;
+    bool slerp;
+};
+
+const BatchType cBatchTypes[] =
+{
+    { IAttribute::RealId, 1, false },
+    { IAttribute::Float2Id, 2, false },
+    { IAttribute::Float3Id, 3, false },
+    { IAttribute::Float4Id, 4, false },
+    { IAttribute::ColorId, 4, false },
+    { IAttribute::QuatId, 0, true },
+    { IAttribute::TransformId, 6, true } // Position and scale, and the orientation as a quaternion.
+};
+
+/// Linear interpolation of one channel of a batch.
+void LerpChannel(const float* start, const float* end, const float* t, float* out, uint count)
+{
+    for(uint i = 0; i < count; ++i)
+        out[i] = start[i] + (end[i] - start[i]) * t[i];
+}
+
+/// Spherical linear interpolation of the quaternion channels x, y, z, w of a batch.
+/** Uses the shorter arc, polynomial approximations of acos and sin, and renormalizes the result like Quat::Slerp.
+    Both branches are computed and selected, so the loop has no data dependent jumps. */
+void SlerpChannels(const float* const* start, const float* const* end, const float* t, float* const* out, uint count)
+{
+    const float *sx = start[0], *sy = start[1], *sz = start[2], *sw = start[3];
+    const float *ex = end[0], *ey = end[1], *ez = end[2], *ew = end[3];
+    float *ox = out[0], *oy = out[1], *oz = out[2], *ow = out[3];
+
+    for(uint i = 0; i < count; ++i)
+    {
+        float cosAngle = sx[i] * ex[i] + sy[i] * ey[i] + sz[i] * ez[i] + sw[i] * ew[i];
+        float sign = cosAngle < 0.f ? -1.f : 1.f;
+        cosAngle *= sign;
+
+        float angle = (-0.69813170079773212f * cosAngle * cosAngle - 0.87266462599716477f) * cosAngle + 1.5707963267948966f;
+        float tb = t[i] * angle;
+        float ta = angle - tb;
+        float tb2 = tb * tb;
+        float ta2 = ta * ta;
+        float sinB = ((5.64311797634681035370e-03f * tb2 - 1.55271410633428644799e-01f) * tb2 + 9.87862135574673806965e-01f) * tb;
+        float sinA = ((5.64311797634681035370e-03f * ta2 - 1.55271410633428644799e-01f) * ta2 + 9.87862135574673806965e-01f) * ta;
+
+        // Close to parallel quaternions would divide by a zero sine, use linear interpolation instead.
+        bool linear = cosAngle >= 0.999f;
+        float a = (linear ? 1.f - t[i] : sinA) * sign;
+        float b = linear ? t[i] : sinB;
+
+        float x = sx[i] * a + ex[i] * b;
+        float y = sy[i] * a + ey[i] * b;
+        float z = sz[i] * a + ez[i] * b;
+        float w = sw[i] * a + ew[i] * b;
+        float invLength = 1.f / sqrtf(x * x + y * y + z * z + w * w);
+        ox[i] = x * invLength;
+        oy[i] = y * invLength;
+        oz[i] = z * invLength;
+        ow[i] = w * invLength;
+    }
+}
+
+}
+
+AttributeInterpolator::AttributeInterpolator() :
+    updating_(false)
+{
+    batchByType_.Resize(IAttribute::NumTypes);
+    for(uint i = 0; i < batchByType_.Size(); ++i)
+        batchByType_[i] = cGeneric;
+
+    const uint numBatchTypes = sizeof(cBatchTypes) / sizeof(cBatchTypes[0]);
+    batches_.Resize(numBatchTypes);
+    for(uint i = 0; i < numBatchTypes; ++i)
+    {
+        Batch& batch = batches_[i];
+        batch.typeId = cBatchTypes[i].typeId;
+        batch.numLerp = cBatchTypes[i].numLerp;
+        batch.slerp = cBatchTypes[i].slerp;
+        uint numChannels = batch.numLerp + (batch.slerp ? 4 : 0);
+        batch.start.Resize(numChannels);
+        batch.end.Resize(numChannels);
+        batch.value.Resize(numChannels);
+        batchByType_[batch.typeId] = i;
+    }
+}
+
+AttributeInterpolator::~AttributeInterpolator()
+{
+    Clear();
+}
+
+void AttributeInterpolator::ReadChannels(const Batch& batch, const IAttribute& attr, float* channels)
+{
+    switch(batch.typeId)
+    {
+    case IAttribute::RealId:
+        channels[0] = static_cast<const Attribute<float>&>(attr).Get();
+        break;
+    case IAttribute::Float2Id:
+    {
+        const float2& v = static_cast<const Attribute<float2>&>(attr).Get();
+        channels[0] = v.x; channels[1] = v.y;
+        break;
+    }
+    case IAttribute::Float3Id:
+    {
+        const float3& v = static_cast<const Attribute<float3>&>(attr).Get();
+        channels[0] = v.x; channels[1] = v.y; channels[2] = v.z;
+        break;
+    }
+    case IAttribute::Float4Id:
+    {
+        const float4& v = static_cast<const Attribute<float4>&>(attr).Get();
+        channels[0] = v.x; channels[1] = v.y; channels[2] = v.z; channels[3] = v.w;
+        break;
+    }
+    case IAttribute::ColorId:
+    {
+        const Color& c = static_cast<const Attribute<Color>&>(attr).Get();
+        channels[0] = c.r; channels[1] = c.g; channels[2] = c.b; channels[3] = c.a;
+        break;
+    }
+    case IAttribute::QuatId:
+    {
+        const Quat& q = static_cast<const Attribute<Quat>&>(attr).Get();
+        channels[0] = q.x; channels[1] = q.y; channels[2] = q.z; channels[3] = q.w;
+        break;
+    }
+    case IAttribute::TransformId:
+    {
+        const Transform& t = static_cast<const Attribute<Transform>&>(attr).Get();
+        Quat q = t.Orientation();
+        channels[0] = t.pos.x; channels[1] = t.pos.y; channels[2] = t.pos.z;
+        channels[3] = t.scale.x; channels[4] = t.scale.y; channels[5] = t.scale.z;
+        channels[6] = q.x; channels[7] = q.y; channels[8] = q.z; channels[9] = q.w;
+        break;
+    }
+    }
+}
+
+void AttributeInterpolator::WriteChannels(const Batch& batch, IAttribute* attr, const float* channels, AttributeChange::Type change)
+{
+    switch(batch.typeId)
+    {
+    case IAttribute::RealId:
+        static_cast<Attribute<float>*>(attr)->Set(channels[0], change);
+        break;
+    case IAttribute::Float2Id:
+        static_cast<Attribute<float2>*>(attr)->Set(float2(channels[0], channels[1]), change);
+        break;
+    case IAttribute::Float3Id:
+        static_cast<Attribute<float3>*>(attr)->Set(float3(channels[0], channels[1], channels[2]), change);
+        break;
+    case IAttribute::Float4Id:
+        static_cast<Attribute<float4>*>(attr)->Set(float4(channels[0], channels[1], channels[2], channels[3]), change);
+        break;
+    case IAttribute::ColorId:
+        static_cast<Attribute<Color>*>(attr)->Set(Color(channels[0], channels[1], channels[2], channels[3]), change);
+        break;
+    case IAttribute::QuatId:
+        static_cast<Attribute<Quat>*>(attr)->Set(Quat(channels[0], channels[1], channels[2], channels[3]), change);
+        break;
+    case IAttribute::TransformId:
+    {
+        Transform t;
+        t.pos = float3(channels[0], channels[1], channels[2]);
+        t.scale = float3(channels[3], channels[4], channels[5]);
+        t.SetOrientation(Quat(channels[6], channels[7], channels[8], channels[9]));
+        static_cast<Attribute<Transform>*>(attr)->Set(t, change);
+        break;
+    }
+    }
+}
+
+const AttributeInterpolator::Location* AttributeInterpolator::Find(IAttribute* attr) const
+{
+    HashMap<IAttribute*, Location>::ConstIterator it = lookup_.Find(attr);
+    if (it == lookup_.End())
+        return 0;
+    // The component of the attribute may have been destroyed and another one allocated at the same address.
+    const Location& loc = it->second_;
+    bool expired = (loc.batch == cGeneric ? generic_[loc.index].owner.Expired() : batches_[loc.batch].owners[loc.index].Expired());
+    return !expired ? &loc : 0;
+}
+
+bool AttributeInterpolator::Contains(IAttribute* attr) const
+{
+    return Find(attr) != 0;
+}
+
+bool AttributeInterpolator::Start(IAttribute* attr, const IAttribute& endValue, float length)
+{
+    if (!attr || endValue.TypeId() != attr->TypeId())
+        return false;
+
+    const bool previous = Contains(attr);
+    const u32 typeId = attr->TypeId();
+    const uint batchIndex = (typeId < batchByType_.Size() ? batchByType_[typeId] : cGeneric);
+
+    // If a previous interpolation does not exist, snap directly to the end value. Done before accessing the storage,
+    // as the attribute change signal handlers may end interpolations.
+    if (batchIndex == cGeneric)
+    {
+        IAttribute* end = endValue.Clone();
+        if (!previous)
+            attr->CopyValue(end, AttributeChange::LocalOnly);
+
+        const Location* loc = Find(attr);
+        uint index = loc ? loc->index : generic_.Size();
+        if (!loc)
+        {
+            generic_.Push(GenericInterpolation());
+            Location newLoc = { cGeneric, index };
+            lookup_[attr] = newLoc;
+        }
+        GenericInterpolation& interp = generic_[index];
+        delete interp.start;
+        delete interp.end;
+        interp.attr = attr;
+        interp.owner = attr->Owner();
+        interp.start = attr->Clone();
+        interp.end = end;
+        interp.time = 0.0f;
+        interp.length = length;
+        interp.finished = false;
+        return previous;
+    }
+
+    Batch& batch = batches_[batchIndex];
+    channels_.Resize(batch.start.Size());
+    if (!previous)
+    {
+        ReadChannels(batch, endValue, &channels_[0]);
+        WriteChannels(batch, attr, &channels_[0], AttributeChange::LocalOnly);
+    }
+
+    const Location* loc = Find(attr);
+    uint index = loc ? loc->index : batch.attrs.Size();
+    if (!loc)
+    {
+        batch.attrs.Push(attr);
+        batch.owners.Push(ComponentWeakPtr(attr->Owner()));
+        batch.times.Push(0.0f);
+        batch.lengths.Push(0.0f);
+        batch.finished.Push(false);
+        for(uint c = 0; c < batch.start.Size(); ++c)
+        {
+            batch.start[c].Push(0.0f);
+            batch.end[c].Push(0.0f);
+            batch.value[c].Push(0.0f);
+        }
+        Location newLoc = { batchIndex, index };
+        lookup_[attr] = newLoc;
+    }
+    batch.owners[index] = attr->Owner();
+    batch.times[index] = 0.0f;
+    batch.lengths[index] = length;
+    batch.finished[index] = false;
+
+    ReadChannels(batch, *attr, &channels_[0]);
+    for(uint c = 0; c < channels_.Size(); ++c)
+        batch.start[c][index] = channels_[c];
+    ReadChannels(batch, endValue, &channels_[0]);
+    for(uint c = 0; c < channels_.Size(); ++c)
+        batch.end[c][index] = channels_[c];
+    return previous;
+}
+
+bool AttributeInterpolator::End(IAttribute* attr)
+{
+    const Location* loc = Find(attr);
+    if (!loc)
+        return false;
+
+    uint batchIndex = loc->batch;
+    uint index = loc->index;
+    // During an update the storage is compacted once the batch has been processed.
+    if (updating_)
+    {
+        if (batchIndex == cGeneric)
+            generic_[index].finished = true;
+        else
+            batches_[batchIndex].finished[index] = true;
+        lookup_.Erase(attr);
+    }
+    else
+        Remove(batchIndex, index);
+    return true;
+}
+
+void AttributeInterpolator::Remove(uint batchIndex, uint index)
+{
+    IAttribute* attr = 0;
+    uint last = 0;
+    if (batchIndex == cGeneric)
+    {
+        attr = generic_[index].attr;
+        delete generic_[index].start;
+        delete generic_[index].end;
+        last = generic_.Size() - 1;
+        if (index != last)
+            generic_[index] = generic_[last];
+        generic_.Pop();
+    }
+    else
+    {
+        Batch& batch = batches_[batchIndex];
+        attr = batch.attrs[index];
+        last = batch.attrs.Size() - 1;
+        if (index != last)
+        {
+            batch.attrs[index] = batch.attrs[last];
+            batch.owners[index] = batch.owners[last];
+            batch.times[index] = batch.times[last];
+            batch.lengths[index] = batch.lengths[last];
+            batch.finished[index] = batch.finished[last];
+            for(uint c = 0; c < batch.start.Size(); ++c)
+            {
+                batch.start[c][index] = batch.start[c][last];
+                batch.end[c][index] = batch.end[c][last];
+                batch.value[c][index] = batch.value[c][last];
+            }
+        }
+        batch.attrs.Pop();
+        batch.owners.Pop();
+        batch.times.Pop();
+        batch.lengths.Pop();
+        batch.finished.Pop();
+        for(uint c = 0; c < batch.start.Size(); ++c)
+        {
+            batch.start[c].Pop();
+            batch.end[c].Pop();
+            batch.value[c].Pop();
+        }
+    }
+
+    // The lookup may already point to a newer interpolation of the same attribute address.
+    HashMap<IAttribute*, Location>::Iterator it = lookup_.Find(attr);
+    if (it != lookup_.End() && it->second_.batch == batchIndex && it->second_.index == index)
+        lookup_.Erase(it);
+    if (index != last)
+    {
+        IAttribute* moved = (batchIndex == cGeneric ? generic_[index].attr : batches_[batchIndex].attrs[index]);
+        it = lookup_.Find(moved);
+        if (it != lookup_.End() && it->second_.batch == batchIndex && it->second_.index == last)
+            it->second_.index = index;
+    }
+}
+
+void AttributeInterpolator::Clear()
+{
+    if (updating_)
+    {
+        // Removed once the batches have been processed.
+        for(uint i = 0; i < batches_.Size(); ++i)
+            for(uint j = 0; j < batches_[i].finished.Size(); ++j)
+                batches_[i].finished[j] = true;
+        for(uint i = 0; i < generic_.Size(); ++i)
+            generic_[i].finished = true;
+        lookup_.Clear();
+        return;
+    }
+
+    for(uint i = 0; i < batches_.Size(); ++i)
+    {
+        Batch& batch = batches_[i];
+        batch.attrs.Clear();
+        batch.owners.Clear();
+        batch.times.Clear();
+        batch.lengths.Clear();
+        batch.finished.Clear();
+        for(uint c = 0; c < batch.start.Size(); ++c)
+        {
+            batch.start[c].Clear();
+            batch.end[c].Clear();
+            batch.value[c].Clear();
+        }
+    }
+    for(uint i = 0; i < generic_.Size(); ++i)
+    {
+        delete generic_[i].start;
+        delete generic_[i].end;
+    }
+    generic_.Clear();
+    lookup_.Clear();
+}
+
+void AttributeInterpolator::Update(float frametime, AttributeChange::Type change)
+{
+    updating_ = true;
+    for(uint i = 0; i < batches_.Size(); ++i)
+        if (!batches_[i].attrs.Empty())
+            UpdateBatch(i, frametime, change);
+    if (!generic_.Empty())
+        UpdateGeneric(frametime, change);
+    updating_ = false;
+}
+
+void AttributeInterpolator::UpdateBatch(uint batchIndex, float frametime, AttributeChange::Type change)
+{
+    // Interpolations started by the attribute change handlers are processed on the next update.
+    Batch& batch = batches_[batchIndex];
+    const uint count = batch.attrs.Size();
+    t_.Resize(count);
+    apply_.Resize(count);
+
+    // Advance the times. The interpolation persists for 2x its length without setting the value,
+    // for the continuous/discontinuous update detection in Start.
+    for(uint i = 0; i < count; ++i)
+    {
+        apply_[i] = false;
+        t_[i] = 1.0f;
+        if (batch.finished[i])
+            continue;
+        if (batch.owners[i].Expired())
+        {
+            batch.finished[i] = true;
+            continue;
+        }
+        bool active = batch.times[i] <= batch.lengths[i];
+        batch.times[i] += frametime;
+        if (active)
+        {
+            apply_[i] = true;
+            t_[i] = Min(batch.times[i] / batch.lengths[i], 1.0f);
+        }
+        else if (batch.times[i] >= batch.lengths[i] * 2.0f)
+            batch.finished[i] = true;
+    }
+
+    // Interpolate all channels of the batch.
+    for(uint c = 0; c < batch.numLerp; ++c)
+        LerpChannel(&batch.start[c][0], &batch.end[c][0], &t_[0], &batch.value[c][0], count);
+    if (batch.slerp)
+    {
+        const uint q = batch.numLerp;
+        const float* start[4] = { &batch.start[q][0], &batch.start[q + 1][0], &batch.start[q + 2][0], &batch.start[q + 3][0] };
+        const float* end[4] = { &batch.end[q][0], &batch.end[q + 1][0], &batch.end[q + 2][0], &batch.end[q + 3][0] };
+        float* value[4] = { &batch.value[q][0], &batch.value[q + 1][0], &batch.value[q + 2][0], &batch.value[q + 3][0] };
+        SlerpChannels(start, end, &t_[0], value, count);
+    }
+
+    // Set the values. The change handlers may remove components or end interpolations, so check each before setting.
+    const uint numChannels = batch.value.Size();
+    channels_.Resize(numChannels);
+    for(uint i = 0; i < count; ++i)
+    {
+        if (!apply_[i] || batch.finished[i] || batch.owners[i].Expired())
+            continue;
+        for(uint c = 0; c < numChannels; ++c)
+            channels_[c] = batch.value[c][i];
+        WriteChannels(batch, batch.attrs[i], &channels_[0], change);
+    }
+
+    // Remove the finished interpolations. Iterate backwards, so that the moved ones have already been checked.
+    for(uint i = batch.attrs.Size() - 1; i < batch.attrs.Size(); --i)
+        if (batch.finished[i] || batch.owners[i].Expired())
+            Remove(batchIndex, i);
+}
+
+void AttributeInterpolator::UpdateGeneric(float frametime, AttributeChange::Type change)
+{
+    const uint count = generic_.Size();
+    for(uint i = 0; i < count; ++i)
+    {
+        GenericInterpolation& interp = generic_[i];
+        if (interp.finished)
+            continue;
+        // Check that the component still exists i.e. it's safe to access the attribute
+        if (interp.owner.Expired())
+        {
+            interp.finished = true;
+            continue;
+        }
+        if (interp.time <= interp.length)
+        {
+            interp.time += frametime;
+            float t = Min(interp.time / interp.length, 1.0f);
+            // Do not use interp after this, the change handlers may start new interpolations.
+            interp.attr->Interpolate(interp.start, interp.end, t, change);
+        }
+        else
+        {
+            interp.time += frametime;
+            if (interp.time >= interp.length * 2.0f)
+                interp.finished = true;
+        }
+    }
+
+    for(uint i = generic_.Size() - 1; i < generic_.Size(); --i)
+        if (generic_[i].finished || generic_[i].owner.Expired())
+            Remove(cGeneric, i);
+}
+
+}
@@ -0,0 +1,128 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   AttributeInterpolator.h
+    @brief  Runs the attribute interpolations of a scene in per-type batches. */
+
+#pragma once
+
+#include "TundraCoreApi.h"
+#include "CoreTypes.h"
+#include "SceneFwd.h"
+#include "AttributeChangeType.h"
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/Vector.h>
+
+namespace Tundra
+{
+
+/// Runs the attribute interpolations of a scene.
+/** Interpolations of float, float2, float3, float4, Color, Quat and Transform attributes are stored in one batch per type
+    as structure of arrays of float channels. A batch is updated with tight loops over each channel, which the compiler
+    vectorizes, and the results are written to the attributes without virtual calls. The storage is reused, so starting
+    an interpolation of these types does not allocate once the batches have grown. Other interpolated types fall back to
+    cloned start and end values and IAttribute::Interpolate.
+
+    Interpolations are looked up by attribute through a hash map. Finished interpolations are removed by moving the last
+    one of the batch in their place. */
+class TUNDRACORE_API AttributeInterpolator
+{
+public:
+    AttributeInterpolator();
+    ~AttributeInterpolator();
+
+    /// Starts an interpolation of @c attr from its current value to @c endValue.
+    /** If no interpolation was running for @c attr, it is set to @c endValue immediately, but the interpolation period is
+        still started, so that the next update is detected to be continuous and interpolated normally.
+        @param endValue Attribute of the same type holding the end value. The value is copied.
+        @return true if an interpolation was already running for @c attr. */
+    bool Start(IAttribute* attr, const IAttribute& endValue, float length);
+
+    /// Ends the interpolation of @c attr. The last set value remains.
+    /** @return true if an interpolation existed. */
+    bool End(IAttribute* attr);
+
+    /// Ends all interpolations.
+    void Clear();
+
+    /// Advances all interpolations by @c frametime and sets the interpolated values with @c change.
+    void Update(float frametime, AttributeChange::Type change);
+
+    /// Returns whether an interpolation is running for @c attr.
+    bool Contains(IAttribute* attr) const;
+
+    /// Returns the number of running interpolations.
+    uint Size() const { return lookup_.Size(); }
+
+private:
+    /// Interpolations of one attribute type.
+    struct Batch
+    {
+        Batch() : typeId(0), numLerp(0), slerp(false) {}
+
+        u32 typeId;
+        /// Number of linearly interpolated channels.
+        uint numLerp;
+        /// If true, the four channels after the linear ones are a quaternion interpolated with Slerp.
+        bool slerp;
+
+        PODVector<IAttribute*> attrs;
+        Vector<ComponentWeakPtr> owners;
+        PODVector<float> times;
+        PODVector<float> lengths;
+        PODVector<bool> finished;
+        /// Channel values, one vector per channel.
+        Vector<PODVector<float> > start;
+        Vector<PODVector<float> > end;
+        Vector<PODVector<float> > value;
+    };
+
+    /// Interpolation of an attribute type without a batch.
+    struct GenericInterpolation
+    {
+        GenericInterpolation() : attr(0), start(0), end(0), time(0.0f), length(0.0f), finished(false) {}
+
+        IAttribute* attr;
+        ComponentWeakPtr owner;
+        IAttribute* start;
+        IAttribute* end;
+        float time;
+        float length;
+        bool finished;
+    };
+
+    /// Location of an interpolation: batch index, or cGeneric, and the index in it.
+    struct Location
+    {
+        uint batch;
+        uint index;
+    };
+
+    /// Reads the channels of a batched attribute value.
+    static void ReadChannels(const Batch& batch, const IAttribute& attr, float* channels);
+    /// Sets a batched attribute value from channels.
+    static void WriteChannels(const Batch& batch, IAttribute* attr, const float* channels, AttributeChange::Type change);
+
+    void UpdateBatch(uint batchIndex, float frametime, AttributeChange::Type change);
+    void UpdateGeneric(float frametime, AttributeChange::Type change);
+    /// Removes the interpolation at @c index of @c batch by moving the last one in its place.
+    void Remove(uint batch, uint index);
+    /// Returns the location of a running interpolation of @c attr, or null.
+    const Location* Find(IAttribute* attr) const;
+
+    static const uint cGeneric = 0xffffffff;
+
+    Vector<Batch> batches_;
+    /// Batch index by attribute type ID, or cGeneric.
+    PODVector<uint> batchByType_;
+    Vector<GenericInterpolation> generic_;
+    HashMap<IAttribute*, Location> lookup_;
+    /// Scratch buffers for the interpolation parameters of a batch, and the channels of a single value.
+    PODVector<float> t_;
+    PODVector<bool> apply_;
+    PODVector<float> channels_;
+    bool updating_;
+};
+
+}
@@ -377,6 +377,10 @@ public:
     /// Returns parent entity of this entity, or null if entity is on the root level.
     EntityPtr Parent() const { return parent_.Lock(); }
 
+    /// Returns parent entity of this entity as a raw pointer, or null if entity is on the root level.
+    /** Does not touch the reference counts, so can be used from worker threads while the scene is not being modified. */
+    Entity* ParentEntity() const { return parent_.Get(); }
+
     /// Returns if parent entity is set.
     bool HasParent() const { return parent_.Get() != nullptr; }
 
@@ -36,6 +36,8 @@ namespace Tundra
 IAttribute::IAttribute(IComponent* owner_, const char* id_) :
     id(id_),
     name(id_),
+    idHash(id_),
+    nameHash(id_),
     metadata(nullptr),
     dynamic(false),
     owner(nullptr),
@@ -49,6 +51,8 @@ IAttribute::IAttribute(IComponent* owner_, const char* id_) :
 IAttribute::IAttribute(IComponent* owner_, const char* id_, const char* name_) :
     id(id_),
     name(name_),
+    idHash(id_),
+    nameHash(name_),
     metadata(nullptr),
     dynamic(false),
     owner(nullptr),
@@ -69,6 +73,7 @@ void IAttribute::Changed(AttributeChange::Type change)
 void IAttribute::SetName(const String& newName)
 {
     name = newName;
+    nameHash = StringHash(newName);
 }
 
 void IAttribute::SetMetadata(AttributeMetadata *meta)
@@ -110,23 +115,23 @@ const String IAttribute::TransformTypeName = "Transform";
 const String IAttribute::PointTypeName = "Point";
 
 // TypeId implementations
-template<> u32 TUNDRACORE_API Attribute<String>::TypeId() const { return StringId; }
-template<> u32 TUNDRACORE_API Attribute<int>::TypeId() const { return IntId; }
-template<> u32 TUNDRACORE_API Attribute<float>::TypeId() const { return RealId; }
-template<> u32 TUNDRACORE_API Attribute<Color>::TypeId() const { return ColorId; }
-template<> u32 TUNDRACORE_API Attribute<float2>::TypeId() const { return Float2Id; }
-template<> u32 TUNDRACORE_API Attribute<float3>::TypeId() const { return Float3Id; }
-template<> u32 TUNDRACORE_API Attribute<float4>::TypeId() const { return Float4Id; }
-template<> u32 TUNDRACORE_API Attribute<bool>::TypeId() const { return BoolId; }
-template<> u32 TUNDRACORE_API Attribute<uint>::TypeId() const { return UIntId; }
-template<> u32 TUNDRACORE_API Attribute<Quat>::TypeId() const { return QuatId; }
-template<> u32 TUNDRACORE_API Attribute<AssetReference>::TypeId() const { return AssetReferenceId; }
-template<> u32 TUNDRACORE_API Attribute<AssetReferenceList>::TypeId() const { return AssetReferenceListId; }
-template<> u32 TUNDRACORE_API Attribute<EntityReference>::TypeId() const { return EntityReferenceId; }
-template<> u32 TUNDRACORE_API Attribute<Variant>::TypeId() const { return VariantId; }
-template<> u32 TUNDRACORE_API Attribute<VariantList>::TypeId() const { return VariantListId; }
-template<> u32 TUNDRACORE_API Attribute<Transform>::TypeId() const { return TransformId; }
-template<> u32 TUNDRACORE_API Attribute<Point>::TypeId() const { return PointId; }
+template<> u32 TUNDRACORE_API Attribute<String>::TypeIdStatic() { return StringId; }
+template<> u32 TUNDRACORE_API Attribute<int>::TypeIdStatic() { return IntId; }
+template<> u32 TUNDRACORE_API Attribute<float>::TypeIdStatic() { return RealId; }
+template<> u32 TUNDRACORE_API Attribute<Color>::TypeIdStatic() { return ColorId; }
+template<> u32 TUNDRACORE_API Attribute<float2>::TypeIdStatic() { return Float2Id; }
+template<> u32 TUNDRACORE_API Attribute<float3>::TypeIdStatic() { return Float3Id; }
+template<> u32 TUNDRACORE_API Attribute<float4>::TypeIdStatic() { return Float4Id; }
+template<> u32 TUNDRACORE_API Attribute<bool>::TypeIdStatic() { return BoolId; }
+template<> u32 TUNDRACORE_API Attribute<uint>::TypeIdStatic() { return UIntId; }
+template<> u32 TUNDRACORE_API Attribute<Quat>::TypeIdStatic() { return QuatId; }
+template<> u32 TUNDRACORE_API Attribute<AssetReference>::TypeIdStatic() { return AssetReferenceId; }
+template<> u32 TUNDRACORE_API Attribute<AssetReferenceList>::TypeIdStatic() { return AssetReferenceListId; }
+template<> u32 TUNDRACORE_API Attribute<EntityReference>::TypeIdStatic() { return EntityReferenceId; }
+template<> u32 TUNDRACORE_API Attribute<Variant>::TypeIdStatic() { return VariantId; }
+template<> u32 TUNDRACORE_API Attribute<VariantList>::TypeIdStatic() { return VariantListId; }
+template<> u32 TUNDRACORE_API Attribute<Transform>::TypeIdStatic() { return TransformId; }
+template<> u32 TUNDRACORE_API Attribute<Point>::TypeIdStatic() { return PointId; }
 
 // TypeName implementations
 template<> const String TUNDRACORE_API & Attribute<int>::TypeName() const { return IntTypeName; }
@@ -12,6 +12,7 @@
 #include "SceneFwd.h"
 
 #include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Math/StringHash.h>
 
 namespace Tundra
 {
@@ -43,6 +44,12 @@ public:
     /// Returns human-readable name of the attribute. This is shown in the EC editor. For dynamic attributes, is the same as ID.
     const String &Name() const { return name; }
 
+    /// Returns the interned ID, for IComponent::AttributeByIdHash. StringHash is case-insensitive like the ID lookups.
+    StringHash IdHash() const { return idHash; }
+
+    /// Returns the interned name, for IComponent::AttributeByNameHash.
+    StringHash NameHash() const { return nameHash; }
+
     /// Change the attribute's name. Needed for PlaceholderComponent when constructing attributes dynamically at deserialization
     void SetName(const String& newName);
 
@@ -172,6 +179,8 @@ protected:
     IComponent* owner; ///< Owning component.
     String id; ///< ID of attribute.
     String name; ///< Human-readable name of attribute for editing.
+    StringHash idHash; ///< Hash of the ID.
+    StringHash nameHash; ///< Hash of the name.
     AttributeMetadata *metadata; ///< Possible attribute metadata.
     bool dynamic; ///< Dynamic attributes must be deleted at component destruction
     u8 index; ///< Attribute index in the parent component's attribute list
@@ -265,7 +274,10 @@ public:
     void FromBinary(kNet::DataDeserializer& source, AttributeChange::Type change) override;
     void Interpolate(IAttribute* start, IAttribute* end, float t, AttributeChange::Type change) override;
     const String &TypeName() const override;
-    u32 TypeId() const override;
+    u32 TypeId() const override { return TypeIdStatic(); }
+
+    /// Returns the type ID of Attribute<T>, for checking the type of an IAttribute without RTTI.
+    static u32 TypeIdStatic();
 
     /// Returns pre-defined default value for the attribute.
     /** Usually zero for primitive data types and for classes/structs that are collections of primitive data types (e.g. float3::zero), or the default consturctor. */
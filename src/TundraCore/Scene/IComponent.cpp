@@ -9,6 +9,7 @@
 #include "IComponent.h"
 #include "Entity.h"
 #include "Scene.h"
+#include "Name.h"
 #include "SceneAPI.h"
 #include "Framework.h"
 #include "LoggingFunctions.h"
@@ -29,7 +30,9 @@ IComponent::IComponent(Urho3D::Context* context, Scene* scene) :
     updateMode(AttributeChange::Replicate),
     replicated(true),
     temporary(false),
-    id(0)
+    id(0),
+    attributeTable(0),
+    sceneTypeIndex(M_MAX_UNSIGNED)
 {
 }
 
@@ -151,20 +154,82 @@ bool IComponent::ShouldBeSerialized(bool serializeTemporary, bool serializeLocal
     return true;
 }
 
-IAttribute* IComponent::AttributeById(const String &id) const
+struct IComponent::AttributeTable
 {
-    for(uint i = 0; i < attributes.Size(); ++i)
-        if(attributes[i] && attributes[i]->Id().Compare(id, false) == 0)
-            return attributes[i];
+    AttributeTable() : numStatic(0) {}
+
+    uint numStatic;
+    HashMap<StringHash, u8> byId;
+    HashMap<StringHash, u8> byName;
+};
+
+const IComponent::AttributeTable *IComponent::StaticAttributeTable() const
+{
+    if (!attributeTable)
+    {
+        // The static attributes are members of the component class, so they are the same for all components of a type.
+        static HashMap<u32, AttributeTable> tables;
+        HashMap<u32, AttributeTable>::Iterator it = tables.Find(TypeId());
+        if (it == tables.End())
+        {
+            AttributeTable &table = tables[TypeId()];
+            table.numStatic = NumStaticAttributes();
+            for(uint i = 0; i < table.numStatic; ++i)
+            {
+                table.byId[attributes[i]->IdHash()] = (u8)i;
+                table.byName[attributes[i]->NameHash()] = (u8)i;
+            }
+            attributeTable = &table;
+        }
+        else
+            attributeTable = &it->second_;
+    }
+    return attributeTable;
+}
+
+IAttribute *IComponent::FindAttribute(StringHash hash, bool byName, const String *str) const
+{
+    const AttributeTable *table = StaticAttributeTable();
+    const HashMap<StringHash, u8> &indices = (byName ? table->byName : table->byId);
+    HashMap<StringHash, u8>::ConstIterator it = indices.Find(hash);
+    if (it != indices.End() && it->second_ < attributes.Size())
+    {
+        // Verify the hit, the attribute may have been renamed or the table created from a differing placeholder component.
+        IAttribute *attr = attributes[it->second_];
+        if (attr && (byName ? attr->NameHash() : attr->IdHash()) == hash &&
+            (!str || (byName ? attr->Name() : attr->Id()).Compare(*str, false) == 0))
+            return attr;
+    }
+
+    // Dynamic attributes, or a renamed static attribute. IDs of the static attributes do not change.
+    for(uint i = (byName ? 0 : table->numStatic); i < attributes.Size(); ++i)
+    {
+        IAttribute *attr = attributes[i];
+        if (attr && (byName ? attr->NameHash() : attr->IdHash()) == hash &&
+            (!str || (byName ? attr->Name() : attr->Id()).Compare(*str, false) == 0))
+            return attr;
+    }
     return nullptr;
 }
 
+IAttribute* IComponent::AttributeById(const String &id) const
+{
+    return FindAttribute(StringHash(id), false, &id);
+}
+
+IAttribute* IComponent::AttributeByIdHash(StringHash idHash) const
+{
+    return FindAttribute(idHash, false, 0);
+}
+
 IAttribute* IComponent::AttributeByName(const String &name) const
 {
-    for(uint i = 0; i < attributes.Size(); ++i)
-        if(attributes[i] && attributes[i]->Name().Compare(name, false) == 0)
-            return attributes[i];
-    return nullptr;
+    return FindAttribute(StringHash(name), true, &name);
+}
+
+IAttribute* IComponent::AttributeByNameHash(StringHash nameHash) const
+{
+    return FindAttribute(nameHash, true, 0);
 }
 
 int IComponent::NumAttributes() const
@@ -393,6 +458,14 @@ bool IComponent::BeginDeserialization(Urho3D::XMLElement& compElem)
 
 void IComponent::EmitAttributeChanged(IAttribute* attribute, AttributeChange::Type change)
 {
+    // The scene indexes entities by name. Keep the index up to date also when the change is not signaled.
+    if (parentEntity && TypeId() == Tundra::Name::ComponentTypeId)
+    {
+        Scene* scene = ParentScene();
+        if (scene)
+            scene->UpdateNameIndex(parentEntity);
+    }
+
     // If this message should be sent with the default attribute change mode specified in the IComponent,
     // take the change mode from this component.
     if (change == AttributeChange::Default)
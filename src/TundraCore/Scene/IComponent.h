@@ -191,10 +191,14 @@ public:
     template<typename T>
     Attribute<T> *AttributeByName(const String &name) const
     {
-        for(uint i = 0; i < attributes.Size(); ++i)
-            if (attributes[i] && attributes[i]->Name().Compare(name, false) == 0)
-                return dynamic_cast<Attribute<T> *>(&attributes[i]);
-        return nullptr;
+        return AttributeCast<T>(AttributeByName(name));
+    }
+
+    /// Finds and returns an attribute of type 'Attribute<T>' and given interned name, see IAttribute::NameHash.
+    template<typename T>
+    Attribute<T> *AttributeByNameHash(StringHash nameHash) const
+    {
+        return AttributeCast<T>(AttributeByNameHash(nameHash));
     }
     
     /// Finds and returns an attribute of type 'Attribute<T>' and given ID
@@ -205,28 +209,46 @@ public:
     template<typename T>
     Attribute<T> *AttributeById(const String &id) const
     {
-        for(uint i = 0; i < attributes.Size(); ++i)
-            if (attributes[i] && attributes[i]->Id().Compare(id, false) == 0)
-                return dynamic_cast<Attribute<T> *>(&attributes[i]);
-        return nullptr;
+        return AttributeCast<T>(AttributeById(id));
+    }
+
+    /// Finds and returns an attribute of type 'Attribute<T>' and given interned ID, see IAttribute::IdHash.
+    /** Prefer this in code that looks up the same attribute repeatedly: hash the ID once, e.g. to a static StringHash. */
+    template<typename T>
+    Attribute<T> *AttributeByIdHash(StringHash idHash) const
+    {
+        return AttributeCast<T>(AttributeByIdHash(idHash));
+    }
+
+    /// Returns @c attr as 'Attribute<T>' if it is of that type, otherwise null. The type is checked by type ID.
+    template<typename T>
+    static Attribute<T> *AttributeCast(IAttribute *attr)
+    {
+        return (attr && attr->TypeId() == Attribute<T>::TypeIdStatic() ? static_cast<Attribute<T> *>(attr) : nullptr);
     }
     
     /// Returns a pointer to the Framework instance.
     Framework *GetFramework() const { return framework; }
 
     /// Returns an Attribute of this component with the given ID.
-    /** This function iterates through the attribute vector and tries to find a member attribute with the given ID
+    /** The static attributes are found through a table shared by the component type, the dynamic ones by comparing hashes.
         @param The ID of the attribute to look for.
         @return A pointer to the attribute, or null if no attribute with the given ID exists */
     IAttribute* AttributeById(const String &name) const;
+
+    /// Returns an Attribute of this component with the given interned ID, see IAttribute::IdHash.
+    IAttribute* AttributeByIdHash(StringHash idHash) const;
     
     /// Returns an Attribute of this component with the given name.
-    /** This function iterates through the attribute vector and tries to find a member attribute with the given name.
+    /** The static attributes are found through a table shared by the component type, the dynamic ones by comparing hashes.
         @param The name of the attribute to look for.
         @return A pointer to the attribute, or null if no attribute with the given name exists. 
         @note attribute names are human-readable (shown in editor) and may be subject to change, while id's
         (property / variable names) should be fixed. */
     IAttribute* AttributeByName(const String &name) const;
+
+    /// Returns an Attribute of this component with the given interned name, see IAttribute::NameHash.
+    IAttribute* AttributeByNameHash(StringHash nameHash) const;
     
     /// Returns true if network synchronization of the attributes of this component is enabled.
     /// A component is always either local or replicated, but not both.
@@ -387,6 +409,7 @@ protected:
 private:
     friend class IAttribute;
     friend class Entity;
+    friend class Scene;
 
     /// This function is called by the base class (IComponent) to signal to the derived class that one or more
     /// of its attributes have changed, and it should update its internal state accordingly.
@@ -396,6 +419,16 @@ private:
 
     /// Set component id. Called by Entity
     void SetNewId(component_id_t newId);
+
+    /// Indices of the static attributes of a component type by interned ID and name.
+    struct AttributeTable;
+    /// Returns the attribute table of this component type, creating it from this component on first use.
+    const AttributeTable *StaticAttributeTable() const;
+    /// Finds an attribute by hash, verifying the ID or name against @c str if not null.
+    IAttribute *FindAttribute(StringHash hash, bool byName, const String *str) const;
+
+    mutable const AttributeTable *attributeTable; ///< Table of the component type, resolved on first attribute lookup.
+    uint sceneTypeIndex; ///< Position in the component type index of the parent scene, M_MAX_UNSIGNED if not indexed. Maintained by Scene.
 };
 
 }
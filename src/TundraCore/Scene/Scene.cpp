@@ -16,6 +16,7 @@
 #include "FrameAPI.h"
 #include "LoggingFunctions.h"
 #include "AssetAPI.h"
+#include "SceneLoader.h"
 
 #include <kNet/DataDeserializer.h>
 #include <kNet/DataSerializer.h>
@@ -32,6 +33,27 @@ using namespace std;
 namespace Tundra
 {
 
+/// Interned ID of the Placeable parentRef attribute.
+static const StringHash cParentRefId("parentRef");
+
+static void AddToNameIndex(Scene::EntityNameIndex &index, const String &key, Entity *entity)
+{
+    if (!key.Empty())
+        index[key].Push(entity);
+}
+
+static void RemoveFromNameIndex(Scene::EntityNameIndex &index, const String &key, Entity *entity)
+{
+    if (key.Empty())
+        return;
+    Scene::EntityNameIndex::Iterator it = index.Find(key);
+    if (it == index.End())
+        return;
+    it->second_.Remove(entity);
+    if (it->second_.Empty())
+        index.Erase(it);
+}
+
 Scene::Scene(const String &name, Framework *framework, bool viewEnabled, bool authority) :
     Object(framework->GetContext()),
     name_(name),
@@ -137,11 +159,8 @@ EntityPtr Scene::EntityByName(const String &name) const
     if (name.Empty())
         return EntityPtr();
 
-    for(ConstIterator it = Begin(); it != End(); ++it)
-        if (it->second_->Name() == name)
-            return it->second_;
-
-    return EntityPtr();
+    EntityNameIndex::ConstIterator it = entitiesByName_.Find(name);
+    return (it != entitiesByName_.End() ? EntityPtr(it->second_.Front()) : EntityPtr());
 }
 
 bool Scene::IsUniqueName(const String& name) const
@@ -212,6 +231,14 @@ bool Scene::RemoveEntity(entity_id_t id, AttributeChange::Type change)
         
         // If entity somehow manages to live, at least it doesn't belong to the scene anymore
         del_entity->SetScene(0);
+
+        // Now that the entity has left the scene this drops it from the name index, even if a Name component was
+        // added back during the removal signals. Normally a no-op, as removing the Name components has updated the index.
+        UpdateNameIndex(del_entity.Get());
+        // Likewise drop the components that were added back, e.g. by the removal signals of the children, from the component index.
+        const Entity::ComponentMap &components = del_entity->Components();
+        for(Entity::ComponentMap::ConstIterator comp = components.Begin(); comp != components.End(); ++comp)
+            RemoveFromComponentIndex(comp->second_.Get());
         del_entity.Reset();
         return true;
     }
@@ -246,6 +273,14 @@ void Scene::RemoveAllEntities(bool signal, AttributeChange::Type change)
     {
         LogWarning("Scene::RemoveAllEntities: entity map was not clear after removing all entities, clearing manually");
         entities_.Clear();
+        // Reset the index positions as RemoveFromComponentIndex would, in case the components outlive the scene.
+        for(HashMap<u32, ComponentIndex>::Iterator it = componentIndex_.Begin(); it != componentIndex_.End(); ++it)
+            for(ComponentIndex::Iterator comp = it->second_.Begin(); comp != it->second_.End(); ++comp)
+                (*comp)->sceneTypeIndex = M_MAX_UNSIGNED;
+        componentIndex_.Clear();
+        entitiesByName_.Clear();
+        entitiesByGroup_.Clear();
+        indexedNames_.Clear();
     }
     
     if (signal)
@@ -275,9 +310,17 @@ EntityVector Scene::EntitiesWithComponent(const String &typeName, const String &
 EntityVector Scene::EntitiesWithComponent(u32 typeId, const String &name) const
 {
     EntityVector entities;
-    for(ConstIterator it = Begin(); it != End(); ++it)
-        if ((name.Empty() && it->second_->Component(typeId)) || it->second_->Component(typeId, name))
-            entities.Push(it->second_);
+    const ComponentIndex &components = ComponentsOfType(typeId);
+    for(ComponentIndex::ConstIterator it = components.Begin(); it != components.End(); ++it)
+    {
+        IComponent *comp = *it;
+        if (!name.Empty() && comp->Name() != name)
+            continue;
+        // Return each entity only once, even if it has several matching components.
+        Entity *entity = comp->ParentEntity();
+        if ((name.Empty() ? entity->Component(typeId) : entity->Component(typeId, name)).Get() == comp)
+            entities.Push(EntityPtr(entity));
+    }
     return entities;
 }
 
@@ -287,10 +330,13 @@ EntityVector Scene::EntitiesOfGroup(const String &groupName) const
     if (groupName.Empty())
         return entities;
 
-    for (ConstIterator it = Begin(); it != End(); ++it)
-        if (it->second_->Group() == groupName)
-            entities.Push(it->second_);
+    EntityNameIndex::ConstIterator it = entitiesByGroup_.Find(groupName);
+    if (it == entitiesByGroup_.End())
+        return entities;
 
+    entities.Reserve(it->second_.Size());
+    for(PODVector<Entity*>::ConstIterator entity = it->second_.Begin(); entity != it->second_.End(); ++entity)
+        entities.Push(EntityPtr(*entity));
     return entities;
 }
 
@@ -302,29 +348,100 @@ Entity::ComponentVector Scene::Components(const String &typeName, const String &
 Entity::ComponentVector Scene::Components(u32 typeId, const String &name) const
 {
     Entity::ComponentVector ret;
-    if (name.Empty())
+    const ComponentIndex &components = ComponentsOfType(typeId);
+    ret.Reserve(components.Size());
+    for(ComponentIndex::ConstIterator it = components.Begin(); it != components.End(); ++it)
     {
-        for(ConstIterator it = Begin(); it != End(); ++it)
-        {
-            Entity::ComponentVector components =  it->second_->ComponentsOfType(typeId);
-            if (!components.Empty())
-                ret.Insert(ret.End(), components.Begin(), components.End());
-        }
+        IComponent *comp = *it;
+        if (name.Empty())
+            ret.Push(ComponentPtr(comp));
+        // As Entity::Component(typeId, name), return only the first component with the name of each entity.
+        else if (comp->Name() == name && comp->ParentEntity()->Component(typeId, name).Get() == comp)
+            ret.Push(ComponentPtr(comp));
     }
-    else
+    return ret;
+}
+
+const Scene::ComponentIndex &Scene::ComponentsOfType(u32 typeId) const
+{
+    static const ComponentIndex empty;
+    HashMap<u32, ComponentIndex>::ConstIterator it = componentIndex_.Find(typeId);
+    return (it != componentIndex_.End() ? it->second_ : empty);
+}
+
+void Scene::AddToComponentIndex(IComponent *comp)
+{
+    if (comp->sceneTypeIndex != M_MAX_UNSIGNED)
+        return;
+    ComponentIndex &components = componentIndex_[comp->TypeId()];
+    comp->sceneTypeIndex = components.Size();
+    components.Push(comp);
+}
+
+void Scene::RemoveFromComponentIndex(IComponent *comp)
+{
+    if (comp->sceneTypeIndex == M_MAX_UNSIGNED)
+        return;
+    // Swap the last component of the type to the removed position.
+    ComponentIndex &components = componentIndex_[comp->TypeId()];
+    IComponent *last = components.Back();
+    components[comp->sceneTypeIndex] = last;
+    last->sceneTypeIndex = comp->sceneTypeIndex;
+    components.Pop();
+    comp->sceneTypeIndex = M_MAX_UNSIGNED;
+}
+
+void Scene::UpdateNameIndex(Entity *entity, IComponent *removedComponent)
+{
+    // Like Entity::Name and Entity::Group, use the first Name component. None if the entity has left the scene.
+    String name, group;
+    if (entity->ParentScene() == this)
     {
-        for(ConstIterator it = Begin(); it != End(); ++it)
+        const Entity::ComponentMap &components = entity->Components();
+        for(Entity::ComponentMap::ConstIterator it = components.Begin(); it != components.End(); ++it)
         {
-            ComponentPtr component = it->second_->Component(typeId, name);
-            if (component)
-                ret.Push(component);
+            if (it->second_->TypeId() == Tundra::Name::ComponentTypeId && it->second_.Get() != removedComponent)
+            {
+                Tundra::Name *nameComp = static_cast<Tundra::Name*>(it->second_.Get());
+                name = nameComp->name.Get();
+                group = nameComp->group.Get();
+                break;
+            }
         }
     }
-    return ret;
+
+    HashMap<Entity*, Pair<String, String> >::Iterator indexed = indexedNames_.Find(entity);
+    if (indexed == indexedNames_.End())
+    {
+        if (name.Empty() && group.Empty())
+            return;
+        indexed = indexedNames_.Insert(MakePair(entity, Pair<String, String>()));
+    }
+
+    Pair<String, String> &current = indexed->second_;
+    if (current.first_ != name)
+    {
+        RemoveFromNameIndex(entitiesByName_, current.first_, entity);
+        AddToNameIndex(entitiesByName_, name, entity);
+        current.first_ = name;
+    }
+    if (current.second_ != group)
+    {
+        RemoveFromNameIndex(entitiesByGroup_, current.second_, entity);
+        AddToNameIndex(entitiesByGroup_, group, entity);
+        current.second_ = group;
+    }
+
+    if (name.Empty() && group.Empty())
+        indexedNames_.Erase(indexed);
 }
 
 void Scene::EmitComponentAdded(Entity* entity, IComponent* comp, AttributeChange::Type change)
 {
+    // The index is kept up to date regardless of signaling.
+    AddToComponentIndex(comp);
+    if (comp->TypeId() == Tundra::Name::ComponentTypeId)
+        UpdateNameIndex(entity);
     if (change == AttributeChange::Disconnected)
         return;
     if (change == AttributeChange::Default)
@@ -334,6 +451,10 @@ void Scene::EmitComponentAdded(Entity* entity, IComponent* comp, AttributeChange
 
 void Scene::EmitComponentRemoved(Entity* entity, IComponent* comp, AttributeChange::Type change)
 {
+    // The index is kept up to date regardless of signaling.
+    RemoveFromComponentIndex(comp);
+    if (comp->TypeId() == Tundra::Name::ComponentTypeId)
+        UpdateNameIndex(entity, comp);
     if (change == AttributeChange::Disconnected)
         return;
     if (change == AttributeChange::Default)
@@ -468,6 +589,31 @@ Vector<Entity *> Scene::LoadSceneXML(const String& filename, bool clearScene, bo
     return CreateContentFromXml(scene_doc, useEntityIDsFromFile, change);
 }
 
+SceneLoaderPtr Scene::BeginLoadSceneXML(const String& filename, bool clearScene, bool useEntityIDsFromFile, AttributeChange::Type change)
+{
+    return BeginLoadScene(filename, false, clearScene, useEntityIDsFromFile, change);
+}
+
+SceneLoaderPtr Scene::BeginLoadSceneBinary(const String& filename, bool clearScene, bool useEntityIDsFromFile, AttributeChange::Type change)
+{
+    return BeginLoadScene(filename, true, clearScene, useEntityIDsFromFile, change);
+}
+
+SceneLoaderPtr Scene::BeginLoadScene(const String& filename, bool binary, bool clearScene, bool useEntityIDsFromFile, AttributeChange::Type change)
+{
+    if (!IsAuthority() && (parentTracker_.IsTracking() || !loaders_.Empty()))
+    {
+        LogError("Scene::BeginLoadScene: Still waiting for previous content creation to complete on the server. Try again after it completes.");
+        return SceneLoaderPtr();
+    }
+
+    SceneLoaderPtr loader(new SceneLoader(this, filename, binary, useEntityIDsFromFile, change));
+    if (!loader->Open(clearScene))
+        return SceneLoaderPtr();
+    loaders_.Push(loader);
+    return loader;
+}
+
 String Scene::SerializeToXmlString(bool serializeTemporary, bool serializeLocal) const
 {
     Urho3D::XMLFile sceneDoc(context_);
@@ -1377,63 +1523,37 @@ bool Scene::StartAttributeInterpolation(IAttribute* attr, IAttribute* endvalue,
 {
     if (!endvalue)
         return false;
-    
+
+    bool success = StartAttributeInterpolation(attr, *endvalue, length);
+    delete endvalue;
+    return success;
+}
+
+bool Scene::StartAttributeInterpolation(IAttribute* attr, const IAttribute& endvalue, float length)
+{
     IComponent* comp = attr ? attr->Owner() : 0;
     Entity* entity = comp ? comp->ParentEntity() : 0;
     Scene* scene = entity ? entity->ParentScene() : 0;
     
     if (length <= 0.0f || !attr || !attr->Metadata() || attr->Metadata()->interpolation == AttributeMetadata::None ||
-        !comp || !entity || !scene || scene != this)
-    {
-        delete endvalue;
+        !comp || !entity || !scene || scene != this || endvalue.TypeId() != attr->TypeId())
         return false;
-    }
     
-    // End previous interpolation if existed
-    bool previous = EndAttributeInterpolation(attr);
-    
-    // If previous interpolation does not exist, perform a direct snapping to the end value
-    // but still start an interpolation period, so that on the next update we detect that an interpolation is going on,
+    // If previous interpolation does not exist, the interpolator performs a direct snapping to the end value
+    // but still starts an interpolation period, so that on the next update we detect that an interpolation is going on,
     // and will interpolate normally
-    if (!previous)
-        attr->CopyValue(endvalue, AttributeChange::LocalOnly);
-    
-    AttributeInterpolation newInterp;
-    newInterp.dest = AttributeWeakPtr(comp, attr);
-    newInterp.start = AttributeWeakPtr(comp, attr->Clone());
-    newInterp.end = AttributeWeakPtr(comp, endvalue);
-    newInterp.length = length;
-    
-    interpolations_.Push(newInterp);
+    interpolator_.Start(attr, endvalue, length);
     return true;
 }
 
 bool Scene::EndAttributeInterpolation(IAttribute* attr)
 {
-    for(uint i = 0; i < interpolations_.Size(); ++i)
-    {
-        AttributeInterpolation& interp = interpolations_[i];
-        if (interp.dest.Get() == attr)
-        {
-            delete interp.start.Get();
-            delete interp.end.Get();
-            interpolations_.Erase(interpolations_.Begin() + i);
-            return true;
-        }
-    }
-    return false;
+    return interpolator_.End(attr);
 }
 
 void Scene::EndAllAttributeInterpolations()
 {
-    for(uint i = 0; i < interpolations_.Size(); ++i)
-    {
-        AttributeInterpolation& interp = interpolations_[i];
-        delete interp.start.Get();
-        delete interp.end.Get();
-    }
-    
-    interpolations_.Clear();
+    interpolator_.Clear();
 }
 
 void Scene::UpdateAttributeInterpolations(float frametime)
@@ -1441,49 +1561,21 @@ void Scene::UpdateAttributeInterpolations(float frametime)
     PROFILE(Scene_UpdateInterpolation);
     
     interpolating_ = true;
-    
-    for(uint i = interpolations_.Size() - 1; i < interpolations_.Size(); --i)
-    {
-        AttributeInterpolation& interp = interpolations_[i];
-        bool finished = false;
-        
-        // Check that the component still exists i.e. it's safe to access the attribute
-        if (!interp.start.owner.Expired())
-        {
-            // Allow the interpolation to persist for 2x time, though we are no longer setting the value
-            // This is for the continuous/discontinuous update detection in StartAttributeInterpolation()
-            if (interp.time <= interp.length)
-            {
-                interp.time += frametime;
-                float t = interp.time / interp.length;
-                if (t > 1.0f)
-                    t = 1.0f;
-                interp.dest.Get()->Interpolate(interp.start.Get(), interp.end.Get(), t, AttributeChange::LocalOnly);
-            }
-            else
-            {
-                interp.time += frametime;
-                if (interp.time >= interp.length * 2.0f)
-                    finished = true;
-            }
-        }
-        else // Component pointer has expired, abort this interpolation
-            finished = true;
-        
-        // Remove interpolation (& delete start/endpoints) when done
-        if (finished)
-        {
-            delete interp.start.Get();
-            delete interp.end.Get();
-            interpolations_.Erase(interpolations_.Begin() + i);
-        }
-    }
-
+    interpolator_.Update(frametime, AttributeChange::LocalOnly);
     interpolating_ = false;
 }
 
 void Scene::OnUpdated(float /*frameTime*/)
 {
+    // Continue the loads in progress. The finished signal may start a new load, so iterate a copy.
+    if (!loaders_.Empty())
+    {
+        Vector<SceneLoaderPtr> loaders = loaders_;
+        for(uint i = 0; i < loaders.Size(); ++i)
+            if (loaders[i]->Update())
+                loaders_.Remove(loaders[i]);
+    }
+
     // Signal queued entity creations now
     for (unsigned i = 0; i < entitiesCreatedThisFrame_.Size(); ++i)
     {
@@ -1523,6 +1615,18 @@ EntityVector Scene::FindEntitiesByName(const String &name, bool caseSensitivity)
 {
     // Don't check if name is empty, we want to allow querying for all entities without a name too.
     EntityVector entities;
+    if (caseSensitivity && !name.Empty())
+    {
+        EntityNameIndex::ConstIterator it = entitiesByName_.Find(name);
+        if (it != entitiesByName_.End())
+        {
+            entities.Reserve(it->second_.Size());
+            for(PODVector<Entity*>::ConstIterator entity = it->second_.Begin(); entity != it->second_.End(); ++entity)
+                entities.Push(EntityPtr(*entity));
+        }
+        return entities;
+    }
+
     for(ConstIterator it = Begin(); it != End(); ++it)
     {
         EntityPtr entity = it->second_;
@@ -1785,8 +1889,8 @@ entity_id_t Scene::PlaceableParentId(const Entity *ent) const
     ComponentPtr comp = ent->Component(20); // Placeable
     if (!comp)
         return 0;
-    Attribute<EntityReference> *parentRef = static_cast<Attribute<EntityReference> *>(comp->AttributeById("parentRef"));
-    if (!parentRef->Get().IsEmpty())
+    Attribute<EntityReference> *parentRef = comp->AttributeByIdHash<EntityReference>(cParentRefId);
+    if (parentRef && !parentRef->Get().IsEmpty())
         return Urho3D::ToUInt(parentRef->Get().ref);
     return 0;
 }
@@ -1837,7 +1941,7 @@ uint Scene::FixPlaceableParentIds(const Vector<Entity *> &entities, const Entity
             continue;
 
         ComponentPtr placeable = entity->Component(20); // Placeable
-        Attribute<EntityReference> *parentRef = (placeable.Get() ? static_cast<Attribute<EntityReference> *>(placeable->AttributeById("parentRef")) : 0);
+        Attribute<EntityReference> *parentRef = (placeable.Get() ? placeable->AttributeByIdHash<EntityReference>(cParentRefId) : 0);
         if (parentRef && !parentRef->Get().IsEmpty())
         {
             // We only need to fix the id parent refs. Ones with Entity names should
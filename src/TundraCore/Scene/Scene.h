@@ -8,6 +8,7 @@
 #include "AttributeChangeType.h"
 #include "EntityAction.h"
 #include "UniqueIdGenerator.h"
+#include "AttributeInterpolator.h"
 #include "Math/float3.h"
 #include "SceneDesc.h"
 #include "Entity.h"
@@ -38,6 +39,8 @@ public:
     typedef EntityMap::ConstIterator ConstIterator; ///< const entity iterator. see begin() and end()
     typedef HashMap<entity_id_t, entity_id_t> EntityIdMap; ///< Used to map entity ID changes (oldId, newId).
     typedef HashMap<StringHash, SharedPtr<Object> > SubsystemMap; ///< Maps scene subsystems by type
+    typedef PODVector<IComponent*> ComponentIndex; ///< Components of a single type, see ComponentsOfType.
+    typedef HashMap<String, PODVector<Entity*> > EntityNameIndex; ///< Entities by name or group, in the order they got it.
 
     /// Returns name of the scene.
     const String &Name() const { return name_; }
@@ -91,6 +94,12 @@ public:
                 must be static-structured, component must be in an entity which is in a scene, scene must be us) */
     bool StartAttributeInterpolation(IAttribute* attr, IAttribute* endvalue, float length);
 
+    /// Starts an attribute interpolation without transferring the ownership of the end value.
+    /** @overload
+        @param endvalue Same kind of attribute holding the endpoint value. The value is copied, so the same attribute
+               can be reused for reading the endpoint values of the following interpolations. */
+    bool StartAttributeInterpolation(IAttribute* attr, const IAttribute& endvalue, float length);
+
     /// Ends an attribute interpolation. The last set value will remain.
     /** @param attr Attribute inside a static-structured component.
         @return true if an interpolation existed */
@@ -185,12 +194,15 @@ public:
     void EmitComponentAcked(IComponent* component, component_id_t oldId);
 
     /// Returns all components of type T (and additionally with specific name) in the scene.
+    /** Without a name, components of types derived from T are returned too, as with Entity::ComponentsOfType.
+        With a name, only the first component of type T with the name of each entity is returned, as with Entity::Component.
+        @note The components are in the order of the scene's component index, not in entity ID order. */
     template <typename T>
     Vector<SharedPtr<T> > Components(const String &name = "") const;
 
     /// Returns list of entities with a specific component present.
     /** @param name Name of the component, optional.
-        @note O(n) */
+        @note O(number of components of type T) */
     template <typename T>
     EntityVector EntitiesWithComponent(const String &name = "") const;
 
@@ -280,12 +292,12 @@ public:
     /** @note The name of the entity is stored in a Name component. If this component is not present in the entity, it has no name.
         @note Returns a shared pointer, but it is preferable to use a weak pointer, EntityWeakPtr,
               to avoid dangling references that prevent entities from being properly destroyed.
-        @note @note O(n)
+        @note O(1). If several entities have the name, returns the one that got it first.
         @sa EntityById, FindEntitiesContaining */
     EntityPtr EntityByName(const String &name) const;
 
     /// Returns whether name is unique within the scene, i.e. is only encountered once, or not at all.
-    /** @note O(n) */
+    /** @note O(1) */
     bool IsUniqueName(const String& name) const;
 
     /// Returns true if entity with the specified id exists in this scene, false otherwise
@@ -315,7 +327,7 @@ public:
     /// Returns list of entities with a specific component present.
     /** @param typeId Type ID of the component
         @param name Name of the component, optional.
-        @note O(n) */
+        @note O(number of components of type @c typeId) */
     EntityVector EntitiesWithComponent(u32 typeId, const String &name = "") const;
     /// @overload
     /** @param typeName typeName Type name of the component.
@@ -323,18 +335,28 @@ public:
     EntityVector EntitiesWithComponent(const String &typeName, const String &name = "") const;
 
     /// Returns list of entities that belong to the group 'groupName'
-    /** @param groupName The name of the group to be queried */
+    /** @param groupName The name of the group to be queried
+        @note O(number of entities in the group) */
     EntityVector EntitiesOfGroup(const String &groupName) const;
 
     /// Returns all components of specific type (and additionally with specific name) in the scene.
-    /*  @param typeId Component type ID.
-        @param name Arbitrary name of the component (optional). */
+    /** With a name, only the first component with the name of each entity is returned, as with Entity::Component.
+        @param typeId Component type ID.
+        @param name Arbitrary name of the component (optional).
+        @note The components are in the order of the scene's component index, not in entity ID order. */
     Entity::ComponentVector Components(u32 typeId, const String &name = "") const;
     /// overload
     /** @param typeName Component type name.
         @note The overload taking type ID is more efficient than this overload. */
     Entity::ComponentVector Components(const String &typeName, const String &name = "") const;
 
+    /// Returns all components of specific type in the scene without allocating a new vector.
+    /** The scene keeps an index of the components of each type, so this is the cheapest way to iterate them.
+        @param typeId Component type ID.
+        @note The returned vector is invalidated when a component of the type is added to or removed from the scene,
+        so do not add or remove components of the type while iterating it, nor store the raw pointers. */
+    const ComponentIndex &ComponentsOfType(u32 typeId) const;
+
     /// Performs a search through the entities, and returns a list of all the entities that contain @c substring in their Entity name.
     /** @param substring String to be searched.
         @param caseSensitive Case sensitivity for the string matching. */
@@ -342,7 +364,8 @@ public:
 
     /// Performs a search through the entities, and returns a list of all the entities where Entity name matches @c name.
     /** @param name Entity name to match.
-        @param caseSensitive Case sensitivity for the string matching. */
+        @param caseSensitive Case sensitivity for the string matching.
+        @note O(number of matches) for a case-sensitive search of a non-empty name, otherwise O(n). */
     EntityVector FindEntitiesByName(const String &name, bool caseSensitive = true) const;
 
     /// Return root-level entities, i.e. those that have no parent.
@@ -359,6 +382,23 @@ public:
         @todo Return list of EntityPtrs instead of raw pointers. Could also consider EntityVector ,though Vector[] has the nice operator [] accessor. */
     Vector<Entity *> LoadSceneXML(const String& filename, bool clearScene, bool useEntityIDsFromFile, AttributeChange::Type change);
 
+    /// Starts loading the scene from XML over several frames.
+    /** The file is read and the scene optionally cleared immediately, the entities are created and signaled in time-budgeted
+        batches on the following frames. See SceneLoader.
+        @param filename File name
+        @param clearScene Do we want to clear the existing scene.
+        @param useEntityIDsFromFile If true, the created entities will use the Entity IDs from the original file, see LoadSceneXML.
+        @param change Change type that will be used, when removing the old scene, and deserializing the new
+        @return The loader, or null if the file could not be read. */
+    SceneLoaderPtr BeginLoadSceneXML(const String& filename, bool clearScene, bool useEntityIDsFromFile, AttributeChange::Type change);
+
+    /// Starts loading the scene from a binary file over several frames.
+    /** @copydetails BeginLoadSceneXML */
+    SceneLoaderPtr BeginLoadSceneBinary(const String& filename, bool clearScene, bool useEntityIDsFromFile, AttributeChange::Type change);
+
+    /// Returns whether scene content is being loaded over several frames.
+    bool IsLoading() const { return !loaders_.Empty(); }
+
     /// Returns scene content as an XML string.
     /** @param serializeTemporary Are temporary entities wanted to be included.
         @param serializeLocal Are local entities wanted to be included.
@@ -505,6 +545,11 @@ private:
     void OnUpdated(float frameTime);
 
     friend class SceneAPI;
+    friend class SceneLoader;
+    friend class IComponent;
+
+    /// Opens a SceneLoader and adds it to be updated each frame.
+    SceneLoaderPtr BeginLoadScene(const String& filename, bool binary, bool clearScene, bool useEntityIDsFromFile, AttributeChange::Type change);
 
     /// Create entity from an XML element and recurse into child entities. Called internally.
     void CreateEntityFromXml(EntityPtr parent, const Urho3D::XMLElement& ent_elem, bool useEntityIDsFromFile,
@@ -518,20 +563,20 @@ private:
     /// Create entity desc from an XML element and recurse into child entities. Called internally.
     void CreateEntityDescFromXml(SceneDesc& sceneDesc, Vector<EntityDesc>& dest, const Urho3D::XMLElement& ent_elem) const;
 
-    /// Container for an ongoing attribute interpolation
-    struct AttributeInterpolation
-    {
-        AttributeInterpolation() : time(0.0f), length(0.0f) {}
-        AttributeWeakPtr dest, start, end;
-        float time;
-        float length;
-    };
-
     /// Resolved parent Entity id that is set to Placeable::parentRef.
     /** @return Returns 0 if parent is not set or the parent ref is not a Entity id (but a entity name). */
     entity_id_t PlaceableParentId(const Entity *ent) const;
     entity_id_t PlaceableParentId(const EntityDesc &ent) const; ///< @overload
 
+    /// Adds @c comp to the component type index.
+    void AddToComponentIndex(IComponent *comp);
+    /// Removes @c comp from the component type index.
+    void RemoveFromComponentIndex(IComponent *comp);
+
+    /// Updates @c entity in the name and group index from its first Name component, ignoring @c removedComponent.
+    /** Called on every change of a Name component, signaled or not, and when one is added or removed. */
+    void UpdateNameIndex(Entity *entity, IComponent *removedComponent = 0);
+
     UniqueIdGenerator idGenerator_; ///< Entity ID generator
     EntityMap entities_; ///< All entities in the scene.
     Framework *framework_; ///< Parent framework.
@@ -539,10 +584,15 @@ private:
     bool viewEnabled_; ///< View enabled -flag.
     bool interpolating_; ///< Currently doing interpolation-flag.
     bool authority_; ///< Authority -flag
-    Vector<AttributeInterpolation> interpolations_; ///< Running attribute interpolations.
+    AttributeInterpolator interpolator_; ///< Running attribute interpolations.
     Vector<Pair<EntityWeakPtr, AttributeChange::Type> > entitiesCreatedThisFrame_; ///< Entities to signal for creation at frame end.
     ParentingTracker parentTracker_; ///< Tracker for client side mass Entity imports (eg. SceneDesc based).
     SubsystemMap subsystems; ///< Scene subsystems
+    Vector<SceneLoaderPtr> loaders_; ///< Scene loads in progress.
+    HashMap<u32, ComponentIndex> componentIndex_; ///< Components of the scene by type ID. IComponent::sceneTypeIndex is the position in the vector.
+    EntityNameIndex entitiesByName_; ///< Entities by Name::name, see EntityByName.
+    EntityNameIndex entitiesByGroup_; ///< Entities by Name::group, see EntitiesOfGroup.
+    HashMap<Entity*, Pair<String, String> > indexedNames_; ///< Name and group of each entity in the name indices.
 };
 
 }
@@ -16,18 +16,30 @@ Vector<SharedPtr<T> > Scene::Components(const String &name) const
     Vector<SharedPtr<T> > ret;
     if (name.Empty())
     {
-        for(ConstIterator it = Begin(); it != End(); ++it)
+        // As Entity::ComponentsOfType, return also the components of types derived from T. The components of a type
+        // share their class, so a type whose first component is not a T is skipped as a whole.
+        for(HashMap<u32, ComponentIndex>::ConstIterator type = componentIndex_.Begin(); type != componentIndex_.End(); ++type)
         {
-            Vector<SharedPtr<T> > components =  it->second_->ComponentsOfType<T>();
-            if (!components.Empty())
-                ret.Insert(ret.End(), components.Begin(), components.End());
+            const ComponentIndex &components = type->second_;
+            if (components.Empty() || !dynamic_cast<T*>(components.Front()))
+                continue;
+            for(ComponentIndex::ConstIterator it = components.Begin(); it != components.End(); ++it)
+            {
+                SharedPtr<T> component(dynamic_cast<T*>(*it));
+                if (component)
+                    ret.Push(component);
+            }
         }
     }
     else
     {
-        for(ConstIterator it = Begin(); it != End(); ++it)
+        // As Entity::Component<T>(name), return the first component of type T with the name of each entity.
+        const ComponentIndex &components = ComponentsOfType(T::ComponentTypeId);
+        for(ComponentIndex::ConstIterator it = components.Begin(); it != components.End(); ++it)
         {
-            SharedPtr<T> component = it->second_->Component<T>(name);
+            if ((*it)->Name() != name || (*it)->ParentEntity()->Component(T::ComponentTypeId, name).Get() != *it)
+                continue;
+            SharedPtr<T> component(dynamic_cast<T*>(*it));
             if (component)
                 ret.Push(component);
         }
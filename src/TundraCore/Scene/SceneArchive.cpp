@@ -0,0 +1,590 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   SceneArchive.cpp
+    @brief  Indexed binary scene file that materializes entities on demand. */
+
+#include "StableHeaders.h"
+#include "Win.h"
+#include "SceneArchive.h"
+#include "Scene/Scene.h"
+#include "Entity.h"
+#include "IComponent.h"
+#include "IAttribute.h"
+#include "Math/Transform.h"
+#include "Geometry/AABB.h"
+#include "LoggingFunctions.h"
+
+#include <kNet/DataSerializer.h>
+#include <kNet/DataDeserializer.h>
+
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/Compression.h>
+#include <Urho3D/Core/Profiler.h>
+
+#include <cmath>
+
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Tundra
+{
+
+/// File identifier and version of the format.
+static const char cArchiveId[4] = { 'T', 'B', 'I', 'X' };
+static const u32 cArchiveVersion = 1;
+/// Header: id, version, flags, number of records, index offset.
+static const uint cHeaderSize = 4 + 4 + 4 + 4 + 8;
+static const u32 cFlagCompressed = 1;
+/// Smallest size of a record in the index, used to reject a corrupted record count before allocating the records.
+static const uint cMinIndexRecordSize = 4 + 8 + 4 + 4 + 3 * 4 + 4;
+/// Cell coordinates are clamped to this range, so that far away positions do not overflow them.
+static const float cMaxCellCoordinate = 1e9f;
+
+/// Reads an entity of the .tbin format, and its children, collecting their IDs and component types.
+static void ScanEntity(kNet::DataDeserializer &source, PODVector<entity_id_t> &ids, PODVector<u32> &typeIds)
+{
+    ids.Push(source.Read<u32>());
+    source.Read<u8>(); // replicated
+    uint numComponents = source.Read<u32>();
+    uint numChildren = numComponents >> 16;
+    numComponents &= 0xffff;
+
+    for(uint i = 0; i < numComponents; ++i)
+    {
+        u32 typeId = source.Read<u32>();
+        source.ReadString();
+        source.Read<u8>(); // replicated
+        uint dataSize = source.Read<u32>();
+        source.SkipBytes(dataSize);
+        if (!typeIds.Contains(typeId))
+            typeIds.Push(typeId);
+    }
+
+    for(uint i = 0; i < numChildren; ++i)
+        ScanEntity(source, ids, typeIds);
+}
+
+/// Returns the cell coordinate of @c value, clamped to [@c minCoord, @c maxCoord].
+static int CellCoordinate(float value, float cellSize, int minCoord, int maxCoord)
+{
+    float coord = floorf(value / cellSize);
+    coord = (coord < -cMaxCellCoordinate ? -cMaxCellCoordinate : (coord > cMaxCellCoordinate ? cMaxCellCoordinate : coord));
+    int cell = (int)coord;
+    return (cell < minCoord ? minCoord : (cell > maxCoord ? maxCoord : cell));
+}
+
+/// Returns the position of the Placeable of @c entity, or NaN if it has none.
+static float3 PlaceablePosition(const Entity *entity)
+{
+    static const StringHash transformId("transform");
+    ComponentPtr placeable = entity->Component("Placeable");
+    Attribute<Transform> *transform = (placeable ? placeable->AttributeByIdHash<Transform>(transformId) : 0);
+    return (transform ? transform->Get().pos : float3::nan);
+}
+
+SceneArchive::SceneArchive() :
+    data_(0),
+    size_(0),
+#ifdef WIN32
+    fileHandle_(INVALID_HANDLE_VALUE),
+    mappingHandle_(0),
+#endif
+    numPending_(0),
+    nextRecord_(0),
+    cellSize_(1.0f)
+{
+    minCell_.x = minCell_.y = minCell_.z = 0;
+    maxCell_ = minCell_;
+}
+
+SceneArchive::~SceneArchive()
+{
+    Close();
+}
+
+bool SceneArchive::Write(const Scene *scene, const String &filename, bool compress, bool saveTemporary, bool saveLocal)
+{
+    if (!scene)
+        return false;
+
+    PROFILE(SceneArchive_Write);
+
+    Urho3D::File file(scene->GetContext());
+    if (!file.Open(filename, Urho3D::FILE_WRITE))
+    {
+        LogError("SceneArchive::Write: Could not open file " + filename + " for writing.");
+        return false;
+    }
+
+    // The header is rewritten with the index offset once the records have been written.
+    char header[cHeaderSize];
+    memset(header, 0, cHeaderSize);
+    file.Write(header, cHeaderSize);
+
+    /// Index entry of a written record.
+    struct WrittenRecord
+    {
+        entity_id_t id;
+        u64 offset;
+        uint size;
+        uint uncompressedSize;
+        float3 position;
+        PODVector<entity_id_t> ids;
+    };
+    Vector<WrittenRecord> records;
+    HashMap<u32, PODVector<uint> > recordsByType;
+    PODVector<u32> typeIds;
+    PODVector<char> bytes;
+    PODVector<unsigned char> compressed;
+    u64 offset = cHeaderSize;
+
+    const bool serializeChildren = true;
+    EntityVector roots = scene->RootLevelEntities();
+    foreach(const EntityPtr &entity, roots)
+    {
+        if (!entity->ShouldBeSerialized(saveTemporary, saveLocal, serializeChildren))
+            continue;
+
+        // Assume 4MB max per root entity, as Scene::SaveSceneBinary does for the whole scene.
+        bytes.Resize(4 * 1024 * 1024);
+        kNet::DataSerializer dest(&bytes[0], bytes.Size());
+        entity->SerializeToBinary(dest, saveTemporary, saveLocal, serializeChildren);
+        uint size = static_cast<uint>(dest.BytesFilled());
+
+        records.Resize(records.Size() + 1);
+        WrittenRecord &written = records.Back();
+        typeIds.Clear();
+        kNet::DataDeserializer scan(&bytes[0], size);
+        ScanEntity(scan, written.ids, typeIds);
+
+        const char *record = &bytes[0];
+        uint storedSize = size;
+        uint uncompressedSize = 0;
+        if (compress && size > 0)
+        {
+            compressed.Resize(Urho3D::EstimateCompressBound(size));
+            uint compressedSize = Urho3D::CompressData(&compressed[0], &bytes[0], size);
+            if (compressedSize > 0 && compressedSize < size)
+            {
+                record = (const char*)&compressed[0];
+                storedSize = compressedSize;
+                uncompressedSize = size;
+            }
+        }
+        file.Write(record, storedSize);
+
+        written.id = entity->Id();
+        written.offset = offset;
+        written.size = storedSize;
+        written.uncompressedSize = uncompressedSize;
+        written.position = PlaceablePosition(entity.Get());
+        for(uint i = 0; i < typeIds.Size(); ++i)
+            recordsByType[typeIds[i]].Push(records.Size() - 1);
+
+        offset += storedSize;
+    }
+
+    // Index: the records with the IDs of their entities, then the component type sections.
+    uint indexSize = 4;
+    for(uint i = 0; i < records.Size(); ++i)
+        indexSize += 4 + 8 + 4 + 4 + 3 * 4 + 4 + 4 * records[i].ids.Size();
+    for(HashMap<u32, PODVector<uint> >::ConstIterator it = recordsByType.Begin(); it != recordsByType.End(); ++it)
+        indexSize += 4 + 4 + 4 * it->second_.Size();
+
+    PODVector<char> indexBytes;
+    indexBytes.Resize(indexSize);
+    kNet::DataSerializer index(&indexBytes[0], indexBytes.Size());
+    for(uint i = 0; i < records.Size(); ++i)
+    {
+        const WrittenRecord &written = records[i];
+        index.Add<u32>(written.id);
+        index.Add<u64>(written.offset);
+        index.Add<u32>(written.size);
+        index.Add<u32>(written.uncompressedSize);
+        index.Add<float>(written.position.x);
+        index.Add<float>(written.position.y);
+        index.Add<float>(written.position.z);
+        index.Add<u32>(written.ids.Size());
+        for(uint j = 0; j < written.ids.Size(); ++j)
+            index.Add<u32>(written.ids[j]);
+    }
+    index.Add<u32>(recordsByType.Size());
+    for(HashMap<u32, PODVector<uint> >::ConstIterator it = recordsByType.Begin(); it != recordsByType.End(); ++it)
+    {
+        index.Add<u32>(it->first_);
+        index.Add<u32>(it->second_.Size());
+        for(uint i = 0; i < it->second_.Size(); ++i)
+            index.Add<u32>(it->second_[i]);
+    }
+    file.Write(&indexBytes[0], indexBytes.Size());
+
+    kNet::DataSerializer headerDest(header, cHeaderSize);
+    headerDest.AddArray<char>(cArchiveId, 4);
+    headerDest.Add<u32>(cArchiveVersion);
+    headerDest.Add<u32>(compress ? cFlagCompressed : 0);
+    headerDest.Add<u32>(records.Size());
+    headerDest.Add<u64>(offset);
+    file.Seek(0);
+    file.Write(header, cHeaderSize);
+    return true;
+}
+
+bool SceneArchive::IsArchive(Urho3D::Context *context, const String &filename)
+{
+    Urho3D::File file(context);
+    char id[4];
+    return file.Open(filename, Urho3D::FILE_READ) && file.Read(id, 4) == 4 && memcmp(id, cArchiveId, 4) == 0;
+}
+
+bool SceneArchive::Open(const String &filename)
+{
+    Close();
+
+#ifdef WIN32
+    HANDLE fileHandle = CreateFileW(Urho3D::WString(filename).CString(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+    {
+        LogError("SceneArchive::Open: Failed to open file " + filename + ".");
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(fileHandle, &fileSize);
+    HANDLE mappingHandle = (fileSize.QuadPart > 0 ? CreateFileMappingW(fileHandle, 0, PAGE_READONLY, 0, 0, 0) : 0);
+    const void *view = (mappingHandle ? MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0) : 0);
+    if (!view)
+    {
+        LogError("SceneArchive::Open: Failed to map file " + filename + " to memory.");
+        if (mappingHandle)
+            CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+        return false;
+    }
+    fileHandle_ = fileHandle;
+    mappingHandle_ = mappingHandle;
+    size_ = (u64)fileSize.QuadPart;
+#else
+    int fd = open(filename.CString(), O_RDONLY);
+    if (fd == -1)
+    {
+        LogError("SceneArchive::Open: Failed to open file " + filename + ".");
+        return false;
+    }
+    struct stat st;
+    void *view = (fstat(fd, &st) == 0 && st.st_size > 0 ? mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED);
+    // The mapping stays valid after closing the descriptor.
+    close(fd);
+    if (view == MAP_FAILED)
+    {
+        LogError("SceneArchive::Open: Failed to map file " + filename + " to memory.");
+        return false;
+    }
+    size_ = (u64)st.st_size;
+#endif
+
+    data_ = (const char*)view;
+    filename_ = filename;
+    if (!ReadIndex())
+    {
+        LogError("SceneArchive::Open: File " + filename + " is not a valid scene archive.");
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void SceneArchive::Close()
+{
+    if (data_)
+    {
+#ifdef WIN32
+        UnmapViewOfFile(data_);
+        CloseHandle(mappingHandle_);
+        CloseHandle(fileHandle_);
+        fileHandle_ = INVALID_HANDLE_VALUE;
+        mappingHandle_ = 0;
+#else
+        munmap((void*)data_, (size_t)size_);
+#endif
+    }
+    data_ = 0;
+    size_ = 0;
+    filename_.Clear();
+    records_.Clear();
+    recordById_.Clear();
+    recordsByComponentType_.Clear();
+    cells_.Clear();
+    numPending_ = 0;
+    nextRecord_ = 0;
+}
+
+bool SceneArchive::ReadIndex()
+{
+    if (size_ < cHeaderSize || memcmp(data_, cArchiveId, 4) != 0)
+        return false;
+
+    try
+    {
+        kNet::DataDeserializer header(data_, cHeaderSize);
+        header.SkipBytes(4);
+        u32 version = header.Read<u32>();
+        if (version != cArchiveVersion)
+        {
+            LogError("SceneArchive::ReadIndex: Unsupported version " + String(version) + ".");
+            return false;
+        }
+        header.Read<u32>(); // flags
+        uint numRecords = header.Read<u32>();
+        u64 indexOffset = header.Read<u64>();
+        if (indexOffset < cHeaderSize || indexOffset > size_)
+            return false;
+
+        if ((u64)numRecords * cMinIndexRecordSize > size_ - indexOffset)
+            return false;
+
+        kNet::DataDeserializer index(data_ + indexOffset, (size_t)(size_ - indexOffset));
+        records_.Resize(numRecords);
+        for(uint i = 0; i < numRecords; ++i)
+        {
+            Record &record = records_[i];
+            record.id = index.Read<u32>();
+            record.offset = index.Read<u64>();
+            record.size = index.Read<u32>();
+            record.uncompressedSize = index.Read<u32>();
+            record.position.x = index.Read<float>();
+            record.position.y = index.Read<float>();
+            record.position.z = index.Read<float>();
+            record.loaded = false;
+            record.failed = false;
+            if (record.offset < cHeaderSize || record.offset + record.size > indexOffset)
+                return false;
+
+            uint numIds = index.Read<u32>();
+            for(uint j = 0; j < numIds; ++j)
+                recordById_[index.Read<u32>()] = i;
+        }
+
+        uint numTypes = index.Read<u32>();
+        for(uint i = 0; i < numTypes; ++i)
+        {
+            PODVector<uint> &indices = recordsByComponentType_[index.Read<u32>()];
+            indices.Resize(index.Read<u32>());
+            for(uint j = 0; j < indices.Size(); ++j)
+            {
+                indices[j] = index.Read<u32>();
+                if (indices[j] >= numRecords)
+                    return false;
+            }
+        }
+    }
+    catch(...)
+    {
+        return false;
+    }
+
+    numPending_ = records_.Size();
+    nextRecord_ = 0;
+    BuildCells();
+    return true;
+}
+
+void SceneArchive::BuildCells()
+{
+    cells_.Clear();
+
+    AABB bounds;
+    bounds.SetNegativeInfinity();
+    uint numPositioned = 0;
+    for(uint i = 0; i < records_.Size(); ++i)
+    {
+        if (records_[i].position.IsFinite())
+        {
+            bounds.Enclose(records_[i].position);
+            ++numPositioned;
+        }
+    }
+    if (!numPositioned)
+        return;
+
+    // About as many cells along the longest axis as the cube root of the number of records, so that a query of a
+    // small area touches few records whether the entities are spread out evenly or on a plane.
+    float cellsPerAxis = ceilf(powf((float)numPositioned, 1.0f / 3.0f));
+    float extent = bounds.Size().MaxElement();
+    cellSize_ = extent / cellsPerAxis;
+    if (!(cellSize_ >= 1.0f))
+        cellSize_ = 1.0f;
+
+    const int minCoord = -(int)cMaxCellCoordinate, maxCoord = (int)cMaxCellCoordinate;
+    minCell_.x = CellCoordinate(bounds.minPoint.x, cellSize_, minCoord, maxCoord);
+    minCell_.y = CellCoordinate(bounds.minPoint.y, cellSize_, minCoord, maxCoord);
+    minCell_.z = CellCoordinate(bounds.minPoint.z, cellSize_, minCoord, maxCoord);
+    maxCell_.x = CellCoordinate(bounds.maxPoint.x, cellSize_, minCoord, maxCoord);
+    maxCell_.y = CellCoordinate(bounds.maxPoint.y, cellSize_, minCoord, maxCoord);
+    maxCell_.z = CellCoordinate(bounds.maxPoint.z, cellSize_, minCoord, maxCoord);
+
+    for(uint i = 0; i < records_.Size(); ++i)
+        if (records_[i].position.IsFinite())
+            cells_[CellOf(records_[i].position)].Push(i);
+}
+
+SceneArchive::Cell SceneArchive::CellOf(const float3 &pos) const
+{
+    Cell cell;
+    cell.x = CellCoordinate(pos.x, cellSize_, minCell_.x, maxCell_.x);
+    cell.y = CellCoordinate(pos.y, cellSize_, minCell_.y, maxCell_.y);
+    cell.z = CellCoordinate(pos.z, cellSize_, minCell_.z, maxCell_.z);
+    return cell;
+}
+
+Vector<Entity *> SceneArchive::LoadRecords(Scene *scene, const PODVector<uint> &indices, AttributeChange::Type change)
+{
+    if (!scene || !data_)
+        return Vector<Entity *>();
+
+    PROFILE(SceneArchive_LoadRecords);
+
+    // Gather the records to a .tbin stream for Scene::CreateContentFromBinary.
+    PODVector<char> bytes;
+    bytes.Resize(4);
+    PODVector<uint> gathered;
+    for(uint i = 0; i < indices.Size(); ++i)
+    {
+        if (indices[i] >= records_.Size())
+            continue;
+        Record &record = records_[indices[i]];
+        if (record.loaded || record.failed)
+            continue;
+
+        const char *src = data_ + record.offset;
+        uint pos = bytes.Size();
+        if (record.uncompressedSize)
+        {
+            bytes.Resize(pos + record.uncompressedSize);
+            if (Urho3D::DecompressData(&bytes[pos], src, record.uncompressedSize) != record.size)
+            {
+                LogError("SceneArchive::LoadRecords: Failed to decompress entity " + String(record.id) + " from " + filename_ + ".");
+                bytes.Resize(pos);
+                record.failed = true;
+                --numPending_;
+                continue;
+            }
+        }
+        else
+        {
+            bytes.Resize(pos + record.size);
+            memcpy(&bytes[pos], src, record.size);
+        }
+        gathered.Push(indices[i]);
+    }
+    if (gathered.Empty())
+        return Vector<Entity *>();
+
+    kNet::DataSerializer count(&bytes[0], 4);
+    count.Add<u32>(gathered.Size());
+    Vector<Entity *> entities = scene->CreateContentFromBinary(&bytes[0], bytes.Size(), true, change);
+
+    // The records are loaded only if their entities were actually created, the rest are not tried again.
+    for(uint i = 0; i < gathered.Size(); ++i)
+    {
+        Record &record = records_[gathered[i]];
+        if (scene->EntityById(record.id))
+            record.loaded = true;
+        else
+        {
+            LogError("SceneArchive::LoadRecords: Failed to create entity " + String(record.id) + " from " + filename_ + ".");
+            record.failed = true;
+        }
+        --numPending_;
+    }
+    return entities;
+}
+
+Vector<Entity *> SceneArchive::LoadEntity(Scene *scene, entity_id_t id, AttributeChange::Type change)
+{
+    HashMap<entity_id_t, uint>::ConstIterator it = recordById_.Find(id);
+    if (it == recordById_.End())
+        return Vector<Entity *>();
+    PODVector<uint> indices;
+    indices.Push(it->second_);
+    return LoadRecords(scene, indices, change);
+}
+
+Vector<Entity *> SceneArchive::LoadEntitiesInSphere(Scene *scene, const float3 &center, float radius, AttributeChange::Type change)
+{
+    if (cells_.Empty() || !center.IsFinite() || !(radius >= 0.0f))
+        return Vector<Entity *>();
+
+    const float radiusSq = radius * radius;
+    PODVector<uint> indices;
+    Cell low = CellOf(center - float3(radius, radius, radius));
+    Cell high = CellOf(center + float3(radius, radius, radius));
+    u64 numCells = (u64)(high.x - low.x + 1) * (u64)(high.y - low.y + 1) * (u64)(high.z - low.z + 1);
+    if (numCells <= cells_.Size())
+    {
+        Cell cell;
+        for(cell.z = low.z; cell.z <= high.z; ++cell.z)
+            for(cell.y = low.y; cell.y <= high.y; ++cell.y)
+                for(cell.x = low.x; cell.x <= high.x; ++cell.x)
+                {
+                    HashMap<Cell, PODVector<uint> >::ConstIterator it = cells_.Find(cell);
+                    if (it == cells_.End())
+                        continue;
+                    for(uint i = 0; i < it->second_.Size(); ++i)
+                    {
+                        const Record &record = records_[it->second_[i]];
+                        if (!record.loaded && !record.failed && record.position.DistanceSq(center) <= radiusSq)
+                            indices.Push(it->second_[i]);
+                    }
+                }
+    }
+    else
+    {
+        // The sphere covers more cells than are occupied, go through the occupied ones.
+        for(HashMap<Cell, PODVector<uint> >::ConstIterator it = cells_.Begin(); it != cells_.End(); ++it)
+            for(uint i = 0; i < it->second_.Size(); ++i)
+            {
+                const Record &record = records_[it->second_[i]];
+                if (!record.loaded && !record.failed && record.position.DistanceSq(center) <= radiusSq)
+                    indices.Push(it->second_[i]);
+            }
+    }
+    return LoadRecords(scene, indices, change);
+}
+
+Vector<Entity *> SceneArchive::LoadEntitiesWithComponent(Scene *scene, u32 typeId, AttributeChange::Type change)
+{
+    HashMap<u32, PODVector<uint> >::ConstIterator it = recordsByComponentType_.Find(typeId);
+    if (it == recordsByComponentType_.End())
+        return Vector<Entity *>();
+    return LoadRecords(scene, it->second_, change);
+}
+
+Vector<Entity *> SceneArchive::LoadNext(Scene *scene, uint maxRecords, AttributeChange::Type change)
+{
+    PODVector<uint> indices;
+    for(; nextRecord_ < records_.Size() && indices.Size() < maxRecords; ++nextRecord_)
+        if (!records_[nextRecord_].loaded && !records_[nextRecord_].failed)
+            indices.Push(nextRecord_);
+    return LoadRecords(scene, indices, change);
+}
+
+Vector<Entity *> SceneArchive::LoadAll(Scene *scene, AttributeChange::Type change)
+{
+    PODVector<uint> indices;
+    for(uint i = 0; i < records_.Size(); ++i)
+        if (!records_[i].loaded && !records_[i].failed)
+            indices.Push(i);
+    return LoadRecords(scene, indices, change);
+}
+
+bool SceneArchive::IsLoaded(entity_id_t id) const
+{
+    HashMap<entity_id_t, uint>::ConstIterator it = recordById_.Find(id);
+    return it != recordById_.End() && records_[it->second_].loaded;
+}
+
+}
@@ -0,0 +1,160 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   SceneArchive.h
+    @brief  Indexed binary scene file that materializes entities on demand. */
+
+#pragma once
+
+#include "TundraCoreApi.h"
+#include "SceneFwd.h"
+#include "AttributeChangeType.h"
+#include "Math/float3.h"
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/RefCounted.h>
+
+namespace Tundra
+{
+
+/// Indexed binary scene file (.tbix) that materializes entities on demand.
+/** The file consists of a header, one record per root-level entity and an index at the end of the file. A record is
+    the entity with its children in the .tbin entity format, optionally LZ4-compressed. The index has the offset and
+    position of every record, the record of every entity ID, and one section per component type listing the records
+    with components of that type.
+
+    An opened archive maps the file into memory and reads only the index. Entities are created into a scene when
+    requested by ID, by position or by component type, in batches, or all at once, and each record is created at most once.
+    The positions are kept in a uniform grid, so a query by position touches only the records in the cells it overlaps.
+
+    @code
+    SceneArchivePtr archive(new SceneArchive());
+    if (archive->Open("scene.tbix"))
+        archive->LoadEntitiesInSphere(scene, cameraPos, 100.f, AttributeChange::Default);
+    @endcode */
+class TUNDRACORE_API SceneArchive : public RefCounted
+{
+public:
+    SceneArchive();
+    ~SceneArchive();
+
+    /// Writes the root-level entities of @c scene, and their children, to @c filename.
+    /** @param compress Whether to LZ4-compress the entity records. Records that do not shrink are stored uncompressed.
+        @param saveTemporary Are temporary entities wanted to be included.
+        @param saveLocal Are local entities wanted to be included.
+        @return true if successful */
+    static bool Write(const Scene *scene, const String &filename, bool compress, bool saveTemporary, bool saveLocal);
+
+    /// Returns whether @c filename starts with the archive file identifier.
+    static bool IsArchive(Urho3D::Context *context, const String &filename);
+
+    /// Maps @c filename into memory and reads its index.
+    /** @return true if successful */
+    bool Open(const String &filename);
+
+    /// Unmaps the file. Entities already created remain in their scenes.
+    void Close();
+
+    /// Returns whether a file is open.
+    bool IsOpen() const { return data_ != 0; }
+
+    /// Returns the name of the open file.
+    const String &Filename() const { return filename_; }
+
+    /// Returns the number of root-level entities, i.e. records, in the file.
+    uint NumRecords() const { return records_.Size(); }
+
+    /// Returns the number of entities in the file, including children.
+    uint NumEntities() const { return recordById_.Size(); }
+
+    /// Returns whether the file contains the entity @c id.
+    bool HasEntity(entity_id_t id) const { return recordById_.Contains(id); }
+
+    /// Creates the entity @c id into @c scene, along with its root-level ancestor and all of its descendants.
+    /** The entities use the IDs from the file and are signaled like in Scene::CreateContentFromBinary.
+        @return The created entities, none if the record had been created already. */
+    Vector<Entity *> LoadEntity(Scene *scene, entity_id_t id, AttributeChange::Type change);
+
+    /// Creates the root-level entities whose Placeable position is within @c radius of @c center, and their children.
+    Vector<Entity *> LoadEntitiesInSphere(Scene *scene, const float3 &center, float radius, AttributeChange::Type change);
+
+    /// Creates the root-level entities with a component of type @c typeId in themselves or in their children.
+    Vector<Entity *> LoadEntitiesWithComponent(Scene *scene, u32 typeId, AttributeChange::Type change);
+
+    /// Creates the next @c maxRecords root-level entities not created yet, in file order, and their children.
+    /** Used to create the whole file over several frames. */
+    Vector<Entity *> LoadNext(Scene *scene, uint maxRecords, AttributeChange::Type change);
+
+    /// Creates all entities not created yet.
+    Vector<Entity *> LoadAll(Scene *scene, AttributeChange::Type change);
+
+    /// Returns whether the record containing entity @c id has been created.
+    bool IsLoaded(entity_id_t id) const;
+
+    /// Returns the number of records that have been neither created nor failed to be created.
+    uint NumPendingRecords() const { return numPending_; }
+
+private:
+    /// A root-level entity and its children.
+    struct Record
+    {
+        entity_id_t id;
+        u64 offset;
+        /// Size of the record in the file.
+        uint size;
+        /// Size of the record uncompressed, or 0 if stored uncompressed.
+        uint uncompressedSize;
+        /// Position of the Placeable of the root entity, NaN if none.
+        float3 position;
+        /// The entities have been created.
+        bool loaded;
+        /// The record could not be decompressed or created, it is not tried again.
+        bool failed;
+    };
+
+    /// Cell of the spatial index.
+    struct Cell
+    {
+        int x, y, z;
+
+        bool operator ==(const Cell &rhs) const { return x == rhs.x && y == rhs.y && z == rhs.z; }
+        unsigned ToHash() const { return ((unsigned)x * 73856093u) ^ ((unsigned)y * 19349663u) ^ ((unsigned)z * 83492791u); }
+    };
+
+    /// Creates the records @c indices that are not loaded yet.
+    /** A record is marked loaded once its entities have been created, or failed if they could not be. */
+    Vector<Entity *> LoadRecords(Scene *scene, const PODVector<uint> &indices, AttributeChange::Type change);
+    /// Reads the index at the end of the file.
+    bool ReadIndex();
+    /// Fills the spatial index from the record positions.
+    void BuildCells();
+    /// Returns the cell of @c pos, clamped to the range of the occupied cells.
+    Cell CellOf(const float3 &pos) const;
+
+    String filename_;
+    /// Memory mapped file content.
+    const char *data_;
+    u64 size_;
+#ifdef WIN32
+    void *fileHandle_;
+    void *mappingHandle_;
+#endif
+
+    Vector<Record> records_;
+    HashMap<entity_id_t, uint> recordById_;
+    HashMap<u32, PODVector<uint> > recordsByComponentType_;
+    /// Records that have been neither loaded nor failed.
+    uint numPending_;
+    /// Records in file order before this have been loaded or failed.
+    uint nextRecord_;
+
+    /// Records with a position by the cell they are in.
+    HashMap<Cell, PODVector<uint> > cells_;
+    /// Edge length of a cell.
+    float cellSize_;
+    /// Range of the occupied cells.
+    Cell minCell_;
+    Cell maxCell_;
+};
+
+}
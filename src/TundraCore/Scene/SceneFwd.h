@@ -26,6 +26,8 @@ namespace Tundra
     class Framework;
     class SceneAPI;
     class Scene;
+    class SceneLoader;
+    class SceneArchive;
     class Entity;
     class IComponent;
     class IComponentFactory;
@@ -45,6 +47,8 @@ namespace Tundra
 
     typedef SharedPtr<Scene> ScenePtr;
     typedef WeakPtr<Scene> SceneWeakPtr;
+    typedef SharedPtr<SceneLoader> SceneLoaderPtr;
+    typedef SharedPtr<SceneArchive> SceneArchivePtr;
     typedef WeakPtr<Entity> EntityWeakPtr;
     typedef SharedPtr<Entity> EntityPtr;
     typedef Vector<EntityPtr> EntityVector;
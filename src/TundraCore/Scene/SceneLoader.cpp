@@ -0,0 +1,285 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   SceneLoader.cpp
+    @brief  Loads scene content from a file over several frames. */
+
+#include "StableHeaders.h"
+#include "SceneLoader.h"
+#include "Scene/Scene.h"
+#include "Entity.h"
+#include "IComponent.h"
+#include "Framework.h"
+#include "AssetAPI.h"
+#include "LoggingFunctions.h"
+
+#include <kNet/DataDeserializer.h>
+
+#include <Urho3D/Container/HashSet.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/Resource/XMLFile.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Core/Profiler.h>
+
+namespace Tundra
+{
+
+SceneLoader::SceneLoader(Scene *scene, const String &filename, bool binary, bool useEntityIDsFromFile, AttributeChange::Type change) :
+    scene_(scene),
+    filename_(filename),
+    binary_(binary),
+    useEntityIDsFromFile_(useEntityIDsFromFile),
+    change_(change),
+    timeBudget_(10.f),
+    state_(StateCreating),
+    failed_(false),
+    numRoots_(0),
+    rootsCreated_(0),
+    entitiesSignaled_(0),
+    source_(0)
+{
+}
+
+SceneLoader::~SceneLoader()
+{
+    delete source_;
+}
+
+void SceneLoader::SetTimeBudget(float msecs)
+{
+    if (msecs > 0.f)
+        timeBudget_ = msecs;
+}
+
+float SceneLoader::Progress() const
+{
+    switch(state_)
+    {
+    case StateCreating:
+        return numRoots_ > 0 ? 0.5f * (float)rootsCreated_ / (float)numRoots_ : 0.f;
+    case StateSignaling:
+        return entities_.Size() > 0 ? 0.5f + 0.5f * (float)entitiesSignaled_ / (float)entities_.Size() : 0.5f;
+    default:
+        return 1.f;
+    }
+}
+
+Vector<Entity *> SceneLoader::Entities() const
+{
+    Vector<Entity *> ret;
+    ret.Reserve(entities_.Size());
+    for(uint i = 0; i < entities_.Size(); ++i)
+        if (!entities_[i].Expired())
+            ret.Push(entities_[i].Get());
+    return ret;
+}
+
+bool SceneLoader::Open(bool clearScene)
+{
+    Urho3D::File file(scene_->GetContext());
+    if (!file.Open(filename_, Urho3D::FILE_READ))
+    {
+        LogError("SceneLoader::Open: Failed to open file " + filename_ + ".");
+        return false;
+    }
+
+    if (binary_)
+    {
+        if (!file.GetSize())
+        {
+            LogError("SceneLoader::Open: File " + filename_ + " contained 0 bytes when loading scene binary.");
+            return false;
+        }
+        bytes_.Resize(file.GetSize());
+        file.Read(&bytes_[0], bytes_.Size());
+        file.Close();
+
+        source_ = new kNet::DataDeserializer(&bytes_[0], bytes_.Size());
+        try
+        {
+            numRoots_ = source_->Read<u32>();
+        }
+        catch(...)
+        {
+            LogError("SceneLoader::Open: File " + filename_ + " is not a valid scene binary.");
+            return false;
+        }
+    }
+    else
+    {
+        xml_ = new Urho3D::XMLFile(scene_->GetContext());
+        if (!xml_->Load(file))
+        {
+            LogError("Parsing scene XML from " + filename_ + " failed.");
+            return false;
+        }
+        file.Close();
+
+        if (!xml_->GetRoot("scene"))
+        {
+            LogError("SceneLoader::Open: Could not find 'scene' element from XML.");
+            return false;
+        }
+    }
+
+    // Purge all old entities. Send events for the removal
+    if (clearScene)
+        scene_->RemoveAllEntities(true, change_);
+
+    if (!binary_)
+    {
+        Urho3D::XMLElement sceneElem = xml_->GetRoot("scene");
+        Framework *framework = scene_->GetFramework();
+        Urho3D::XMLElement storageElem = sceneElem.GetChild("storage");
+        while(storageElem)
+        {
+            framework->Asset()->DeserializeAssetStorageFromString(framework->ParseWildCardFilename(storageElem.GetAttribute("specifier")), false);
+            storageElem = storageElem.GetNext("storage");
+        }
+
+        nextElement_ = sceneElem.GetChild("entity");
+        for(Urho3D::XMLElement entElem = nextElement_; entElem; entElem = entElem.GetNext("entity"))
+            ++numRoots_;
+    }
+    return true;
+}
+
+bool SceneLoader::CreateNext()
+{
+    if (rootsCreated_ >= numRoots_)
+        return false;
+
+    if (binary_)
+        scene_->CreateEntityFromBinary(EntityPtr(), *source_, useEntityIDsFromFile_, change_, entities_, oldToNewIds_);
+    else
+    {
+        scene_->CreateEntityFromXml(EntityPtr(), nextElement_, useEntityIDsFromFile_, change_, entities_, oldToNewIds_);
+        nextElement_ = nextElement_.GetNext("entity");
+    }
+    ++rootsCreated_;
+    return true;
+}
+
+void SceneLoader::RemoveFromCreatedThisFrame(uint firstEntity)
+{
+    if (firstEntity >= entities_.Size())
+        return;
+
+    // The entities are signaled by the loader once all of them exist, not at the end of this frame.
+    HashSet<Entity *> created;
+    for(uint i = firstEntity; i < entities_.Size(); ++i)
+        created.Insert(entities_[i].Get());
+
+    Vector<Pair<EntityWeakPtr, AttributeChange::Type> > &queue = scene_->entitiesCreatedThisFrame_;
+    uint kept = 0;
+    for(uint i = 0; i < queue.Size(); ++i)
+        if (!created.Contains(queue[i].first_.Get()))
+            queue[kept++] = queue[i];
+    queue.Resize(kept);
+}
+
+void SceneLoader::BeginSignaling()
+{
+    // Sort the XML entities so that parents are before children, as Scene::CreateContentFromXml does.
+    if (!binary_)
+        entities_ = scene_->SortEntities(entities_);
+
+    // Fix parent ref of Placeable if new entity IDs were generated, before any signals are fired.
+    // The entities may have been replicated while being created, so the fixed refs are sent with the load's change type.
+    if (!useEntityIDsFromFile_)
+        scene_->FixPlaceableParentIds(entities_, oldToNewIds_, change_);
+
+    ReleaseFile();
+    state_ = StateSignaling;
+}
+
+void SceneLoader::ReleaseFile()
+{
+    xml_.Reset();
+    nextElement_ = Urho3D::XMLElement();
+    delete source_;
+    source_ = 0;
+    bytes_.Clear();
+}
+
+void SceneLoader::Finish()
+{
+    ReleaseFile();
+    state_ = StateFinished;
+
+    Vector<Entity *> entities = (failed_ ? Vector<Entity *>() : Entities());
+    LogInfo("SceneLoader: Loaded " + String(entities.Size()) + " entities from " + filename_ + (failed_ ? " with errors." : "."));
+    Finished.Emit(this, entities);
+}
+
+bool SceneLoader::Update()
+{
+    if (state_ == StateFinished)
+        return true;
+
+    PROFILE(SceneLoader_Update);
+
+    Urho3D::HiresTimer timer;
+    const long long budget = (long long)(timeBudget_ * 1000.f);
+
+    if (state_ == StateCreating)
+    {
+        const uint firstEntity = entities_.Size();
+        try
+        {
+            while(CreateNext())
+                if (timer.GetUSec(false) >= budget)
+                    break;
+        }
+        catch(...)
+        {
+            // Like Scene::CreateContentFromBinary, emit no signals for a file that could not be read.
+            LogError("SceneLoader::Update: Failed to read scene binary " + filename_ + ".");
+            failed_ = true;
+        }
+        RemoveFromCreatedThisFrame(firstEntity);
+
+        if (failed_)
+        {
+            Finish();
+            return true;
+        }
+        if (rootsCreated_ < numRoots_)
+        {
+            ProgressChanged.Emit(this, Progress());
+            return false;
+        }
+        BeginSignaling();
+    }
+
+    // Trigger the EntityCreated and ComponentChanged signals in the creation order, at least one entity per update.
+    const uint firstSignaled = entitiesSignaled_;
+    while(entitiesSignaled_ < entities_.Size() && (entitiesSignaled_ == firstSignaled || timer.GetUSec(false) < budget))
+    {
+        EntityWeakPtr weakEnt = entities_[entitiesSignaled_++];
+
+        // On a client start tracking of the server ack messages.
+        if (!scene_->IsAuthority() && !weakEnt.Expired())
+            scene_->parentTracker_.Track(weakEnt.Get());
+
+        if (!weakEnt.Expired())
+            scene_->EmitEntityCreated(weakEnt.Get(), change_);
+        if (!weakEnt.Expired())
+        {
+            EntityPtr entityShared = weakEnt.Lock();
+            const Entity::ComponentMap &components = entityShared->Components();
+            for (Entity::ComponentMap::ConstIterator it = components.Begin(); it != components.End(); ++it)
+                it->second_->ComponentChanged(change_);
+        }
+    }
+
+    if (entitiesSignaled_ < entities_.Size())
+    {
+        ProgressChanged.Emit(this, Progress());
+        return false;
+    }
+    Finish();
+    return true;
+}
+
+}
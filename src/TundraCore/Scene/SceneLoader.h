@@ -0,0 +1,114 @@
+/**
+    For conditions of distribution and use, see copyright notice in LICENSE
+
+    @file   SceneLoader.h
+    @brief  Loads scene content from a file over several frames. */
+
+#pragma once
+
+#include "TundraCoreApi.h"
+#include "SceneFwd.h"
+#include "AttributeChangeType.h"
+#include "Signals.h"
+
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Container/RefCounted.h>
+#include <Urho3D/Resource/XMLElement.h>
+
+namespace Tundra
+{
+
+/// Loads scene content from an XML or binary scene file over several frames.
+/** Started with Scene::BeginLoadSceneXML or Scene::BeginLoadSceneBinary and updated by the scene each frame until finished.
+    The entities are created in batches limited by the time budget, at least one entity per update. Once all entities have
+    been created, the Placeable parent refs are fixed and the EntityCreated and ComponentChanged signals are emitted, also in
+    batches. The other systems, e.g. the network sync, keep running between the batches, so the fixed parent refs are set
+    with the change type of the load to replicate them.
+
+    The entities are in the scene already while being created, but they are signaled only after the whole file has been
+    read, in the same order as Scene::LoadSceneXML and Scene::LoadSceneBinary would signal them. */
+class TUNDRACORE_API SceneLoader : public RefCounted
+{
+public:
+    ~SceneLoader();
+
+    /// Returns the loaded file name.
+    const String &Filename() const { return filename_; }
+
+    /// Sets the time in milliseconds the loader may use per frame. The default is 10 msecs.
+    void SetTimeBudget(float msecs);
+    float TimeBudget() const { return timeBudget_; } ///< @copydoc SetTimeBudget
+
+    /// Returns the load progress in the range [0, 1]. Creating the entities is the first half, signaling them the second.
+    float Progress() const;
+
+    /// Returns whether the load has finished, successfully or not.
+    bool IsFinished() const { return state_ == StateFinished; }
+
+    /// Returns whether the file could not be read fully. No signals are emitted for the entities of a failed load.
+    bool HasFailed() const { return failed_; }
+
+    /// Returns the created entities that still exist.
+    Vector<Entity *> Entities() const;
+
+    /// Emitted after each batch with the current progress.
+    Signal2<SceneLoader*, float> ProgressChanged;
+
+    /// Emitted when the load has finished, with the created entities that still exist, or none if the load failed.
+    Signal2<SceneLoader*, const Vector<Entity *> &> Finished;
+
+private:
+    friend class Scene;
+
+    enum State
+    {
+        StateCreating,
+        StateSignaling,
+        StateFinished
+    };
+
+    SceneLoader(Scene *scene, const String &filename, bool binary, bool useEntityIDsFromFile, AttributeChange::Type change);
+
+    /// Reads the file and optionally clears the scene. Called by the scene before the first update.
+    bool Open(bool clearScene);
+    /// Runs the load until the time budget is used.
+    /** @return true when finished. */
+    bool Update();
+
+    /// Creates the next root-level entity and its children.
+    /** @return false if there are no more entities. */
+    bool CreateNext();
+    /// Drops the entities created since @c firstEntity from the scene's end of frame creation signaling.
+    void RemoveFromCreatedThisFrame(uint firstEntity);
+    /// Fixes the parent refs and prepares the entity list for signaling.
+    void BeginSignaling();
+    /// Frees the file content once all entities have been created.
+    void ReleaseFile();
+    void Finish();
+
+    Scene *scene_;
+    String filename_;
+    bool binary_;
+    bool useEntityIDsFromFile_;
+    AttributeChange::Type change_;
+    float timeBudget_;
+    State state_;
+    bool failed_;
+
+    /// Created entities, in signaling order once all have been created.
+    Vector<EntityWeakPtr> entities_;
+    HashMap<entity_id_t, entity_id_t> oldToNewIds_;
+    uint numRoots_;
+    uint rootsCreated_;
+    uint entitiesSignaled_;
+
+    /// XML document and the next root-level entity element of it.
+    SharedPtr<Urho3D::XMLFile> xml_;
+    Urho3D::XMLElement nextElement_;
+
+    /// Binary file content and the reader of it.
+    PODVector<char> bytes_;
+    kNet::DataDeserializer *source_;
+};
+
+}
@@ -0,0 +1,163 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "TestRunner.h"
+
+#include "AssetAPI.h"
+#include "AssetCache.h"
+#include "IAsset.h"
+#include "IAssetBundle.h"
+#include "IAssetBundleTypeFactory.h"
+
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+
+using namespace Tundra;
+using namespace Tundra::Test;
+
+namespace
+{
+
+/// Bundle that serves its sub assets from files extracted to the cache, like a zip bundle.
+class ExtractedBundle : public IAssetBundle
+{
+    OBJECT(ExtractedBundle);
+
+public:
+    ExtractedBundle(AssetAPI *owner, const String &type_, const String &name_) : IAssetBundle(owner, type_, name_) {}
+
+    bool IsLoaded() const override { return true; }
+    bool RequiresDiskSource() override { return false; }
+    bool DeserializeFromDiskSource() override { return false; }
+    bool DeserializeFromData(const u8 * /*data*/, uint /*numBytes*/) override { return false; }
+    Vector<u8> GetSubAssetData(const String &/*subAssetName*/) override { return Vector<u8>(); }
+    String GetSubAssetDiskSource(const String &/*subAssetName*/) override { return ""; }
+    void DoUnload() override {}
+};
+
+class ExtractedBundleFactory : public IAssetBundleTypeFactory
+{
+public:
+    String Type() const override { return "Extracted"; }
+    StringVector TypeExtensions() const override
+    {
+        StringVector extensions;
+        extensions.Push(".extracted");
+        return extensions;
+    }
+    AssetBundlePtr CreateEmptyAssetBundle(AssetAPI *owner, const String &name) override
+    {
+        return AssetBundlePtr(new ExtractedBundle(owner, Type(), name));
+    }
+};
+
+String CacheTestDirectory(Framework *framework)
+{
+    return framework->GetSubsystem<Urho3D::FileSystem>()->GetProgramDir() + "TundraTestAssetCache/";
+}
+
+String Store(AssetCache *cache, const String &assetRef, uint numBytes)
+{
+    Vector<u8> data(numBytes);
+    for(uint i = 0; i < numBytes; ++i)
+        data[i] = (u8)i;
+    return cache->StoreAsset(&data[0], data.Size(), assetRef);
+}
+
+void RemoveCacheTestDirectory(Framework *framework)
+{
+    Urho3D::FileSystem *fileSystem = framework->GetSubsystem<Urho3D::FileSystem>();
+    const String directory = CacheTestDirectory(framework);
+    StringVector filenames;
+    fileSystem->ScanDir(filenames, directory, "*", Urho3D::SCAN_FILES, false);
+    foreach(const String &filename, filenames)
+        fileSystem->Delete(directory + filename);
+    fileSystem->RemoveDir(directory, false);
+}
+
+}
+
+TEST_F(Runner, AssetCacheIndex)
+{
+    RemoveCacheTestDirectory(framework);
+    Urho3D::FileSystem *fileSystem = framework->GetSubsystem<Urho3D::FileSystem>();
+    {
+        SharedPtr<AssetCache> cache(new AssetCache(framework->Asset(), CacheTestDirectory(framework)));
+        ASSERT_FALSE(Store(cache, "http://test.com/a.bin", 100).Empty());
+        ASSERT_FALSE(Store(cache, "http://test.com/b.bin", 50).Empty());
+        EXPECT_EQ(cache->NumEntries(), 2u);
+        EXPECT_EQ(cache->TotalSize(), 150u);
+        EXPECT_NE(cache->ContentHash("http://test.com/a.bin"), 0u);
+        EXPECT_TRUE(cache->SetETag("http://test.com/a.bin", "\"a\""));
+        EXPECT_TRUE(cache->SetETag("http://test.com/b.bin", "\"b\""));
+        EXPECT_TRUE(cache->FindInCache("http://test.com/c.bin").Empty());
+
+        // The changed index is written periodically, not only when the cache is destroyed.
+        const String indexPath = CacheTestDirectory(framework) + "assetcache.idx";
+        fileSystem->Delete(indexPath);
+        cache->Update(1.0f);
+        EXPECT_FALSE(fileSystem->FileExists(indexPath));
+        cache->Update(60.0f);
+        EXPECT_TRUE(fileSystem->FileExists(indexPath));
+    }
+
+    // Change one of the files while the cache is not running.
+    {
+        Urho3D::File file(context.Get(), CacheTestDirectory(framework) + AssetAPI::SanitateAssetRef("http://test.com/b.bin"), Urho3D::FILE_WRITE);
+        ASSERT_TRUE(file.IsOpen());
+        file.Write("changed", 7);
+    }
+
+    {
+        SharedPtr<AssetCache> cache(new AssetCache(framework->Asset(), CacheTestDirectory(framework)));
+        EXPECT_EQ(cache->NumEntries(), 2u);
+        EXPECT_EQ(cache->TotalSize(), 107u);
+        // The unchanged entry is taken from the index as is.
+        EXPECT_TRUE(cache->ETag("http://test.com/a.bin") == "\"a\"");
+        EXPECT_NE(cache->ContentHash("http://test.com/a.bin"), 0u);
+        // The changed file no longer matches its hash and entity tag.
+        EXPECT_TRUE(cache->ETag("http://test.com/b.bin").Empty());
+        EXPECT_EQ(cache->ContentHash("http://test.com/b.bin"), 0u);
+        EXPECT_FALSE(cache->FindInCache("http://test.com/b.bin").Empty());
+    }
+
+    RemoveCacheTestDirectory(framework);
+}
+
+TEST_F(Runner, AssetCacheEviction)
+{
+    RemoveCacheTestDirectory(framework);
+    AssetAPI *assetAPI = framework->Asset();
+    assetAPI->RegisterAssetBundleTypeFactory(AssetBundleTypeFactoryPtr(new ExtractedBundleFactory()));
+    SharedPtr<AssetCache> cache(new AssetCache(assetAPI, CacheTestDirectory(framework)));
+
+    const String loadedRef = "http://test.com/loaded.bin";
+    const String bundleRef = "http://test.com/bundle.extracted";
+    const String subAssetRef = bundleRef + "#sub.bin";
+    ASSERT_FALSE(Store(cache, "http://test.com/unused.bin", 100).Empty());
+    ASSERT_FALSE(Store(cache, loadedRef, 100).Empty());
+    ASSERT_FALSE(Store(cache, subAssetRef, 100).Empty());
+    ASSERT_TRUE(assetAPI->CreateNewAsset("Binary", loadedRef).Get() != nullptr);
+    ASSERT_TRUE(assetAPI->CreateNewAssetBundle("Extracted", bundleRef).Get() != nullptr);
+    EXPECT_EQ(cache->TotalSize(), 300u);
+
+    // Only the file that no loaded asset or bundle uses can be evicted.
+    cache->SetMaxSize(150);
+    EXPECT_EQ(cache->NumEntries(), 2u);
+    EXPECT_EQ(cache->TotalSize(), 200u);
+    EXPECT_TRUE(cache->FindInCache("http://test.com/unused.bin").Empty());
+    EXPECT_FALSE(cache->FindInCache(loadedRef).Empty());
+    EXPECT_FALSE(cache->FindInCache(subAssetRef).Empty());
+
+    // Once the bundle is gone, its extracted files are evicted as well.
+    assetAPI->ForgetBundle(bundleRef, false);
+    ASSERT_TRUE(assetAPI->FindBundle(bundleRef).Get() == nullptr);
+    cache->SetMaxSize(150);
+    EXPECT_EQ(cache->NumEntries(), 1u);
+    EXPECT_TRUE(cache->FindInCache(subAssetRef).Empty());
+    EXPECT_FALSE(cache->FindInCache(loadedRef).Empty());
+
+    cache.Reset();
+    RemoveCacheTestDirectory(framework);
+}
+
+TUNDRA_TEST_MAIN();
@@ -0,0 +1,261 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "TestRunner.h"
+
+#include "AssetAPI.h"
+#include "IAsset.h"
+#include "IAssetDecodeJob.h"
+#include "IAssetProvider.h"
+#include "IAssetTransfer.h"
+#include "GenericAssetFactory.h"
+
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+
+using namespace Tundra;
+using namespace Tundra::Test;
+
+namespace
+{
+
+/// Asset whose data is a text. The text "fail" fails to decode.
+class TextAsset : public IAsset
+{
+    OBJECT(TextAsset);
+
+public:
+    TextAsset(AssetAPI *owner, const String &type_, const String &name_) : IAsset(owner, type_, name_) {}
+    ~TextAsset() { Unload(); }
+
+    bool DeserializeFromData(const u8 *data, uint numBytes, bool allowAsynchronous) override;
+    void DoUnload() override { text.Clear(); }
+    bool IsLoaded() const override { return !text.Empty(); }
+    Vector<AssetReference> FindReferences() const override { return Vector<AssetReference>(); }
+
+    String text;
+};
+
+class TextDecodeJob : public IAssetDecodeJob
+{
+public:
+    TextDecodeJob(TextAsset *asset, const u8 *data, uint numBytes) : IAssetDecodeJob(asset, data, numBytes) {}
+
+    bool Decode() override
+    {
+        decodedText = String((const char *)&data[0], data.Size());
+        if (decodedText == "fail")
+        {
+            error = "Invalid text";
+            return false;
+        }
+        return true;
+    }
+    bool Commit() override
+    {
+        static_cast<TextAsset *>(Asset())->text = decodedText;
+        return true;
+    }
+
+    String decodedText;
+};
+
+bool TextAsset::DeserializeFromData(const u8 *data, uint numBytes, bool allowAsynchronous)
+{
+    return assetAPI->DecodeAsset(AssetDecodeJobPtr(new TextDecodeJob(this, data, numBytes)), allowAsynchronous);
+}
+
+/// Provider for test:// refs whose transfers are completed by the test.
+class ManualAssetProvider : public IAssetProvider
+{
+    OBJECT(ManualAssetProvider);
+
+public:
+    explicit ManualAssetProvider(Urho3D::Context *context) : IAssetProvider(context) {}
+
+    String Name() const override { return "Manual"; }
+    bool IsValidRef(String assetRef, String /*assetType*/) const override { return assetRef.StartsWith("test://"); }
+    AssetTransferPtr CreateTransfer(String assetRef, String assetType) override
+    {
+        AssetTransferPtr transfer(new IAssetTransfer());
+        transfer->source.ref = assetRef;
+        transfer->assetType = assetType;
+        transfer->SetCachingBehavior(false, "");
+        return transfer;
+    }
+    void ExecuteTransfer(AssetTransferPtr /*transfer*/) override {}
+    void DeleteAssetFromStorage(String /*assetRef*/) override {}
+    Vector<AssetStoragePtr> Storages() const override { return Vector<AssetStoragePtr>(); }
+    AssetStoragePtr StorageByName(const String &/*name*/) const override { return AssetStoragePtr(); }
+    AssetStoragePtr StorageForAssetRef(const String &/*assetRef*/) const override { return AssetStoragePtr(); }
+
+private:
+    AssetStoragePtr TryCreateStorage(HashMap<String, String> &/*storageParams*/, bool /*fromNetwork*/) override { return AssetStoragePtr(); }
+};
+
+bool LoadText(const AssetPtr &asset, const String &text, bool allowAsynchronous)
+{
+    return asset->LoadFromFileInMemory((const u8 *)text.CString(), text.Length(), allowAsynchronous);
+}
+
+AssetAPI *RegisterTextAssets(Framework *framework)
+{
+    AssetAPI *assetAPI = framework->Asset();
+    assetAPI->RegisterAssetTypeFactory(AssetTypeFactoryPtr(new GenericAssetFactory<TextAsset>("Text", ".text")));
+    return assetAPI;
+}
+
+}
+
+TEST_F(Runner, AssetDecodeAsynchronous)
+{
+    AssetAPI *assetAPI = RegisterTextAssets(framework);
+    Urho3D::WorkQueue *workQueue = context->GetSubsystem<Urho3D::WorkQueue>();
+    ASSERT_TRUE(workQueue != nullptr);
+    ASSERT_TRUE(assetAPI->IsAsynchronousLoadEnabled());
+
+    AssetPtr asset = assetAPI->CreateNewAsset("Text", "async.text");
+    ASSERT_TRUE(LoadText(asset, "decoded", true));
+    // Committed in the main thread on a later frame.
+    EXPECT_FALSE(asset->IsLoaded());
+    EXPECT_EQ(assetAPI->NumPendingAssetDecodes(), 1u);
+
+    workQueue->Complete(0);
+    ProcessEvents();
+    EXPECT_EQ(assetAPI->NumPendingAssetDecodes(), 0u);
+    ASSERT_TRUE(asset->IsLoaded());
+    EXPECT_TRUE(static_cast<TextAsset *>(asset.Get())->text == "decoded");
+
+    // A failed decode unloads the asset.
+    ASSERT_TRUE(LoadText(asset, "fail", true));
+    workQueue->Complete(0);
+    ProcessEvents();
+    EXPECT_FALSE(asset->IsLoaded());
+}
+
+TEST_F(Runner, AssetDecodeCommitBudget)
+{
+    AssetAPI *assetAPI = RegisterTextAssets(framework);
+    Urho3D::WorkQueue *workQueue = context->GetSubsystem<Urho3D::WorkQueue>();
+    ASSERT_TRUE(workQueue != nullptr);
+
+    // With no time budget, one asset is committed per frame.
+    assetAPI->SetAssetCommitTimeBudget(0.0f);
+    Vector<AssetPtr> assets;
+    for(uint i = 0; i < 3; ++i)
+    {
+        assets.Push(assetAPI->CreateNewAsset("Text", "budget" + String(i) + ".text"));
+        ASSERT_TRUE(LoadText(assets.Back(), "decoded", true));
+    }
+    workQueue->Complete(0);
+
+    for(uint frame = 1; frame <= 3; ++frame)
+    {
+        ProcessEvents();
+        EXPECT_EQ(assetAPI->NumPendingAssetDecodes(), 3u - frame);
+        uint numLoaded = 0;
+        for(uint i = 0; i < assets.Size(); ++i)
+            if (assets[i]->IsLoaded())
+                ++numLoaded;
+        EXPECT_EQ(numLoaded, frame);
+    }
+}
+
+TEST_F(Runner, AssetDecodeCancel)
+{
+    AssetAPI *assetAPI = RegisterTextAssets(framework);
+    Urho3D::WorkQueue *workQueue = context->GetSubsystem<Urho3D::WorkQueue>();
+    ASSERT_TRUE(workQueue != nullptr);
+
+    SharedPtr<ManualAssetProvider> provider(new ManualAssetProvider(context.Get()));
+    assetAPI->RegisterAssetProvider(provider);
+    AssetTransferPtr transfer = assetAPI->RequestAsset("test://cancel.text", "Text");
+    ASSERT_TRUE(transfer.Get() != nullptr);
+    ProcessEvents();
+
+    const String text("decoded");
+    transfer->rawAssetData.Resize(text.Length());
+    memcpy(&transfer->rawAssetData[0], text.CString(), text.Length());
+    assetAPI->AssetTransferCompleted(transfer.Get());
+    ASSERT_TRUE(transfer->asset.Get() != nullptr);
+    EXPECT_EQ(assetAPI->NumCurrentTransfers(), 1u);
+
+    // Unloading before the commit discards the decoded data and fails the transfer.
+    transfer->asset->Unload();
+    workQueue->Complete(0);
+    ProcessEvents();
+    EXPECT_EQ(assetAPI->NumPendingAssetDecodes(), 0u);
+    EXPECT_FALSE(transfer->asset->IsLoaded());
+    EXPECT_EQ(assetAPI->NumCurrentTransfers(), 0u);
+
+    // A newer load supersedes the one in progress without failing anything.
+    AssetPtr asset = assetAPI->CreateNewAsset("Text", "reload.text");
+    ASSERT_TRUE(LoadText(asset, "first", true));
+    ASSERT_TRUE(LoadText(asset, "second", true));
+    workQueue->Complete(0);
+    ProcessEvents();
+    ProcessEvents();
+    EXPECT_EQ(assetAPI->NumPendingAssetDecodes(), 0u);
+    EXPECT_TRUE(static_cast<TextAsset *>(asset.Get())->text == "second");
+}
+
+TEST_F(Runner, AssetDecodeFromFile)
+{
+    AssetAPI *assetAPI = RegisterTextAssets(framework);
+    Urho3D::WorkQueue *workQueue = context->GetSubsystem<Urho3D::WorkQueue>();
+    ASSERT_TRUE(workQueue != nullptr);
+    Urho3D::FileSystem *fileSystem = framework->GetSubsystem<Urho3D::FileSystem>();
+    const String path = fileSystem->GetProgramDir() + "TundraTestAssetDecode.text";
+    {
+        Urho3D::File file(context.Get(), path, Urho3D::FILE_WRITE);
+        ASSERT_TRUE(file.IsOpen());
+        file.Write("from disk", 9);
+    }
+
+    // A transfer whose data the provider wrote only to the disk source, like a large HTTP download.
+    SharedPtr<ManualAssetProvider> provider(new ManualAssetProvider(context.Get()));
+    assetAPI->RegisterAssetProvider(provider);
+    AssetTransferPtr transfer = assetAPI->RequestAsset("test://disk.text", "Text");
+    ASSERT_TRUE(transfer.Get() != nullptr);
+    ProcessEvents();
+    transfer->SetCachingBehavior(false, path);
+    assetAPI->AssetTransferCompleted(transfer.Get());
+    ASSERT_TRUE(transfer->asset.Get() != nullptr);
+    EXPECT_FALSE(transfer->asset->IsLoaded());
+    EXPECT_EQ(assetAPI->NumPendingAssetDecodes(), 1u);
+
+    // The file is read in a worker thread, after which the data is decoded in a worker thread too.
+    for(uint i = 0; i < 2; ++i)
+    {
+        workQueue->Complete(0);
+        ProcessEvents();
+    }
+    EXPECT_EQ(assetAPI->NumPendingAssetDecodes(), 0u);
+    ASSERT_TRUE(transfer->asset->IsLoaded());
+    EXPECT_TRUE(static_cast<TextAsset *>(transfer->asset.Get())->text == "from disk");
+    EXPECT_EQ(assetAPI->NumCurrentTransfers(), 0u);
+
+    // A missing file fails the load once it has been attempted.
+    AssetPtr missing = assetAPI->CreateNewAsset("Text", "missing.text");
+    EXPECT_TRUE(missing->LoadFromFile(path + ".missing", true));
+    workQueue->Complete(0);
+    ProcessEvents();
+    EXPECT_FALSE(missing->IsLoaded());
+
+    fileSystem->Delete(path);
+}
+
+TEST_F(Runner, AssetDecodeSynchronous)
+{
+    AssetAPI *assetAPI = RegisterTextAssets(framework);
+    AssetPtr asset = assetAPI->CreateNewAsset("Text", "sync.text");
+    ASSERT_TRUE(LoadText(asset, "decoded", false));
+    EXPECT_EQ(assetAPI->NumPendingAssetDecodes(), 0u);
+    ASSERT_TRUE(asset->IsLoaded());
+    EXPECT_TRUE(static_cast<TextAsset *>(asset.Get())->text == "decoded");
+
+    EXPECT_FALSE(LoadText(asset, "fail", false));
+    EXPECT_FALSE(asset->IsLoaded());
+}
+
+TUNDRA_TEST_MAIN();
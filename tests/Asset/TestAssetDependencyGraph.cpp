@@ -0,0 +1,228 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "TestRunner.h"
+
+#include "AssetDependencyGraph.h"
+#include "AssetAPI.h"
+#include "IAsset.h"
+#include "GenericAssetFactory.h"
+
+using namespace Tundra;
+using namespace Tundra::Test;
+
+namespace
+{
+
+typedef Vector<AssetDependencyGraph::Dependency> Dependencies;
+
+/// Returns dependencies on @c refs that are not ignored.
+Dependencies Deps(const String &first, const String &second = String())
+{
+    Dependencies dependencies;
+    dependencies.Push(MakePair(first, false));
+    if (!second.Empty())
+        dependencies.Push(MakePair(second, false));
+    return dependencies;
+}
+
+/// Asset whose data is a list of refs, one per line. Signals the load completion directly with IAsset::LoadCompleted.
+class RefListAsset : public IAsset
+{
+    OBJECT(RefListAsset);
+
+public:
+    RefListAsset(AssetAPI *owner, const String &type_, const String &name_) : IAsset(owner, type_, name_), loaded(false) {}
+    ~RefListAsset() { Unload(); }
+
+    bool DeserializeFromData(const u8 *data, uint numBytes, bool /*allowAsynchronous*/) override
+    {
+        refs = String((const char *)data, numBytes).Split('\n');
+        loaded = true;
+        LoadCompleted();
+        return true;
+    }
+    void DoUnload() override { refs.Clear(); loaded = false; }
+    bool IsLoaded() const override { return loaded; }
+    Vector<AssetReference> FindReferences() const override
+    {
+        Vector<AssetReference> references;
+        for(uint i = 0; i < refs.Size(); ++i)
+            references.Push(AssetReference(refs[i]));
+        return references;
+    }
+
+    StringVector refs;
+    bool loaded;
+};
+
+bool LoadRefList(const AssetPtr &asset, const String &refs)
+{
+    return asset->LoadFromFileInMemory((const u8 *)refs.CString(), refs.Length(), false);
+}
+
+}
+
+TEST_F(Runner, AssetDependencyChains)
+{
+    AssetDependencyGraph graph;
+    graph.SetDependencies("scene.txml", Deps("material.material"));
+    graph.SetDependencies("material.material", Deps("texture.png"));
+    graph.SetLoaded("scene.txml", true);
+
+    // Pending dependencies are counted through the chain.
+    EXPECT_TRUE(graph.HasPendingDependencies("scene.txml"));
+    EXPECT_EQ(graph.NumPendingDependencies("scene.txml"), 2u);
+    EXPECT_FALSE(graph.IsReady("scene.txml"));
+
+    graph.SetLoaded("texture.png", true);
+    EXPECT_EQ(graph.NumPendingDependencies("scene.txml"), 1u);
+    EXPECT_FALSE(graph.HasPendingDependencies("material.material"));
+    EXPECT_FALSE(graph.IsReady("material.material"));
+    EXPECT_FALSE(graph.IsReady("scene.txml"));
+
+    graph.SetLoaded("material.material", true);
+    EXPECT_EQ(graph.NumPendingDependencies("scene.txml"), 0u);
+    EXPECT_FALSE(graph.HasPendingDependencies("scene.txml"));
+    EXPECT_TRUE(graph.IsReady("scene.txml"));
+
+    // Unloading a dependency makes the chain pending again, and reloading it makes it ready.
+    graph.SetLoaded("texture.png", false);
+    EXPECT_FALSE(graph.IsReady("material.material"));
+    EXPECT_TRUE(graph.HasPendingDependencies("scene.txml"));
+    EXPECT_EQ(graph.NumPendingDependencies("scene.txml"), 1u);
+    graph.SetLoaded("texture.png", true);
+    EXPECT_TRUE(graph.IsReady("scene.txml"));
+
+    // Refs are case-insensitive.
+    EXPECT_EQ(graph.Dependents("TEXTURE.PNG").Size(), 1u);
+    EXPECT_TRUE(graph.Dependents("texture.png")[0] == "material.material");
+}
+
+TEST_F(Runner, AssetDependencyReplacement)
+{
+    AssetDependencyGraph graph;
+    graph.SetDependencies("scene.txml", Deps("material.material"));
+    graph.SetDependencies("material.material", Deps("texture.png"));
+    graph.SetLoaded("scene.txml", true);
+    graph.SetLoaded("material.material", true);
+    graph.SetLoaded("texture.png", true);
+    EXPECT_TRUE(graph.IsReady("scene.txml"));
+
+    // Replacing the dependencies drops the old ones and waits for the new ones.
+    graph.SetDependencies("material.material", Deps("other.png"));
+    EXPECT_FALSE(graph.IsReady("scene.txml"));
+    EXPECT_EQ(graph.Dependents("texture.png").Size(), 0u);
+    StringVector dependencies = graph.Dependencies("material.material");
+    ASSERT_EQ(dependencies.Size(), 1u);
+    EXPECT_TRUE(dependencies[0] == "other.png");
+    graph.SetLoaded("other.png", true);
+    EXPECT_TRUE(graph.IsReady("scene.txml"));
+
+    // Ignored dependencies, e.g. of a disabled asset type, are never pending.
+    Dependencies withIgnored = Deps("other.png");
+    withIgnored.Push(MakePair(String("disabled.ogg"), true));
+    graph.SetDependencies("material.material", withIgnored);
+    EXPECT_TRUE(graph.IsReady("scene.txml"));
+    EXPECT_EQ(graph.NumPendingDependencies("scene.txml"), 0u);
+    EXPECT_EQ(graph.Dependencies("material.material").Size(), 2u);
+}
+
+TEST_F(Runner, AssetDependencyPruning)
+{
+    AssetDependencyGraph graph;
+    graph.SetDependencies("scene.txml", Deps("material.material"));
+    Dependencies withIgnored = Deps("texture.png");
+    withIgnored.Push(MakePair(String("disabled.ogg"), true));
+    graph.SetDependencies("material.material", withIgnored);
+    graph.SetLoaded("scene.txml", true);
+    graph.SetLoaded("material.material", true);
+    graph.SetLoaded("texture.png", true);
+    EXPECT_EQ(graph.NumNodes(), 4u);
+    EXPECT_EQ(graph.Edges().Size(), 3u);
+
+    // Nodes that are not loaded and have no edges are removed.
+    graph.RemoveDependencies("material.material");
+    EXPECT_EQ(graph.NumNodes(), 3u);
+    graph.SetLoaded("texture.png", false);
+    EXPECT_EQ(graph.NumNodes(), 2u);
+    // A node with a dependent stays while unloaded.
+    graph.SetLoaded("material.material", false);
+    EXPECT_EQ(graph.NumNodes(), 2u);
+    EXPECT_FALSE(graph.IsReady("scene.txml"));
+    graph.RemoveDependencies("scene.txml");
+    EXPECT_EQ(graph.NumNodes(), 1u);
+    graph.SetLoaded("scene.txml", false);
+    EXPECT_EQ(graph.NumNodes(), 0u);
+    EXPECT_EQ(graph.Edges().Size(), 0u);
+}
+
+TEST_F(Runner, AssetDependencyCycle)
+{
+    AssetDependencyGraph graph;
+    graph.SetDependencies("a.material", Deps("b.material"));
+    graph.SetDependencies("b.material", Deps("a.material"));
+    graph.SetDependencies("scene.txml", Deps("a.material"));
+    graph.SetLoaded("scene.txml", true);
+    graph.SetLoaded("a.material", true);
+    EXPECT_FALSE(graph.IsReady("a.material"));
+    EXPECT_EQ(graph.NumPendingDependencies("a.material"), 1u);
+
+    // The cycle does not keep its assets pending once they are all loaded.
+    graph.SetLoaded("b.material", true);
+    EXPECT_TRUE(graph.IsReady("a.material"));
+    EXPECT_TRUE(graph.IsReady("b.material"));
+    EXPECT_TRUE(graph.IsReady("scene.txml"));
+
+    graph.SetLoaded("b.material", false);
+    EXPECT_FALSE(graph.IsReady("a.material"));
+    EXPECT_FALSE(graph.IsReady("scene.txml"));
+    graph.SetLoaded("b.material", true);
+    EXPECT_TRUE(graph.IsReady("scene.txml"));
+}
+
+TEST_F(Runner, AssetDependencyHashCollision)
+{
+    // These refs have the same StringHash, but must not share a node.
+    AssetDependencyGraph graph;
+    graph.SetDependencies("scene.txml", Deps("local://yictiexy.png"));
+    graph.SetLoaded("local://znlhayrh.png", true);
+    EXPECT_EQ(graph.NumNodes(), 3u);
+    EXPECT_TRUE(graph.HasPendingDependencies("scene.txml"));
+    EXPECT_TRUE(graph.Dependents("local://znlhayrh.png").Empty());
+
+    graph.SetLoaded("local://yictiexy.png", true);
+    EXPECT_FALSE(graph.HasPendingDependencies("scene.txml"));
+    ASSERT_EQ(graph.Dependencies("scene.txml").Size(), 1u);
+    EXPECT_TRUE(graph.Dependencies("scene.txml")[0] == "local://yictiexy.png");
+}
+
+TEST_F(Runner, AssetDependencyGraphFollowsLoads)
+{
+    AssetAPI *assetAPI = framework->Asset();
+    assetAPI->RegisterAssetTypeFactory(AssetTypeFactoryPtr(new GenericAssetFactory<RefListAsset>("RefList", ".reflist")));
+
+    // Loaded directly, without AssetAPI::AssetLoadCompleted.
+    AssetPtr dependent = assetAPI->CreateNewAsset("RefList", "dependent.reflist");
+    AssetPtr dependency = assetAPI->CreateNewAsset("RefList", "dependency.reflist");
+    ASSERT_TRUE(dependent.Get() && dependency.Get());
+    ASSERT_TRUE(LoadRefList(dependent, "dependency.reflist"));
+    EXPECT_TRUE(assetAPI->HasPendingDependencies(dependent));
+
+    ASSERT_TRUE(LoadRefList(dependency, "\n"));
+    EXPECT_FALSE(assetAPI->HasPendingDependencies(dependent));
+
+    // A reload replaces the dependencies.
+    ASSERT_TRUE(LoadRefList(dependent, "other.reflist"));
+    AssetAPI::AssetDependenciesMap edges = assetAPI->DebugGetAssetDependencies();
+    ASSERT_EQ(edges.Size(), 1u);
+    EXPECT_TRUE(edges[0].second_ == "other.reflist");
+    EXPECT_TRUE(assetAPI->HasPendingDependencies(dependent));
+
+    // Unloading marks the asset pending again for its dependents.
+    ASSERT_TRUE(LoadRefList(dependent, "dependency.reflist"));
+    EXPECT_FALSE(assetAPI->HasPendingDependencies(dependent));
+    dependency->Unload();
+    EXPECT_TRUE(assetAPI->HasPendingDependencies(dependent));
+}
+
+TUNDRA_TEST_MAIN();
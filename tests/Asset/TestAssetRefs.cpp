@@ -0,0 +1,82 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "TestRunner.h"
+#include "TestBenchmark.h"
+
+#include "AssetAPI.h"
+#include "ParsedAssetRef.h"
+
+using namespace Tundra;
+using namespace Tundra::Test;
+
+TEST_F(Runner, AssetRefInterning)
+{
+    AssetAPI *asset = framework->Asset();
+
+    ParsedAssetRefPtr parsed = asset->InternAssetRef("http://Server.com/path/Bundle.zip#sub folder/Mesh.mesh");
+    String protocol, namedStorage, path, filename, subAssetName, fullRef, fullRefNoSubAssetName;
+    AssetAPI::AssetRefType type = AssetAPI::ParseAssetRef(parsed->ref, &protocol, &namedStorage, 0, 0, 0, &path, &filename,
+        &subAssetName, &fullRef, &fullRefNoSubAssetName);
+    ASSERT_EQ(parsed->type, type);
+    ASSERT_EQ(parsed->protocol, protocol);
+    ASSERT_EQ(parsed->namedStorage, namedStorage);
+    ASSERT_EQ(parsed->path, path);
+    ASSERT_EQ(parsed->filename, filename);
+    ASSERT_EQ(parsed->subAssetName, subAssetName);
+    ASSERT_EQ(parsed->fullRef, fullRef);
+    ASSERT_EQ(parsed->fullRefNoSubAssetName, fullRefNoSubAssetName);
+    ASSERT_EQ(parsed->hash, StringHash(fullRef));
+
+    // The same ref is parsed once. Refs differing in case are kept apart, as their parts may be case-sensitive, but hash the same.
+    ASSERT_EQ(asset->InternAssetRef(parsed->ref).Get(), parsed.Get());
+    ParsedAssetRefPtr lowerCase = asset->InternAssetRef(parsed->ref.ToLower());
+    ASSERT_NE(lowerCase.Get(), parsed.Get());
+    ASSERT_EQ(lowerCase->hash, parsed->hash);
+
+    ASSERT_EQ(asset->ResolveAssetRef("local://folder/scene.txml", "texture.png"), String("local://folder/texture.png"));
+    ASSERT_EQ(asset->ResolveAssetRef("http://server.com/bundle.zip#meshes/a.mesh", "b.mesh"), String("http://server.com/bundle.zip#meshes/b.mesh"));
+
+    // The asset maps are case-insensitive.
+    AssetMap assets;
+    assets["local://Texture.png"] = AssetPtr();
+    ASSERT_TRUE(assets.find("LOCAL://texture.PNG") != assets.end());
+    ASSERT_TRUE(assets.find("local://texture2.png") == assets.end());
+
+    // Scene load ref churn: the mesh and material refs of each entity are resolved, typed and requested, each parsing the ref.
+    StringVector refs;
+    for(uint i = 0; i < 1000; ++i)
+    {
+        refs.Push("local://meshes/mesh" + String(i % 100) + ".mesh");
+        refs.Push("http://server.com/materials/material" + String(i % 50) + ".material");
+    }
+
+    Tundra::Benchmark::Iterations = 100;
+
+    BENCHMARK("ParseAssetRef", 25)
+    {
+        for(uint r = 0; r < refs.Size(); ++r)
+            for(uint n = 0; n < 3; ++n)
+                AssetAPI::ParseAssetRef(refs[r], &protocol, &namedStorage, 0, 0, 0, &path, &filename, &subAssetName, &fullRef, &fullRefNoSubAssetName);
+        BENCHMARK_STEP_END;
+    }
+    BENCHMARK_END;
+
+    BENCHMARK("InternAssetRef", 25)
+    {
+        for(uint r = 0; r < refs.Size(); ++r)
+            for(uint n = 0; n < 3; ++n)
+                asset->InternAssetRef(refs[r]);
+        BENCHMARK_STEP_END;
+    }
+    BENCHMARK_END;
+
+    BENCHMARK("ResolveAssetRef", 25)
+    {
+        for(uint r = 0; r < refs.Size(); ++r)
+            asset->ResolveAssetRef("", refs[r]);
+        BENCHMARK_STEP_END;
+    }
+    BENCHMARK_END;
+}
+
+TUNDRA_TEST_MAIN();
@@ -0,0 +1,95 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "TestRunner.h"
+
+#include "AssetAPI.h"
+#include "IAssetProvider.h"
+#include "IAssetTransfer.h"
+#include "IAssetTransferPrioritizer.h"
+
+using namespace Tundra;
+using namespace Tundra::Test;
+
+namespace
+{
+
+/// Provider for test:// refs that records the executed transfers and never completes them.
+class RecordingAssetProvider : public IAssetProvider
+{
+    OBJECT(RecordingAssetProvider);
+
+public:
+    explicit RecordingAssetProvider(Urho3D::Context *context) : IAssetProvider(context) {}
+
+    String Name() const override { return "Recording"; }
+    bool IsValidRef(String assetRef, String /*assetType*/) const override { return assetRef.StartsWith("test://"); }
+    AssetTransferPtr CreateTransfer(String assetRef, String assetType) override
+    {
+        AssetTransferPtr transfer(new IAssetTransfer());
+        transfer->source.ref = assetRef;
+        transfer->assetType = assetType;
+        return transfer;
+    }
+    void ExecuteTransfer(AssetTransferPtr transfer) override { executed.Push(transfer->source.ref); }
+    void DeleteAssetFromStorage(String /*assetRef*/) override {}
+    Vector<AssetStoragePtr> Storages() const override { return Vector<AssetStoragePtr>(); }
+    AssetStoragePtr StorageByName(const String &/*name*/) const override { return AssetStoragePtr(); }
+    AssetStoragePtr StorageForAssetRef(const String &/*assetRef*/) const override { return AssetStoragePtr(); }
+
+    StringVector executed;
+
+private:
+    AssetStoragePtr TryCreateStorage(HashMap<String, String> &/*storageParams*/, bool /*fromNetwork*/) override { return AssetStoragePtr(); }
+};
+
+/// Keeps the request order and starts at most @c limit transfers per frame.
+class LimitingPrioritizer : public IAssetTransferPrioritizer
+{
+public:
+    explicit LimitingPrioritizer(uint limit_) : limit(limit_) {}
+
+    AssetTransferPtrVector Prioritize(const AssetTransferPtrVector &transfers) override { return transfers; }
+    uint MaxTransfersPerFrame() const override { return limit; }
+
+    uint limit;
+};
+
+}
+
+TEST_F(Runner, AssetTransfersPerFrame)
+{
+    AssetAPI *asset = framework->Asset();
+    SharedPtr<RecordingAssetProvider> provider(new RecordingAssetProvider(context.Get()));
+    asset->RegisterAssetProvider(provider);
+    asset->SetAssetTransferPrioritizer(AssetTransferPrioritizerPtr(new LimitingPrioritizer(2)));
+
+    Vector<AssetTransferPtr> transfers;
+    for(uint i = 0; i < 6; ++i)
+    {
+        transfers.Push(asset->RequestAsset("test://server/" + String(i) + ".dat", "TestData"));
+        ASSERT_TRUE(transfers.Back().Get() != nullptr);
+    }
+
+    // The transfers forgotten while pending are skipped and do not count against the limit.
+    asset->AssetTransferAborted(transfers[0].Get());
+    asset->AssetTransferAborted(transfers[2].Get());
+
+    ProcessEvents();
+    ASSERT_EQ(provider->executed.Size(), 2u);
+    EXPECT_TRUE(provider->executed[0] == "test://server/1.dat");
+    EXPECT_TRUE(provider->executed[1] == "test://server/3.dat");
+
+    ProcessEvents();
+    ASSERT_EQ(provider->executed.Size(), 4u);
+    EXPECT_TRUE(provider->executed[2] == "test://server/4.dat");
+    EXPECT_TRUE(provider->executed[3] == "test://server/5.dat");
+
+    // Without a limit all pending transfers start on the next frame.
+    asset->SetAssetTransferPrioritizer(AssetTransferPrioritizerPtr(new LimitingPrioritizer(0)));
+    for(uint i = 6; i < 10; ++i)
+        asset->RequestAsset("test://server/" + String(i) + ".dat", "TestData");
+    ProcessEvents();
+    EXPECT_EQ(provider->executed.Size(), 8u);
+}
+
+TUNDRA_TEST_MAIN();
@@ -0,0 +1,106 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "TestRunner.h"
+
+#include "LocalAssetStorage.h"
+
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+
+using namespace Tundra;
+using namespace Tundra::Test;
+
+namespace
+{
+
+String StorageTestDirectory(Framework *framework)
+{
+    return framework->GetSubsystem<Urho3D::FileSystem>()->GetProgramDir() + "TundraTestLocalAssetStorage/";
+}
+
+bool WriteTestFile(Urho3D::Context *context, const String &path)
+{
+    Urho3D::File file(context, path, Urho3D::FILE_WRITE);
+    return file.IsOpen() && file.Write("data", 4) == 4;
+}
+
+/// Returns true if the index file @c indexFile exists and mentions @c text.
+bool IndexContains(Urho3D::Context *context, const String &indexFile, const String &text)
+{
+    Urho3D::File file(context, indexFile, Urho3D::FILE_READ);
+    if (!file.IsOpen() || file.GetSize() == 0)
+        return false;
+    String contents;
+    contents.Resize(file.GetSize());
+    file.Read(&contents[0], file.GetSize());
+    return contents.Contains(text);
+}
+
+SharedPtr<LocalAssetStorage> CreateStorage(Framework *framework)
+{
+    SharedPtr<LocalAssetStorage> storage(new LocalAssetStorage(framework->GetContext(), true, false, true));
+    storage->directory = StorageTestDirectory(framework) + "storage/";
+    storage->name = "Test";
+    storage->recursive = true;
+    storage->SetIndexFile(StorageTestDirectory(framework) + "index/storage.idx");
+    return storage;
+}
+
+}
+
+TEST_F(Runner, LocalAssetStorageIndex)
+{
+    Urho3D::FileSystem *fileSystem = framework->GetSubsystem<Urho3D::FileSystem>();
+    fileSystem->RemoveDir(StorageTestDirectory(framework), true);
+    const String storageDirectory = StorageTestDirectory(framework) + "storage/";
+    const String indexFile = StorageTestDirectory(framework) + "index/storage.idx";
+    fileSystem->CreateDir(StorageTestDirectory(framework));
+    fileSystem->CreateDir(storageDirectory);
+    ASSERT_TRUE(fileSystem->CreateDir(storageDirectory + "sub"));
+    ASSERT_TRUE(WriteTestFile(context.Get(), storageDirectory + "sub/a.txt"));
+
+    {
+        SharedPtr<LocalAssetStorage> storage = CreateStorage(framework);
+        EXPECT_TRUE(storage->GetFullPathForAsset("a.txt", true) == storageDirectory + "sub/");
+        EXPECT_TRUE(IndexContains(context.Get(), indexFile, "a.txt"));
+
+        // A rescan that finds nothing new does not rewrite the index.
+        ASSERT_TRUE(fileSystem->Delete(indexFile));
+        storage->CacheStorageContents();
+        EXPECT_FALSE(fileSystem->FileExists(indexFile));
+
+        // A rescan that finds a new file does.
+        ASSERT_TRUE(WriteTestFile(context.Get(), storageDirectory + "sub/b.txt"));
+        storage->CacheStorageContents();
+        EXPECT_TRUE(IndexContains(context.Get(), indexFile, "b.txt"));
+
+        // A file change notification is persisted as well, at the latest when the storage is destroyed.
+        ASSERT_TRUE(WriteTestFile(context.Get(), storageDirectory + "sub/c.txt"));
+        storage->UpdateFileIndex(storageDirectory + "sub/c.txt");
+        EXPECT_TRUE(storage->GetFullPathForAsset("c.txt", true) == storageDirectory + "sub/");
+    }
+    EXPECT_TRUE(IndexContains(context.Get(), indexFile, "c.txt"));
+
+    // The saved index is still valid for the next run, as it has the updated modification time of the directory.
+    // Trailing bytes that the loader ignores tell whether the index was used as is, or the storage was scanned and the index written again.
+    uint indexSize = 0;
+    {
+        Urho3D::File file(context.Get(), indexFile, Urho3D::FILE_READWRITE);
+        ASSERT_TRUE(file.IsOpen());
+        file.Seek(file.GetSize());
+        file.Write("marker", 6);
+        indexSize = file.GetSize();
+    }
+    {
+        SharedPtr<LocalAssetStorage> storage = CreateStorage(framework);
+        EXPECT_TRUE(storage->GetFullPathForAsset("c.txt", true) == storageDirectory + "sub/");
+    }
+    {
+        Urho3D::File file(context.Get(), indexFile, Urho3D::FILE_READ);
+        EXPECT_EQ(file.GetSize(), indexSize);
+    }
+
+    fileSystem->RemoveDir(StorageTestDirectory(framework), true);
+}
+
+TUNDRA_TEST_MAIN();
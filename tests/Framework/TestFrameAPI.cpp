@@ -0,0 +1,253 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "TestRunner.h"
+
+#include "FrameAPI.h"
+#include "FrameSystem.h"
+
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/Core/Thread.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Core/WorkQueue.h>
+
+using namespace Tundra;
+using namespace Tundra::Test;
+
+namespace
+{
+
+/// Main thread system that records the order in which the systems are updated.
+class RecordingSystem : public FrameSystem
+{
+public:
+    RecordingSystem(const String &name, StringVector *log) :
+        FrameSystem(name),
+        log_(log)
+    {
+    }
+
+    void Update(float /*frametime*/) override
+    {
+        log_->Push(Name());
+    }
+
+private:
+    StringVector *log_;
+};
+
+/// System that counts its updates, and how many of them were run on the main thread.
+class CountingSystem : public FrameSystem
+{
+public:
+    CountingSystem(const String &name, bool threadSafe) :
+        FrameSystem(name, threadSafe),
+        updates_(0),
+        mainThreadUpdates_(0)
+    {
+    }
+
+    void Update(float /*frametime*/) override
+    {
+        Urho3D::MutexLock lock(mutex_);
+        ++updates_;
+        if (Urho3D::Thread::IsMainThread())
+            ++mainThreadUpdates_;
+    }
+
+    int Updates()
+    {
+        Urho3D::MutexLock lock(mutex_);
+        return updates_;
+    }
+
+    int MainThreadUpdates()
+    {
+        Urho3D::MutexLock lock(mutex_);
+        return mainThreadUpdates_;
+    }
+
+private:
+    Urho3D::Mutex mutex_;
+    int updates_;
+    int mainThreadUpdates_;
+};
+
+/// Main thread system that checks that @c other has been updated on the same frame before or while this one is.
+class DependentSystem : public CountingSystem
+{
+public:
+    /// @param wait Whether to wait for @c other, which only finishes if @c other runs on another thread meanwhile.
+    DependentSystem(const String &name, CountingSystem *other, bool wait) :
+        CountingSystem(name, false),
+        other_(other),
+        wait_(wait),
+        missed(0)
+    {
+    }
+
+    void Update(float frametime) override
+    {
+        CountingSystem::Update(frametime);
+        Urho3D::Timer timer;
+        while(wait_ && other_->Updates() < Updates() && timer.GetMSec(false) < 1000)
+            Urho3D::Time::Sleep(1);
+        if (other_->Updates() < Updates())
+            ++missed;
+    }
+
+private:
+    CountingSystem *other_;
+    bool wait_;
+
+public:
+    int missed;
+};
+
+/// Instance type for ComponentSystem.
+struct Counter : public RefCounted
+{
+    Counter() : updates(0) {}
+    void Update(float /*frametime*/) { ++updates; }
+    int updates;
+};
+
+}
+
+TEST_F(Runner, FrameSystemConflicts)
+{
+    RecordingSystem writer("Writer", 0), reader("Reader", 0), other("Other", 0), readerToo("ReaderToo", 0);
+    writer.Writes("Placeable");
+    reader.Reads("Placeable");
+    readerToo.Reads("Placeable");
+    other.Writes("Mesh");
+
+    // Writing conflicts with reading and writing the same resource, in both directions.
+    EXPECT_TRUE(writer.ConflictsWith(reader));
+    EXPECT_TRUE(reader.ConflictsWith(writer));
+    EXPECT_TRUE(writer.ConflictsWith(writer));
+    // Readers do not conflict with each other, nor do systems with disjoint resources.
+    EXPECT_FALSE(reader.ConflictsWith(readerToo));
+    EXPECT_FALSE(writer.ConflictsWith(other));
+    EXPECT_FALSE(other.ConflictsWith(reader));
+}
+
+TEST_F(Runner, FrameSystemPhases)
+{
+    FrameAPI *frame = framework->Frame();
+    StringVector log;
+
+    SharedPtr<RecordingSystem> writer(new RecordingSystem("Writer", &log));
+    writer->Writes("Placeable");
+    SharedPtr<RecordingSystem> reader(new RecordingSystem("Reader", &log));
+    reader->Reads("Placeable");
+    SharedPtr<RecordingSystem> other(new RecordingSystem("Other", &log));
+    other->Writes("Mesh");
+    SharedPtr<RecordingSystem> lateWriter(new RecordingSystem("LateWriter", &log));
+    lateWriter->Writes("Placeable");
+
+    frame->RegisterSystem(writer);
+    frame->RegisterSystem(reader);
+    frame->RegisterSystem(other);
+    frame->RegisterSystem(lateWriter);
+    // A second system with the same name is rejected.
+    frame->RegisterSystem(SharedPtr<FrameSystem>(new RecordingSystem("Writer", &log)));
+    EXPECT_EQ(frame->System("Writer"), writer.Get());
+
+    // Phase 0: Writer and Other, phase 1: Reader, which conflicts with Writer, phase 2: LateWriter, which conflicts with Reader.
+    ProcessEvents();
+    ASSERT_EQ(log.Size(), 4u);
+    EXPECT_TRUE(log[0] == "Writer");
+    EXPECT_TRUE(log[1] == "Other");
+    EXPECT_TRUE(log[2] == "Reader");
+    EXPECT_TRUE(log[3] == "LateWriter");
+
+    // Declaring a new dependency reschedules: Other now reads what Writer writes, so it moves to the phase of Reader.
+    log.Clear();
+    other->Reads("Placeable");
+    ProcessEvents();
+    ASSERT_EQ(log.Size(), 4u);
+    EXPECT_TRUE(log[0] == "Writer");
+    EXPECT_TRUE(log[1] == "Reader");
+    EXPECT_TRUE(log[2] == "Other");
+    EXPECT_TRUE(log[3] == "LateWriter");
+
+    // Unregistered systems are no longer updated.
+    log.Clear();
+    frame->UnregisterSystem(reader);
+    EXPECT_TRUE(frame->System("Reader") == 0);
+    ProcessEvents();
+    ASSERT_EQ(log.Size(), 3u);
+    EXPECT_TRUE(log[0] == "Writer");
+    EXPECT_TRUE(log[1] == "Other");
+    EXPECT_TRUE(log[2] == "LateWriter");
+
+    frame->UnregisterSystem(writer);
+    frame->UnregisterSystem(other);
+    frame->UnregisterSystem(lateWriter);
+}
+
+TEST_F(Runner, FrameSystemWorkerThreads)
+{
+    Urho3D::WorkQueue *workQueue = context->GetSubsystem<Urho3D::WorkQueue>();
+    ASSERT_TRUE(workQueue != nullptr);
+    if (workQueue->GetNumThreads() == 0)
+        workQueue->CreateThreads(1);
+    FrameAPI *frame = framework->Frame();
+
+    // Phase 0: Worker on a worker thread while Waiting runs on the main thread, phase 1: Reader, which conflicts with Worker.
+    SharedPtr<CountingSystem> worker(new CountingSystem("Worker", true));
+    worker->Writes("Placeable");
+    SharedPtr<DependentSystem> waiting(new DependentSystem("Waiting", worker.Get(), true));
+    waiting->Writes("Mesh");
+    SharedPtr<DependentSystem> reader(new DependentSystem("Reader", worker.Get(), false));
+    reader->Reads("Placeable");
+    frame->RegisterSystem(worker);
+    frame->RegisterSystem(waiting);
+    frame->RegisterSystem(reader);
+
+    const int numFrames = 10;
+    for(int i = 0; i < numFrames; ++i)
+        ProcessEvents();
+
+    // Waiting saw Worker finish while it was itself running, so Worker was run by a worker thread every frame.
+    EXPECT_EQ(worker->Updates(), numFrames);
+    EXPECT_EQ(worker->MainThreadUpdates(), 0);
+    EXPECT_EQ(waiting->Updates(), numFrames);
+    EXPECT_EQ(waiting->MainThreadUpdates(), numFrames);
+    EXPECT_EQ(waiting->missed, 0);
+    // The next phase starts only after the worker threads have completed the previous one.
+    EXPECT_EQ(reader->Updates(), numFrames);
+    EXPECT_EQ(reader->MainThreadUpdates(), numFrames);
+    EXPECT_EQ(reader->missed, 0);
+
+    frame->UnregisterSystem(worker);
+    frame->UnregisterSystem(waiting);
+    frame->UnregisterSystem(reader);
+}
+
+TEST_F(Runner, ComponentSystemInstances)
+{
+    ComponentSystem<Counter> system("Counter");
+    SharedPtr<Counter> a(new Counter());
+    SharedPtr<Counter> b(new Counter());
+
+    // Adding is idempotent.
+    system.Add(a);
+    system.Add(a);
+    system.Add(b);
+    EXPECT_EQ(system.NumInstances(), 2u);
+    system.Update(0.f);
+    EXPECT_EQ(a->updates, 1);
+    EXPECT_EQ(b->updates, 1);
+
+    // Destroyed instances are dropped on the next update.
+    a.Reset();
+    system.Update(0.f);
+    EXPECT_EQ(system.NumInstances(), 1u);
+    EXPECT_EQ(b->updates, 2);
+
+    system.Remove(b);
+    EXPECT_EQ(system.NumInstances(), 0u);
+}
+
+TUNDRA_TEST_MAIN();
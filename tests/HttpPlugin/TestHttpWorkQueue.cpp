@@ -0,0 +1,267 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifdef _WIN32
+#include "Win.h"
+#include <ws2tcpip.h>
+typedef SOCKET SocketHandle;
+#define CloseSocket closesocket
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int SocketHandle;
+#define INVALID_SOCKET -1
+#define CloseSocket close
+#endif
+
+#include "TestRunner.h"
+
+#include "HttpPlugin.h"
+#include "HttpClient.h"
+#include "HttpRequest.h"
+
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/Core/StringUtils.h>
+#include <Urho3D/Core/Thread.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+
+#include <cstring>
+
+using namespace Tundra;
+using namespace Tundra::Test;
+
+namespace
+{
+
+/// Byte @c i of the resource /data/<size>.
+u8 DataByte(uint i)
+{
+    return (u8)(i * 7);
+}
+
+bool IsData(const u8 *data, uint size)
+{
+    for(uint i = 0; i < size; ++i)
+        if (data[i] != DataByte(i))
+            return false;
+    return true;
+}
+
+/// Minimal HTTP server on the loopback interface. Serves GET /data/<size> with the ETag "<size>",
+/// and '304 Not Modified' if the request has a matching If-None-Match header.
+class TestHttpServer : public Urho3D::Thread
+{
+public:
+    TestHttpServer() : socket_(INVALID_SOCKET), port_(0), numRequests_(0) {}
+    ~TestHttpServer()
+    {
+        Stop();
+        if (socket_ != INVALID_SOCKET)
+            CloseSocket(socket_);
+    }
+
+    bool Start()
+    {
+        socket_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (socket_ == INVALID_SOCKET)
+            return false;
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = 0;
+        socklen_t addressLength = sizeof(address);
+        if (bind(socket_, (sockaddr *)&address, sizeof(address)) != 0 || listen(socket_, 64) != 0 ||
+            getsockname(socket_, (sockaddr *)&address, &addressLength) != 0)
+            return false;
+        port_ = ntohs(address.sin_port);
+        return Run();
+    }
+
+    String Url(uint size) const { return "http://127.0.0.1:" + String(port_) + "/data/" + String(size); }
+
+    uint NumRequests()
+    {
+        Urho3D::MutexLock m(mutex_);
+        return numRequests_;
+    }
+
+    void ThreadFunction() override
+    {
+        while(shouldRun_)
+        {
+            fd_set readSet;
+            FD_ZERO(&readSet);
+            FD_SET(socket_, &readSet);
+            timeval timeout = { 0, 50000 };
+            if (select((int)socket_ + 1, &readSet, 0, 0, &timeout) <= 0)
+                continue;
+            SocketHandle connection = accept(socket_, 0, 0);
+            if (connection == INVALID_SOCKET)
+                continue;
+            Serve(connection);
+            CloseSocket(connection);
+        }
+    }
+
+private:
+    void Serve(SocketHandle connection)
+    {
+        String request;
+        char buffer[1024];
+        while(!request.Contains("\r\n\r\n"))
+        {
+            int received = recv(connection, buffer, sizeof(buffer), 0);
+            if (received <= 0)
+                return;
+            request.Append(buffer, received);
+        }
+        {
+            Urho3D::MutexLock m(mutex_);
+            ++numRequests_;
+        }
+
+        uint size = 0;
+        uint pathStart = request.Find("/data/");
+        if (pathStart != String::NPOS)
+            size = Urho3D::ToUInt(request.Substring(pathStart + 6, request.Find(' ', pathStart) - pathStart - 6));
+        String etag = "\"" + String(size) + "\"";
+
+        String response;
+        PODVector<u8> body;
+        if (request.Contains("If-None-Match: " + etag, false))
+            response = "HTTP/1.1 304 Not Modified\r\nETag: " + etag + "\r\nConnection: close\r\n\r\n";
+        else
+        {
+            response = "HTTP/1.1 200 OK\r\nContent-Length: " + String(size) + "\r\nETag: " + etag + "\r\nConnection: close\r\n\r\n";
+            body.Resize(size);
+            for(uint i = 0; i < size; ++i)
+                body[i] = DataByte(i);
+        }
+        if (Send(connection, response.CString(), response.Length()) && !body.Empty())
+            Send(connection, (const char *)&body[0], body.Size());
+    }
+
+    bool Send(SocketHandle connection, const char *data, uint size)
+    {
+        while(size > 0)
+        {
+            int sent = send(connection, data, (int)size, 0);
+            if (sent <= 0)
+                return false;
+            data += sent;
+            size -= sent;
+        }
+        return true;
+    }
+
+    SocketHandle socket_;
+    unsigned short port_;
+    Urho3D::Mutex mutex_;
+    uint numRequests_;
+};
+
+HttpClientPtr CreateClient(Framework *framework)
+{
+    HttpPlugin *plugin = new HttpPlugin(framework);
+    framework->RegisterModule(plugin);
+    return plugin->Client();
+}
+
+/// Processes frames until all @c requests have completed, or gives up after 10 seconds.
+bool WaitForCompletion(Framework *framework, const Vector<HttpRequestPtr> &requests)
+{
+    Urho3D::Timer timer;
+    while(timer.GetMSec(false) < 10000)
+    {
+        framework->Pump();
+        bool completed = true;
+        for(uint i = 0; i < requests.Size() && completed; ++i)
+            completed = requests[i]->HasCompleted();
+        if (completed)
+        {
+            // Let the completion signals be emitted.
+            framework->Pump();
+            return true;
+        }
+        Urho3D::Time::Sleep(1);
+    }
+    return false;
+}
+
+}
+
+TEST_F(Runner, HttpWorkQueueRequests)
+{
+    TestHttpServer server;
+    ASSERT_TRUE(server.Start());
+    HttpClientPtr client = CreateClient(framework);
+    ASSERT_TRUE(client.Get() != nullptr);
+
+    // More requests than there are simultaneous transfers.
+    Vector<HttpRequestPtr> requests;
+    for(uint i = 0; i < 80; ++i)
+        requests.Push(client->Get(server.Url(1000 + i)));
+    ASSERT_TRUE(WaitForCompletion(framework, requests));
+
+    for(uint i = 0; i < requests.Size(); ++i)
+    {
+        EXPECT_EQ(requests[i]->StatusCode(), 200);
+        EXPECT_TRUE(requests[i]->Error().Empty());
+        ASSERT_EQ(requests[i]->ResponseBodySize(), 1000u + i);
+        EXPECT_TRUE(IsData(&requests[i]->ResponseBody()[0], 1000 + i));
+    }
+    EXPECT_EQ(server.NumRequests(), 80u);
+    EXPECT_EQ(client->Stats()->current.pending, 0u);
+    EXPECT_EQ(client->Stats()->current.executing, 0u);
+}
+
+TEST_F(Runner, HttpWorkQueueCacheFile)
+{
+    TestHttpServer server;
+    ASSERT_TRUE(server.Start());
+    HttpClientPtr client = CreateClient(framework);
+    ASSERT_TRUE(client.Get() != nullptr);
+    Urho3D::FileSystem *fileSystem = framework->GetSubsystem<Urho3D::FileSystem>();
+    const String cacheFile = fileSystem->GetProgramDir() + "TundraTestHttpCacheFile.bin";
+    fileSystem->Delete(cacheFile);
+
+    // A large body is written to the cache file in several parts by the disk thread, without buffering it to memory.
+    const uint size = 1024 * 1024 + 123;
+    Vector<HttpRequestPtr> requests;
+    requests.Push(client->Get(server.Url(size)));
+    requests.Back()->SetCacheFile(cacheFile, false);
+    requests.Back()->SetMaxBufferedBodySize(1024);
+    ASSERT_TRUE(WaitForCompletion(framework, requests));
+    EXPECT_EQ(requests.Back()->StatusCode(), 200);
+    EXPECT_TRUE(requests.Back()->Error().Empty());
+    EXPECT_EQ(requests.Back()->ResponseBodySize(), 0u);
+    {
+        Urho3D::File file(context.Get(), cacheFile, Urho3D::FILE_READ);
+        ASSERT_TRUE(file.IsOpen());
+        ASSERT_EQ(file.GetSize(), size);
+        PODVector<u8> data(size);
+        ASSERT_EQ(file.Read(&data[0], size), size);
+        EXPECT_TRUE(IsData(&data[0], size));
+    }
+    EXPECT_FALSE(fileSystem->FileExists(HttpRequest::PartialCacheFile(cacheFile)));
+
+    // A '304 Not Modified' response is answered from the cache file, which is read by the disk thread.
+    requests.Clear();
+    requests.Push(client->Get(server.Url(size)));
+    requests.Back()->SetCacheFile(cacheFile, false);
+    requests.Back()->SetCacheETag("\"" + String(size) + "\"");
+    ASSERT_TRUE(WaitForCompletion(framework, requests));
+    EXPECT_EQ(requests.Back()->StatusCode(), 304);
+    ASSERT_EQ(requests.Back()->ResponseBody().Size(), size);
+    EXPECT_TRUE(IsData(&requests.Back()->ResponseBody()[0], size));
+    EXPECT_EQ(server.NumRequests(), 2u);
+
+    fileSystem->Delete(cacheFile);
+}
+
+TUNDRA_TEST_MAIN();
@@ -5,11 +5,27 @@
 
 #include "Scene.h"
 #include "Entity.h"
+#include "Name.h"
+#include "SceneAPI.h"
+#include "IComponentFactory.h"
+#include "SceneLoader.h"
+#include "SceneArchive.h"
+#include "SceneDesc.h"
+#include "DynamicComponent.h"
+#include "AttributeMetadata.h"
+#include "IAttribute.h"
+#include "Math/Transform.h"
 #include "LoggingFunctions.h"
+#include "Framework.h"
 
+#include <Urho3D/IO/File.h>
 #include <Urho3D/IO/FileSystem.h>
 
 #include <kNet/DataSerializer.h>
+#include <kNet/DataDeserializer.h>
+
+#include <Math/Quat.h>
+#include <Math/MathFunc.h>
 
 using namespace Tundra;
 using namespace Tundra::Test;
@@ -194,6 +210,248 @@ TEST_F(Runner, CreateComponentsParented)
     }
 }
 
+TEST_F(Runner, EntitiesWithComponent)
+{
+    scene->RemoveAllEntities();
+
+    const uint numEntities = 10000;
+    const uint numWithComponent = numEntities / 10;
+    for(uint i = 0; i < numEntities; ++i)
+    {
+        EntityPtr ent = scene->CreateEntity();
+        if (i % 10 == 0)
+            ent->CreateComponent(Name::ComponentTypeId, "Indexed");
+    }
+
+    BENCHMARK("ComponentsOfType", 25)
+    {
+        const Scene::ComponentIndex &components = scene->ComponentsOfType(Name::ComponentTypeId);
+        ASSERT_EQ(components.Size(), numWithComponent);
+
+        BENCHMARK_STEP_END;
+    }
+    BENCHMARK_END;
+
+    BENCHMARK("EntitiesWithComponent", 25)
+    {
+        EntityVector ents = scene->EntitiesWithComponent(Name::ComponentTypeId);
+        ASSERT_EQ(ents.Size(), numWithComponent);
+
+        BENCHMARK_STEP_END;
+    }
+    BENCHMARK_END;
+
+    BENCHMARK("Components by name", 25)
+    {
+        Entity::ComponentVector components = scene->Components(Name::ComponentTypeId, "Indexed");
+        ASSERT_EQ(components.Size(), numWithComponent);
+
+        BENCHMARK_STEP_END;
+    }
+    BENCHMARK_END;
+
+    // The index follows component and entity removals.
+    EntityVector ents = scene->EntitiesWithComponent<Name>();
+    for(uint i = 0; i < ents.Size(); i += 2)
+        ents[i]->RemoveComponent(ents[i]->Component(Name::ComponentTypeId));
+    for(uint i = 1; i < ents.Size(); i += 4)
+        scene->RemoveEntity(ents[i]->Id());
+    ents.Clear();
+
+    ASSERT_EQ(scene->ComponentsOfType(Name::ComponentTypeId).Size(), numWithComponent / 4);
+    ASSERT_EQ(scene->Components<Name>().Size(), numWithComponent / 4);
+    foreach(IComponent *comp, scene->ComponentsOfType(Name::ComponentTypeId))
+        ASSERT_TRUE(comp->ParentEntity() != nullptr);
+
+    // Querying by name returns one component per entity, like Entity::Component.
+    EntityPtr twice = scene->CreateEntity();
+    twice->CreateComponent(Name::ComponentTypeId, "Twice");
+    twice->CreateComponent(Name::ComponentTypeId, "Twice");
+    Entity::ComponentVector named = scene->Components(Name::ComponentTypeId, "Twice");
+    ASSERT_EQ(named.Size(), 1U);
+    ASSERT_TRUE(named[0] == twice->Component(Name::ComponentTypeId, "Twice"));
+    ASSERT_EQ(scene->Components<Name>("Twice").Size(), 1U);
+    ASSERT_EQ(scene->Components(Name::ComponentTypeId).Size(), numWithComponent / 4 + 2);
+    twice.Reset();
+
+    scene->RemoveAllEntities();
+    ASSERT_EQ(scene->ComponentsOfType(Name::ComponentTypeId).Size(), 0U);
+}
+
+namespace
+{
+
+/// Name with a type ID of its own, to query components of a derived type.
+class DerivedName : public Name
+{
+    COMPONENT_NAME(DerivedName, 100001)
+
+public:
+    DerivedName(Urho3D::Context *context, Scene *scene) : Name(context, scene) {}
+};
+
+/// Adds a component to the parent entity when its child is removed, i.e. after the components of the parent were removed.
+struct ChildRemovalHandler
+{
+    void OnEntityRemoved(Entity *entity, AttributeChange::Type /*change*/)
+    {
+        if (entity == child)
+            added = parent->CreateComponent(Name::ComponentTypeId, "Added");
+    }
+
+    Entity *parent;
+    Entity *child;
+    ComponentPtr added;
+};
+
+}
+
+TEST_F(Runner, ComponentsOfDerivedTypes)
+{
+    framework->Scene()->RegisterComponentFactory(ComponentFactoryPtr(new GenericComponentFactory<DerivedName>()));
+    EntityPtr base = scene->CreateEntity();
+    base->CreateComponent(Name::ComponentTypeId, "Base");
+    EntityPtr derived = scene->CreateEntity();
+    derived->CreateComponent(DerivedName::ComponentTypeId, "Derived");
+
+    // As Entity::ComponentsOfType, the components of derived types are returned when not querying by name.
+    ASSERT_EQ(scene->Components<Name>().Size(), 2u);
+    ASSERT_EQ(scene->Components<DerivedName>().Size(), 1u);
+    ASSERT_TRUE(scene->Components<DerivedName>()[0] == derived->Component(DerivedName::ComponentTypeId));
+    ASSERT_EQ(scene->Components(Name::ComponentTypeId).Size(), 1u);
+
+    // As Entity::Component<T>(name), querying by name returns only the components of type T.
+    ASSERT_EQ(scene->Components<Name>("Base").Size(), 1u);
+    ASSERT_EQ(scene->Components<Name>("Derived").Size(), 0u);
+    ASSERT_EQ(scene->Components<DerivedName>("Derived").Size(), 1u);
+
+    scene->RemoveAllEntities();
+}
+
+TEST_F(Runner, ComponentIndexEntityRemoval)
+{
+    EntityPtr parent = scene->CreateEntity();
+    EntityPtr child = scene->CreateEntity();
+    child->SetParent(parent);
+
+    ChildRemovalHandler handler;
+    handler.parent = parent.Get();
+    handler.child = child.Get();
+    scene->EntityRemoved.Connect(&handler, &ChildRemovalHandler::OnEntityRemoved);
+
+    // The component is added after the components of the parent were removed, but the entity is still leaving the scene.
+    scene->RemoveEntity(parent->Id());
+    scene->EntityRemoved.Disconnect(&handler, &ChildRemovalHandler::OnEntityRemoved);
+    ASSERT_TRUE(handler.added != nullptr);
+    ASSERT_TRUE(parent->ParentScene() == nullptr);
+    ASSERT_EQ(scene->ComponentsOfType(Name::ComponentTypeId).Size(), 0u);
+    ASSERT_EQ(scene->Components<Name>().Size(), 0u);
+    ASSERT_TRUE(scene->EntitiesWithComponent<Name>().Empty());
+}
+
+TEST_F(Runner, AttributeInterpolation)
+{
+    scene->RemoveAllEntities();
+
+    AttributeMetadata interpolated;
+    interpolated.interpolation = AttributeMetadata::Interpolate;
+
+    const uint numEntities = 2000;
+    Vector<Attribute<float3>*> positions;
+    Vector<Attribute<Quat>*> rotations;
+    Vector<Attribute<Transform>*> transforms;
+    for(uint i = 0; i < numEntities; ++i)
+    {
+        EntityPtr ent = scene->CreateEntity();
+        SharedPtr<DynamicComponent> comp = Urho3D::DynamicCast<DynamicComponent>(ent->CreateComponent(DynamicComponent::ComponentTypeId));
+        ASSERT_TRUE(comp != nullptr);
+        IAttribute *position = comp->CreateAttribute("float3", "position", AttributeChange::LocalOnly);
+        IAttribute *rotation = comp->CreateAttribute("Quat", "rotation", AttributeChange::LocalOnly);
+        IAttribute *transform = comp->CreateAttribute("Transform", "transform", AttributeChange::LocalOnly);
+        position->SetMetadata(&interpolated);
+        rotation->SetMetadata(&interpolated);
+        transform->SetMetadata(&interpolated);
+        positions.Push(static_cast<Attribute<float3>*>(position));
+        rotations.Push(static_cast<Attribute<Quat>*>(rotation));
+        transforms.Push(static_cast<Attribute<Transform>*>(transform));
+    }
+
+    Attribute<float3> endPosition(0, "endPosition");
+    Attribute<Quat> endRotation(0, "endRotation");
+    Attribute<Transform> endTransform(0, "endTransform");
+    const Quat startQuat = Quat::RotateY(0.2f);
+    const Quat endQuat = Quat::RotateAxisAngle(float3(1.f, 1.f, 0.f).Normalized(), 1.5f);
+
+    // The first update snaps to the end value, the second one is interpolated from it.
+    for(uint i = 0; i < numEntities; ++i)
+    {
+        endPosition.Set(float3((float)i, 0.f, 0.f), AttributeChange::Disconnected);
+        endRotation.Set(startQuat, AttributeChange::Disconnected);
+        endTransform.Set(Transform(float3(0.f, (float)i, 0.f), float3(0.f, 10.f, 0.f), float3::one), AttributeChange::Disconnected);
+        ASSERT_TRUE(scene->StartAttributeInterpolation(positions[i], endPosition, 1.0f));
+        ASSERT_TRUE(scene->StartAttributeInterpolation(rotations[i], endRotation, 1.0f));
+        ASSERT_TRUE(scene->StartAttributeInterpolation(transforms[i], endTransform, 1.0f));
+    }
+    ASSERT_TRUE(positions[5]->Get().Equals(float3(5.f, 0.f, 0.f)));
+    for(uint i = 0; i < numEntities; ++i)
+    {
+        endPosition.Set(float3((float)i, 10.f, 0.f), AttributeChange::Disconnected);
+        endRotation.Set(endQuat, AttributeChange::Disconnected);
+        endTransform.Set(Transform(float3(0.f, (float)i, 10.f), float3(0.f, 50.f, 0.f), float3(2.f, 2.f, 2.f)), AttributeChange::Disconnected);
+        ASSERT_TRUE(scene->StartAttributeInterpolation(positions[i], endPosition, 1.0f));
+        ASSERT_TRUE(scene->StartAttributeInterpolation(rotations[i], endRotation, 1.0f));
+        ASSERT_TRUE(scene->StartAttributeInterpolation(transforms[i], endTransform, 1.0f));
+    }
+
+    scene->UpdateAttributeInterpolations(0.25f);
+    for(uint i = 0; i < numEntities; i += 97)
+    {
+        ASSERT_TRUE(positions[i]->Get().Equals(float3((float)i, 2.5f, 0.f)));
+        ASSERT_TRUE(rotations[i]->Get().Equals(Slerp(startQuat, endQuat, 0.25f), 5e-3f));
+        const Transform &t = transforms[i]->Get();
+        ASSERT_TRUE(t.pos.Equals(float3(0.f, (float)i, 2.5f)));
+        ASSERT_TRUE(t.scale.Equals(float3(1.25f, 1.25f, 1.25f)));
+        ASSERT_TRUE(t.rot.Equals(float3(0.f, 20.f, 0.f), 0.1f));
+    }
+
+    // Ending an interpolation leaves the last set value.
+    ASSERT_TRUE(scene->EndAttributeInterpolation(positions[0]));
+    ASSERT_FALSE(scene->EndAttributeInterpolation(positions[0]));
+    scene->UpdateAttributeInterpolations(0.25f);
+    ASSERT_TRUE(positions[0]->Get().Equals(float3(0.f, 2.5f, 0.f)));
+    ASSERT_TRUE(positions[1]->Get().Equals(float3(1.f, 5.f, 0.f)));
+
+    // Interpolations are removed after 2x their length, and when their component is removed.
+    scene->RemoveEntity(positions[1]->Owner()->ParentEntity()->Id());
+    scene->UpdateAttributeInterpolations(1.0f);
+    ASSERT_TRUE(positions[2]->Get().Equals(float3(2.f, 10.f, 0.f)));
+    ASSERT_TRUE(scene->EndAttributeInterpolation(positions[2]));
+    scene->UpdateAttributeInterpolations(1.0f);
+    ASSERT_FALSE(scene->EndAttributeInterpolation(positions[3]));
+
+    Tundra::Benchmark::Iterations = 100;
+
+    BENCHMARK("Start and update interpolations", 35)
+    {
+        for(uint i = 2; i < numEntities; ++i)
+        {
+            endPosition.Set(float3((float)i, 0.f, 0.f), AttributeChange::Disconnected);
+            endTransform.Set(Transform(float3(0.f, (float)i, 0.f), float3(0.f, 10.f, 0.f), float3::one), AttributeChange::Disconnected);
+            scene->StartAttributeInterpolation(positions[i], endPosition, 0.1f);
+            scene->StartAttributeInterpolation(rotations[i], endRotation, 0.1f);
+            scene->StartAttributeInterpolation(transforms[i], endTransform, 0.1f);
+        }
+        for(uint f = 0; f < 6; ++f)
+            scene->UpdateAttributeInterpolations(1.0f / 60.0f);
+
+        BENCHMARK_STEP_END;
+    }
+    BENCHMARK_END;
+
+    scene->EndAllAttributeInterpolations();
+    scene->RemoveAllEntities();
+}
+
 TEST_F(Runner, SceneSerialization)
 {
     // Remove tundra.json hardcoded scene ents
@@ -238,4 +496,474 @@ TEST_F(Runner, SceneSerialization)
     }
 }
 
+TEST_F(Runner, IncrementalSceneLoad)
+{
+    scene->RemoveAllEntities();
+
+    const uint numEnts = 100;
+    for(uint i = 0; i < numEnts; ++i)
+    {
+        EntityPtr ent = scene->CreateEntity();
+        ent->SetName("Entity_" + String(i));
+        EntityPtr child = ent->CreateChild();
+        child->SetName("Child_" + String(i));
+    }
+
+    Urho3D::FileSystem *fileSystem = framework->GetSubsystem<Urho3D::FileSystem>();
+    foreach_std(bool binary, TrueAndFalse)
+    {
+        String path = fileSystem->GetProgramDir() + (binary ? "TundraTestScene.tbin" : "TundraTestScene.txml");
+        ASSERT_TRUE(binary ? scene->SaveSceneBinary(path, false, false) : scene->SaveSceneXML(path, false, false));
+
+        SceneLoaderPtr loader = (binary ? scene->BeginLoadSceneBinary(path, true, true, AttributeChange::Default) :
+            scene->BeginLoadSceneXML(path, true, true, AttributeChange::Default));
+        fileSystem->Delete(path);
+        ASSERT_TRUE(loader != nullptr);
+        ASSERT_TRUE(scene->IsLoading());
+
+        // A tiny budget creates and signals one root entity per frame.
+        loader->SetTimeBudget(0.001f);
+        uint frames = 0;
+        while(!loader->IsFinished() && frames < 4 * numEnts)
+        {
+            ProcessEvents();
+            ++frames;
+        }
+
+        ASSERT_TRUE(loader->IsFinished());
+        ASSERT_FALSE(loader->HasFailed());
+        ASSERT_FALSE(scene->IsLoading());
+        ASSERT_GT(frames, 1U);
+        ASSERT_EQ(loader->Progress(), 1.f);
+        ASSERT_EQ(loader->Entities().Size(), 2 * numEnts);
+        ASSERT_EQ(scene->Entities().Size(), 2 * numEnts);
+
+        EntityPtr ent = scene->EntityByName("Entity_" + String(numEnts - 1));
+        ASSERT_TRUE(ent != nullptr);
+        ASSERT_EQ(ent->NumChildren(), 1U);
+        ASSERT_EQ(ent->Child(0)->Name(), "Child_" + String(numEnts - 1));
+
+        Log(PadString(binary ? "Binary" : "XML", 25) + String(frames) + " frames", 2);
+    }
+
+    scene->RemoveAllEntities();
+}
+
+TEST_F(Runner, IncrementalSceneLoadNewIds)
+{
+    scene->RemoveAllEntities();
+
+    // Placeable is in UrhoRenderer, a placeholder type with the same parent reference attribute stands in for it.
+    ComponentDesc placeableDesc;
+    placeableDesc.typeId = 20;
+    placeableDesc.typeName = "Placeable";
+    AttributeDesc parentRefDesc;
+    parentRefDesc.typeName = "EntityReference";
+    parentRefDesc.id = "parentRef";
+    parentRefDesc.name = "Parent entity ref";
+    placeableDesc.attributes.Push(parentRefDesc);
+    framework->Scene()->RegisterPlaceholderComponentType(placeableDesc);
+
+    EntityPtr parent = scene->CreateEntity();
+    parent->SetName("Parent");
+    EntityPtr child = scene->CreateEntity();
+    child->SetName("Child");
+    ComponentPtr placeable = child->CreateComponent("Placeable");
+    ASSERT_TRUE(placeable != nullptr);
+    placeable->AttributeById<EntityReference>("parentRef")->Set(EntityReference(parent->Id()), AttributeChange::Default);
+    const entity_id_t originalParentId = parent->Id();
+
+    Urho3D::FileSystem *fileSystem = framework->GetSubsystem<Urho3D::FileSystem>();
+    foreach_std(bool binary, TrueAndFalse)
+    {
+        String path = fileSystem->GetProgramDir() + (binary ? "TundraTestSceneNewIds.tbin" : "TundraTestSceneNewIds.txml");
+        ASSERT_TRUE(binary ? scene->SaveSceneBinary(path, false, false) : scene->SaveSceneXML(path, false, false));
+
+        // Loading next to the existing entities with new IDs points the parent references to the new entities.
+        SceneLoaderPtr loader = (binary ? scene->BeginLoadSceneBinary(path, false, false, AttributeChange::Default) :
+            scene->BeginLoadSceneXML(path, false, false, AttributeChange::Default));
+        fileSystem->Delete(path);
+        ASSERT_TRUE(loader != nullptr);
+        loader->SetTimeBudget(0.001f);
+        uint frames = 0;
+        while(!loader->IsFinished() && frames < 100)
+        {
+            ProcessEvents();
+            ++frames;
+        }
+        ASSERT_TRUE(loader->IsFinished());
+        ASSERT_FALSE(loader->HasFailed());
+
+        Entity *loadedParent = 0, *loadedChild = 0;
+        foreach(Entity *ent, loader->Entities())
+        {
+            if (ent->Name() == "Parent")
+                loadedParent = ent;
+            else if (ent->Name() == "Child")
+                loadedChild = ent;
+        }
+        ASSERT_TRUE(loadedParent != nullptr);
+        ASSERT_TRUE(loadedChild != nullptr);
+        ASSERT_NE(loadedParent->Id(), originalParentId);
+        ComponentPtr loadedPlaceable = loadedChild->Component("Placeable");
+        ASSERT_TRUE(loadedPlaceable != nullptr);
+        ASSERT_EQ(loadedPlaceable->AttributeById<EntityReference>("parentRef")->Get().ref, String(loadedParent->Id()));
+        // The original entity keeps its reference.
+        ASSERT_EQ(placeable->AttributeById<EntityReference>("parentRef")->Get().ref, String(originalParentId));
+
+        // Only the original entities are saved on the next round.
+        const Vector<Entity *> loaded = loader->Entities();
+        foreach(Entity *ent, loaded)
+            scene->RemoveEntity(ent->Id());
+    }
+
+    scene->RemoveAllEntities();
+}
+
+TEST_F(Runner, SceneArchive)
+{
+    scene->RemoveAllEntities();
+
+    const uint numEnts = 1000;
+    PODVector<entity_id_t> ids;
+    for(uint i = 0; i < numEnts; ++i)
+    {
+        EntityPtr ent = scene->CreateEntity();
+        ent->SetName("Entity_" + String(i));
+        if (i % 10 == 0)
+            ent->CreateComponent<DynamicComponent>("Dynamic_" + String(i));
+        EntityPtr child = ent->CreateChild();
+        child->SetName("Child_" + String(i));
+        ids.Push(ent->Id());
+        ids.Push(child->Id());
+    }
+
+    Urho3D::FileSystem *fileSystem = framework->GetSubsystem<Urho3D::FileSystem>();
+    String path = fileSystem->GetProgramDir() + "TundraTestScene.tbix";
+    foreach_std(bool compress, TrueAndFalse)
+    {
+        ASSERT_TRUE(SceneArchive::Write(scene.Get(), path, compress, false, false));
+        ASSERT_TRUE(SceneArchive::IsArchive(framework->GetContext(), path));
+
+        scene->RemoveAllEntities();
+
+        SceneArchivePtr archive(new SceneArchive());
+        ASSERT_TRUE(archive->Open(path));
+        ASSERT_EQ(archive->NumRecords(), numEnts);
+        ASSERT_EQ(archive->NumEntities(), 2 * numEnts);
+
+        // Loading a child creates its root-level parent and nothing else.
+        Vector<Entity *> ents = archive->LoadEntity(scene.Get(), ids[3], AttributeChange::Default);
+        ASSERT_EQ(ents.Size(), 2U);
+        ASSERT_EQ(scene->Entities().Size(), 2U);
+        ASSERT_TRUE(archive->IsLoaded(ids[2]));
+        ASSERT_FALSE(archive->IsLoaded(ids[4]));
+        ASSERT_EQ(scene->EntityById(ids[3])->Name(), "Child_1");
+        ASSERT_TRUE(archive->LoadEntity(scene.Get(), ids[2], AttributeChange::Default).Empty());
+
+        ents = archive->LoadEntitiesWithComponent(scene.Get(), DynamicComponent::ComponentTypeId, AttributeChange::Default);
+        ASSERT_EQ(ents.Size(), 2 * numEnts / 10);
+
+        ents = archive->LoadAll(scene.Get(), AttributeChange::Default);
+        ASSERT_EQ(ents.Size(), 2 * numEnts - 2 - 2 * numEnts / 10);
+        ASSERT_EQ(scene->Entities().Size(), 2 * numEnts);
+        ASSERT_TRUE(archive->LoadAll(scene.Get(), AttributeChange::Default).Empty());
+
+        EntityPtr ent = scene->EntityById(ids[2 * (numEnts - 10)]);
+        ASSERT_TRUE(ent != nullptr);
+        ASSERT_EQ(ent->Name(), "Entity_" + String(numEnts - 10));
+        ASSERT_TRUE(ent->Component<DynamicComponent>() != nullptr);
+        ASSERT_EQ(ent->NumChildren(), 1U);
+
+        Log(PadString(compress ? "Compressed" : "Uncompressed", 25) + "OK", 2);
+    }
+    fileSystem->Delete(path);
+
+    scene->RemoveAllEntities();
+}
+
+TEST_F(Runner, SceneArchiveSpatial)
+{
+    scene->RemoveAllEntities();
+
+    // Placeable is in UrhoRenderer, a placeholder type with the same transform attribute stands in for it.
+    ComponentDesc placeableDesc;
+    placeableDesc.typeId = 20;
+    placeableDesc.typeName = "Placeable";
+    AttributeDesc transformDesc;
+    transformDesc.typeName = "Transform";
+    transformDesc.id = "transform";
+    transformDesc.name = "Transform";
+    placeableDesc.attributes.Push(transformDesc);
+    framework->Scene()->RegisterPlaceholderComponentType(placeableDesc);
+
+    // A 20 x 20 grid of entities 10 units apart, and one without a position.
+    const uint gridSize = 20;
+    for(uint z = 0; z < gridSize; ++z)
+        for(uint x = 0; x < gridSize; ++x)
+        {
+            EntityPtr ent = scene->CreateEntity();
+            ComponentPtr placeable = ent->CreateComponent("Placeable");
+            ASSERT_TRUE(placeable != nullptr);
+            Attribute<Transform> *transform = placeable->AttributeById<Transform>("transform");
+            ASSERT_TRUE(transform != nullptr);
+            transform->Set(Transform(float3(x * 10.f, 0.f, z * 10.f), float3::zero, float3::one), AttributeChange::Default);
+        }
+    scene->CreateEntity();
+
+    Urho3D::FileSystem *fileSystem = framework->GetSubsystem<Urho3D::FileSystem>();
+    String path = fileSystem->GetProgramDir() + "TundraTestSceneSpatial.tbix";
+    ASSERT_TRUE(SceneArchive::Write(scene.Get(), path, true, false, false));
+    scene->RemoveAllEntities();
+
+    SceneArchivePtr archive(new SceneArchive());
+    ASSERT_TRUE(archive->Open(path));
+    ASSERT_EQ(archive->NumPendingRecords(), gridSize * gridSize + 1);
+
+    // A radius of 15 around (50, 0, 50) covers the center and its 4 neighbours on the grid, plus the 4 diagonal ones at 14.1.
+    Vector<Entity *> ents = archive->LoadEntitiesInSphere(scene.Get(), float3(50.f, 0.f, 50.f), 15.f, AttributeChange::Default);
+    ASSERT_EQ(ents.Size(), 9U);
+    ASSERT_EQ(archive->NumPendingRecords(), gridSize * gridSize + 1 - 9);
+    // The same area again creates nothing, and an area outside the grid finds nothing.
+    ASSERT_TRUE(archive->LoadEntitiesInSphere(scene.Get(), float3(50.f, 0.f, 50.f), 15.f, AttributeChange::Default).Empty());
+    ASSERT_TRUE(archive->LoadEntitiesInSphere(scene.Get(), float3(1000.f, 0.f, 1000.f), 50.f, AttributeChange::Default).Empty());
+    // A sphere covering everything gets all the positioned entities, but not the one without a position.
+    ents = archive->LoadEntitiesInSphere(scene.Get(), float3(95.f, 0.f, 95.f), 1e6f, AttributeChange::Default);
+    ASSERT_EQ(ents.Size(), gridSize * gridSize - 9);
+    ASSERT_EQ(archive->NumPendingRecords(), 1U);
+
+    // The rest of the file in batches.
+    ents = archive->LoadNext(scene.Get(), 16, AttributeChange::Default);
+    ASSERT_EQ(ents.Size(), 1U);
+    ASSERT_EQ(archive->NumPendingRecords(), 0U);
+    ASSERT_TRUE(archive->LoadNext(scene.Get(), 16, AttributeChange::Default).Empty());
+    ASSERT_EQ(scene->Entities().Size(), gridSize * gridSize + 1);
+
+    // Batches go through the file in order, each record once.
+    scene->RemoveAllEntities();
+    ASSERT_TRUE(archive->Open(path));
+    uint numBatches = 0;
+    uint numCreated = 0;
+    while(archive->NumPendingRecords() > 0 && numBatches < 1000)
+    {
+        numCreated += archive->LoadNext(scene.Get(), 16, AttributeChange::Default).Size();
+        ++numBatches;
+    }
+    ASSERT_EQ(numCreated, gridSize * gridSize + 1);
+    ASSERT_EQ(numBatches, (gridSize * gridSize + 1 + 15) / 16);
+
+    archive->Close();
+    fileSystem->Delete(path);
+    scene->RemoveAllEntities();
+}
+
+TEST_F(Runner, SceneArchiveCorrupted)
+{
+    scene->RemoveAllEntities();
+    for(uint i = 0; i < 10; ++i)
+        scene->CreateEntity()->SetName("Entity_" + String(i));
+
+    Urho3D::FileSystem *fileSystem = framework->GetSubsystem<Urho3D::FileSystem>();
+    String path = fileSystem->GetProgramDir() + "TundraTestSceneCorrupted.tbix";
+    ASSERT_TRUE(SceneArchive::Write(scene.Get(), path, false, false, false));
+    scene->RemoveAllEntities();
+
+    PODVector<char> data;
+    {
+        Urho3D::File file(context.Get(), path, Urho3D::FILE_READ);
+        ASSERT_TRUE(file.IsOpen());
+        data.Resize(file.GetSize());
+        ASSERT_EQ(file.Read(&data[0], data.Size()), data.Size());
+    }
+
+    // Garble the data of the first record: it fails to be created, and is not marked loaded.
+    {
+        PODVector<char> garbled = data;
+        for(uint i = 24; i < 40; ++i)
+            garbled[i] = (char)0xff;
+        Urho3D::File file(context.Get(), path, Urho3D::FILE_WRITE);
+        file.Write(&garbled[0], garbled.Size());
+    }
+    SceneArchivePtr archive(new SceneArchive());
+    ASSERT_TRUE(archive->Open(path));
+    // The index offset is the last field of the header, and the index starts with the ID of the first record.
+    kNet::DataDeserializer header(&data[16], 8);
+    kNet::DataDeserializer index(&data[(uint)header.Read<u64>()], 4);
+    const entity_id_t firstId = index.Read<u32>();
+    archive->LoadEntity(scene.Get(), firstId, AttributeChange::Default);
+    ASSERT_FALSE(archive->IsLoaded(firstId));
+    ASSERT_TRUE(scene->EntityById(firstId) == nullptr);
+    ASSERT_EQ(archive->NumPendingRecords(), 9U);
+    archive->Close();
+
+    // A component type section referring to a record that does not exist is rejected.
+    {
+        PODVector<char> bad = data;
+        // The last u32 of the file is the record index of the last entry of the last component type section.
+        kNet::DataSerializer dest(&bad[bad.Size() - 4], 4);
+        dest.Add<u32>(1000);
+        Urho3D::File file(context.Get(), path, Urho3D::FILE_WRITE);
+        file.Write(&bad[0], bad.Size());
+    }
+    ASSERT_FALSE(archive->Open(path));
+
+    fileSystem->Delete(path);
+    scene->RemoveAllEntities();
+}
+
+TEST_F(Runner, AttributeLookup)
+{
+    EntityPtr ent = scene->CreateEntity();
+    SharedPtr<Name> name = ent->CreateComponent<Name>();
+    ASSERT_TRUE(name != nullptr);
+    SharedPtr<DynamicComponent> dynamic = ent->CreateComponent<DynamicComponent>();
+    for(uint i = 0; i < 8; ++i)
+        dynamic->CreateAttribute("real", "dynamic" + String(i));
+
+    const StringHash groupId("group");
+    const StringHash dynamicId("dynamic7");
+    IAttribute *group = name->AttributeById("group");
+    ASSERT_TRUE(group != nullptr);
+
+    // The typed lookups validate the type by type ID, IDs are case-insensitive.
+    ASSERT_EQ(name->AttributeById<String>("group"), group);
+    ASSERT_EQ(name->AttributeById<String>("GROUP"), group);
+    ASSERT_EQ(name->AttributeByIdHash<String>(groupId), group);
+    ASSERT_EQ(name->AttributeByIdHash<String>(group->IdHash()), group);
+    ASSERT_EQ(name->AttributeByName<String>(group->Name()), group);
+    ASSERT_EQ(name->AttributeByNameHash<String>(group->NameHash()), group);
+    ASSERT_TRUE(name->AttributeById<float>("group") == nullptr);
+    ASSERT_TRUE(name->AttributeById("nonexisting") == nullptr);
+    ASSERT_TRUE(dynamic->AttributeByIdHash<float>(dynamicId) != nullptr);
+    ASSERT_EQ(dynamic->AttributeByIdHash<float>(dynamicId), dynamic->AttributeById<float>("dynamic7"));
+
+    Tundra::Benchmark::Iterations = 100000;
+
+    // The lookup done before the attribute tables: string comparisons and dynamic_cast.
+    BENCHMARK("String scan + dynamic_cast", 30)
+    {
+        Attribute<String> *found = nullptr;
+        const AttributeVector &attributes = name->Attributes();
+        for(uint i = 0; i < attributes.Size(); ++i)
+            if (attributes[i] && attributes[i]->Id().Compare("group", false) == 0)
+            {
+                found = dynamic_cast<Attribute<String> *>(attributes[i]);
+                break;
+            }
+        ASSERT_EQ(found, group);
+        BENCHMARK_STEP_END;
+    }
+    BENCHMARK_END;
+
+    BENCHMARK("AttributeById<T>", 30)
+    {
+        ASSERT_EQ(name->AttributeById<String>("group"), group);
+        BENCHMARK_STEP_END;
+    }
+    BENCHMARK_END;
+
+    BENCHMARK("AttributeByIdHash<T>", 30)
+    {
+        ASSERT_EQ(name->AttributeByIdHash<String>(groupId), group);
+        BENCHMARK_STEP_END;
+    }
+    BENCHMARK_END;
+
+    BENCHMARK("AttributeByIdHash<T> dynamic", 30)
+    {
+        ASSERT_TRUE(dynamic->AttributeByIdHash<float>(dynamicId) != nullptr);
+        BENCHMARK_STEP_END;
+    }
+    BENCHMARK_END;
+
+    scene->RemoveEntity(ent->Id());
+}
+
+TEST_F(Runner, NameIndex)
+{
+    const uint numEntities = 2000;
+    Vector<EntityPtr> entities;
+    for(uint n = 0; n < numEntities; ++n)
+    {
+        EntityPtr ent = scene->CreateEntity();
+        SharedPtr<Name> name = ent->CreateComponent<Name>();
+        // Unsignaled changes, like those done while loading a scene, are indexed as well.
+        name->name.Set("entity" + String(n), AttributeChange::Disconnected);
+        name->group.Set("group" + String(n % 10), AttributeChange::Default);
+        entities.Push(ent);
+    }
+
+    ASSERT_EQ(scene->EntityByName("entity42"), entities[42]);
+    ASSERT_FALSE(scene->IsUniqueName("entity42"));
+    ASSERT_TRUE(scene->IsUniqueName("nonexisting"));
+    ASSERT_EQ(scene->EntitiesOfGroup("group3").Size(), numEntities / 10);
+    ASSERT_EQ(scene->FindEntitiesByName("entity7").Size(), 1u);
+    ASSERT_EQ(scene->FindEntitiesByName("ENTITY7", false).Size(), 1u);
+
+    // Renames, and removals of the Name component and the entity, update the index.
+    entities[42]->SetName("renamed");
+    ASSERT_TRUE(scene->EntityByName("entity42") == nullptr);
+    ASSERT_EQ(scene->EntityByName("renamed"), entities[42]);
+    entities[43]->SetGroup("group2");
+    ASSERT_EQ(scene->EntitiesOfGroup("group3").Size(), numEntities / 10 - 1);
+    ASSERT_EQ(scene->EntitiesOfGroup("group2").Size(), numEntities / 10 + 1);
+    entities[44]->RemoveComponent(Name::TypeNameStatic());
+    ASSERT_TRUE(scene->EntityByName("entity44") == nullptr);
+    ASSERT_EQ(scene->EntitiesOfGroup("group4").Size(), numEntities / 10 - 1);
+    scene->RemoveEntity(entities[45]->Id());
+    ASSERT_TRUE(scene->EntityByName("entity45") == nullptr);
+    ASSERT_EQ(scene->EntitiesOfGroup("group5").Size(), numEntities / 10 - 1);
+
+    // Duplicate names resolve to the entity that got the name first.
+    entities[46]->SetName("entity47");
+    ASSERT_EQ(scene->EntityByName("entity47"), entities[47]);
+    ASSERT_EQ(scene->FindEntitiesByName("entity47").Size(), 2u);
+    entities[47]->SetName("entity47b");
+    ASSERT_EQ(scene->EntityByName("entity47"), entities[46]);
+
+    StringVector names;
+    for(uint n = 0; n < 100; ++n)
+        names.Push("entity" + String((n * 19 + 100) % numEntities));
+
+    Tundra::Benchmark::Iterations = 100;
+
+    // The lookup done before the index: a scan of all entities per name, as e.g. Placeable parenting by name did.
+    BENCHMARK("EntityByName scan", 25)
+    {
+        for(uint n = 0; n < names.Size(); ++n)
+        {
+            EntityPtr found;
+            for(Scene::ConstIterator it = scene->Begin(); it != scene->End(); ++it)
+                if (it->second_->Name() == names[n])
+                {
+                    found = it->second_;
+                    break;
+                }
+            ASSERT_TRUE(found != nullptr);
+        }
+        BENCHMARK_STEP_END;
+    }
+    BENCHMARK_END;
+
+    BENCHMARK("EntityByName", 25)
+    {
+        for(uint n = 0; n < names.Size(); ++n)
+            ASSERT_TRUE(scene->EntityByName(names[n]) != nullptr);
+        BENCHMARK_STEP_END;
+    }
+    BENCHMARK_END;
+
+    BENCHMARK("EntitiesOfGroup", 25)
+    {
+        for(uint n = 0; n < 10; ++n)
+            ASSERT_FALSE(scene->EntitiesOfGroup("group" + String(n)).Empty());
+        BENCHMARK_STEP_END;
+    }
+    BENCHMARK_END;
+
+    scene->RemoveAllEntities();
+    ASSERT_TRUE(scene->EntityByName("entity1") == nullptr);
+    ASSERT_TRUE(scene->EntitiesOfGroup("group1").Empty());
+}
+
 TUNDRA_TEST_MAIN();
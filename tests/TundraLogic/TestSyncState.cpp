@@ -0,0 +1,348 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "TestRunner.h"
+#include "TestBenchmark.h"
+
+#include "Scene.h"
+#include "Entity.h"
+#include "SyncState.h"
+#include "EntitySpatialIndex.h"
+#include "UserConnection.h"
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/List.h>
+
+#include <Math/float3.h>
+
+#include <map>
+
+using namespace Tundra;
+using namespace Tundra::Test;
+
+namespace
+{
+
+/// The std::map based sync state layout that SceneSyncState used before EntitySyncStateMap, kept for comparison.
+namespace Legacy
+{
+    struct ComponentSyncState
+    {
+        ComponentSyncState() : id(0), isInQueue(false) { memset(dirtyAttributes, 0, sizeof dirtyAttributes); }
+
+        u8 dirtyAttributes[32];
+        Urho3D::HashMap<u8, bool> newAndRemovedAttributes;
+        component_id_t id;
+        bool isInQueue;
+    };
+
+    struct EntitySyncState
+    {
+        EntitySyncState() : id(0), isInQueue(false) {}
+
+        void MarkComponentDirty(component_id_t compId)
+        {
+            ComponentSyncState& compState = components[compId];
+            if (!compState.id)
+                compState.id = compId;
+            if (!compState.isInQueue)
+            {
+                dirtyQueue.Push(&compState);
+                compState.isInQueue = true;
+            }
+        }
+
+        Urho3D::List<ComponentSyncState*> dirtyQueue;
+        std::map<component_id_t, ComponentSyncState> components;
+        entity_id_t id;
+        bool isInQueue;
+    };
+
+    struct SceneSyncState
+    {
+        EntitySyncState& GetOrCreateEntitySyncState(entity_id_t id)
+        {
+            EntitySyncState& state = entities[id];
+            if (!state.id)
+                state.id = id;
+            return state;
+        }
+
+        bool MarkEntityDirty(entity_id_t id)
+        {
+            EntitySyncState& entityState = GetOrCreateEntitySyncState(id);
+            if (!entityState.isInQueue)
+            {
+                dirtyQueue.Insert(Urho3D::MakePair(id, &entityState));
+                entityState.isInQueue = true;
+            }
+            return true;
+        }
+
+        void MarkAttributeDirty(entity_id_t id, component_id_t compId, u8 attrIndex)
+        {
+            if (MarkEntityDirty(id))
+            {
+                EntitySyncState& entityState = GetOrCreateEntitySyncState(id);
+                entityState.MarkComponentDirty(compId);
+                ComponentSyncState& compState = entityState.components[compId];
+                compState.dirtyAttributes[attrIndex >> 3] |= (1 << (attrIndex & 7));
+            }
+        }
+
+        std::map<entity_id_t, EntitySyncState> entities;
+        Urho3D::HashMap<entity_id_t, EntitySyncState*> dirtyQueue;
+    };
+
+    /// Walks the dirty queue the way SyncManager::ProcessSyncState did. Returns number of dirty attributes.
+    uint ProcessSyncState(SceneSyncState& state)
+    {
+        uint numDirty = 0;
+        for (auto iter = state.dirtyQueue.Begin(); iter != state.dirtyQueue.End(); ++iter)
+        {
+            EntitySyncState* entityState = iter->second_;
+            entityState->isInQueue = false;
+            while (!entityState->dirtyQueue.Empty())
+            {
+                ComponentSyncState& compState = *entityState->dirtyQueue.Front();
+                entityState->dirtyQueue.PopFront();
+                compState.isInQueue = false;
+                compState.newAndRemovedAttributes.Clear();
+                for (uint i = 0; i < 32; ++i)
+                {
+                    numDirty += (compState.dirtyAttributes[i] != 0 ? 1 : 0);
+                    compState.dirtyAttributes[i] = 0;
+                }
+            }
+        }
+        state.dirtyQueue.Clear();
+        return numDirty;
+    }
+}
+
+/// Walks the dirty queue the way SyncManager::ProcessSyncState does. Returns number of dirty attributes.
+uint ProcessSyncState(SceneSyncState& state)
+{
+    uint numDirty = 0;
+    for (uint q = 0; q < state.dirtyQueue.Size(); ++q)
+    {
+        EntitySyncState* entityState = state.DirtyEntity(state.dirtyQueue[q]);
+        if (!entityState)
+            continue;
+        entityState->isInQueue = false;
+        for (uint ci = 0; ci < entityState->components.Size(); ++ci)
+        {
+            ComponentSyncState& compState = entityState->components[ci];
+            if (!compState.isInQueue)
+                continue;
+            compState.isInQueue = false;
+            for (uint i = 0; i < 32; ++i)
+            {
+                numDirty += (compState.dirtyAttributes[i] != 0 ? 1 : 0);
+                compState.dirtyAttributes[i] = 0;
+                compState.createdAttributes[i] = 0;
+                compState.removedAttributes[i] = 0;
+            }
+        }
+    }
+    state.dirtyQueue.Clear();
+    return numDirty;
+}
+
+/// Dirties one attribute of one component in each entity.
+template <typename SyncStateType>
+void MarkAttributesDirty(SyncStateType& state, const Vector<entity_id_t>& ids, uint numComponents)
+{
+    for (uint i = 0; i < ids.Size(); ++i)
+        state.MarkAttributeDirty(ids[i], (i % numComponents) + 1, (u8)(i & 7));
+}
+
+}
+
+TEST_F(Runner, EntitySyncStateMap)
+{
+    EntitySyncStateMap map;
+    std::map<entity_id_t, entity_id_t> reference;
+
+    // Insert, erase and reinsert in an order that produces long probe sequences and reuses storage slots.
+    for (entity_id_t id = 1; id <= 5000; ++id)
+    {
+        map[id].id = id;
+        reference[id] = id;
+    }
+    EntitySyncState* stable = map.Find(4000);
+    for (entity_id_t id = 1; id <= 5000; id += 3)
+    {
+        map.Erase(id);
+        reference.erase(id);
+    }
+    for (entity_id_t id = 10000; id < 12000; ++id)
+    {
+        map[id].id = id;
+        reference[id] = id;
+    }
+
+    ASSERT_EQ(map.Size(), (uint)reference.size());
+    ASSERT_TRUE(map.Find(4000) == stable);
+    for (entity_id_t id = 1; id < 12000; ++id)
+    {
+        EntitySyncState* state = map.Find(id);
+        if (reference.find(id) != reference.end())
+        {
+            ASSERT_TRUE(state != nullptr);
+            ASSERT_EQ(state->id, id);
+        }
+        else
+            ASSERT_TRUE(state == nullptr);
+    }
+    ASSERT_TRUE(map.Find(0) == nullptr);
+
+    map.Clear();
+    ASSERT_EQ(map.Size(), 0U);
+    ASSERT_TRUE(map.Find(4000) == nullptr);
+}
+
+TEST_F(Runner, EntitySpatialIndex)
+{
+    EntitySpatialIndex index(10.f);
+    std::map<entity_id_t, float3> reference;
+
+    // Entities on a grid that spans negative and positive cells, then move and remove some of them.
+    for (entity_id_t id = 1; id <= 1000; ++id)
+    {
+        float3 pos((float)(id % 10) * 7.f - 35.f, (float)((id / 10) % 10) * 3.f, (float)(id / 100) * -11.f);
+        index.Update(id, pos);
+        reference[id] = pos;
+    }
+    for (entity_id_t id = 1; id <= 1000; id += 7)
+    {
+        float3 pos = reference[id] + float3(13.f, -4.f, 25.f);
+        index.Update(id, pos);
+        reference[id] = pos;
+    }
+    for (entity_id_t id = 2; id <= 1000; id += 5)
+    {
+        index.Remove(id);
+        reference.erase(id);
+    }
+    // A non-finite position removes the entity.
+    index.Update(3, float3::nan);
+    reference.erase(3);
+
+    ASSERT_EQ(index.Size(), (uint)reference.size());
+    ASSERT_FALSE(index.Contains(2));
+    ASSERT_TRUE(index.Position(4).Equals(reference[4]));
+
+    const float3 centers[] = { float3(0.f, 0.f, 0.f), float3(-30.f, 10.f, -50.f), float3(20.f, 15.f, -90.f) };
+    const float radii[] = { 0.f, 5.f, 24.f, 60.f, 500.f };
+    for (uint c = 0; c < 3; ++c)
+    {
+        for (uint r = 0; r < 5; ++r)
+        {
+            PODVector<entity_id_t> result;
+            index.QuerySphere(centers[c], radii[r], result);
+
+            uint expected = 0;
+            for (auto it = reference.begin(); it != reference.end(); ++it)
+                if (it->second.DistanceSq(centers[c]) <= radii[r] * radii[r])
+                {
+                    ++expected;
+                    ASSERT_TRUE(result.Contains(it->first));
+                }
+            ASSERT_EQ(result.Size(), expected);
+        }
+    }
+
+    // Re-bucketing with another cell size keeps the positions.
+    index.SetCellSize(3.f);
+    PODVector<entity_id_t> result;
+    index.QuerySphere(float3::zero, FLOAT_INF, result);
+    ASSERT_EQ(result.Size(), (uint)reference.size());
+    ASSERT_TRUE(index.Position(4).Equals(reference[4]));
+
+    index.Clear();
+    ASSERT_EQ(index.Size(), 0U);
+}
+
+TEST_F(Runner, SyncStateLayouts)
+{
+    const uint numEntities = 10000;
+    const uint numComponents = 4;
+
+    Vector<entity_id_t> ids;
+    for (uint i = 0; i < numEntities; ++i)
+    {
+        EntityPtr entity = scene->CreateEntity(0, StringVector(), AttributeChange::LocalOnly, true, true);
+        ASSERT_TRUE(entity != nullptr);
+        ids.Push(entity->Id());
+    }
+
+    SharedPtr<KNetUserConnection> user(new KNetUserConnection(framework.Get()));
+    SharedPtr<SceneSyncState> state(new SceneSyncState(user.Get()));
+    state->SetParentScene(scene);
+    Legacy::SceneSyncState legacyState;
+
+    // Create the entity and component states before measuring
+    for (uint i = 0; i < numEntities; ++i)
+    {
+        for (uint c = 1; c <= numComponents; ++c)
+        {
+            state->MarkAttributeDirty(ids[i], c, 0);
+            legacyState.MarkAttributeDirty(ids[i], c, 0);
+        }
+    }
+    ASSERT_EQ(ProcessSyncState(*state), numEntities * numComponents);
+    ASSERT_EQ(Legacy::ProcessSyncState(legacyState), numEntities * numComponents);
+
+    Tundra::Benchmark::Iterations = 100;
+
+    BENCHMARK("MarkAttributeDirty std::map", 40)
+    {
+        MarkAttributesDirty(legacyState, ids, numComponents);
+
+        BENCHMARK_STEP_END;
+
+        Legacy::ProcessSyncState(legacyState);
+    }
+    BENCHMARK_END;
+
+    Tundra::Benchmark::Iterations = 100;
+
+    BENCHMARK("MarkAttributeDirty EntitySyncStateMap", 40)
+    {
+        MarkAttributesDirty(*state, ids, numComponents);
+
+        BENCHMARK_STEP_END;
+
+        ProcessSyncState(*state);
+    }
+    BENCHMARK_END;
+
+    // The dirty queue is filled outside the measured part of the iteration
+    MarkAttributesDirty(legacyState, ids, numComponents);
+    Tundra::Benchmark::Iterations = 100;
+
+    BENCHMARK("ProcessSyncState std::map", 40)
+    {
+        ASSERT_EQ(Legacy::ProcessSyncState(legacyState), numEntities);
+
+        BENCHMARK_STEP_END;
+
+        MarkAttributesDirty(legacyState, ids, numComponents);
+    }
+    BENCHMARK_END;
+
+    MarkAttributesDirty(*state, ids, numComponents);
+    Tundra::Benchmark::Iterations = 100;
+
+    BENCHMARK("ProcessSyncState EntitySyncStateMap", 40)
+    {
+        ASSERT_EQ(ProcessSyncState(*state), numEntities);
+
+        BENCHMARK_STEP_END;
+
+        MarkAttributesDirty(*state, ids, numComponents);
+    }
+    BENCHMARK_END;
+}
+
+TUNDRA_TEST_MAIN();
@@ -0,0 +1,139 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "TestRunner.h"
+
+#include "UrhoRenderer.h"
+#include "CameraAssetTransferPrioritizer.h"
+#include "IAssetTransfer.h"
+#include "Camera.h"
+#include "Placeable.h"
+#include "Entity.h"
+#include "Scene/Scene.h"
+#include "SceneAPI.h"
+
+using namespace Tundra;
+using namespace Tundra::Test;
+
+namespace
+{
+
+AssetTransferPtr MakeTransfer(const String &ref, const String &type)
+{
+    AssetTransferPtr transfer(new IAssetTransfer());
+    transfer->source.ref = ref;
+    transfer->assetType = type;
+    return transfer;
+}
+
+/// Creates an entity with a Placeable at @c pos.
+EntityPtr CreatePlacedEntity(Scene *scene, const float3 &pos)
+{
+    EntityPtr entity = scene->CreateEntity();
+    entity->CreateComponent<Placeable>()->SetPosition(pos);
+    return entity;
+}
+
+}
+
+TEST_F(Runner, CameraAssetTransferPrioritizerWithoutCamera)
+{
+    SharedPtr<UrhoRenderer> renderer(new UrhoRenderer(framework.Get()));
+    SharedPtr<CameraAssetTransferPrioritizer> prioritizer(new CameraAssetTransferPrioritizer(renderer.Get()));
+    prioritizer->SetTransferLimit(2);
+
+    // Without a main camera nothing is held back.
+    EXPECT_EQ(prioritizer->MaxTransfersPerFrame(), 0u);
+
+    // Without a main camera the transfers are ordered by asset type, meshes before materials before the rest.
+    AssetTransferPtr texture = MakeTransfer("test://server/a.png", "Texture");
+    AssetTransferPtr material = MakeTransfer("test://server/a.material", "OgreMaterial");
+    AssetTransferPtr mesh = MakeTransfer("test://server/a.mesh", "OgreMesh");
+    AssetTransferPtrVector transfers;
+    transfers.Push(texture);
+    transfers.Push(material);
+    transfers.Push(mesh);
+    AssetTransferPtrVector sorted = prioritizer->Prioritize(transfers);
+    ASSERT_EQ(sorted.Size(), 3u);
+    EXPECT_TRUE(sorted[0] == mesh);
+    EXPECT_TRUE(sorted[1] == material);
+    EXPECT_TRUE(sorted[2] == texture);
+
+    // Only the given transfers are returned. A ranked transfer keeps its place before a new one of equal priority.
+    AssetTransferPtr script = MakeTransfer("test://server/a.js", "Script");
+    transfers.Clear();
+    transfers.Push(script);
+    transfers.Push(texture);
+    sorted = prioritizer->Prioritize(transfers);
+    ASSERT_EQ(sorted.Size(), 2u);
+    EXPECT_TRUE(sorted[0] == texture);
+    EXPECT_TRUE(sorted[1] == script);
+
+    // Duplicates in the input are returned in the input order, so that no transfer is lost.
+    transfers.Clear();
+    transfers.Push(texture);
+    transfers.Push(mesh);
+    transfers.Push(mesh);
+    sorted = prioritizer->Prioritize(transfers);
+    ASSERT_EQ(sorted.Size(), 3u);
+    EXPECT_TRUE(sorted[0] == texture);
+    EXPECT_TRUE(sorted[1] == mesh);
+    EXPECT_TRUE(sorted[2] == mesh);
+}
+
+TEST_F(Runner, CameraAssetTransferPrioritizerWithCamera)
+{
+    UrhoRenderer *renderer = new UrhoRenderer(framework.Get());
+    framework->RegisterModule(renderer);
+    renderer->Initialize();
+    CameraAssetTransferPrioritizer *prioritizer = renderer->TransferPrioritizer();
+    ASSERT_TRUE(prioritizer != nullptr);
+
+    // The view scene gets a GraphicsWorld, which the camera needs.
+    ScenePtr viewScene = framework->Scene()->CreateScene("CameraTestScene", true, true);
+    ASSERT_TRUE(viewScene.Get() != nullptr);
+    // The camera is at the origin, looking towards -Z.
+    EntityPtr cameraEntity = CreatePlacedEntity(viewScene.Get(), float3::zero);
+    cameraEntity->CreateComponent<Camera>();
+    renderer->SetMainCamera(cameraEntity.Get());
+    ASSERT_TRUE(renderer->MainCameraComponent() != nullptr);
+    EXPECT_EQ(prioritizer->MaxTransfersPerFrame(), 32u);
+
+    // The near entity is in front of the camera, the far one far behind it.
+    EntityPtr nearEntity = CreatePlacedEntity(viewScene.Get(), float3(0.f, 0.f, -10.f));
+    EntityPtr farEntity = CreatePlacedEntity(viewScene.Get(), float3(0.f, 0.f, 500.f));
+
+    AssetTransferPtr farMesh = MakeTransfer("test://server/far.mesh", "OgreMesh");
+    farMesh->AddReferencingEntity(farEntity.Get());
+    AssetTransferPtr script = MakeTransfer("test://server/a.js", "Script");
+    AssetTransferPtr nearTexture = MakeTransfer("test://server/near.png", "Texture");
+    nearTexture->AddReferencingEntity(nearEntity.Get());
+    AssetTransferPtrVector transfers;
+    transfers.Push(farMesh);
+    transfers.Push(script);
+    transfers.Push(nearTexture);
+    AssetTransferPtrVector sorted = prioritizer->Prioritize(transfers);
+    ASSERT_EQ(sorted.Size(), 3u);
+    // The visible near entity comes first, then the transfer without entities, then the culled far entity.
+    EXPECT_TRUE(sorted[0] == nearTexture);
+    EXPECT_TRUE(sorted[1] == script);
+    EXPECT_TRUE(sorted[2] == farMesh);
+
+    // A dependency is prioritized by the entities that refer to the asset depending on it, also the ones added later.
+    AssetTransferPtr material = MakeTransfer("test://server/far.material", "OgreMaterial");
+    farMesh->AddDependency(material.Get());
+    EXPECT_TRUE(material->ReferencingEntities().Contains(EntityWeakPtr(farEntity.Get())));
+    farMesh->AddReferencingEntity(nearEntity.Get());
+    EXPECT_TRUE(material->ReferencingEntities().Contains(EntityWeakPtr(nearEntity.Get())));
+
+    // Re-ranked on the next frame.
+    ProcessEvents();
+    transfers.Push(material);
+    sorted = prioritizer->Prioritize(transfers);
+    ASSERT_EQ(sorted.Size(), 4u);
+    EXPECT_TRUE(sorted[0] == farMesh);
+    EXPECT_TRUE(sorted[1] == material);
+    EXPECT_TRUE(sorted[2] == nearTexture);
+    EXPECT_TRUE(sorted[3] == script);
+}
+
+TUNDRA_TEST_MAIN();
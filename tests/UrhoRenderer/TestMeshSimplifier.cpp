@@ -0,0 +1,191 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "TestRunner.h"
+
+#include "MeshSimplifier.h"
+
+#include <Urho3D/Container/HashSet.h>
+
+#include <Math/float3.h>
+
+using namespace Tundra;
+using namespace Tundra::Test;
+
+namespace
+{
+
+const uint cGridSize = 16;
+
+/// Triangulates a grid of cGridSize x cGridSize quads centered on the origin, with the height given by @c curvature * (x^2 + y^2).
+void MakeGrid(float curvature, PODVector<float3> &positions, PODVector<uint> &indices)
+{
+    const int half = cGridSize / 2;
+    for(int y = -half; y <= half; ++y)
+        for(int x = -half; x <= half; ++x)
+            positions.Push(float3((float)x, (float)y, curvature * (float)(x * x + y * y)));
+    for(uint y = 0; y < cGridSize; ++y)
+    {
+        for(uint x = 0; x < cGridSize; ++x)
+        {
+            const uint v = y * (cGridSize + 1) + x;
+            indices.Push(v); indices.Push(v + 1); indices.Push(v + cGridSize + 2);
+            indices.Push(v); indices.Push(v + cGridSize + 2); indices.Push(v + cGridSize + 1);
+        }
+    }
+}
+
+/// Splits the grid made by MakeGrid into two UV islands at x = 0, by giving the quads at x >= 0 their own copies of the
+/// vertices at x = 0. The copies are added after the grid vertices, one per row.
+void SplitGrid(PODVector<float3> &positions, PODVector<uint> &indices)
+{
+    const uint numGridVertices = positions.Size();
+    const uint half = cGridSize / 2;
+    for(uint row = 0; row <= cGridSize; ++row)
+        positions.Push(positions[row * (cGridSize + 1) + half]);
+    for(uint i = 0; i < indices.Size(); ++i)
+    {
+        const uint quadColumn = (i / 6) % cGridSize;
+        if (quadColumn >= half && indices[i] < numGridVertices && indices[i] % (cGridSize + 1) == half)
+            indices[i] = numGridVertices + indices[i] / (cGridSize + 1);
+    }
+}
+
+/// Checks that @c indices is a triangle list to @c positions without degenerate triangles.
+void ExpectValidTriangles(const PODVector<float3> &positions, const PODVector<uint> &indices)
+{
+    ASSERT_EQ(indices.Size() % 3, 0u);
+    for(uint i = 0; i < indices.Size(); i += 3)
+    {
+        ASSERT_LT(indices[i], positions.Size());
+        ASSERT_LT(indices[i + 1], positions.Size());
+        ASSERT_LT(indices[i + 2], positions.Size());
+        const float3 &p0 = positions[indices[i]], &p1 = positions[indices[i + 1]], &p2 = positions[indices[i + 2]];
+        EXPECT_GT((p1 - p0).Cross(p2 - p0).Length(), 0.f);
+    }
+}
+
+}
+
+TEST_F(Runner, SimplifyMeshTargetIndexCount)
+{
+    PODVector<float3> positions;
+    PODVector<uint> indices;
+    MakeGrid(0.f, positions, indices);
+
+    // A flat surface simplifies without error, down to the target.
+    const uint targetIndexCount = indices.Size() / 2 / 3 * 3;
+    PODVector<uint> simplified = SimplifyMesh(positions, indices, targetIndexCount, 0.f);
+    EXPECT_LE(simplified.Size(), targetIndexCount);
+    EXPECT_GT(simplified.Size(), 0u);
+    ExpectValidTriangles(positions, simplified);
+
+    // A target that is already met leaves the indices untouched.
+    PODVector<uint> unchanged = SimplifyMesh(positions, indices, indices.Size(), 0.f);
+    EXPECT_TRUE(unchanged == indices);
+}
+
+TEST_F(Runner, SimplifyMeshErrorBound)
+{
+    PODVector<float3> positions;
+    PODVector<uint> indices;
+    MakeGrid(0.1f, positions, indices);
+    const uint targetIndexCount = indices.Size() / 4 / 3 * 3;
+
+    // Every collapse on a curved surface has an error, so no error allowed means no collapses.
+    PODVector<uint> none = SimplifyMesh(positions, indices, targetIndexCount, 0.f);
+    EXPECT_TRUE(none == indices);
+
+    // A larger error limit allows at least as many collapses as a smaller one.
+    PODVector<uint> small = SimplifyMesh(positions, indices, targetIndexCount, 0.005f);
+    PODVector<uint> large = SimplifyMesh(positions, indices, targetIndexCount, 0.05f);
+    ExpectValidTriangles(positions, small);
+    ExpectValidTriangles(positions, large);
+    EXPECT_LE(small.Size(), indices.Size());
+    EXPECT_LE(large.Size(), small.Size());
+    EXPECT_LT(large.Size(), indices.Size());
+}
+
+TEST_F(Runner, SimplifyMeshInvalidInput)
+{
+    PODVector<float3> positions;
+    PODVector<uint> indices;
+    MakeGrid(0.f, positions, indices);
+
+    // Out of range indices are returned as is.
+    indices.Push(positions.Size()); indices.Push(0); indices.Push(1);
+    PODVector<uint> result = SimplifyMesh(positions, indices, 0, 1.f);
+    EXPECT_TRUE(result == indices);
+}
+
+TEST_F(Runner, SimplifyMeshSeam)
+{
+    PODVector<float3> positions;
+    PODVector<uint> indices;
+    MakeGrid(0.f, positions, indices);
+    const uint numGridVertices = positions.Size();
+    const uint half = cGridSize / 2;
+    SplitGrid(positions, indices);
+
+    PODVector<uint> simplified = SimplifyMesh(positions, indices, 0, 0.f);
+    ExpectValidTriangles(positions, simplified);
+    EXPECT_LT(simplified.Size(), indices.Size());
+
+    // The triangles of the islands still use only the vertices of their own island, and both sides of the seam
+    // still meet at the same rows, so the vertices on the seam moved along it together.
+    HashSet<uint> leftSeamRows, rightSeamRows;
+    for(uint i = 0; i < simplified.Size(); i += 3)
+    {
+        int sides[3];
+        for(uint k = 0; k < 3; ++k)
+        {
+            const uint v = simplified[i + k];
+            const uint column = v % (cGridSize + 1);
+            if (v >= numGridVertices)
+            {
+                sides[k] = 1;
+                rightSeamRows.Insert(v - numGridVertices);
+            }
+            else if (column == half)
+            {
+                sides[k] = -1;
+                leftSeamRows.Insert(v / (cGridSize + 1));
+            }
+            else
+                sides[k] = column < half ? -1 : 1;
+        }
+        EXPECT_EQ(sides[0], sides[1]);
+        EXPECT_EQ(sides[1], sides[2]);
+    }
+    EXPECT_EQ(leftSeamRows.Size(), rightSeamRows.Size());
+    for(HashSet<uint>::ConstIterator i = leftSeamRows.Begin(); i != leftSeamRows.End(); ++i)
+        EXPECT_TRUE(rightSeamRows.Contains(*i));
+    // The ends of the seam are on the border and stay, but the seam in between is simplified.
+    EXPECT_TRUE(leftSeamRows.Contains(0));
+    EXPECT_TRUE(leftSeamRows.Contains(cGridSize));
+    EXPECT_LT(leftSeamRows.Size(), cGridSize + 1);
+}
+
+TEST_F(Runner, SimplifyMeshDegenerateTriangles)
+{
+    PODVector<float3> positions;
+    PODVector<uint> gridIndices;
+    MakeGrid(0.f, positions, gridIndices);
+
+    // Triangles with a repeated index, or with two vertices at the same position.
+    PODVector<uint> indices(gridIndices);
+    indices.Push(5); indices.Push(5); indices.Push(6);
+    positions.Push(positions[7]);
+    indices.Push(7); indices.Push(8); indices.Push(positions.Size() - 1);
+
+    // The degenerate triangles are dropped first, which may already meet the target.
+    PODVector<uint> result = SimplifyMesh(positions, indices, gridIndices.Size(), 0.f);
+    EXPECT_TRUE(result == gridIndices);
+
+    // They neither end up in the result nor prevent the collapses around them.
+    const uint targetIndexCount = gridIndices.Size() / 2 / 3 * 3;
+    result = SimplifyMesh(positions, indices, targetIndexCount, 0.f);
+    ExpectValidTriangles(positions, result);
+    EXPECT_LE(result.Size(), targetIndexCount);
+}
+
+TUNDRA_TEST_MAIN();
@@ -0,0 +1,299 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "TestRunner.h"
+
+#include "AssetAPI.h"
+#include "AssetCache.h"
+#include "GenericAssetFactory.h"
+#include "Ogre/OgreMeshAsset.h"
+
+#include <Urho3D/Graphics/Geometry.h>
+#include <Urho3D/Graphics/IndexBuffer.h>
+#include <Urho3D/Graphics/Model.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/VectorBuffer.h>
+
+using namespace Tundra;
+using namespace Tundra::Test;
+
+namespace
+{
+
+// Chunk IDs and enum values of the Ogre binary mesh format.
+const u16 cMeshHeader = 0x1000;
+const u16 cMesh = 0x3000;
+const u16 cSubMesh = 0x4000;
+const u16 cSubMeshOperation = 0x4010;
+const u16 cGeometry = 0x5000;
+const u16 cVertexDeclaration = 0x5100;
+const u16 cVertexElement = 0x5110;
+const u16 cVertexBuffer = 0x5200;
+const u16 cVertexBufferData = 0x5210;
+const u16 cMeshLod = 0x8000;
+const u16 cMeshLodUsage = 0x8100;
+const u16 cMeshLodGenerated = 0x8120;
+const u16 cTypeFloat3 = 2;
+const u16 cSemanticPosition = 1;
+const u16 cTriangleList = 4;
+
+const uint cGridSize = 8;
+
+void WriteOgreString(Urho3D::Serializer &dest, const String &str)
+{
+    dest.Write(str.CString(), str.Length());
+    dest.WriteByte('\n');
+}
+
+/// Writes a chunk whose length covers its header and @c content, which contains its data and child chunks.
+void WriteChunk(Urho3D::Serializer &dest, u16 id, const Urho3D::VectorBuffer &content)
+{
+    dest.WriteUShort(id);
+    dest.WriteUInt(6 + content.GetSize());
+    if (content.GetSize())
+        dest.Write(content.GetData(), content.GetSize());
+}
+
+void WriteIndices(Urho3D::Serializer &dest, const PODVector<uint> &indices)
+{
+    dest.WriteUInt(indices.Size());
+    dest.WriteBool(false);
+    for(uint i = 0; i < indices.Size(); ++i)
+        dest.WriteUShort((u16)indices[i]);
+}
+
+/// Triangulates a flat grid of cGridSize x cGridSize quads.
+void MakeGrid(PODVector<float3> &positions, PODVector<uint> &indices)
+{
+    for(uint y = 0; y <= cGridSize; ++y)
+        for(uint x = 0; x <= cGridSize; ++x)
+            positions.Push(float3((float)x, (float)y, 0.f));
+    for(uint y = 0; y < cGridSize; ++y)
+    {
+        for(uint x = 0; x < cGridSize; ++x)
+        {
+            const uint v = y * (cGridSize + 1) + x;
+            indices.Push(v); indices.Push(v + 1); indices.Push(v + cGridSize + 2);
+            indices.Push(v); indices.Push(v + cGridSize + 2); indices.Push(v + cGridSize + 1);
+        }
+    }
+}
+
+/// Returns an Ogre mesh file with one submesh of @c positions and @c indices, and the generated LOD levels
+/// @c lodIndices that start at the distances @c lodDistances.
+Vector<u8> MakeOgreMesh(const PODVector<float3> &positions, const PODVector<uint> &indices,
+    const Vector<PODVector<uint> > &lodIndices = Vector<PODVector<uint> >(), const PODVector<float> &lodDistances = PODVector<float>())
+{
+    Urho3D::VectorBuffer vertexElement;
+    vertexElement.WriteUShort(0); // source
+    vertexElement.WriteUShort(cTypeFloat3);
+    vertexElement.WriteUShort(cSemanticPosition);
+    vertexElement.WriteUShort(0); // offset
+    vertexElement.WriteUShort(0); // index
+    Urho3D::VectorBuffer declaration;
+    WriteChunk(declaration, cVertexElement, vertexElement);
+
+    Urho3D::VectorBuffer vertexData;
+    for(uint i = 0; i < positions.Size(); ++i)
+        vertexData.Write(&positions[i], sizeof(float3));
+    Urho3D::VectorBuffer vertexBuffer;
+    vertexBuffer.WriteUShort(0); // bind index
+    vertexBuffer.WriteUShort(sizeof(float3));
+    WriteChunk(vertexBuffer, cVertexBufferData, vertexData);
+
+    Urho3D::VectorBuffer geometry;
+    geometry.WriteUInt(positions.Size());
+    WriteChunk(geometry, cVertexDeclaration, declaration);
+    WriteChunk(geometry, cVertexBuffer, vertexBuffer);
+
+    Urho3D::VectorBuffer operation;
+    operation.WriteUShort(cTriangleList);
+
+    Urho3D::VectorBuffer subMesh;
+    WriteOgreString(subMesh, "");
+    subMesh.WriteBool(false); // shared vertices
+    WriteIndices(subMesh, indices);
+    WriteChunk(subMesh, cGeometry, geometry);
+    WriteChunk(subMesh, cSubMeshOperation, operation);
+
+    Urho3D::VectorBuffer mesh;
+    mesh.WriteBool(false); // skeletally animated
+    WriteChunk(mesh, cSubMesh, subMesh);
+    if (!lodIndices.Empty())
+    {
+        Urho3D::VectorBuffer lod;
+        WriteOgreString(lod, "distance");
+        lod.WriteUShort((u16)(lodIndices.Size() + 1));
+        lod.WriteBool(false); // manual
+        for(uint level = 0; level < lodIndices.Size(); ++level)
+        {
+            Urho3D::VectorBuffer generated;
+            WriteIndices(generated, lodIndices[level]);
+            Urho3D::VectorBuffer usage;
+            usage.WriteFloat(lodDistances[level]);
+            WriteChunk(usage, cMeshLodGenerated, generated);
+            WriteChunk(lod, cMeshLodUsage, usage);
+        }
+        WriteChunk(mesh, cMeshLod, lod);
+    }
+
+    Urho3D::VectorBuffer file;
+    file.WriteUShort(cMeshHeader);
+    WriteOgreString(file, "[MeshSerializer_v1.8]");
+    WriteChunk(file, cMesh, mesh);
+    return Vector<u8>(file.GetData(), file.GetSize());
+}
+
+AssetPtr CreateMesh(Framework *framework, const String &name)
+{
+    AssetAPI *assetAPI = framework->Asset();
+    if (!assetAPI->AssetTypeFactory("OgreMesh"))
+        assetAPI->RegisterAssetTypeFactory(AssetTypeFactoryPtr(new GenericAssetFactory<OgreMeshAsset>("OgreMesh", ".mesh")));
+    return assetAPI->CreateNewAsset("OgreMesh", name);
+}
+
+/// Loads @c data to @c asset synchronously and returns its model, or null if the load failed.
+Urho3D::Model *LoadMesh(const AssetPtr &asset, const Vector<u8> &data)
+{
+    if (!asset->LoadFromFileInMemory(&data[0], data.Size(), false))
+        return 0;
+    return static_cast<OgreMeshAsset*>(asset.Get())->UrhoModel();
+}
+
+PODVector<uint> GeometryIndices(Urho3D::Model *model, uint lodLevel)
+{
+    PODVector<uint> indices;
+    Urho3D::Geometry *geometry = model->GetGeometry(0, lodLevel);
+    Urho3D::IndexBuffer *indexBuffer = geometry ? geometry->GetIndexBuffer() : 0;
+    if (!indexBuffer || !indexBuffer->GetShadowData())
+        return indices;
+    const u16 *src = reinterpret_cast<const u16*>(indexBuffer->GetShadowData());
+    for(uint i = 0; i < indexBuffer->GetIndexCount(); ++i)
+        indices.Push(src[i]);
+    return indices;
+}
+
+String LodCacheTestDirectory(Framework *framework)
+{
+    return framework->GetSubsystem<Urho3D::FileSystem>()->GetProgramDir() + "TundraTestMeshLodCache/";
+}
+
+void RemoveLodCacheTestDirectory(Framework *framework)
+{
+    Urho3D::FileSystem *fileSystem = framework->GetSubsystem<Urho3D::FileSystem>();
+    const String directory = LodCacheTestDirectory(framework);
+    StringVector filenames;
+    fileSystem->ScanDir(filenames, directory, "*", Urho3D::SCAN_FILES, false);
+    foreach(const String &filename, filenames)
+        fileSystem->Delete(directory + filename);
+    fileSystem->RemoveDir(directory, false);
+}
+
+}
+
+TEST_F(Runner, OgreMeshLodImport)
+{
+    PODVector<float3> positions;
+    PODVector<uint> indices;
+    MakeGrid(positions, indices);
+
+    // Two generated levels, the second with half of the triangles of the first.
+    Vector<PODVector<uint> > lodIndices(2);
+    lodIndices[0].Insert(0, indices.Begin(), indices.Begin() + indices.Size() / 2);
+    lodIndices[1].Insert(0, indices.Begin(), indices.Begin() + indices.Size() / 4);
+    PODVector<float> lodDistances;
+    lodDistances.Push(20.f);
+    lodDistances.Push(40.f);
+
+    Urho3D::Model *model = LoadMesh(CreateMesh(framework, "lod.mesh"), MakeOgreMesh(positions, indices, lodIndices, lodDistances));
+    ASSERT_TRUE(model != nullptr);
+    ASSERT_EQ(model->GetNumGeometries(), 1u);
+    ASSERT_EQ(model->GetNumGeometryLodLevels(0), 3u);
+    EXPECT_TRUE(GeometryIndices(model, 0) == indices);
+    for(uint level = 0; level < 2; ++level)
+    {
+        Urho3D::Geometry *geometry = model->GetGeometry(0, level + 1);
+        ASSERT_TRUE(geometry != nullptr);
+        EXPECT_EQ(geometry->GetLodDistance(), lodDistances[level]);
+        // The levels share the vertex buffer of the full detail level.
+        EXPECT_EQ(geometry->GetVertexBuffer(0), model->GetGeometry(0, 0)->GetVertexBuffer(0));
+        EXPECT_TRUE(GeometryIndices(model, level + 1) == lodIndices[level]);
+    }
+}
+
+TEST_F(Runner, OgreMeshLodIndicesOutOfRange)
+{
+    PODVector<float3> positions;
+    PODVector<uint> indices;
+    MakeGrid(positions, indices);
+
+    // A level that indexes past the vertices of the submesh fails the load instead of reading out of bounds when drawn.
+    Vector<PODVector<uint> > lodIndices(1);
+    lodIndices[0].Push(0); lodIndices[0].Push(1); lodIndices[0].Push(positions.Size());
+    PODVector<float> lodDistances;
+    lodDistances.Push(20.f);
+    EXPECT_TRUE(LoadMesh(CreateMesh(framework, "invalidlod.mesh"), MakeOgreMesh(positions, indices, lodIndices, lodDistances)) == nullptr);
+}
+
+TEST_F(Runner, OgreMeshLodCache)
+{
+    RemoveLodCacheTestDirectory(framework);
+    Urho3D::FileSystem *fileSystem = framework->GetSubsystem<Urho3D::FileSystem>();
+    AssetAPI *assetAPI = framework->Asset();
+    assetAPI->OpenAssetCache(LodCacheTestDirectory(framework));
+    ASSERT_TRUE(assetAPI->Cache() != nullptr);
+    framework->AddCommandLineParameter("--meshLodLevels", "1");
+
+    PODVector<float3> positions;
+    PODVector<uint> indices;
+    MakeGrid(positions, indices);
+    const Vector<u8> data = MakeOgreMesh(positions, indices);
+
+    // A mesh without LOD levels gets a generated one, which is stored in the asset cache.
+    AssetPtr asset = CreateMesh(framework, "generated.mesh");
+    Urho3D::Model *model = LoadMesh(asset, data);
+    ASSERT_TRUE(model != nullptr);
+    ASSERT_EQ(model->GetNumGeometryLodLevels(0), 2u);
+    const PODVector<uint> lodIndices = GeometryIndices(model, 1);
+    EXPECT_GT(lodIndices.Size(), 0u);
+    EXPECT_LT(lodIndices.Size(), indices.Size());
+
+    String cacheFile;
+    StringVector filenames;
+    fileSystem->ScanDir(filenames, LodCacheTestDirectory(framework), "*", Urho3D::SCAN_FILES, false);
+    foreach(const String &filename, filenames)
+        if (filename.Contains(".lod"))
+            cacheFile = LodCacheTestDirectory(framework) + filename;
+    ASSERT_FALSE(cacheFile.Empty());
+
+    // Change the distance of the level in the cache file, so that a level read from the cache can be told apart
+    // from a generated one. The distance follows the file ID, the version and the number of levels.
+    {
+        Urho3D::File file(context.Get(), cacheFile, Urho3D::FILE_READWRITE);
+        ASSERT_TRUE(file.IsOpen());
+        file.Seek(12);
+        file.WriteFloat(123.f);
+    }
+    model = LoadMesh(asset, data);
+    ASSERT_TRUE(model != nullptr);
+    ASSERT_EQ(model->GetNumGeometryLodLevels(0), 2u);
+    EXPECT_EQ(model->GetGeometry(0, 1)->GetLodDistance(), 123.f);
+    EXPECT_TRUE(GeometryIndices(model, 1) == lodIndices);
+
+    // A cache file that does not match the mesh is ignored, and the level is generated again.
+    {
+        Urho3D::File file(context.Get(), cacheFile, Urho3D::FILE_READWRITE);
+        ASSERT_TRUE(file.IsOpen());
+        file.Seek(16);
+        file.WriteUInt(2); // number of submeshes
+    }
+    model = LoadMesh(asset, data);
+    ASSERT_TRUE(model != nullptr);
+    ASSERT_EQ(model->GetNumGeometryLodLevels(0), 2u);
+    EXPECT_NE(model->GetGeometry(0, 1)->GetLodDistance(), 123.f);
+    EXPECT_TRUE(GeometryIndices(model, 1) == lodIndices);
+
+    RemoveLodCacheTestDirectory(framework);
+}
+
+TUNDRA_TEST_MAIN();
@@ -0,0 +1,222 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "TestRunner.h"
+
+#include "ZipAssetBundle.h"
+#include "ZipBundleFactory.h"
+#include "ZipHelpers.h"
+
+#include "AssetAPI.h"
+#include "AssetCache.h"
+#include "BinaryAsset.h"
+#include "IAsset.h"
+
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/VectorBuffer.h>
+
+using namespace Tundra;
+using namespace Tundra::Test;
+
+namespace
+{
+
+const char *cBundleRef = "http://test.com/bundle.zip";
+
+/// Writes a zip file that stores "a.bin" uncompressed. If @c corruptCrc is true, the CRC32 in the headers does not match the data.
+bool WriteZip(Urho3D::Context *context, const String &path, const Vector<u8> &data, bool corruptCrc)
+{
+    const String name = "a.bin";
+    const uint crc = UpdateCrc32(0, &data[0], data.Size()) ^ (corruptCrc ? 1u : 0u);
+
+    Urho3D::VectorBuffer zip;
+    zip.WriteUInt(0x04034b50); // Local file header
+    zip.WriteUShort(10);
+    zip.WriteUShort(0);
+    zip.WriteUShort(0); // Stored
+    zip.WriteUInt(0);
+    zip.WriteUInt(crc);
+    zip.WriteUInt(data.Size());
+    zip.WriteUInt(data.Size());
+    zip.WriteUShort((unsigned short)name.Length());
+    zip.WriteUShort(0);
+    zip.Write(name.CString(), name.Length());
+    zip.Write(&data[0], data.Size());
+
+    const uint directoryOffset = zip.GetSize();
+    zip.WriteUInt(0x02014b50); // Central directory header
+    zip.WriteUShort(20);
+    zip.WriteUShort(10);
+    zip.WriteUShort(0);
+    zip.WriteUShort(0);
+    zip.WriteUInt(0);
+    zip.WriteUInt(crc);
+    zip.WriteUInt(data.Size());
+    zip.WriteUInt(data.Size());
+    zip.WriteUShort((unsigned short)name.Length());
+    zip.WriteUShort(0);
+    zip.WriteUShort(0);
+    zip.WriteUShort(0);
+    zip.WriteUShort(0);
+    zip.WriteUInt(0);
+    zip.WriteUInt(0); // Offset of the local header
+    zip.Write(name.CString(), name.Length());
+    const uint directorySize = zip.GetSize() - directoryOffset;
+
+    zip.WriteUInt(0x06054b50); // End of central directory
+    zip.WriteUShort(0);
+    zip.WriteUShort(0);
+    zip.WriteUShort(1);
+    zip.WriteUShort(1);
+    zip.WriteUInt(directorySize);
+    zip.WriteUInt(directoryOffset);
+    zip.WriteUShort(0);
+
+    Urho3D::File file(context, path, Urho3D::FILE_WRITE);
+    return file.IsOpen() && file.Write(zip.GetData(), zip.GetSize()) == zip.GetSize();
+}
+
+Vector<u8> TestData()
+{
+    Vector<u8> data(3000);
+    for(uint i = 0; i < data.Size(); ++i)
+        data[i] = (u8)(i * 13);
+    return data;
+}
+
+String ZipTestDirectory(Framework *framework)
+{
+    return framework->GetSubsystem<Urho3D::FileSystem>()->GetProgramDir() + "TundraTestZipAssetBundle/";
+}
+
+void RemoveZipTestDirectory(Framework *framework)
+{
+    framework->GetSubsystem<Urho3D::FileSystem>()->RemoveDir(ZipTestDirectory(framework), true);
+}
+
+/// Records the outcome of loading a bundle.
+struct BundleLoadListener
+{
+    BundleLoadListener() : loaded(false), failed(false) {}
+
+    void OnLoaded(IAssetBundle*) { loaded = true; }
+    void OnFailed(IAssetBundle*) { failed = true; }
+
+    bool loaded;
+    bool failed;
+};
+
+/// Creates the bundle from the zip file @c path and processes frames until it has loaded or failed. Returns true if it loaded.
+bool LoadBundle(Framework *framework, const String &path, AssetBundlePtr &bundle)
+{
+    AssetAPI *assetAPI = framework->Asset();
+    bundle = assetAPI->CreateNewAssetBundle("Zip", cBundleRef);
+    if (!bundle)
+        return false;
+    BundleLoadListener listener;
+    bundle->Loaded.Connect(&listener, &BundleLoadListener::OnLoaded);
+    bundle->Failed.Connect(&listener, &BundleLoadListener::OnFailed);
+    bundle->SetDiskSource(path);
+    bool started = bundle->DeserializeFromDiskSource();
+
+    Urho3D::Timer timer;
+    while(started && !listener.loaded && !listener.failed && timer.GetMSec(false) < 10000)
+    {
+        framework->Pump();
+        Urho3D::Time::Sleep(1);
+    }
+    bundle->Loaded.Disconnect(&listener, &BundleLoadListener::OnLoaded);
+    bundle->Failed.Disconnect(&listener, &BundleLoadListener::OnFailed);
+    return listener.loaded;
+}
+
+AssetAPI *SetUpZipAssets(Framework *framework)
+{
+    RemoveZipTestDirectory(framework);
+    AssetAPI *assetAPI = framework->Asset();
+    assetAPI->OpenAssetCache(ZipTestDirectory(framework) + "cache/");
+    assetAPI->RegisterAssetBundleTypeFactory(AssetBundleTypeFactoryPtr(new ZipBundleFactory()));
+    return assetAPI;
+}
+
+}
+
+TEST_F(Runner, ZipCrc32)
+{
+    const String text = "123456789";
+    const u8 *data = (const u8 *)text.CString();
+    EXPECT_EQ(UpdateCrc32(0, data, text.Length()), 0xCBF43926u);
+    // Updating in parts gives the same CRC32.
+    EXPECT_EQ(UpdateCrc32(UpdateCrc32(0, data, 4), data + 4, text.Length() - 4), 0xCBF43926u);
+    EXPECT_EQ(UpdateCrc32(0, data, 0), 0u);
+}
+
+TEST_F(Runner, ZipAssetBundleExtract)
+{
+    AssetAPI *assetAPI = SetUpZipAssets(framework);
+    const String zipPath = ZipTestDirectory(framework) + "bundle.zip";
+    const Vector<u8> data = TestData();
+    const String subAssetRef = String(cBundleRef) + "#a.bin";
+
+    ASSERT_TRUE(WriteZip(context.Get(), zipPath, data, false));
+    AssetBundlePtr bundle;
+    ASSERT_TRUE(LoadBundle(framework, zipPath, bundle));
+    EXPECT_TRUE(bundle->GetSubAssetData("a.bin") == data);
+    EXPECT_FALSE(bundle->GetSubAssetDiskSource("a.bin").Empty());
+    EXPECT_FALSE(assetAPI->Cache()->ETag(subAssetRef).Empty());
+    assetAPI->ForgetBundle(bundle, false);
+
+    // A file whose data does not match the CRC32 of the central directory fails the bundle and is not left in the cache.
+    ASSERT_TRUE(WriteZip(context.Get(), zipPath, data, true));
+    EXPECT_FALSE(LoadBundle(framework, zipPath, bundle));
+    EXPECT_TRUE(assetAPI->Cache()->FindInCache(subAssetRef).Empty());
+    EXPECT_TRUE(assetAPI->Cache()->ETag(subAssetRef).Empty());
+    assetAPI->ForgetBundle(bundle, false);
+    bundle.Reset();
+
+    RemoveZipTestDirectory(framework);
+}
+
+TEST_F(Runner, ZipAssetBundleInMemory)
+{
+    framework->AddCommandLineParameter("--zipInMemory");
+    AssetAPI *assetAPI = SetUpZipAssets(framework);
+    const String zipPath = ZipTestDirectory(framework) + "bundle.zip";
+    const Vector<u8> data = TestData();
+
+    ASSERT_TRUE(WriteZip(context.Get(), zipPath, data, false));
+    AssetBundlePtr bundle;
+    ASSERT_TRUE(LoadBundle(framework, zipPath, bundle));
+    EXPECT_TRUE(bundle->GetSubAssetDiskSource("a.bin").Empty());
+    EXPECT_TRUE(bundle->GetSubAssetData("a.bin") == data);
+
+    // A sub asset without a disk source is reloaded from its bundle, e.g. when a texture is lost on device reset.
+    AssetPtr asset = assetAPI->CreateNewAsset("Binary", String(cBundleRef) + "#a.bin");
+    ASSERT_TRUE(asset.Get() != nullptr);
+    asset->SetDiskSourceType(IAsset::Bundle);
+    EXPECT_TRUE(asset->HasReloadSource());
+    ASSERT_TRUE(asset->LoadFromCache());
+    EXPECT_TRUE(static_cast<BinaryAsset *>(asset.Get())->data == data);
+    asset->Unload();
+    ASSERT_TRUE(asset->LoadFromCache());
+    EXPECT_TRUE(static_cast<BinaryAsset *>(asset.Get())->data == data);
+
+    // Without the bundle there is nothing to reload from.
+    assetAPI->ForgetBundle(bundle, false);
+    bundle.Reset();
+    asset->Unload();
+    EXPECT_FALSE(asset->HasReloadSource());
+    EXPECT_FALSE(asset->LoadFromCache());
+
+    // The in-memory path verifies the CRC32 as well.
+    ASSERT_TRUE(WriteZip(context.Get(), zipPath, data, true));
+    ASSERT_TRUE(LoadBundle(framework, zipPath, bundle));
+    EXPECT_TRUE(bundle->GetSubAssetData("a.bin").Empty());
+    assetAPI->ForgetBundle(bundle, false);
+    bundle.Reset();
+
+    RemoveZipTestDirectory(framework);
+}
+
+TUNDRA_TEST_MAIN();